@@ -158,7 +158,7 @@ _darktable_chart()
   COMPREPLY=()
 
   # the possible options
-  opts="--csv --help"
+  opts="--csv --headless --help"
 
   # if the user started with a '-' suggest the possible command line options
   if [[ "$cur" == -* ]]; then
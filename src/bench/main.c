@@ -0,0 +1,760 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * darktable-bench: runs the pixelpipe on one image a number of times and reports per module timings as json.
+ *
+ * the workload is fixed by the image, an optional xmp sidecar or style, the pipe types and the thread counts,
+ * so results of different machines or releases can be compared. to not depend on a particular raw file, a few
+ * synthetic raw images can be generated (see --synthetic), they are written once to the cache directory.
+ */
+
+#include "common/darktable.h"
+#include "common/exif.h"
+#include "common/file_location.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/image_cache.h"
+#include "common/imageio.h"
+#include "common/imageio_dng.h"
+#include "common/mipmap_cache.h"
+#include "common/styles.h"
+#include "control/conf.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/imageop_math.h"
+#include "develop/pixelpipe.h"
+
+#include <inttypes.h>
+#include <json-glib/json-glib.h>
+#include <libintl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include "osx/osx.h"
+#endif
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+typedef enum dt_bench_pipe_type_t
+{
+  DT_BENCH_PIPE_FULL = 0,
+  DT_BENCH_PIPE_PREVIEW,
+  DT_BENCH_PIPE_THUMBNAIL,
+  DT_BENCH_PIPE_EXPORT,
+  DT_BENCH_PIPE_LAST
+} dt_bench_pipe_type_t;
+
+static const char *_pipe_names[DT_BENCH_PIPE_LAST] = { "full", "preview", "thumbnail", "export" };
+// full: width of the 1:1 crop, thumbnail and export: maximum size, 0 is full resolution
+static const int _pipe_default_size[DT_BENCH_PIPE_LAST] = { 1920, 0, 720, 0 };
+
+typedef struct dt_bench_pipe_t
+{
+  dt_bench_pipe_type_t type;
+  int size;
+} dt_bench_pipe_t;
+
+// samples of one module instance over the runs
+typedef struct dt_bench_module_t
+{
+  gchar *name;
+  GArray *times;   // double, seconds
+  GArray *allocs;  // double, bytes
+} dt_bench_module_t;
+
+typedef struct dt_bench_synthetic_t
+{
+  const char *name;
+  int width, height;
+  gboolean xtrans;
+  float noise;     // read noise, the shot noise scales with it
+} dt_bench_synthetic_t;
+
+static const dt_bench_synthetic_t _synthetic[] = {
+  { "bayer-6mp",            3008, 2000, FALSE, 0.001f },
+  { "bayer-24mp",           6016, 4000, FALSE, 0.001f },
+  { "bayer-24mp-iso6400",   6016, 4000, FALSE, 0.01f },
+  { "xtrans-24mp",          6000, 4002, TRUE,  0.001f },
+};
+
+static const uint8_t _xtrans_pattern[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 },
+                                               { 2, 0, 1, 0, 2, 1 }, { 1, 1, 2, 1, 1, 0 },
+                                               { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s <input file> [<xmp file>] [options] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "   --synthetic <name>    use a generated raw instead of an input file\n");
+  fprintf(stderr, "                         use --help synthetic for the list\n");
+  fprintf(stderr, "   --pipe <type>[:<size>] full, preview, thumbnail or export, can be given\n");
+  fprintf(stderr, "                         multiple times. default: export\n");
+  fprintf(stderr, "                         size is the crop width for full (default 1920) and the\n");
+  fprintf(stderr, "                         maximum size for thumbnail (720) and export (0 = full)\n");
+  fprintf(stderr, "   --runs <n>            timed runs per pipe and thread count, default: 5\n");
+  fprintf(stderr, "   --cold                reload the raw and start with empty caches on every run\n");
+  fprintf(stderr, "                         default: one untimed warm up run, pixelpipe cache flushed\n");
+  fprintf(stderr, "   --threads <n,n,...>   thread counts to sweep, default: all\n");
+  fprintf(stderr, "   --style <style name>  apply a style to the image first\n");
+  fprintf(stderr, "   --output <file>       write the json report there instead of stdout\n");
+  fprintf(stderr, "   --help,-h [synthetic]\n");
+  fprintf(stderr, "   --version\n");
+}
+
+static void synthetic_list()
+{
+  fprintf(stderr, "available synthetic images:\n");
+  for(size_t k = 0; k < G_N_ELEMENTS(_synthetic); k++)
+    fprintf(stderr, " %-20s %dx%d %s\n", _synthetic[k].name, _synthetic[k].width, _synthetic[k].height,
+            _synthetic[k].xtrans ? "x-trans" : "bayer");
+}
+
+static gboolean _parse_pipe(const char *arg, dt_bench_pipe_t *pipe)
+{
+  gchar **parts = g_strsplit(arg, ":", 2);
+  gboolean ok = FALSE;
+  for(int k = 0; k < DT_BENCH_PIPE_LAST; k++)
+  {
+    if(g_ascii_strcasecmp(parts[0], _pipe_names[k])) continue;
+    pipe->type = k;
+    pipe->size = parts[1] ? MAX(atoi(parts[1]), 0) : _pipe_default_size[k];
+    ok = TRUE;
+  }
+  g_strfreev(parts);
+  return ok;
+}
+
+// deterministic test scene in camera rgb: flat colour patches, smooth ramps and a zone plate
+static void _scene(const float u, const float v, float rgb[3])
+{
+  if(u < 1.0f / 3.0f)
+  {
+    // 4x6 patches of varying hue and lightness
+    const int patch = (int)(v * 6.0f) * 4 + (int)(u * 12.0f);
+    const float hue = patch * (2.0f * M_PI / 24.0f);
+    const float lum = 0.05f + 0.7f * (patch % 6) / 5.0f;
+    for(int c = 0; c < 3; c++) rgb[c] = lum * (1.0f + 0.5f * cosf(hue + c * 2.0f * M_PI / 3.0f));
+  }
+  else if(u < 2.0f / 3.0f)
+  {
+    // exponential lightness ramp from top to bottom, hue ramp from left to right, with some highlights
+    const float lum = exp2f(-12.0f * v) * 1.2f;
+    const float hue = (u - 1.0f / 3.0f) * 6.0f * M_PI;
+    for(int c = 0; c < 3; c++) rgb[c] = lum * (1.0f + 0.3f * sinf(hue + c * 2.0f * M_PI / 3.0f));
+  }
+  else
+  {
+    // zone plate for demosaicing and sharpening
+    const float x = (u - 5.0f / 6.0f) * 6.0f, y = v - 0.5f;
+    const float r2 = x * x + y * y;
+    const float val = 0.25f + 0.2f * cosf(400.0f * r2);
+    for(int c = 0; c < 3; c++) rgb[c] = val;
+  }
+}
+
+static gboolean _write_synthetic(const dt_bench_synthetic_t *s, const char *filename)
+{
+  const int wd = s->width, ht = s->height;
+  float *pixels = dt_alloc_align_float((size_t)wd * ht);
+  if(!pixels) return FALSE;
+
+  const uint32_t filters = s->xtrans ? 9u : 0x94949494u;
+  const float wb_coeffs[3] = { 2.0f, 1.0f, 1.5f };
+  const float noise = s->noise;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(pixels, wd, ht, filters, noise, wb_coeffs) \
+  dt_omp_sharedconst(_xtrans_pattern) schedule(static)
+#endif
+  for(int j = 0; j < ht; j++)
+  {
+    // xorshift seeded by the row, so the image does not depend on the number of threads
+    uint32_t state = 2463534242u ^ (uint32_t)(j * 2654435761u);
+    for(int i = 0; i < wd; i++)
+    {
+      float rgb[3];
+      _scene((i + 0.5f) / wd, (j + 0.5f) / ht, rgb);
+      const int c = filters == 9u ? _xtrans_pattern[(j + 600) % 6][(i + 600) % 6] : FC(j, i, filters);
+      const float val = rgb[c] / wb_coeffs[c];
+      // gaussian approximation of shot and read noise, sum of uniforms
+      float n = -2.0f;
+      for(int k = 0; k < 4; k++)
+      {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        n += state * (1.0f / 4294967296.0f);
+      }
+      const float sigma = sqrtf(noise * 0.1f * MAX(val, 0.0f) + noise * noise);
+      pixels[(size_t)j * wd + i] = CLAMP(val + sigma * n * 1.7f, 0.0f, 1.0f);
+    }
+  }
+
+  dt_imageio_write_dng(filename, pixels, wd, ht, NULL, 0, filters, _xtrans_pattern, 1.0f, wb_coeffs,
+                       "darktable-bench");
+  dt_free_align(pixels);
+  return g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
+// path of the synthetic image, generated on first use
+static gchar *_synthetic_file(const char *name)
+{
+  const dt_bench_synthetic_t *s = NULL;
+  for(size_t k = 0; k < G_N_ELEMENTS(_synthetic); k++)
+    if(!strcmp(_synthetic[k].name, name)) s = &_synthetic[k];
+  if(!s) return NULL;
+
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *dir = g_build_filename(cachedir, "bench", NULL);
+  g_mkdir_with_parents(dir, 0750);
+  gchar *basename = g_strconcat(name, ".dng", NULL);
+  gchar *filename = g_build_filename(dir, basename, NULL);
+  g_free(basename);
+  g_free(dir);
+
+  if(!g_file_test(filename, G_FILE_TEST_EXISTS))
+  {
+    fprintf(stderr, "generating %s\n", filename);
+    if(!_write_synthetic(s, filename))
+    {
+      g_free(filename);
+      return NULL;
+    }
+  }
+  return filename;
+}
+
+static gboolean _setup(const int32_t imgid, const dt_bench_pipe_t *spec, dt_develop_t *dev,
+                       dt_dev_pixelpipe_t *pipe, dt_mipmap_buffer_t *buf)
+{
+  const dt_mipmap_size_t mip = spec->type == DT_BENCH_PIPE_PREVIEW ? DT_MIPMAP_F : DT_MIPMAP_FULL;
+  dt_mipmap_cache_get(darktable.mipmap_cache, buf, imgid, mip, DT_MIPMAP_BLOCKING, 'r');
+  if(!buf->buf || !buf->width || !buf->height)
+  {
+    dt_mipmap_cache_release(darktable.mipmap_cache, buf);
+    return FALSE;
+  }
+
+  dt_dev_init(dev, 0);
+  dt_dev_load_image(dev, imgid);
+
+  int res = 0;
+  switch(spec->type)
+  {
+    case DT_BENCH_PIPE_FULL:
+      res = dt_dev_pixelpipe_init(pipe);
+      break;
+    case DT_BENCH_PIPE_PREVIEW:
+      res = dt_dev_pixelpipe_init_preview(pipe);
+      break;
+    case DT_BENCH_PIPE_THUMBNAIL:
+      res = dt_dev_pixelpipe_init_thumbnail(pipe, buf->width, buf->height);
+      break;
+    default:
+      res = dt_dev_pixelpipe_init_export(pipe, buf->width, buf->height, IMAGEIO_RGB | IMAGEIO_FLOAT, FALSE);
+      break;
+  }
+  if(!res)
+  {
+    dt_dev_cleanup(dev);
+    dt_mipmap_cache_release(darktable.mipmap_cache, buf);
+    return FALSE;
+  }
+
+  dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf->buf, buf->width, buf->height, buf->iscale);
+  dt_dev_pixelpipe_create_nodes(pipe, dev);
+  dt_dev_pixelpipe_synch_all(pipe, dev);
+  dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight, &pipe->processed_width,
+                                  &pipe->processed_height);
+  return TRUE;
+}
+
+static void _teardown(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, dt_mipmap_buffer_t *buf)
+{
+  dt_dev_pixelpipe_cleanup(pipe);
+  dt_dev_cleanup(dev);
+  dt_mipmap_cache_release(darktable.mipmap_cache, buf);
+}
+
+// runs the pipe once the way the corresponding view or job would. returns non-zero on failure.
+static int _process(const dt_bench_pipe_t *spec, dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, int *width,
+                    int *height)
+{
+  const int pw = pipe->processed_width, ph = pipe->processed_height;
+  switch(spec->type)
+  {
+    case DT_BENCH_PIPE_FULL:
+    {
+      // 1:1 crop in the middle of the image, as when zoomed in in darkroom
+      *width = MIN(pw, spec->size);
+      *height = MIN(ph, spec->size * 9 / 16);
+      return dt_dev_pixelpipe_process(pipe, dev, (pw - *width) / 2, (ph - *height) / 2, *width, *height, 1.0f);
+    }
+    case DT_BENCH_PIPE_PREVIEW:
+      *width = pw;
+      *height = ph;
+      return dt_dev_pixelpipe_process(pipe, dev, 0, 0, pw, ph, 1.0f);
+    default:
+    {
+      const float scale = spec->size ? fminf(1.0f, (float)spec->size / MAX(pw, ph)) : 1.0f;
+      *width = MAX(1, (int)(pw * scale));
+      *height = MAX(1, (int)(ph * scale));
+      if(spec->type == DT_BENCH_PIPE_THUMBNAIL)
+        return dt_dev_pixelpipe_process(pipe, dev, 0, 0, *width, *height, scale);
+      return dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, 0, *width, *height, scale);
+    }
+  }
+}
+
+static int _cmp_double(const void *a, const void *b)
+{
+  const double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void _add_stats(JsonBuilder *builder, const char *prefix, GArray *samples, const double unit)
+{
+  double min = 0.0, median = 0.0;
+  if(samples->len)
+  {
+    g_array_sort(samples, _cmp_double);
+    const double *v = (const double *)samples->data;
+    min = v[0];
+    median = samples->len & 1 ? v[samples->len / 2] : 0.5 * (v[samples->len / 2 - 1] + v[samples->len / 2]);
+  }
+  gchar *key = g_strconcat(prefix, "_min", NULL);
+  json_builder_set_member_name(builder, key);
+  json_builder_add_double_value(builder, min * unit);
+  g_free(key);
+  key = g_strconcat(prefix, "_median", NULL);
+  json_builder_set_member_name(builder, key);
+  json_builder_add_double_value(builder, median * unit);
+  g_free(key);
+}
+
+static void _module_free(gpointer data)
+{
+  dt_bench_module_t *m = (dt_bench_module_t *)data;
+  g_free(m->name);
+  g_array_free(m->times, TRUE);
+  g_array_free(m->allocs, TRUE);
+  free(m);
+}
+
+// samples of all module instances of the pipe after one run, in pipe order
+static GList *_record(dt_dev_pixelpipe_t *pipe, GList *modules)
+{
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+
+    gchar *name = piece->module->multi_name[0]
+                      ? g_strdup_printf("%s %s", piece->module->op, piece->module->multi_name)
+                      : g_strdup(piece->module->op);
+    dt_bench_module_t *m = NULL;
+    for(GList *l = modules; l && !m; l = g_list_next(l))
+      if(!strcmp(((dt_bench_module_t *)l->data)->name, name)) m = (dt_bench_module_t *)l->data;
+    if(!m)
+    {
+      m = (dt_bench_module_t *)calloc(1, sizeof(dt_bench_module_t));
+      m->name = name;
+      m->times = g_array_new(FALSE, FALSE, sizeof(double));
+      m->allocs = g_array_new(FALSE, FALSE, sizeof(double));
+      modules = g_list_append(modules, m);
+    }
+    else
+      g_free(name);
+
+    const double alloc = piece->run_alloc;
+    g_array_append_val(m->times, piece->run_time);
+    g_array_append_val(m->allocs, alloc);
+  }
+  return modules;
+}
+
+// one entry of the "results" array: a pipe type at a thread count
+static gboolean _bench(JsonBuilder *builder, const int32_t imgid, const dt_bench_pipe_t *spec, const int threads,
+                       const int runs, const gboolean cold)
+{
+  darktable.num_openmp_threads = threads;
+  dt_set_team_threads(threads);
+
+  dt_develop_t dev;
+  dt_dev_pixelpipe_t pipe;
+  dt_mipmap_buffer_t buf;
+  gboolean ready = FALSE, ok = TRUE;
+  int width = 0, height = 0;
+  GArray *totals = g_array_new(FALSE, FALSE, sizeof(double));
+  GArray *loads = g_array_new(FALSE, FALSE, sizeof(double));
+  GArray *faults = g_array_new(FALSE, FALSE, sizeof(double));
+  GList *modules = NULL;
+
+  // warm runs start with one untimed run to load the raw and fill the allocator
+  for(int run = cold ? 0 : -1; run < runs && ok; run++)
+  {
+    double load = 0.0;
+    if(cold || !ready)
+    {
+      if(ready) _teardown(&dev, &pipe, &buf);
+      ready = FALSE;
+      if(cold) dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+      const double start = dt_get_wtime();
+      if(!_setup(imgid, spec, &dev, &pipe, &buf))
+      {
+        ok = FALSE;
+        break;
+      }
+      load = dt_get_wtime() - start;
+      ready = TRUE;
+    }
+    else
+      dt_dev_pixelpipe_flush_caches(&pipe);
+
+    struct rusage ru_start, ru_end;
+    getrusage(RUSAGE_SELF, &ru_start);
+    const double start = dt_get_wtime();
+    if(_process(spec, &dev, &pipe, &width, &height))
+    {
+      ok = FALSE;
+      break;
+    }
+    const double total = dt_get_wtime() - start;
+    getrusage(RUSAGE_SELF, &ru_end);
+    if(run < 0) continue;
+
+    const double minflt = ru_end.ru_minflt - ru_start.ru_minflt;
+    g_array_append_val(totals, total);
+    g_array_append_val(faults, minflt);
+    if(cold) g_array_append_val(loads, load);
+    modules = _record(&pipe, modules);
+  }
+  if(ready) _teardown(&dev, &pipe, &buf);
+
+  if(ok)
+  {
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "pipe");
+    json_builder_add_string_value(builder, _pipe_names[spec->type]);
+    json_builder_set_member_name(builder, "size");
+    json_builder_add_int_value(builder, spec->size);
+    json_builder_set_member_name(builder, "threads");
+    json_builder_add_int_value(builder, threads);
+    json_builder_set_member_name(builder, "width");
+    json_builder_add_int_value(builder, width);
+    json_builder_set_member_name(builder, "height");
+    json_builder_add_int_value(builder, height);
+    _add_stats(builder, "total_ms", totals, 1e3);
+    if(cold) _add_stats(builder, "load_ms", loads, 1e3);
+    _add_stats(builder, "page_faults", faults, 1.0);
+
+    json_builder_set_member_name(builder, "modules");
+    json_builder_begin_array(builder);
+    for(GList *l = modules; l; l = g_list_next(l))
+    {
+      dt_bench_module_t *m = (dt_bench_module_t *)l->data;
+      json_builder_begin_object(builder);
+      json_builder_set_member_name(builder, "module");
+      json_builder_add_string_value(builder, m->name);
+      _add_stats(builder, "time_ms", m->times, 1e3);
+      _add_stats(builder, "scratch_bytes", m->allocs, 1.0);
+      json_builder_end_object(builder);
+    }
+    json_builder_end_array(builder);
+    json_builder_end_object(builder);
+  }
+  else
+    fprintf(stderr, "error: could not run the %s pipe\n", _pipe_names[spec->type]);
+
+  g_list_free_full(modules, _module_free);
+  g_array_free(totals, TRUE);
+  g_array_free(loads, TRUE);
+  g_array_free(faults, TRUE);
+  return ok;
+}
+
+int main(int argc, char *arg[])
+{
+#ifdef __APPLE__
+  dt_osx_prepare_environment();
+#endif
+
+  // get valid locale dir
+  dt_loc_init(NULL, NULL, NULL, NULL, NULL, NULL);
+  char localedir[PATH_MAX] = { 0 };
+  dt_loc_get_localedir(localedir, sizeof(localedir));
+  bindtextdomain(GETTEXT_PACKAGE, localedir);
+
+  char *input_filename = NULL;
+  char *xmp_filename = NULL;
+  char *synthetic = NULL;
+  char *style = NULL;
+  char *output_filename = NULL;
+  char *thread_list = NULL;
+  int runs = 5;
+  gboolean cold = FALSE;
+  GArray *pipes = g_array_new(FALSE, FALSE, sizeof(dt_bench_pipe_t));
+  int file_counter = 0;
+
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(arg[k][0] == '-')
+    {
+      if(!strcmp(arg[k], "--help") || !strcmp(arg[k], "-h"))
+      {
+        usage(arg[0]);
+        if(k + 1 < argc && !strcmp(arg[k + 1], "synthetic")) synthetic_list();
+        exit(1);
+      }
+      else if(!strcmp(arg[k], "--version"))
+      {
+        printf("this is darktable-bench %s\n", darktable_package_version);
+        exit(0);
+      }
+      else if(!strcmp(arg[k], "--synthetic") && argc > k + 1)
+        synthetic = arg[++k];
+      else if(!strcmp(arg[k], "--pipe") && argc > k + 1)
+      {
+        dt_bench_pipe_t pipe;
+        if(!_parse_pipe(arg[++k], &pipe))
+        {
+          fprintf(stderr, "unknown pipe type '%s'\n", arg[k]);
+          usage(arg[0]);
+          exit(1);
+        }
+        g_array_append_val(pipes, pipe);
+      }
+      else if(!strcmp(arg[k], "--runs") && argc > k + 1)
+        runs = MAX(atoi(arg[++k]), 1);
+      else if(!strcmp(arg[k], "--cold"))
+        cold = TRUE;
+      else if(!strcmp(arg[k], "--threads") && argc > k + 1)
+        thread_list = arg[++k];
+      else if(!strcmp(arg[k], "--style") && argc > k + 1)
+        style = arg[++k];
+      else if(!strcmp(arg[k], "--output") && argc > k + 1)
+        output_filename = arg[++k];
+      else if(!strcmp(arg[k], "--core"))
+      {
+        // everything from here on should be passed to the core
+        k++;
+        break;
+      }
+      else
+        fprintf(stderr, "warning: unknown option '%s'\n", arg[k]);
+    }
+    else
+    {
+      if(file_counter == 0)
+        input_filename = arg[k];
+      else if(file_counter == 1)
+        xmp_filename = arg[k];
+      file_counter++;
+    }
+  }
+
+  if((!input_filename && !synthetic) || (input_filename && synthetic && file_counter > 1) || file_counter > 2)
+  {
+    usage(arg[0]);
+    exit(1);
+  }
+  if(synthetic && input_filename)
+  {
+    // only an xmp was given next to --synthetic
+    xmp_filename = input_filename;
+    input_filename = NULL;
+  }
+  if(pipes->len == 0)
+  {
+    const dt_bench_pipe_t pipe = { DT_BENCH_PIPE_EXPORT, _pipe_default_size[DT_BENCH_PIPE_EXPORT] };
+    g_array_append_val(pipes, pipe);
+  }
+
+  int m_argc = 0;
+  char **m_arg = malloc(sizeof(char *) * (5 + argc - k + 1));
+  m_arg[m_argc++] = "darktable-bench";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  // init dt without gui and without data.db:
+  if(dt_init(m_argc, m_arg, FALSE, TRUE, NULL))
+  {
+    free(m_arg);
+    exit(1);
+  }
+
+  // for the scratch memory of each module. only one pipe runs at a time here, so the allocations of a module's
+  // run are the ones made meanwhile.
+  dt_alloc_align_set_counting(TRUE);
+
+  gchar *input = synthetic ? _synthetic_file(synthetic) : g_strdup(input_filename);
+  if(!input)
+  {
+    fprintf(stderr, "error: unknown synthetic image '%s'\n", synthetic);
+    synthetic_list();
+    dt_cleanup();
+    free(m_arg);
+    exit(1);
+  }
+
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(input);
+  const int filmid = dt_film_new(&film, directory);
+  const int32_t imgid = dt_image_import(filmid, input, TRUE, TRUE);
+  g_free(directory);
+  if(!imgid)
+  {
+    fprintf(stderr, "error: can't open file %s\n", input);
+    g_free(input);
+    dt_cleanup();
+    free(m_arg);
+    exit(1);
+  }
+
+  if(xmp_filename)
+  {
+    dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'w');
+    const int err = dt_exif_xmp_read(image, xmp_filename, 1);
+    dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+    if(err)
+    {
+      fprintf(stderr, "error: can't open xmp file %s\n", xmp_filename);
+      g_free(input);
+      dt_cleanup();
+      free(m_arg);
+      exit(1);
+    }
+  }
+
+  if(style)
+  {
+    if(!dt_styles_exists(style))
+    {
+      fprintf(stderr, "error: cannot find the style '%s'\n", style);
+      g_free(input);
+      dt_cleanup();
+      free(m_arg);
+      exit(1);
+    }
+    dt_styles_apply_to_image(style, FALSE, imgid);
+  }
+
+  // thread counts of the sweep
+  GArray *threads = g_array_new(FALSE, FALSE, sizeof(int));
+  if(thread_list)
+  {
+    gchar **counts = g_strsplit(thread_list, ",", -1);
+    for(gchar **c = counts; *c; c++)
+    {
+      const int n = CLAMP(atoi(*c), 1, (int)dt_get_num_threads());
+      g_array_append_val(threads, n);
+    }
+    g_strfreev(counts);
+  }
+  if(threads->len == 0)
+  {
+    const int n = darktable.num_openmp_threads;
+    g_array_append_val(threads, n);
+  }
+  const int num_openmp_threads = darktable.num_openmp_threads;
+
+  JsonBuilder *builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "version");
+  json_builder_add_string_value(builder, darktable_package_version);
+  json_builder_set_member_name(builder, "image");
+  json_builder_add_string_value(builder, synthetic ? synthetic : input);
+  json_builder_set_member_name(builder, "xmp");
+  if(xmp_filename) json_builder_add_string_value(builder, xmp_filename);
+  else json_builder_add_null_value(builder);
+  json_builder_set_member_name(builder, "style");
+  if(style) json_builder_add_string_value(builder, style);
+  else json_builder_add_null_value(builder);
+  json_builder_set_member_name(builder, "cpus");
+  json_builder_add_int_value(builder, dt_get_num_threads());
+  json_builder_set_member_name(builder, "opencl");
+  json_builder_add_boolean_value(builder, dt_conf_get_bool("opencl"));
+  json_builder_set_member_name(builder, "runs");
+  json_builder_add_int_value(builder, runs);
+  json_builder_set_member_name(builder, "caches");
+  json_builder_add_string_value(builder, cold ? "cold" : "warm");
+  json_builder_set_member_name(builder, "results");
+  json_builder_begin_array(builder);
+
+  int res = 0;
+  for(guint p = 0; p < pipes->len; p++)
+    for(guint t = 0; t < threads->len; t++)
+      if(!_bench(builder, imgid, &g_array_index(pipes, dt_bench_pipe_t, p), g_array_index(threads, int, t), runs,
+                 cold))
+        res = 1;
+
+  json_builder_end_array(builder);
+  json_builder_end_object(builder);
+
+  darktable.num_openmp_threads = num_openmp_threads;
+  dt_set_team_threads(num_openmp_threads);
+
+  JsonGenerator *generator = json_generator_new();
+  JsonNode *root = json_builder_get_root(builder);
+  json_generator_set_root(generator, root);
+  json_generator_set_pretty(generator, TRUE);
+  if(output_filename)
+  {
+    GError *error = NULL;
+    if(!json_generator_to_file(generator, output_filename, &error))
+    {
+      fprintf(stderr, "error: can't write %s: %s\n", output_filename, error->message);
+      g_error_free(error);
+      res = 1;
+    }
+  }
+  else
+  {
+    gchar *json = json_generator_to_data(generator, NULL);
+    printf("%s\n", json);
+    g_free(json);
+  }
+  json_node_free(root);
+  g_object_unref(generator);
+  g_object_unref(builder);
+
+  g_array_free(threads, TRUE);
+  g_array_free(pipes, TRUE);
+  g_free(input);
+
+  dt_cleanup();
+
+  free(m_arg);
+  exit(res);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
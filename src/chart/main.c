@@ -1089,18 +1089,14 @@ static void process_data(dt_lut_t *self, double *target_L, double *target_a, dou
   tonecurve_delete(&tonecurve);
 }
 
-static void process_button_clicked_callback(GtkButton *button, gpointer user_data)
+// fits the style to the picked source patches and the reference values of the chart
+static void process_patches(dt_lut_t *self, const int sparsity)
 {
-  dt_lut_t *self = (dt_lut_t *)user_data;
-
-  gtk_widget_set_sensitive(self->export_button, FALSE);
   free(self->tonecurve_encoded);
   free(self->colorchecker_encoded);
   self->tonecurve_encoded = NULL;
   self->colorchecker_encoded = NULL;
 
-  if(!self->chart) return;
-
   int i = 0;
   int N = g_hash_table_size(self->chart->box_table);
 
@@ -1121,19 +1117,30 @@ static void process_button_clicked_callback(GtkButton *button, gpointer user_dat
 
   add_hdr_patches(&N, &target_L, &target_a, &target_b, &colorchecker_Lab);
 
-  int sparsity = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(self->number_patches)) + 4;
-
   process_data(self, target_L, target_a, target_b, colorchecker_Lab, N, sparsity);
 
-  gtk_widget_set_sensitive(self->export_button, TRUE);
-  gtk_widget_set_sensitive(self->export_raw_button, TRUE);
-
   free(target_L);
   free(target_a);
   free(target_b);
   free(colorchecker_Lab);
 }
 
+static void process_button_clicked_callback(GtkButton *button, gpointer user_data)
+{
+  dt_lut_t *self = (dt_lut_t *)user_data;
+
+  gtk_widget_set_sensitive(self->export_button, FALSE);
+
+  if(!self->chart) return;
+
+  const int sparsity = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(self->number_patches)) + 4;
+
+  process_patches(self, sparsity);
+
+  gtk_widget_set_sensitive(self->export_button, TRUE);
+  gtk_widget_set_sensitive(self->export_raw_button, TRUE);
+}
+
 static void cht_state_callback(GtkWidget *widget, GtkStateFlags flags, gpointer user_data)
 {
   dt_lut_t *self = (dt_lut_t *)user_data;
@@ -1885,11 +1892,68 @@ static int main_csv(dt_lut_t *self, int argc, char *argv[])
   return 0;
 }
 
+// same as the gui with its initial settings: the chart has to fill the images up to a margin of 5%
+static int main_headless(dt_lut_t *self, int argc, char *argv[])
+{
+  const char *filename_source = argv[2];
+  const char *filename_cht = argv[3];
+  const char *filename_reference = argv[4];
+  const int num_patches = atoi(argv[5]);
+  const char *filename_style = argv[6];
+
+  const int sparsity = num_patches + 4;
+
+  self->source.chart = &self->chart;
+  self->reference.chart = &self->chart;
+  self->source.shrink = 1.0;
+  self->reference.shrink = 1.0;
+
+  if(!open_image(&self->source, filename_source)) return 1;
+
+  self->chart = parse_cht(filename_cht);
+  if(!self->chart)
+  {
+    fprintf(stderr, "error parsing `%s', giving up\n", filename_cht);
+    return 1;
+  }
+  collect_source_patches(self);
+
+  char *upper_string = g_ascii_strup(filename_reference, -1);
+  const gboolean reference_is_image = g_str_has_suffix(upper_string, ".PFM");
+  g_free(upper_string);
+  if(reference_is_image)
+  {
+    if(!open_image(&self->reference, filename_reference)) return 1;
+    collect_reference_patches(self);
+  }
+  else if(!parse_it8(filename_reference, self->chart))
+  {
+    fprintf(stderr, "error parsing `%s', giving up\n", filename_reference);
+    return 1;
+  }
+
+  process_patches(self, sparsity);
+
+  char *reference_name = get_filename_base(filename_reference);
+  char *description = g_strdup_printf("fitted LUT style from %s", reference_name);
+  char *name_dot = g_strrstr(reference_name, ".");
+  if(name_dot) *name_dot = '\0';
+
+  export_style(self, filename_style, reference_name, description, TRUE, TRUE, TRUE, TRUE);
+
+  g_free(reference_name);
+  g_free(description);
+
+  return 0;
+}
+
 static void show_usage(const char *exe)
 {
   fprintf(stderr, "Usage: %s [<input Lab pfm file>] [<cht file>] [<reference cgats/it8 or Lab pfm file>]\n"
-                  "       %s --csv <csv file> <number patches> <output dtstyle file>\n",
-          exe, exe);
+                  "       %s --csv <csv file> <number patches> <output dtstyle file>\n"
+                  "       %s --headless <input Lab pfm file> <cht file> <reference cgats/it8 or Lab pfm file> "
+                  "<number patches> <output dtstyle file>\n",
+          exe, exe, exe);
 }
 
 int main(int argc, char *argv[])
@@ -1918,6 +1982,13 @@ int main(int argc, char *argv[])
     else
       res = main_csv(self, argc, argv);
   }
+  else if(argc >= 2 && !g_strcmp0(argv[1], "--headless"))
+  {
+    if(argc != 7)
+      show_usage(argv[0]);
+    else
+      res = main_headless(self, argc, argv);
+  }
   else if(argc <= 4)
     res = main_gui(self, argc, argv);
   else
@@ -25,6 +25,7 @@
 
 #include "chart/thinplate.h"
 #include "chart/deltaE.h"
+#include "common/darktable.h"
 #include "iop/svd.h"
 
 #include <assert.h>
@@ -137,6 +138,61 @@ static inline int solve(double *As, double *w, double *v, const double *b, doubl
   return 0;
 }
 
+// smallest singular value of the leading (s+1)x(s+1) block of the upper triangular R. the chosen columns of A
+// are Q R with orthonormal Q, so this is the smallest singular value solve() would see for them.
+// Rs (S x S), w (S) and v (S x S) are scratch space.
+static inline double qr_min_singular_value(const double *R, double *Rs, double *w, double *v, const int s,
+                                           const int S)
+{
+  for(int i = 0; i <= s; i++)
+    for(int k = 0; k <= s; k++) Rs[i * S + k] = k < i ? 0.0 : R[i * S + k];
+  dsvd(Rs, s + 1, s + 1, S, w, v);
+  double wmin = w[0];
+  for(int i = 1; i <= s; i++) wmin = MIN(wmin, w[i]);
+  return wmin;
+}
+
+// appends column a to the thin QR decomposition of the s columns chosen so far, using modified Gram-Schmidt
+// with one pass of reorthogonalisation. Q holds the orthonormal columns one after the other, R is upper
+// triangular with row stride S. returns 1 if the smallest singular value of the s+1 columns drops below 1e-3,
+// the same stop as in solve(). the norm of what is left of a bounds that value from above, so it is only
+// checked directly to skip the svd of R and the division by zero.
+static inline int qr_append(double *Q, double *R, const double *a, const int wd, const int s, const int S,
+                            double *Rs, double *w, double *v)
+{
+  double *const q = Q + (size_t)s * wd;
+  memcpy(q, a, sizeof(double) * wd);
+  for(int i = 0; i <= s; i++) R[i * S + s] = 0.0;
+  for(int pass = 0; pass < 2; pass++)
+    for(int i = 0; i < s; i++)
+    {
+      const double *const qi = Q + (size_t)i * wd;
+      double h = 0.0;
+      for(int j = 0; j < wd; j++) h += qi[j] * q[j];
+      for(int j = 0; j < wd; j++) q[j] -= h * qi[j];
+      R[i * S + s] += h;
+    }
+  double n = 0.0;
+  for(int j = 0; j < wd; j++) n += q[j] * q[j];
+  n = sqrt(n);
+  if(n < 1e-3) return 1;
+  R[s * S + s] = n;
+  if(qr_min_singular_value(R, Rs, w, v, s, S) < 1e-3) return 1;
+  for(int j = 0; j < wd; j++) q[j] /= n;
+  return 0;
+}
+
+// coeff = R^-1 Q^t b for the first s+1 columns by back substitution
+static inline void qr_solve(const double *R, const double *qtb, double *coeff, const int s, const int S)
+{
+  for(int i = s; i >= 0; i--)
+  {
+    double c = qtb[i];
+    for(int k = i + 1; k <= s; k++) c -= R[i * S + k] * coeff[k];
+    coeff[i] = c / R[i * S + i];
+  }
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wvla"
 
@@ -167,7 +223,12 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
   // to interpolate values f_i with the radial basis function system matrix R and a polynomial term P.
   // P is a 3D linear polynomial a + b x + c y + d z
   //
+  // A is symmetric, so column t can be read as row t.
+  //
   // radial basis function part R
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(A, N, point, wd) schedule(dynamic)
+#endif
   for(int j = 0; j < N; j++)
     for(int i = j; i < N; i++) A[j * wd + i] = A[i * wd + j] = thinplate_kernel(point + 3 * i, point + 3 * j);
 
@@ -185,7 +246,7 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
   for(int i = 0; i < wd; i++)
   {
     norm[i] = 0.0;
-    for(int j = 0; j < wd; j++) norm[i] += A[j * wd + i] * A[j * wd + i];
+    for(int j = 0; j < wd; j++) norm[i] += A[i * wd + j] * A[i * wd + j];
     norm[i] = 1.0 / sqrt(norm[i]);
   }
 
@@ -198,10 +259,23 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
 
   double *w = malloc(sizeof(double) * S);
   double *v = malloc(sizeof(double) * S * S);
+#ifdef EXACT
   double *As = calloc((size_t)wd * S, sizeof(double));
+#else
+  double *Rs = malloc(sizeof(double) * S * S);
+#endif
+
+  // the least squares fit of the chosen columns is kept as a QR decomposition which is extended by one column
+  // per iteration, instead of a full svd of all chosen columns per iteration and channel.
+  double *Q = malloc(sizeof(double) * wd * S);
+  double *R = calloc((size_t)S * S, sizeof(double));
+  double(*qtb)[S] = calloc((size_t)dim * S, sizeof(double));
+  double *dots = malloc(sizeof(double) * wd);
+  int rank = 0; // number of columns in Q
 
   // for rank from 0 to sparsity level
   int s = 0, patches = 0;
+  int result = -1;
   double olderr = FLT_MAX;
   // in case of replacement, iterate all the way to wd
   for(; s < wd; s++)
@@ -210,27 +284,19 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
 #ifndef REPLACEMENT
     if(patches >= S - 4)
     {
-      free(r);
-      free(b);
-      free(w);
-      free(v);
-      free(As);
-      free(norm);
-      free(A);
-      return sparsity;
+      result = sparsity;
+      goto cleanup;
     }
     assert(sparsity < S + 4);
 #endif
     // find (sparsity+1)-th column a_m by m = argmax_t{ a_t^t r . norm_t}
     // by searching over all three residuals
-    double maxdot = 0.0;
-    int maxcol = 0;
+#ifdef EXACT // use full solve
     for(int t = 0; t < wd; t++)
     {
       double dot = 0.0;
       if(norm[t] > 0.0)
       {
-#ifdef EXACT // use full solve
         permutation[sparsity] = t;
         for(int ch = 0; ch < dim; ch++)
         {
@@ -241,14 +307,8 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
 
           if(solve(As, w, v, b[ch], coeff[ch], wd, sparsity, S))
           {
-            free(r);
-            free(b);
-            free(w);
-            free(v);
-            free(As);
-            free(norm);
-            free(A);
-            return sparsity;
+            result = sparsity;
+            goto cleanup;
           }
 
           // compute tentative residual:
@@ -263,21 +323,38 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
         // compute error:
         const double err = compute_error(curve, target, r[0], r[1], r[2], wd, 0);
         dot = 1. / err; // searching for smallest error or largest dot
-#else                   // use dot product
+      }
+      dots[t] = dot;
+    }
+#else // use dot product, the candidates are independent
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(A, dim, dots, norm, r, wd) schedule(static)
+#endif
+    for(int t = 0; t < wd; t++)
+    {
+      double dot = 0.0;
+      if(norm[t] > 0.0)
+      {
         for(int ch = 0; ch < dim; ch++)
         {
           double chdot = 0.0;
-          for(int j = 0; j < wd; j++) chdot += A[j * wd + t] * r[ch][j];
+          for(int j = 0; j < wd; j++) chdot += A[t * wd + j] * r[ch][j];
           dot += fabs(chdot);
         }
         dot *= norm[t];
-#endif
       }
-      // fprintf(stderr, "dot %d = %g\n", i, dot);
-      if(dot > maxdot)
+      dots[t] = dot;
+    }
+#endif
+    double maxdot = 0.0;
+    int maxcol = 0;
+    for(int t = 0; t < wd; t++)
+    {
+      // fprintf(stderr, "dot %d = %g\n", t, dots[t]);
+      if(dots[t] > maxdot)
       {
         maxcol = t;
-        maxdot = dot;
+        maxdot = dots[t];
       }
     }
 
@@ -308,14 +385,8 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
 
           if(solve(As, w, v, b[ch], coeff[ch], wd, sparsity-1, S))
           {
-            free(r);
-            free(b);
-            free(w);
-            free(v);
-            free(As);
-            free(norm);
-            free(A);
-            return s;
+            result = s;
+            goto cleanup;
           }
 
           // compute tentative residual:
@@ -366,6 +437,12 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
         norm[mincol] = 1.0 / sqrt(norm[mincol]);
 #endif
         norm[maxcol] = 0.0;
+        // the decomposition has to be built again from the first replaced column
+        rank = MIN(rank, mincol);
+        for(int k = 0; k < dim; k++) memcpy(r[k], b[k], sizeof(double) * wd);
+        for(int i = 0; i < rank; i++)
+          for(int k = 0; k < dim; k++)
+            for(int j = 0; j < wd; j++) r[k][j] -= qtb[k][i] * Q[(size_t)i * wd + j];
       }
     }
 
@@ -373,35 +450,27 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
     double err = 1. / maxdot;
 #else
     const int sp = MIN(sparsity, S-1); // need to fix up for replacement
-    // solve linear least squares for sparse c for every output channel:
-    for(int ch = 0; ch < dim; ch++)
+    // extend the decomposition by the new columns and project them out of the residual of every output channel.
+    // on error, return last valid configuration
+    for(; rank <= sp; rank++)
     {
-      // re-init all of the previous columns in As since
-      // svd will destroy its contents:
-      for(int i = 0; i <= sp; i++)
-        for(int j = 0; j < wd; j++) As[j * S + i] = A[j * wd + permutation[i]];
-
-      // on error, return last valid configuration
-      if(solve(As, w, v, b[ch], coeff[ch], wd, sp, S))
+      if(qr_append(Q, R, A + (size_t)permutation[rank] * wd, wd, rank, S, Rs, w, v))
       {
-        free(r);
-        free(b);
-        free(w);
-        free(v);
-        free(As);
-        free(norm);
-        free(A);
-        return sparsity;
+        result = sparsity;
+        goto cleanup;
       }
-
-      // compute new residual:
-      // r = b - As c
-      for(int j = 0; j < wd; j++)
+      const double *const q = Q + (size_t)rank * wd;
+      for(int ch = 0; ch < dim; ch++)
       {
-        r[ch][j] = b[ch][j];
-        for(int i = 0; i <= sp; i++) r[ch][j] -= A[j * wd + permutation[i]] * coeff[ch][i];
+        // r is orthogonal to the previous columns, so q^t r = q^t b
+        double h = 0.0;
+        for(int j = 0; j < wd; j++) h += q[j] * r[ch][j];
+        for(int j = 0; j < wd; j++) r[ch][j] -= h * q[j];
+        qtb[ch][rank] = h;
       }
     }
+    // solve linear least squares for sparse c for every output channel:
+    for(int ch = 0; ch < dim; ch++) qr_solve(R, qtb[ch], coeff[ch], sp, S);
 
     double merr = 0.0;
     const double err = compute_error(curve, target, r[0], r[1], r[2], wd, &merr);
@@ -420,14 +489,24 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
     // if(err < 2.0) return sparsity+1;
     olderr = err;
   }
+
+cleanup:
+  free(dots);
+  free(qtb);
+  free(R);
+  free(Q);
   free(r);
   free(b);
   free(w);
   free(v);
+#ifdef EXACT
   free(As);
+#else
+  free(Rs);
+#endif
   free(norm);
   free(A);
-  return -1;
+  return result;
 }
 
 #pragma GCC diagnostic pop
@@ -24,6 +24,8 @@
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 
+#include <limits.h>
+
 static inline size_t _box_size(const int *const box)
 {
   return (size_t)((box[3] - box[1]) * (box[2] - box[0]));
@@ -608,6 +610,108 @@ void dt_color_picker_helper(const dt_iop_buffer_dsc_t *dsc, const float *const p
     dt_unreachable_codepath();
 }
 
+__DT_CLONE_TARGETS__
+void dt_color_picker_boxes_4ch(const float *const pixel, const size_t width, dt_color_picker_box_t *const boxes,
+                               const int count)
+{
+  if(count <= 0) return;
+
+  int top = INT_MAX, bottom = -1;
+  size_t area = 0;
+  for(int k = 0; k < count; k++)
+  {
+    int *const box = boxes[k].box;
+    const int x0 = MIN(box[0], box[2]), x1 = MAX(box[0], box[2]);
+    const int y0 = MIN(box[1], box[3]), y1 = MAX(box[1], box[3]);
+    box[0] = x0;
+    box[1] = y0;
+    box[2] = x1;
+    box[3] = y1;
+    top = MIN(top, y0);
+    bottom = MAX(bottom, y1);
+    area += (size_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+  }
+
+  const size_t numthreads = dt_get_num_threads();
+  size_t sumsize, minmaxsize;
+  double *const restrict sums = dt_alloc_perthread(4 * count, sizeof(double), &sumsize);
+  float *const restrict minmax = dt_alloc_perthread_float(8 * count, &minmaxsize);
+  for(size_t n = 0; n < numthreads; n++)
+  {
+    double *const tsum = sums + n * sumsize;
+    float *const tminmax = minmax + n * minmaxsize;
+    for(int k = 0; k < 4 * count; k++)
+    {
+      tsum[k] = 0.0;
+      tminmax[k] = INFINITY;
+      tminmax[4 * count + k] = -INFINITY;
+    }
+  }
+
+  // every thread walks its rows once and updates all the boxes crossing them. threads don't pay off for
+  // small areas, especially points (arbitrary limit).
+#ifdef _OPENMP
+#pragma omp parallel for default(none) if(area > 10000) \
+  dt_omp_firstprivate(pixel, width, boxes, count, top, bottom, sums, sumsize, minmax, minmaxsize) \
+  schedule(static)
+#endif
+  for(int j = top; j <= bottom; j++)
+  {
+    double *const restrict tsum = dt_get_perthread(sums, sumsize);
+    float *const restrict tmin = dt_get_perthread(minmax, minmaxsize);
+    float *const restrict tmax = tmin + 4 * count;
+    const float *const restrict row = pixel + 4 * width * j;
+    for(int k = 0; k < count; k++)
+    {
+      const int *const box = boxes[k].box;
+      if(j < box[1] || j > box[3]) continue;
+
+      float sum[4] DT_ALIGNED_PIXEL = { 0.0f, 0.0f, 0.0f, 0.0f };
+      float min[4] DT_ALIGNED_PIXEL = { INFINITY, INFINITY, INFINITY, INFINITY };
+      float max[4] DT_ALIGNED_PIXEL = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
+      for(int i = box[0]; i <= box[2]; i++)
+      {
+        for_four_channels(c)
+        {
+          const float v = row[4 * i + c];
+          sum[c] += v;
+          // not fminf()/fmaxf(), which don't vectorize without -ffinite-math-only. NaNs are skipped as well.
+          min[c] = v < min[c] ? v : min[c];
+          max[c] = v > max[c] ? v : max[c];
+        }
+      }
+      for_four_channels(c)
+      {
+        tsum[4 * k + c] += sum[c];
+        tmin[4 * k + c] = fminf(tmin[4 * k + c], min[c]);
+        tmax[4 * k + c] = fmaxf(tmax[4 * k + c], max[c]);
+      }
+    }
+  }
+
+  for(int k = 0; k < count; k++)
+  {
+    dt_color_picker_box_t *const b = boxes + k;
+    const double size = (double)(b->box[2] - b->box[0] + 1) * (b->box[3] - b->box[1] + 1);
+    for(int c = 0; c < 4; c++)
+    {
+      double sum = 0.0;
+      b->min[c] = INFINITY;
+      b->max[c] = -INFINITY;
+      for(size_t n = 0; n < numthreads; n++)
+      {
+        sum += sums[n * sumsize + 4 * k + c];
+        b->min[c] = fminf(b->min[c], minmax[n * minmaxsize + 4 * k + c]);
+        b->max[c] = fmaxf(b->max[c], minmax[n * minmaxsize + 4 * count + 4 * k + c]);
+      }
+      b->mean[c] = sum / size;
+    }
+  }
+
+  dt_free_align(minmax);
+  dt_free_align(sums);
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -31,6 +31,19 @@ void dt_color_picker_helper(const struct dt_iop_buffer_dsc_t *dsc, const float *
                             const enum dt_iop_colorspace_type_t picker_cst,
                             const dt_iop_order_iccprofile_info_t *const profile);
 
+/** statistics of a box of a 4 channel image, the corners x0, y0, x1, y1 are included */
+typedef struct dt_color_picker_box_t
+{
+  int box[4];
+  float mean[4] DT_ALIGNED_PIXEL;
+  float min[4] DT_ALIGNED_PIXEL;
+  float max[4] DT_ALIGNED_PIXEL;
+} dt_color_picker_box_t;
+
+/** fills mean, min and max of all the boxes in one pass over the rows they cover */
+void dt_color_picker_boxes_4ch(const float *const pixel, const size_t width, dt_color_picker_box_t *const boxes,
+                               const int count);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
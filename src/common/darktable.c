@@ -43,6 +43,7 @@
 #include "common/file_location.h"
 #include "common/film.h"
 #include "common/grealpath.h"
+#include "common/history.h"
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
@@ -50,8 +51,10 @@
 #include "common/l10n.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
+#include "common/numa.h"
 #include "common/opencl.h"
 #include "common/points.h"
+#include "common/presets.h"
 #include "common/resource_limits.h"
 #include "common/undo.h"
 #include "control/conf.h"
@@ -1045,6 +1048,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, dt_get_num_threads());
 
+  darktable.numa = dt_numa_init();
+
   darktable.noiseprofile_parser = dt_noiseprofile_init(noiseprofiles_from_command);
 
   // must come before mipmap_cache, because that one will need to access
@@ -1284,6 +1289,8 @@ void dt_cleanup()
   free(darktable.conf);
   dt_points_cleanup(darktable.points);
   free(darktable.points);
+  dt_numa_cleanup(darktable.numa);
+  darktable.numa = NULL;
   dt_iop_unload_modules_so();
   g_list_free_full(darktable.iop_order_list, free);
   darktable.iop_order_list = NULL;
@@ -1332,6 +1339,8 @@ void dt_cleanup()
   {
     g_strfreev(snaps_to_remove);
   }
+  dt_presets_autoapply_cleanup();
+  dt_history_hash_cleanup();
   dt_database_destroy(darktable.db);
 
   if(init_gui)
@@ -1385,9 +1394,23 @@ void dt_gettime(char *datetime, size_t datetime_len)
   dt_gettime_t(datetime, datetime_len, time(NULL));
 }
 
+static gboolean _count_allocs = FALSE;
+static uint64_t _counted_bytes = 0;
+
+void dt_alloc_align_set_counting(const gboolean enable)
+{
+  _count_allocs = enable;
+}
+
+uint64_t dt_alloc_align_counted(void)
+{
+  return __atomic_load_n(&_counted_bytes, __ATOMIC_RELAXED);
+}
+
 void *dt_alloc_align(size_t alignment, size_t size)
 {
   const size_t aligned_size = dt_round_size(size, alignment);
+  if(_count_allocs) __atomic_fetch_add(&_counted_bytes, aligned_size, __ATOMIC_RELAXED);
 #if defined(__FreeBSD_version) && __FreeBSD_version < 700013
   return malloc(aligned_size);
 #elif defined(_WIN32)
@@ -297,6 +297,7 @@ typedef struct darktable_t
   const struct dt_collection_t *collection;
   struct dt_selection_t *selection;
   struct dt_points_t *points;
+  struct dt_numa_t *numa;
   struct dt_imageio_t *imageio;
   struct dt_opencl_t *opencl;
   struct dt_dbus_t *dbus;
@@ -340,6 +341,10 @@ void dt_gettime_t(char *datetime, size_t datetime_len, time_t t);
 void dt_gettime(char *datetime, size_t datetime_len);
 
 void *dt_alloc_align(size_t alignment, size_t size);
+/** while enabled, the bytes allocated with dt_alloc_align() (and so dt_alloc_align_float(), dt_alloc_perthread()
+    and the pixelpipe's pool and cache) are added up. used by darktable-bench for the memory of each module. */
+void dt_alloc_align_set_counting(const gboolean enable);
+uint64_t dt_alloc_align_counted(void);
 static inline float *dt_alloc_align_float(size_t pixels)
 {
   return (float*)__builtin_assume_aligned(dt_alloc_align(64, pixels * sizeof(float)), 64);
@@ -472,6 +477,32 @@ static inline int dt_get_thread_num()
 #endif
 }
 
+// Number of threads a parallel region started by the calling thread will use.  Inside the pixelpipe this is
+// the team size picked for the current module invocation (see dt_iop_get_num_threads()), which can be less
+// than dt_get_num_threads() for small regions of interest or when several pipes are running.  Use it for
+// num_threads() clauses and for splitting work into per-thread chunks; per-thread buffers must still be
+// sized with dt_get_num_threads().
+static inline int dt_get_team_threads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// Set the team size for parallel regions started by the calling thread and return the previous one.
+static inline int dt_set_team_threads(const int nthreads)
+{
+#ifdef _OPENMP
+  const int prev = omp_get_max_threads();
+  omp_set_num_threads(MAX(1, nthreads));
+  return prev;
+#else
+  return 1;
+#endif
+}
+
 // Allocate a buffer for 'n' objects each of size 'objsize' bytes for each of the program's threads.
 // Ensures that there is no false sharing among threads by aligning and rounding up the allocation to
 // a multiple of the cache line size.  Returns a pointer to the allocated pool and the adjusted number
@@ -36,9 +36,9 @@
  * but subtract them I2 = I0 - I1, where I0 is the sample image to be
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
- * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation.
- * It could benefit from a multi-grid evaluation of an initial solution
- * before the main iteration loop.
+ * mask. The solver is a multigrid v-cycle with red/black checker Gauss-Seidel
+ * smoothing. The original red/black Gauss-Seidel with over-relaxation is kept
+ * as dt_heal_sor().
  *
  * I reduced the convergence criteria to 0.1% (0.001) as we are
  * dealing here with RGB integer components, more is overkill.
@@ -261,13 +261,278 @@ cleanup:
 }
 
 
+/* Multigrid solver of the same equations. Red/black SOR needs more iterations the larger the area is, as
+ * the borders propagate into the middle by one pixel per iteration. The v-cycle smooths the error with a
+ * few Gauss-Seidel sweeps, and corrects the smooth rest of it on a grid of half the size, recursively. It
+ * converges in a few cycles on areas that are large in both directions. Thin areas can't be halved enough
+ * for the coarsest grid to be small, they are left to SOR which converges fast on them anyway.
+ */
+
+typedef struct dt_heal_level_t
+{
+  int width, height;
+  uint8_t *mask; // 1 where the pixel is solved for
+  float *u;      // solution, or correction of the finer level
+  float *f;      // right hand side
+  float *r;      // residual
+} dt_heal_level_t;
+
+#define DT_HEAL_MG_MIN_SIZE 8    // the coarsest level is solved by iterating to convergence
+#define DT_HEAL_MG_MAX_COARSE 64 // longest side of the coarsest level, SOR is used above that
+#define DT_HEAL_MG_SMOOTH 2      // red/black Gauss-Seidel sweeps before and after the coarse correction
+#define DT_HEAL_MG_MAX_CYCLES 30
+
+// neighbors of (i, j) in the canvas, and their number which is the diagonal of the equation
+static inline float _mg_neighbors(const float *const u, const int i, const int j, const int width, const int height,
+                                  const int ch, const int k, int *const count)
+{
+  const float *const p = u + ((size_t)i * width + j) * ch + k;
+  float sum = 0.0f;
+  int n = 0;
+  if(j > 0) { sum += p[-ch]; n++; }
+  if(j < width - 1) { sum += p[ch]; n++; }
+  if(i > 0) { sum += p[-(size_t)width * ch]; n++; }
+  if(i < height - 1) { sum += p[(size_t)width * ch]; n++; }
+  *count = n;
+  return sum;
+}
+
+// red/black Gauss-Seidel sweeps on the masked pixels of a level
+static void _mg_smooth(const dt_heal_level_t *const l, const int ch, const int ch1, const int sweeps)
+{
+  const int width = l->width, height = l->height;
+  float *const u = l->u;
+  const float *const f = l->f;
+  const uint8_t *const mask = l->mask;
+  for(int s = 0; s < sweeps; s++)
+    for(int parity = 0; parity < 2; parity++)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(ch, ch1, f, height, mask, parity, u, width) \
+  schedule(static)
+#endif
+      for(int i = 0; i < height; i++)
+        for(int j = (i & 1) ^ parity; j < width; j += 2)
+        {
+          const size_t idx = (size_t)i * width + j;
+          if(!mask[idx]) continue;
+          for(int k = 0; k < ch1; k++)
+          {
+            int n;
+            const float sum = _mg_neighbors(u, i, j, width, height, ch, k, &n);
+            u[idx * ch + k] = (f[idx * ch + k] + sum) / n;
+          }
+        }
+    }
+}
+
+// residual of the equations on the masked pixels of a level, returns its sum of squares
+static float _mg_residual(const dt_heal_level_t *const l, const int ch, const int ch1)
+{
+  const int width = l->width, height = l->height;
+  const float *const u = l->u;
+  const float *const f = l->f;
+  float *const r = l->r;
+  const uint8_t *const mask = l->mask;
+  float err = 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(ch, ch1, f, height, mask, r, u, width) \
+  schedule(static) reduction(+ : err)
+#endif
+  for(int i = 0; i < height; i++)
+    for(int j = 0; j < width; j++)
+    {
+      const size_t idx = (size_t)i * width + j;
+      for(int k = 0; k < ch1; k++)
+      {
+        float res = 0.0f;
+        if(mask[idx])
+        {
+          int n;
+          const float sum = _mg_neighbors(u, i, j, width, height, ch, k, &n);
+          res = f[idx * ch + k] - (n * u[idx * ch + k] - sum);
+        }
+        r[idx * ch + k] = res;
+        err += res * res;
+      }
+    }
+  return err;
+}
+
+// sums the residuals of 2x2 fine pixels into the right hand side of the coarse level. the coarse grid
+// spacing is twice the fine one, so the sum is the mean residual scaled by the ratio of the stencils.
+static void _mg_restrict(const dt_heal_level_t *const fine, const dt_heal_level_t *const coarse, const int ch,
+                         const int ch1)
+{
+  const int fw = fine->width, fh = fine->height, cw = coarse->width, chh = coarse->height;
+  const float *const r = fine->r;
+  float *const f = coarse->f;
+  float *const u = coarse->u;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(ch, ch1, chh, cw, f, fh, fw, r, u) schedule(static)
+#endif
+  for(int i = 0; i < chh; i++)
+    for(int j = 0; j < cw; j++)
+    {
+      const size_t idx = (size_t)i * cw + j;
+      for(int k = 0; k < ch1; k++)
+      {
+        float sum = 0.0f;
+        for(int di = 0; di < 2; di++)
+          for(int dj = 0; dj < 2; dj++)
+          {
+            const int fi = 2 * i + di, fj = 2 * j + dj;
+            if(fi < fh && fj < fw) sum += r[((size_t)fi * fw + fj) * ch + k];
+          }
+        f[idx * ch + k] = sum;
+        u[idx * ch + k] = 0.0f;
+      }
+    }
+}
+
+static inline float _mg_coarse_at(const dt_heal_level_t *const c, int i, int j, const int ch, const int k)
+{
+  // the correction is zero on the fixed pixels and continues flat at the borders of the canvas
+  i = CLAMP(i, 0, c->height - 1);
+  j = CLAMP(j, 0, c->width - 1);
+  const size_t idx = (size_t)i * c->width + j;
+  return c->mask[idx] ? c->u[idx * ch + k] : 0.0f;
+}
+
+// adds the bilinear interpolation of the coarse correction to the masked fine pixels
+static void _mg_prolongate(const dt_heal_level_t *const coarse, const dt_heal_level_t *const fine, const int ch,
+                           const int ch1)
+{
+  const int fw = fine->width, fh = fine->height;
+  float *const u = fine->u;
+  const uint8_t *const mask = fine->mask;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(ch, ch1, coarse, fh, fw, mask, u) schedule(static)
+#endif
+  for(int i = 0; i < fh; i++)
+  {
+    // fine pixel centers are at a quarter of a coarse pixel from the coarse centers
+    const int ci = i / 2, ni = (i & 1) ? ci + 1 : ci - 1;
+    for(int j = 0; j < fw; j++)
+    {
+      const size_t idx = (size_t)i * fw + j;
+      if(!mask[idx]) continue;
+      const int cj = j / 2, nj = (j & 1) ? cj + 1 : cj - 1;
+      for(int k = 0; k < ch1; k++)
+        u[idx * ch + k] += 0.5625f * _mg_coarse_at(coarse, ci, cj, ch, k)
+                           + 0.1875f * (_mg_coarse_at(coarse, ni, cj, ch, k) + _mg_coarse_at(coarse, ci, nj, ch, k))
+                           + 0.0625f * _mg_coarse_at(coarse, ni, nj, ch, k);
+    }
+  }
+}
+
+static void _mg_vcycle(const dt_heal_level_t *const levels, const int level, const int nlevels, const int ch,
+                       const int ch1)
+{
+  const dt_heal_level_t *const l = levels + level;
+  if(level == nlevels - 1)
+  {
+    // a few pixels only, iterate until the residual dropped by a factor of 100, or the corrections propagated
+    // through the whole level
+    const float err0 = _mg_residual(l, ch, ch1);
+    for(int s = 0; s < 2 * (l->width + l->height); s += DT_HEAL_MG_SMOOTH)
+    {
+      _mg_smooth(l, ch, ch1, DT_HEAL_MG_SMOOTH);
+      if(_mg_residual(l, ch, ch1) <= 1e-4f * err0) break;
+    }
+    return;
+  }
+  _mg_smooth(l, ch, ch1, DT_HEAL_MG_SMOOTH);
+  _mg_residual(l, ch, ch1);
+  _mg_restrict(l, levels + level + 1, ch, ch1);
+  _mg_vcycle(levels, level + 1, nlevels, ch, ch1);
+  _mg_prolongate(levels + level + 1, l, ch, ch1);
+  _mg_smooth(l, ch, ch1, DT_HEAL_MG_SMOOTH);
+}
+
+// Solve the laplace equation for pixels with a multigrid v-cycle and store the result in-place.
+static void dt_heal_laplace_multigrid(float *pixels, const int width, const int height, const int ch,
+                                      const float *const mask, const int use_sse)
+{
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+
+  int nlevels = 1;
+  int w = width, h = height;
+  for(; MIN(w, h) > DT_HEAL_MG_MIN_SIZE; w = (w + 1) / 2, h = (h + 1) / 2) nlevels++;
+  if(MAX(w, h) > DT_HEAL_MG_MAX_COARSE)
+  {
+    // the coarsest level would take as many sweeps as SOR on the whole area
+    dt_heal_laplace_loop(pixels, width, height, ch, mask, use_sse);
+    return;
+  }
+
+  dt_heal_level_t *levels = calloc(nlevels, sizeof(dt_heal_level_t));
+  gboolean ok = levels != NULL;
+  for(int n = 0; ok && n < nlevels; n++)
+  {
+    dt_heal_level_t *l = levels + n;
+    l->width = n ? (levels[n - 1].width + 1) / 2 : width;
+    l->height = n ? (levels[n - 1].height + 1) / 2 : height;
+    const size_t size = (size_t)l->width * l->height;
+    l->mask = dt_alloc_align(64, size);
+    l->u = n ? dt_alloc_align_float(size * ch) : pixels;
+    l->f = dt_alloc_align_float(size * ch);
+    l->r = dt_alloc_align_float(size * ch);
+    ok = l->mask && l->u && l->f && l->r;
+  }
+  if(!ok)
+  {
+    fprintf(stderr, "dt_heal_laplace_multigrid: error allocating memory for healing\n");
+    goto cleanup;
+  }
+
+  // a coarse pixel is solved for if all of its fine pixels are. extending the coarse levels over the fixed
+  // pixels makes the corrections overshoot at the borders of the mask.
+  for(size_t k = 0; k < (size_t)width * height; k++) levels[0].mask[k] = mask[k] != 0.0f;
+  memset(levels[0].f, 0, sizeof(float) * width * height * ch);
+  for(int n = 1; n < nlevels; n++)
+  {
+    const dt_heal_level_t *fine = levels + n - 1, *coarse = levels + n;
+    for(int i = 0; i < coarse->height; i++)
+      for(int j = 0; j < coarse->width; j++)
+      {
+        uint8_t m = 1;
+        for(int di = 0; di < 2; di++)
+          for(int dj = 0; dj < 2; dj++)
+            if(2 * i + di < fine->height && 2 * j + dj < fine->width)
+              m &= fine->mask[(size_t)(2 * i + di) * fine->width + 2 * j + dj];
+        coarse->mask[(size_t)i * coarse->width + j] = m;
+      }
+  }
+
+  const float epsilon = (0.1 / 255);
+  for(int cycle = 0; cycle < DT_HEAL_MG_MAX_CYCLES; cycle++)
+  {
+    _mg_vcycle(levels, 0, nlevels, ch, ch1);
+    if(_mg_residual(levels, ch, ch1) < epsilon * epsilon) break;
+  }
+
+cleanup:
+  if(levels)
+  {
+    for(int n = 0; n < nlevels; n++)
+    {
+      dt_free_align(levels[n].mask);
+      if(n) dt_free_align(levels[n].u);
+      dt_free_align(levels[n].f);
+      dt_free_align(levels[n].r);
+    }
+    free(levels);
+  }
+}
+
 /* Original Algorithm Design:
  *
  * T. Georgiev, "Photoshop Healing Brush: a Tool for Seamless Cloning
  * http://www.tgeorgiev.net/Photoshop_Healing.pdf
  */
-void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
-             const int height, const int ch, const int use_sse)
+static void _heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer,
+                  const int width, const int height, const int ch, const int use_sse, const gboolean multigrid)
 {
   float *diff_buffer = dt_alloc_align_float((size_t)ch * width * (height + 1));
 
@@ -280,7 +545,10 @@ void dt_heal(const float *const src_buffer, float *dest_buffer, const float *con
   /* subtract pattern from image and store the result in diff */
   dt_heal_sub(dest_buffer, src_buffer, diff_buffer, width, height, ch);
 
-  dt_heal_laplace_loop(diff_buffer, width, height, ch, mask_buffer, use_sse);
+  if(multigrid)
+    dt_heal_laplace_multigrid(diff_buffer, width, height, ch, mask_buffer, use_sse);
+  else
+    dt_heal_laplace_loop(diff_buffer, width, height, ch, mask_buffer, use_sse);
 
   /* add solution to original image and store in dest */
   dt_heal_add(diff_buffer, src_buffer, dest_buffer, width, height, ch);
@@ -289,6 +557,18 @@ cleanup:
   if(diff_buffer) dt_free_align(diff_buffer);
 }
 
+void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
+             const int height, const int ch, const int use_sse)
+{
+  _heal(src_buffer, dest_buffer, mask_buffer, width, height, ch, use_sse, TRUE);
+}
+
+void dt_heal_sor(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer,
+                 const int width, const int height, const int ch, const int use_sse)
+{
+  _heal(src_buffer, dest_buffer, mask_buffer, width, height, ch, use_sse, FALSE);
+}
+
 #ifdef HAVE_OPENCL
 
 dt_heal_cl_global_t *dt_heal_init_cl_global()
@@ -25,6 +25,12 @@
 void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
              const int height, const int ch, const int use_sse);
 
+/* same as dt_heal() with the red/black SOR solver, which needs many more iterations on large areas. kept as
+ * the reference for the multigrid solver of dt_heal().
+ */
+void dt_heal_sor(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer,
+                 const int width, const int height, const int ch, const int use_sse);
+
 #ifdef HAVE_OPENCL
 
 typedef struct dt_heal_cl_global_t
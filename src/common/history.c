@@ -732,9 +732,10 @@ static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const
   return ret_val;
 }
 
-int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_imgid,
-                                       const gboolean merge, GList *ops,
-                                       const gboolean copy_iop_order, const gboolean copy_full)
+static int _history_copy_and_paste_on_image_ext(const int32_t imgid, const int32_t dest_imgid,
+                                                const gboolean merge, GList *ops,
+                                                const gboolean copy_iop_order, const gboolean copy_full,
+                                                const gboolean bulk)
 {
   if(imgid == dest_imgid) return 1;
 
@@ -746,9 +747,10 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
 
   dt_lock_image_pair(imgid, dest_imgid);
 
-  // be sure the current history is written before pasting some other history data
+  // be sure the current history is written before pasting some other history data. in bulk mode the caller
+  // does this once for the whole list.
   const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
-  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+  if(!bulk && cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
 
   dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
   hist->imgid = dest_imgid;
@@ -773,12 +775,20 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
                  dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
   dt_undo_end_group(darktable.undo);
 
-  /* attach changed tag reflecting actual change */
-  guint tagid = 0;
-  dt_tag_new("darktable|changed", &tagid);
-  dt_tag_attach(tagid, dest_imgid, FALSE, FALSE);
-  /* set change_timestamp */
-  dt_image_cache_set_change_timestamp(darktable.image_cache, dest_imgid);
+  if(bulk)
+  {
+    // tag, sidecar file and thumbnail are left to dt_history_bulk_finish()
+    dt_history_bulk_changed(dest_imgid);
+  }
+  else
+  {
+    /* attach changed tag reflecting actual change */
+    guint tagid = 0;
+    dt_tag_new("darktable|changed", &tagid);
+    dt_tag_attach(tagid, dest_imgid, FALSE, FALSE);
+    /* set change_timestamp */
+    dt_image_cache_set_change_timestamp(darktable.image_cache, dest_imgid);
+  }
 
   /* if current image in develop reload history */
   if(dt_dev_is_current_image(darktable.develop, dest_imgid))
@@ -787,26 +797,92 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
     dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
   }
 
-  /* update xmp file */
-  dt_image_synch_xmp(dest_imgid);
+  if(!bulk)
+  {
+    /* update xmp file */
+    dt_image_synch_xmp(dest_imgid);
 
-  dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
-  dt_image_reset_final_size(imgid);
+    dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
+    dt_image_reset_final_size(imgid);
 
-  /* update the aspect ratio. recompute only if really needed for performance reasons */
-  if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
-    dt_image_set_aspect_ratio(dest_imgid, FALSE);
-  else
-    dt_image_reset_aspect_ratio(dest_imgid, FALSE);
+    /* update the aspect ratio. recompute only if really needed for performance reasons */
+    if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
+      dt_image_set_aspect_ratio(dest_imgid, FALSE);
+    else
+      dt_image_reset_aspect_ratio(dest_imgid, FALSE);
 
-  // signal that the mipmap need to be updated
-  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, dest_imgid);
+    // signal that the mipmap need to be updated
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, dest_imgid);
+  }
 
   dt_unlock_image_pair(imgid, dest_imgid);
 
   return ret_val;
 }
 
+int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_imgid,
+                                       const gboolean merge, GList *ops,
+                                       const gboolean copy_iop_order, const gboolean copy_full)
+{
+  return _history_copy_and_paste_on_image_ext(imgid, dest_imgid, merge, ops, copy_iop_order, copy_full, FALSE);
+}
+
+void dt_history_bulk_changed(const int32_t imgid)
+{
+  // one write for what dt_image_cache_set_change_timestamp(), dt_image_reset_final_size() and
+  // dt_image_reset_aspect_ratio() do one by one, without writing the sidecar file
+  dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'w');
+  if(!image) return;
+  image->change_timestamp = time(NULL);
+  image->final_width = image->final_height = 0;
+  image->aspect_ratio = 0.f;
+  dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+}
+
+static int32_t _history_bulk_finish_job_run(dt_job_t *job)
+{
+  GList *imgs = (GList *)dt_control_job_get_params(job);
+  const gboolean sort_aspect_ratio = darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO;
+  const double total = g_list_length(imgs);
+  int count = 0;
+
+  for(GList *l = imgs; l; l = g_list_next(l))
+  {
+    const int32_t imgid = GPOINTER_TO_INT(l->data);
+    dt_image_synch_xmp(imgid);
+    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+    /* recompute the aspect ratio only if really needed for performance reasons */
+    if(sort_aspect_ratio) dt_image_set_aspect_ratio(imgid, FALSE);
+    dt_control_job_set_progress(job, ++count / total);
+  }
+
+  if(sort_aspect_ratio)
+    dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, g_list_copy(imgs));
+
+  // one signal for all the thumbnails
+  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, -1);
+  return 0;
+}
+
+void dt_history_bulk_finish(GList *imgs)
+{
+  if(!imgs) return;
+
+  /* attach changed tag reflecting actual change */
+  guint tagid = 0;
+  if(dt_tag_new("darktable|changed", &tagid)) dt_tag_attach_images(tagid, imgs, FALSE);
+
+  dt_job_t *job = dt_control_job_create(&_history_bulk_finish_job_run, "update sidecar files and thumbnails");
+  if(!job)
+  {
+    g_list_free(imgs);
+    return;
+  }
+  dt_control_job_add_progress(job, _("updating sidecar files and thumbnails"), FALSE);
+  dt_control_job_set_params(job, imgs, (dt_job_destroy_callback)g_list_free);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
+}
+
 GList *dt_history_get_items(const int32_t imgid, gboolean enabled)
 {
   GList *result = NULL;
@@ -1388,12 +1464,9 @@ static gsize _history_hash_compute_from_db(const int32_t imgid, guint8 **hash)
   return hash_len;
 }
 
-void dt_history_hash_write_from_history(const int32_t imgid, const dt_history_hash_t type)
+static void _history_hash_write_value(const int32_t imgid, const dt_history_hash_t type, guint8 *hash,
+                                      const gsize hash_len)
 {
-  if(imgid == -1) return;
-
-  guint8 *hash = NULL;
-  gsize hash_len = _history_hash_compute_from_db(imgid, &hash);
   if(hash_len)
   {
     char *fields = NULL;
@@ -1464,10 +1537,95 @@ void dt_history_hash_write_from_history(const int32_t imgid, const dt_history_ha
       g_free(values);
       g_free(conflict);
     }
-    g_free(hash);
   }
 }
 
+void dt_history_hash_write_from_history(const int32_t imgid, const dt_history_hash_t type)
+{
+  if(imgid == -1) return;
+
+  guint8 *hash = NULL;
+  const gsize hash_len = _history_hash_compute_from_db(imgid, &hash);
+  _history_hash_write_value(imgid, type, hash, hash_len);
+  g_free(hash);
+}
+
+// same as _history_hash_compute_from_db() on the history of dev once dt_dev_write_history_ext() has written it
+// for imgid, without reading it back
+static gsize _history_hash_compute_from_dev(dt_develop_t *dev, guint8 **hash)
+{
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+  gsize hash_len = 0;
+
+  // the items are written with num = their position and the active ones are the last items of each
+  // operation and multi_priority up to history_end (included, as in the query)
+  const int count = MIN((int)g_list_length(dev->history), dev->history_end + 1);
+  dt_dev_history_item_t **items = g_new(dt_dev_history_item_t *, MAX(count, 1));
+  gboolean *active = g_new0(gboolean, MAX(count, 1));
+  GList *history = dev->history;
+  for(int i = 0; i < count; i++, history = g_list_next(history))
+    items[i] = (dt_dev_history_item_t *)history->data;
+
+  GHashTable *seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for(int i = count - 1; i >= 0; i--)
+  {
+    gchar *key = g_strdup_printf("%s %d", items[i]->module->op, items[i]->multi_priority);
+    active[i] = !g_hash_table_contains(seen, key);
+    if(active[i])
+      g_hash_table_add(seen, key);
+    else
+      g_free(key);
+  }
+  g_hash_table_destroy(seen);
+
+  gboolean history_on = FALSE;
+  for(int i = 0; i < count; i++)
+  {
+    const dt_dev_history_item_t *hist = items[i];
+    if(!active[i] || !hist->enabled) continue;
+
+    g_checksum_update(checksum, (const guchar *)hist->module->op, -1);
+    if(hist->params && hist->module->params_size > 0)
+      g_checksum_update(checksum, (const guchar *)hist->params, hist->module->params_size);
+    if(hist->blend_params)
+      g_checksum_update(checksum, (const guchar *)hist->blend_params, sizeof(dt_develop_blend_params_t));
+    history_on = TRUE;
+  }
+  g_free(items);
+  g_free(active);
+
+  if(history_on)
+  {
+    // module order, as written by dt_ioppr_write_iop_order_list()
+    const int version = dt_ioppr_get_iop_order_list_kind(dev->iop_order_list);
+    g_checksum_update(checksum, (const guchar *)&version, sizeof(version));
+    if(version == DT_IOP_ORDER_CUSTOM)
+    {
+      gchar *buf = dt_ioppr_serialize_text_iop_order_list(dev->iop_order_list);
+      if(buf) g_checksum_update(checksum, (const guchar *)buf, -1);
+      g_free(buf);
+    }
+
+    const gsize checksum_len = g_checksum_type_get_length(G_CHECKSUM_MD5);
+    *hash = g_malloc(checksum_len);
+    hash_len = checksum_len;
+    g_checksum_get_digest(checksum, *hash, &hash_len);
+  }
+  g_checksum_free(checksum);
+
+  return hash_len;
+}
+
+void dt_history_hash_write_from_dev(dt_develop_t *dev, const int32_t imgid, const dt_history_hash_t type)
+{
+  if(imgid == -1) return;
+
+  guint8 *hash = NULL;
+  const gsize hash_len = _history_hash_compute_from_dev(dev, &hash);
+  _history_hash_write_value(imgid, type, hash, hash_len);
+  g_free(hash);
+}
+
 void dt_history_hash_write(const int32_t imgid, dt_history_hash_values_t *hash)
 {
   if(hash->basic || hash->auto_apply || hash->current)
@@ -1563,35 +1721,160 @@ void dt_history_hash_set_mipmap(const int32_t imgid)
   sqlite3_finalize(stmt);
 }
 
-dt_history_hash_t dt_history_hash_get_status(const int32_t imgid)
+// status of the images as dt_history_hash_get_status() returns it, filled for the whole collection at
+// once as the thumbtable asks for all the visible images in a row. an outdated status is stored as minus
+// the number of the change which made it outdated.
+static GMutex _hash_status_lock;
+static GHashTable *_hash_status = NULL;
+static int _hash_status_changes = 0;
+
+// called from the triggers on main.history_hash. this runs inside of sqlite, so nobody may call sqlite
+// while holding the lock.
+static void _hash_status_changed(sqlite3_context *context, int argc, sqlite3_value **argv)
 {
-  dt_history_hash_t status = 0;
-  if(imgid == -1) return status;
+  const int32_t imgid = sqlite3_value_int(argv[0]);
+  g_mutex_lock(&_hash_status_lock);
+  if(!_hash_status) _hash_status = g_hash_table_new(NULL, NULL);
+  _hash_status_changes++;
+  g_hash_table_insert(_hash_status, GINT_TO_POINTER(imgid), GINT_TO_POINTER(-_hash_status_changes));
+  g_mutex_unlock(&_hash_status_lock);
+  sqlite3_result_null(context);
+}
+
+// keeps what was read after change number changes unless the image changed once more meanwhile.
+// _hash_status_lock must be held.
+static void _hash_status_store(const int32_t imgid, const dt_history_hash_t status, const int changes)
+{
+  const int value = GPOINTER_TO_INT(g_hash_table_lookup(_hash_status, GINT_TO_POINTER(imgid)));
+  if(value >= 0 || -value <= changes)
+    g_hash_table_insert(_hash_status, GINT_TO_POINTER(imgid), GINT_TO_POINTER(status));
+}
+
+static void _hash_status_create_triggers(sqlite3 *db)
+{
+  sqlite3_create_function(db, "dt_history_hash_changed", 1, SQLITE_UTF8, NULL, _hash_status_changed, NULL,
+                          NULL);
+  const char *events[3] = { "INSERT", "UPDATE", "DELETE" };
+  for(int e = 0; e < 3; e++)
+  {
+    gchar *query = g_strdup_printf("CREATE TEMP TRIGGER IF NOT EXISTS history_hash_status_%d"
+                                   " AFTER %s ON main.history_hash"
+                                   " BEGIN SELECT dt_history_hash_changed(%s.imgid); END",
+                                   e, events[e], e == 2 ? "OLD" : "NEW");
+    sqlite3_exec(db, query, NULL, NULL, NULL);
+    g_free(query);
+  }
+}
+
+// no history hash means basic
+#define DT_HISTORY_HASH_STATUS_CASE                                                                          \
+  "CASE"                                                                                                     \
+  "  WHEN h.imgid IS NULL THEN %d"                                                                           \
+  "  WHEN basic_hash == current_hash THEN %d"                                                                \
+  "  WHEN auto_hash == current_hash THEN %d"                                                                 \
+  "  WHEN (basic_hash IS NULL OR current_hash != basic_hash) AND"                                            \
+  "       (auto_hash IS NULL OR current_hash != auto_hash) THEN %d"                                          \
+  "  ELSE %d END"
+
+static dt_history_hash_t _hash_status_read(const int32_t imgid)
+{
+  dt_history_hash_t status = DT_HISTORY_HASH_BASIC;
   sqlite3_stmt *stmt;
-  char *query = dt_util_dstrcat(NULL,
-                                "SELECT CASE"
-                                "  WHEN basic_hash == current_hash THEN %d"
-                                "  WHEN auto_hash == current_hash THEN %d"
-                                "  WHEN (basic_hash IS NULL OR current_hash != basic_hash) AND"
-                                "       (auto_hash IS NULL OR current_hash != auto_hash) THEN %d"
-                                "  ELSE %d END AS status"
-                                " FROM main.history_hash"
-                                " WHERE imgid = %d",
-                                DT_HISTORY_HASH_BASIC, DT_HISTORY_HASH_AUTO,
-                                DT_HISTORY_HASH_CURRENT, DT_HISTORY_HASH_BASIC, imgid);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              query, -1, &stmt, NULL);
+  gchar *query = g_strdup_printf("SELECT " DT_HISTORY_HASH_STATUS_CASE
+                                 " FROM main.history_hash AS h"
+                                 " WHERE imgid = ?1",
+                                 DT_HISTORY_HASH_BASIC, DT_HISTORY_HASH_BASIC, DT_HISTORY_HASH_AUTO,
+                                 DT_HISTORY_HASH_CURRENT, DT_HISTORY_HASH_BASIC);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
     status = sqlite3_column_int(stmt, 0);
-  }
-  // if no history_hash basic status
-  else status = DT_HISTORY_HASH_BASIC;
   sqlite3_finalize(stmt);
   g_free(query);
   return status;
 }
 
+// reads the status of all the images of the current collection
+static GHashTable *_hash_status_read_collection(void)
+{
+  GHashTable *status = g_hash_table_new(NULL, NULL);
+  sqlite3_stmt *stmt;
+  gchar *query = g_strdup_printf("SELECT c.imgid, " DT_HISTORY_HASH_STATUS_CASE
+                                 " FROM memory.collected_images AS c"
+                                 " LEFT JOIN main.history_hash AS h ON h.imgid = c.imgid",
+                                 DT_HISTORY_HASH_BASIC, DT_HISTORY_HASH_BASIC, DT_HISTORY_HASH_AUTO,
+                                 DT_HISTORY_HASH_CURRENT, DT_HISTORY_HASH_BASIC);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    g_hash_table_insert(status, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)),
+                        GINT_TO_POINTER(sqlite3_column_int(stmt, 1)));
+  sqlite3_finalize(stmt);
+  g_free(query);
+  return status;
+}
+
+#undef DT_HISTORY_HASH_STATUS_CASE
+
+dt_history_hash_t dt_history_hash_get_status(const int32_t imgid)
+{
+  if(imgid == -1) return 0;
+
+  static gsize triggers = 0;
+  if(g_once_init_enter(&triggers))
+  {
+    _hash_status_create_triggers(dt_database_get(darktable.db));
+    g_once_init_leave(&triggers, 1);
+  }
+
+  g_mutex_lock(&_hash_status_lock);
+  if(!_hash_status) _hash_status = g_hash_table_new(NULL, NULL);
+  gpointer value = NULL;
+  const gboolean known = g_hash_table_lookup_extended(_hash_status, GINT_TO_POINTER(imgid), NULL, &value);
+  const int changes = _hash_status_changes;
+  g_mutex_unlock(&_hash_status_lock);
+
+  dt_history_hash_t status = MAX(GPOINTER_TO_INT(value), 0);
+  if(status) return status;
+
+  if(known)
+  {
+    // only this image changed since it was read
+    status = _hash_status_read(imgid);
+    g_mutex_lock(&_hash_status_lock);
+    _hash_status_store(imgid, status, changes);
+    g_mutex_unlock(&_hash_status_lock);
+    return status;
+  }
+
+  // not read yet, which happens for all of them after a new collection
+  GHashTable *collection = _hash_status_read_collection();
+  status = GPOINTER_TO_INT(g_hash_table_lookup(collection, GINT_TO_POINTER(imgid)));
+  if(!status)
+  {
+    status = _hash_status_read(imgid);
+    g_hash_table_insert(collection, GINT_TO_POINTER(imgid), GINT_TO_POINTER(status));
+  }
+
+  g_mutex_lock(&_hash_status_lock);
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init(&iter, collection);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+    _hash_status_store(GPOINTER_TO_INT(key), GPOINTER_TO_INT(value), changes);
+  g_mutex_unlock(&_hash_status_lock);
+  g_hash_table_destroy(collection);
+
+  return status;
+}
+
+void dt_history_hash_cleanup(void)
+{
+  g_mutex_lock(&_hash_status_lock);
+  if(_hash_status) g_hash_table_destroy(_hash_status);
+  _hash_status = NULL;
+  g_mutex_unlock(&_hash_status_lock);
+}
+
 gboolean dt_history_copy(int imgid)
 {
   // note that this routine does not copy anything, it just setup the copy_paste proxy
@@ -1631,6 +1914,33 @@ gboolean dt_history_copy_parts(int imgid)
     return FALSE;
 }
 
+// pastes the copied history on all images of the list. the sidecar files, thumbnails and changed tags are
+// updated once for the whole list afterwards, instead of after every image.
+static void _history_paste_on_list_bulk(const GList *list, const gboolean merge, const gboolean undo)
+{
+  const int32_t src = darktable.view_manager->copy_paste.copied_imageid;
+
+  // be sure the current history is written before pasting some other history data
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  GList *changed = NULL;
+  if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+  for(const GList *l = list; l; l = g_list_next(l))
+  {
+    const int dest = GPOINTER_TO_INT(l->data);
+    if(dest == src) continue;
+    _history_copy_and_paste_on_image_ext(src, dest, merge,
+                                         darktable.view_manager->copy_paste.selops,
+                                         darktable.view_manager->copy_paste.copy_iop_order,
+                                         darktable.view_manager->copy_paste.full_copy, TRUE);
+    changed = g_list_prepend(changed, GINT_TO_POINTER(dest));
+  }
+  if(undo) dt_undo_end_group(darktable.undo);
+
+  dt_history_bulk_finish(g_list_reverse(changed));
+}
+
 gboolean dt_history_paste_on_list(const GList *list, gboolean undo)
 {
   if(darktable.view_manager->copy_paste.copied_imageid <= 0) return FALSE;
@@ -1641,17 +1951,7 @@ gboolean dt_history_paste_on_list(const GList *list, gboolean undo)
   gboolean merge = FALSE;
   if(mode == 0) merge = TRUE;
 
-  if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  for(GList *l = (GList *)list; l; l = g_list_next(l))
-  {
-    const int dest = GPOINTER_TO_INT(l->data);
-    dt_history_copy_and_paste_on_image(darktable.view_manager->copy_paste.copied_imageid,
-                                       dest, merge,
-                                       darktable.view_manager->copy_paste.selops,
-                                       darktable.view_manager->copy_paste.copy_iop_order,
-                                       darktable.view_manager->copy_paste.full_copy);
-  }
-  if(undo) dt_undo_end_group(darktable.undo);
+  _history_paste_on_list_bulk(list, merge, undo);
   return TRUE;
 }
 
@@ -1680,17 +1980,7 @@ gboolean dt_history_paste_parts_on_list(const GList *list, gboolean undo)
     return FALSE;
   }
 
-  if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  for (const GList *l = l_copy; l; l = g_list_next(l))
-  {
-    const int dest = GPOINTER_TO_INT(l->data);
-    dt_history_copy_and_paste_on_image(darktable.view_manager->copy_paste.copied_imageid,
-                                       dest, merge,
-                                       darktable.view_manager->copy_paste.selops,
-                                       darktable.view_manager->copy_paste.copy_iop_order,
-                                       darktable.view_manager->copy_paste.full_copy);
-  }
-  if(undo) dt_undo_end_group(darktable.undo);
+  _history_paste_on_list_bulk(l_copy, merge, undo);
 
   g_list_free(l_copy);
   return TRUE;
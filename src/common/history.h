@@ -67,6 +67,13 @@ int dt_history_merge_module_into_history(struct dt_develop_t *dev_dest, struct d
 /** copy history from imgid and pasts on dest_imgid, merge or overwrite... */
 int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops, gboolean copy_iop_order, const gboolean copy_full);
 
+/** for changing the history of many images at once: marks the history of imgid as changed in the image cache,
+    without writing its sidecar file. dt_history_bulk_finish() must be called for the images afterwards. */
+void dt_history_bulk_changed(const int32_t imgid);
+/** attaches the changed tag to imgs and updates their sidecar files and thumbnails in a background job.
+    takes ownership of the list. */
+void dt_history_bulk_finish(GList *imgs);
+
 /** delete all history for the given image */
 void dt_history_delete_on_image(int32_t imgid);
 
@@ -126,9 +133,15 @@ gboolean dt_history_check_module_exists(int32_t imgid, const char *operation);
 /** calculate history hash and save it to database*/
 void dt_history_hash_write_from_history(const int32_t imgid, const dt_history_hash_t type);
 
-/** return the hash history status */
+/** same from the history of dev just written to imgid, without reading it back from the database */
+void dt_history_hash_write_from_dev(struct dt_develop_t *dev, const int32_t imgid, const dt_history_hash_t type);
+
+/** return the hash history status, cached for the whole collection */
 dt_history_hash_t dt_history_hash_get_status(const int32_t imgid);
 
+/** free the cached status */
+void dt_history_hash_cleanup(void);
+
 /** return true if mipmap_hash = current_hash */
 gboolean dt_history_hash_is_mipmap_synced(const int32_t imgid);
 
@@ -0,0 +1,272 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/icc_lut.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_ICC_LUT_MAGIC "dticclut"
+#define DT_ICC_LUT_VERSION 1
+
+typedef struct dt_icc_lut_header_t
+{
+  char magic[8];
+  int32_t version;
+  int32_t domain;
+  int32_t level;
+} dt_icc_lut_header_t;
+
+static gchar *_cache_filename(const char *key)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *basename = g_strconcat(key, ".lut", NULL);
+  gchar *filename = g_build_filename(cachedir, "icc_luts", basename, NULL);
+  g_free(basename);
+  return filename;
+}
+
+static gboolean _cache_read(dt_icc_lut_t *lut, const char *key)
+{
+  gchar *filename = _cache_filename(key);
+  gchar *contents = NULL;
+  gsize length = 0;
+  const gboolean found = g_file_get_contents(filename, &contents, &length, NULL);
+  g_free(filename);
+  if(!found) return FALSE;
+
+  const size_t clut_size = sizeof(float) * 3 * lut->level * lut->level * lut->level;
+  const dt_icc_lut_header_t *header = (const dt_icc_lut_header_t *)contents;
+  const gboolean valid = length == sizeof(dt_icc_lut_header_t) + clut_size
+                         && !memcmp(header->magic, DT_ICC_LUT_MAGIC, sizeof(header->magic))
+                         && header->version == DT_ICC_LUT_VERSION && header->domain == lut->domain
+                         && header->level == lut->level;
+  if(valid) memcpy(lut->clut, contents + sizeof(dt_icc_lut_header_t), clut_size);
+  g_free(contents);
+  return valid;
+}
+
+static void _cache_write(const dt_icc_lut_t *lut, const char *key)
+{
+  gchar *filename = _cache_filename(key);
+  gchar *dirname = g_path_get_dirname(filename);
+  g_mkdir_with_parents(dirname, 0750);
+  g_free(dirname);
+
+  const size_t clut_size = sizeof(float) * 3 * lut->level * lut->level * lut->level;
+  const size_t length = sizeof(dt_icc_lut_header_t) + clut_size;
+  char *contents = g_malloc(length);
+  dt_icc_lut_header_t header = { .version = DT_ICC_LUT_VERSION, .domain = lut->domain, .level = lut->level };
+  memcpy(header.magic, DT_ICC_LUT_MAGIC, sizeof(header.magic));
+  memcpy(contents, &header, sizeof(header));
+  memcpy(contents + sizeof(header), lut->clut, clut_size);
+
+  GError *error = NULL;
+  if(!g_file_set_contents(filename, contents, length, &error))
+  {
+    fprintf(stderr, "[icc_lut] can't write `%s': %s\n", filename, error->message);
+    g_error_free(error);
+  }
+  g_free(contents);
+  g_free(filename);
+}
+
+// input value of node i on a channel
+static inline float _node_value(const dt_icc_lut_domain_t domain, const int c, const int i, const int level)
+{
+  const float t = (float)i / (level - 1);
+  if(domain == DT_ICC_LUT_RGB) return t * t;
+  return c == 0 ? 100.0f * t : 256.0f * t - 128.0f;
+}
+
+dt_icc_lut_t *dt_icc_lut_bake(const dt_icc_lut_domain_t domain, const int level, dt_icc_lut_sample_t *sample,
+                              void *data, const char *key)
+{
+  if(level < 2) return NULL;
+
+  dt_icc_lut_t *lut = (dt_icc_lut_t *)malloc(sizeof(dt_icc_lut_t));
+  if(!lut) return NULL;
+  lut->domain = domain;
+  lut->level = level;
+  lut->clut = dt_alloc_align_float((size_t)3 * level * level * level);
+  if(!lut->clut)
+  {
+    free(lut);
+    return NULL;
+  }
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  if(key && _cache_read(lut, key))
+  {
+    dt_show_times_f(&start, "[icc_lut]", "read %d^3 lut from cache", level);
+    return lut;
+  }
+
+  // sample one slice of constant third input channel at a time
+  const size_t slice = (size_t)level * level;
+  float *const restrict clut = lut->clut;
+  int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(clut, data, domain, level, sample, slice) \
+  shared(failed) schedule(static)
+#endif
+  for(int b = 0; b < level; b++)
+  {
+    float *const restrict in = dt_alloc_align_float(4 * slice);
+    float *const restrict out = dt_alloc_align_float(4 * slice);
+    if(!in || !out)
+    {
+      // this slice of the lut stays undefined, the whole lut is useless
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+      failed = 1;
+    }
+    else
+    {
+      for(int g = 0; g < level; g++)
+        for(int r = 0; r < level; r++)
+        {
+          float *const px = in + 4 * ((size_t)g * level + r);
+          px[0] = _node_value(domain, 0, r, level);
+          px[1] = _node_value(domain, 1, g, level);
+          px[2] = _node_value(domain, 2, b, level);
+          px[3] = 0.0f;
+        }
+      sample(in, out, slice, data);
+      for(size_t k = 0; k < slice; k++)
+        for(int c = 0; c < 3; c++) clut[3 * (b * slice + k) + c] = out[4 * k + c];
+    }
+    dt_free_align(in);
+    dt_free_align(out);
+  }
+
+  if(failed)
+  {
+    fprintf(stderr, "[icc_lut] out of memory baking %d^3 lut\n", level);
+    dt_icc_lut_free(lut);
+    return NULL;
+  }
+
+  dt_show_times_f(&start, "[icc_lut]", "baked %d^3 lut", level);
+  if(key) _cache_write(lut, key);
+  return lut;
+}
+
+void dt_icc_lut_free(dt_icc_lut_t *lut)
+{
+  if(!lut) return;
+  dt_free_align(lut->clut);
+  free(lut);
+}
+
+gchar *dt_icc_lut_key(const cmsHPROFILE *profiles, const int num_profiles, const int intent, const char *extra)
+{
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+  for(int k = 0; k < num_profiles; k++)
+  {
+    cmsUInt32Number size = 0;
+    if(!profiles[k] || !cmsSaveProfileToMem(profiles[k], NULL, &size) || !size)
+    {
+      g_checksum_free(checksum);
+      return NULL;
+    }
+    guchar *buf = g_malloc(size);
+    cmsSaveProfileToMem(profiles[k], buf, &size);
+    g_checksum_update(checksum, buf, size);
+    g_free(buf);
+  }
+  g_checksum_update(checksum, (const guchar *)&intent, sizeof(intent));
+  if(extra) g_checksum_update(checksum, (const guchar *)extra, strlen(extra));
+
+  gchar *key = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  return key;
+}
+
+__DT_CLONE_TARGETS__
+void dt_icc_lut_apply(const dt_icc_lut_t *const lut, const float *const in, float *const out,
+                      const size_t npixels)
+{
+  const int level = lut->level;
+  const size_t level2 = (size_t)level * level;
+  const float *const restrict clut = lut->clut;
+  const gboolean rgb = lut->domain == DT_ICC_LUT_RGB;
+
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+  {
+    // shaper: map the input to the unit cube
+    float t[3];
+    if(rgb)
+    {
+      for(int c = 0; c < 3; c++) t[c] = sqrtf(CLAMP(in[k + c], 0.0f, 1.0f));
+    }
+    else
+    {
+      t[0] = CLAMP(in[k] * (1.0f / 100.0f), 0.0f, 1.0f);
+      t[1] = CLAMP((in[k + 1] + 128.0f) * (1.0f / 256.0f), 0.0f, 1.0f);
+      t[2] = CLAMP((in[k + 2] + 128.0f) * (1.0f / 256.0f), 0.0f, 1.0f);
+    }
+
+    int i[3];
+    float d[3];
+    for(int c = 0; c < 3; c++)
+    {
+      const float x = t[c] * (level - 1);
+      i[c] = MIN((int)x, level - 2);
+      d[c] = x - i[c];
+    }
+
+    // tetrahedral interpolation: walk from node 000 to 111 along the axes in order of decreasing fraction
+    const size_t i000 = 3 * (i[0] + i[1] * (size_t)level + i[2] * level2);
+    const size_t step[3] = { 3, 3 * (size_t)level, 3 * level2 };
+    int first, second, third;
+    if(d[0] > d[1])
+    {
+      if(d[1] > d[2])      { first = 0; second = 1; third = 2; }
+      else if(d[0] > d[2]) { first = 0; second = 2; third = 1; }
+      else                 { first = 2; second = 0; third = 1; }
+    }
+    else
+    {
+      if(d[2] > d[1])      { first = 2; second = 1; third = 0; }
+      else if(d[2] > d[0]) { first = 1; second = 2; third = 0; }
+      else                 { first = 1; second = 0; third = 2; }
+    }
+    const size_t i1 = i000 + step[first];
+    const size_t i2 = i1 + step[second];
+    const size_t i3 = i2 + step[third];
+    const float w0 = 1.0f - d[first], w1 = d[first] - d[second], w2 = d[second] - d[third], w3 = d[third];
+
+    const float alpha = in[k + 3];
+    for(int c = 0; c < 3; c++)
+      out[k + c] = w0 * clut[i000 + c] + w1 * clut[i1 + c] + w2 * clut[i2 + c] + w3 * clut[i3 + c];
+    out[k + 3] = alpha;
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
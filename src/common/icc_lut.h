@@ -0,0 +1,70 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <lcms2.h>
+#include <stddef.h>
+
+/*
+ * color transforms which can't be reduced to a matrix and tone curves (lut based camera profiles, printer
+ * profiles for softproofing) are sampled once into a 3d lut and then evaluated with tetrahedral
+ * interpolation, instead of running the lcms2 pipeline on every pixel.
+ *
+ * the input is mapped to the unit cube by a per channel shaper: a square root for rgb, which puts more
+ * nodes into the shadows, and a linear mapping of the lcms2 float encoding ranges for Lab. inputs outside
+ * of the cube are clipped, like the clut stages of lut based profiles do anyway.
+ */
+
+typedef enum dt_icc_lut_domain_t
+{
+  DT_ICC_LUT_RGB = 0, // [0, 1]^3
+  DT_ICC_LUT_LAB = 1  // L in [0, 100], a and b in [-128, 128]
+} dt_icc_lut_domain_t;
+
+// nodes per axis of baked luts
+#define DT_ICC_LUT_LEVEL 33
+
+typedef struct dt_icc_lut_t
+{
+  dt_icc_lut_domain_t domain;
+  int level;
+  float *clut; // level^3 rgb triplets, first input channel varying fastest
+} dt_icc_lut_t;
+
+/** evaluates the exact transform on npixels 4 channel pixels, to sample the lut */
+typedef void(dt_icc_lut_sample_t)(const float *const in, float *const out, const size_t npixels, void *data);
+
+/** samples the transform into a new lut. if key is not NULL the lut is looked up in and written to the disk
+    cache under this name first. returns NULL on failure. */
+dt_icc_lut_t *dt_icc_lut_bake(const dt_icc_lut_domain_t domain, const int level, dt_icc_lut_sample_t *sample,
+                              void *data, const char *key);
+void dt_icc_lut_free(dt_icc_lut_t *lut);
+
+/** disk cache key from the checksums of the profiles of a transform, in the order they are applied, the
+    intent and any further settings which change the transform. returns NULL if a profile can't be read. */
+gchar *dt_icc_lut_key(const cmsHPROFILE *profiles, const int num_profiles, const int intent, const char *extra);
+
+/** transforms npixels 4 channel pixels, in and out may be the same. alpha is copied. */
+void dt_icc_lut_apply(const dt_icc_lut_t *const lut, const float *const in, float *const out,
+                      const size_t npixels);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -46,6 +46,7 @@
 #include "common/imageio_avif.h"
 #endif
 #include "common/mipmap_cache.h"
+#include "common/numa.h"
 #include "common/styles.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -683,6 +684,9 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
 
   int res = 0;
 
+  // on multi-socket hosts keep the export on the cores and memory of one node
+  const int numa_node = thumbnail_export ? -1 : dt_numa_bind_thread(darktable.numa);
+
   dt_times_t start;
   dt_get_times(&start);
   dt_dev_pixelpipe_t pipe;
@@ -1037,6 +1041,8 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
     goto error;
 
   dt_dev_pixelpipe_cleanup(&pipe);
+  dt_numa_print_usage(darktable.numa);
+  dt_numa_unbind_thread(darktable.numa, numa_node);
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
@@ -1080,6 +1086,7 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
 
 error:
   dt_dev_pixelpipe_cleanup(&pipe);
+  dt_numa_unbind_thread(darktable.numa, numa_node);
 error_early:
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
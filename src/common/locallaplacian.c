@@ -570,7 +570,8 @@ void local_laplacian_internal(
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
     const int use_sse2,         // flag whether to use SSE version
-    local_laplacian_boundary_t *b)
+    local_laplacian_boundary_t *b,
+    dt_dev_pixelpipe_iop_t *piece)
 {
   if(wd <= 1 || ht <= 1) return;
 
@@ -625,8 +626,15 @@ void local_laplacian_internal(
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
   // willing to pay the cost).
+  int cancelled = 0;
   for(int k=0;k<num_gamma;k++)
   { // process images
+    // the pipe will discard our output, skip the remaining work
+    if(piece && dt_iop_cancelled(piece))
+    {
+      cancelled = 1;
+      goto cleanup;
+    }
 #if defined(__SSE2__)
     if(use_sse2)
       apply_curve_sse2(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
@@ -707,6 +715,11 @@ void local_laplacian_internal(
   {
     const int pw = dl(w,l), ph = dl(h,l);
 
+    if(piece && dt_iop_cancelled(piece))
+    {
+      cancelled = 1;
+      goto cleanup;
+    }
     gauss_expand(output[l+1], output[l], pw, ph);
     // go through all coefficients in the upsampled gauss buffer:
 #ifdef _OPENMP
@@ -756,11 +769,14 @@ void local_laplacian_internal(
     b->num_levels = num_levels;
     for(int l=0;l<num_levels;l++) b->output[l] = output[l];
   }
+cleanup:
+  if(cancelled) dt_iop_set_incomplete(piece);
   // free all buffers except the ones passed out for preview rendering
+  const int keep = b && b->mode == 1 && !cancelled;
   for(int l=0;l<max_levels;l++)
   {
-    if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
-    if(!b || b->mode != 1)        dt_free_align(output[l]);
+    if(!keep || l)                dt_free_align(padded[l]);
+    if(!keep)                     dt_free_align(output[l]);
     for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
   }
 }
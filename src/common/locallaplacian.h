@@ -56,7 +56,8 @@ void local_laplacian_internal(
     const float clarity,        // user param: increase clarity/local contrast
     const int use_sse2,         // switch on sse optimised version, if available
     // the following is just needed for clipped roi with boundary conditions from coarse buffer (can be 0)
-    local_laplacian_boundary_t *b);
+    local_laplacian_boundary_t *b,
+    dt_dev_pixelpipe_iop_t *piece); // if set, polled for cancellation once per curve and level (can be 0)
 
 void local_laplacian(
     const float *const input,   // input buffer in some Labx or yuvx format
@@ -67,9 +68,10 @@ void local_laplacian(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    local_laplacian_boundary_t *b) // can be 0
+    local_laplacian_boundary_t *b, // can be 0
+    dt_dev_pixelpipe_iop_t *piece) // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 0, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 0, b, piece);
 }
 
 size_t local_laplacian_memory_use(const int width,      // width of input image
@@ -90,8 +92,9 @@ void local_laplacian_sse2(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    local_laplacian_boundary_t *b) // can be 0
+    local_laplacian_boundary_t *b, // can be 0
+    dt_dev_pixelpipe_iop_t *piece) // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 1, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 1, b, piece);
 }
 #endif
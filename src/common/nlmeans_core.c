@@ -417,7 +417,7 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
   const int chk_height = compute_slice_height(roi_out->height);
   const int chk_width = compute_slice_width(roi_out->width);
 #ifdef _OPENMP
-#pragma omp parallel for default(none) num_threads(darktable.num_openmp_threads) \
+#pragma omp parallel for default(none) num_threads(dt_get_team_threads()) \
       dt_omp_firstprivate(patches, num_patches, scratch_buf, padded_scratch_size, chk_height, chk_width, radius) \
       dt_omp_sharedconst(params, roi_out, outbuf, inbuf, stride, center_norm, skip_blend, weight, invert) \
       schedule(static) \
@@ -427,6 +427,12 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
   {
     for (int chunk_left = 0; chunk_left < roi_out->width; chunk_left += chk_width)
     {
+      // the pipe will discard our output, skip the remaining slices
+      if(params->piece && dt_iop_cancelled(params->piece))
+      {
+        dt_iop_set_incomplete(params->piece);
+        continue;
+      }
       // locate our scratch space within the big buffer allocated above
       // we'll offset by chunk_left so that we don't have to subtract on every access
       float *const restrict tmpbuf = dt_get_perthread(scratch_buf, padded_scratch_size);
@@ -641,7 +647,7 @@ void nlmeans_denoise_sse2(const float *const inbuf, float *const outbuf,
   const int chk_height = compute_slice_height(roi_out->height);
   const int chk_width = compute_slice_width(roi_out->width);
 #ifdef _OPENMP
-#pragma omp parallel for default(none) num_threads(darktable.num_openmp_threads) \
+#pragma omp parallel for default(none) num_threads(dt_get_team_threads()) \
       dt_omp_firstprivate(patches, num_patches, scratch_buf, padded_scratch_size, chk_height, chk_width, radius) \
       dt_omp_sharedconst(params, roi_out, outbuf, inbuf, stride, center_norm, skip_blend, weight, invert) \
       schedule(static) \
@@ -651,6 +657,12 @@ void nlmeans_denoise_sse2(const float *const inbuf, float *const outbuf,
   {
     for (int chunk_left = 0; chunk_left < roi_out->width; chunk_left += chk_width)
     {
+      // the pipe will discard our output, skip the remaining slices
+      if(params->piece && dt_iop_cancelled(params->piece))
+      {
+        dt_iop_set_incomplete(params->piece);
+        continue;
+      }
       // locate our scratch space within the big buffer allocated above
       // we'll offset by chunk_left so that we don't have to subtract on every access
       float *const restrict tmpbuf = dt_get_perthread(scratch_buf, padded_scratch_size);
@@ -0,0 +1,333 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include "common/numa.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define DT_NUMA_PAGE_SIZE 4096
+
+// binding of the calling thread, see dt_numa_bind_thread()
+static __thread int _bound_node = -1;
+static __thread int _bound_cpus = 0;
+static __thread int _prev_team = 0;
+#ifdef __linux__
+static __thread cpu_set_t _prev_affinity;
+#endif
+
+// parses a cpu list like "0-3,8,10-11" into cpus, returns FALSE on syntax errors
+static gboolean _parse_cpulist(const char *list, GArray *cpus)
+{
+  gchar **ranges = g_strsplit(list, ",", -1);
+  gboolean ok = TRUE;
+  for(gchar **r = ranges; *r && ok; r++)
+  {
+    gchar *range = g_strstrip(*r);
+    if(!*range) continue;
+    char *end = NULL;
+    const long first = strtol(range, &end, 10);
+    long last = first;
+    if(end == range || first < 0)
+      ok = FALSE;
+    else if(*end == '-')
+    {
+      char *start = end + 1;
+      last = strtol(start, &end, 10);
+      if(end == start || last < first) ok = FALSE;
+    }
+    if(ok && *end) ok = FALSE;
+    for(long c = first; ok && c <= last; c++)
+    {
+      const int cpu = (int)c;
+      g_array_append_val(cpus, cpu);
+    }
+  }
+  g_strfreev(ranges);
+  return ok && cpus->len > 0;
+}
+
+static dt_numa_t *_numa_new(const char *spec, const int *ids)
+{
+  if(!spec) return NULL;
+
+  gchar **lists = g_strsplit(spec, ";", -1);
+  const int num_nodes = g_strv_length(lists);
+  if(num_nodes == 0)
+  {
+    g_strfreev(lists);
+    return NULL;
+  }
+
+  dt_numa_t *numa = (dt_numa_t *)calloc(1, sizeof(dt_numa_t));
+  numa->nodes = (dt_numa_node_t *)calloc(num_nodes, sizeof(dt_numa_node_t));
+  numa->num_nodes = num_nodes;
+  dt_pthread_mutex_init(&numa->lock, NULL);
+
+  for(int k = 0; k < num_nodes; k++)
+  {
+    GArray *cpus = g_array_new(FALSE, FALSE, sizeof(int));
+    const gboolean ok = _parse_cpulist(lists[k], cpus);
+    numa->nodes[k].id = ids ? ids[k] : k;
+    numa->nodes[k].num_cpus = cpus->len;
+    numa->nodes[k].cpus = (int *)g_array_free(cpus, FALSE);
+    if(!ok)
+    {
+      g_strfreev(lists);
+      dt_numa_free(numa);
+      return NULL;
+    }
+  }
+  g_strfreev(lists);
+  return numa;
+}
+
+dt_numa_t *dt_numa_new(const char *spec)
+{
+  return _numa_new(spec, NULL);
+}
+
+void dt_numa_free(dt_numa_t *numa)
+{
+  if(!numa) return;
+  for(int k = 0; k < numa->num_nodes; k++) g_free(numa->nodes[k].cpus);
+  free(numa->nodes);
+  dt_pthread_mutex_destroy(&numa->lock);
+  free(numa);
+}
+
+#ifdef __linux__
+// collects the cpu lists of the nodes with cpus from sysfs
+static dt_numa_t *_numa_from_sysfs(void)
+{
+  const char *const base = "/sys/devices/system/node";
+  GDir *dir = g_dir_open(base, 0, NULL);
+  if(!dir) return NULL;
+
+  GString *spec = g_string_new(NULL);
+  GArray *ids = g_array_new(FALSE, FALSE, sizeof(int));
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_prefix(name, "node") || !g_ascii_isdigit(name[4])) continue;
+    gchar *path = g_build_filename(base, name, "cpulist", NULL);
+    gchar *cpulist = NULL;
+    if(g_file_get_contents(path, &cpulist, NULL, NULL) && *g_strstrip(cpulist))
+    {
+      const int id = atoi(name + 4);
+      g_array_append_val(ids, id);
+      if(spec->len) g_string_append_c(spec, ';');
+      g_string_append(spec, cpulist);
+    }
+    g_free(cpulist);
+    g_free(path);
+  }
+  g_dir_close(dir);
+
+  dt_numa_t *numa = ids->len ? _numa_new(spec->str, (int *)ids->data) : NULL;
+  g_array_free(ids, TRUE);
+  g_string_free(spec, TRUE);
+  return numa;
+}
+#endif
+
+dt_numa_t *dt_numa_init(void)
+{
+  dt_numa_t *numa = NULL;
+  gchar *simulated = dt_conf_get_string("numa_topology");
+  if(simulated && *simulated)
+  {
+    numa = dt_numa_new(simulated);
+    if(numa)
+      numa->simulated = TRUE;
+    else
+      fprintf(stderr, "[numa] ignoring invalid numa_topology `%s'\n", simulated);
+  }
+  g_free(simulated);
+
+#ifdef __linux__
+  if(!numa) numa = _numa_from_sysfs();
+#endif
+
+  if(!numa)
+  {
+    // unknown topology, one node with all cpus
+    gchar *spec = g_strdup_printf("0-%d", (int)dt_get_num_threads() - 1);
+    numa = dt_numa_new(spec);
+    g_free(spec);
+  }
+
+  dt_print(DT_DEBUG_PERF, "[numa] %d node(s)%s\n", numa->num_nodes, numa->simulated ? " (simulated)" : "");
+  return numa;
+}
+
+void dt_numa_cleanup(dt_numa_t *numa)
+{
+  dt_numa_free(numa);
+}
+
+int dt_numa_acquire_node(dt_numa_t *numa)
+{
+  if(!numa || numa->num_nodes < 2) return -1;
+
+  dt_pthread_mutex_lock(&numa->lock);
+  int node = 0;
+  for(int k = 1; k < numa->num_nodes; k++)
+    if(numa->nodes[k].users < numa->nodes[node].users) node = k;
+  numa->nodes[node].users++;
+  dt_pthread_mutex_unlock(&numa->lock);
+  return node;
+}
+
+void dt_numa_release_node(dt_numa_t *numa, const int node)
+{
+  if(!numa || node < 0 || node >= numa->num_nodes) return;
+
+  dt_pthread_mutex_lock(&numa->lock);
+  numa->nodes[node].users--;
+  dt_pthread_mutex_unlock(&numa->lock);
+}
+
+#ifdef __linux__
+// applies set to the calling thread and to the threads of its openmp pool
+static gboolean _bind_team(const cpu_set_t *set)
+{
+  if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), set)) return FALSE;
+#ifdef _OPENMP
+  const int nthreads = MAX(1, darktable.num_openmp_threads);
+#pragma omp parallel num_threads(nthreads) default(none) dt_omp_firstprivate(set)
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), set);
+#endif
+  return TRUE;
+}
+#endif
+
+int dt_numa_bind_thread(dt_numa_t *numa)
+{
+#ifdef __linux__
+  if(_bound_node >= 0 || !dt_conf_get_bool("numa_binding")) return -1;
+  const int node = dt_numa_acquire_node(numa);
+  if(node < 0) return -1;
+
+  const dt_numa_node_t *const n = &numa->nodes[node];
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(int k = 0; k < n->num_cpus; k++)
+    if(n->cpus[k] < CPU_SETSIZE) CPU_SET(n->cpus[k], &set);
+
+  pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &_prev_affinity);
+  if(!_bind_team(&set))
+  {
+    // e.g. a simulated node without any online cpu
+    dt_print(DT_DEBUG_PERF, "[numa] could not bind to node %d\n", n->id);
+    dt_numa_release_node(numa, node);
+    return -1;
+  }
+  _bound_node = node;
+  _bound_cpus = n->num_cpus;
+  // never more threads than the user allowed with -t
+  _prev_team = dt_set_team_threads(MIN(n->num_cpus, darktable.num_openmp_threads));
+
+  dt_print(DT_DEBUG_PERF, "[numa] bound thread to node %d (%d cpus)\n", n->id, n->num_cpus);
+  return node;
+#else
+  return -1;
+#endif
+}
+
+void dt_numa_unbind_thread(dt_numa_t *numa, const int node)
+{
+#ifdef __linux__
+  if(node < 0 || node != _bound_node) return;
+  _bind_team(&_prev_affinity);
+  dt_set_team_threads(_prev_team);
+  _bound_node = -1;
+  _bound_cpus = 0;
+  dt_numa_release_node(numa, node);
+#endif
+}
+
+int dt_numa_thread_cpus(void)
+{
+  return _bound_cpus;
+}
+
+void dt_numa_first_touch(dt_numa_t *numa, void *buf, const size_t size)
+{
+  if(!numa || !buf || _bound_node < 0) return;
+
+  char *const bytes = (char *)buf;
+  const size_t pages = (size + DT_NUMA_PAGE_SIZE - 1) / DT_NUMA_PAGE_SIZE;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(bytes, pages) schedule(static)
+#endif
+  for(size_t k = 0; k < pages; k++) bytes[k * DT_NUMA_PAGE_SIZE] = 0;
+
+  dt_pthread_mutex_lock(&numa->lock);
+  numa->nodes[_bound_node].placed += size;
+  dt_pthread_mutex_unlock(&numa->lock);
+}
+
+// MemUsed of a real node in kB, -1 if unknown
+static long _node_mem_used(const dt_numa_t *numa, const int node)
+{
+  long used = -1;
+#ifdef __linux__
+  if(numa->simulated) return -1;
+  gchar *path = g_strdup_printf("/sys/devices/system/node/node%d/meminfo", numa->nodes[node].id);
+  gchar *meminfo = NULL;
+  if(g_file_get_contents(path, &meminfo, NULL, NULL))
+  {
+    const char *line = strstr(meminfo, "MemUsed:");
+    if(line) used = strtol(line + strlen("MemUsed:"), NULL, 10);
+  }
+  g_free(meminfo);
+  g_free(path);
+#endif
+  return used;
+}
+
+void dt_numa_print_usage(dt_numa_t *numa)
+{
+  if(!numa || !(darktable.unmuted & DT_DEBUG_PERF)) return;
+
+  dt_pthread_mutex_lock(&numa->lock);
+  for(int k = 0; k < numa->num_nodes; k++)
+  {
+    const dt_numa_node_t *const n = &numa->nodes[k];
+    const long used = _node_mem_used(numa, k);
+    gchar *node_used = used >= 0 ? g_strdup_printf(", %.1f MB used on the node", used / 1024.0) : g_strdup("");
+    dt_print(DT_DEBUG_PERF, "[numa] node %d: %d cpus, %d job(s), %.1f MB placed by darktable%s\n", n->id,
+             n->num_cpus, n->users, n->placed / (1024.0 * 1024.0), node_used);
+    g_free(node_used);
+  }
+  dt_pthread_mutex_unlock(&numa->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,82 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+
+#include <glib.h>
+#include <stddef.h>
+
+/*
+ * numa placement for export on multi-socket hosts: each export job binds its thread and openmp team to the
+ * cores of one node, and the pixelpipe cache and scratch buffers it allocates are first touched from there
+ * so that the kernel places their pages on that node.
+ *
+ * the topology is read from /sys/devices/system/node on linux. for testing on a single node machine it can be
+ * replaced by the numa_topology config key, listing the cpus of each simulated node separated by ';', for
+ * example "0-3;4-7".
+ */
+
+typedef struct dt_numa_node_t
+{
+  int id;           // node number of the system, or index of a simulated node
+  int num_cpus;
+  int *cpus;
+  int users;        // export jobs bound to this node right now
+  size_t placed;    // bytes first touched by threads bound to this node
+} dt_numa_node_t;
+
+typedef struct dt_numa_t
+{
+  dt_pthread_mutex_t lock;
+  int num_nodes;
+  dt_numa_node_t *nodes;
+  gboolean simulated;
+} dt_numa_t;
+
+/** builds a topology from a list of per node cpu lists as described above. returns NULL if spec is invalid. */
+dt_numa_t *dt_numa_new(const char *spec);
+void dt_numa_free(dt_numa_t *numa);
+
+/** topology of this host, or the simulated one from the config. never NULL. */
+dt_numa_t *dt_numa_init(void);
+void dt_numa_cleanup(dt_numa_t *numa);
+
+/** reserves the node with the fewest users, -1 if there is only one node */
+int dt_numa_acquire_node(dt_numa_t *numa);
+void dt_numa_release_node(dt_numa_t *numa, const int node);
+
+/** binds the calling thread and its openmp team to the cores of the least used node, if numa binding is
+    enabled. returns the node or -1. */
+int dt_numa_bind_thread(dt_numa_t *numa);
+/** undoes dt_numa_bind_thread() */
+void dt_numa_unbind_thread(dt_numa_t *numa, const int node);
+/** number of cpus the calling thread is bound to, 0 if it is not bound */
+int dt_numa_thread_cpus(void);
+
+/** if the calling thread is bound, write to every page of a fresh allocation from its openmp team so that
+    the pages end up on its node */
+void dt_numa_first_touch(dt_numa_t *numa, void *buf, const size_t size);
+
+/** prints the memory placed on each node with -d perf */
+void dt_numa_print_usage(dt_numa_t *numa);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
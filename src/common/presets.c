@@ -17,6 +17,7 @@
 */
 
 #include "common/darktable.h"
+#include "common/atomic.h"
 #include "common/debug.h"
 #include "common/presets.h"
 #include "common/exif.h"
@@ -32,7 +33,11 @@
 
 #include <glib.h>
 #include <inttypes.h>
+#include <math.h>
 #include <sqlite3.h>
+#ifdef HAVE_ICU
+#include <unicode/uchar.h>
+#endif
 
 static char *dt_preset_encode(sqlite3_stmt *stmt, int row)
 {
@@ -293,6 +298,339 @@ int dt_presets_import_from_file(const char *preset_path)
   return result;
 }
 
+/*
+ * auto-applied presets are matched in memory instead of running the auto-apply query on the preset tables for
+ * every new image. the index holds the presets which are auto-applied or could be applied by name, sorted like
+ * the query sorted them, and is rebuilt on the next use after a trigger reported a change of the tables.
+ */
+
+// the columns inserted into memory.history, in the order of its schema
+#define DT_PRESETS_HISTORY_COLUMNS 8
+
+typedef struct dt_presets_autoapply_t
+{
+  gboolean legacy;    // from main.legacy_presets
+  gboolean autoapply;
+  gchar *name;
+  gchar *operation;
+  gchar *model, *maker, *lens; // LIKE patterns, NULL never matches
+  gboolean ranges;             // FALSE if a bound is NULL, which never matches
+  double min[4], max[4];       // iso, exposure, aperture and focal length
+  gboolean has_format;
+  int64_t format;
+  // sort keys
+  gboolean has_writeprotect;
+  int64_t writeprotect;
+  int len_model, len_maker, len_lens; // -1 for NULL
+  int64_t rowid;
+  sqlite3_value *history[DT_PRESETS_HISTORY_COLUMNS];
+} dt_presets_autoapply_t;
+
+static GMutex _autoapply_lock;
+static GPtrArray *_autoapply_index = NULL;
+static gboolean _autoapply_triggers = FALSE;
+static int _autoapply_version = -1;
+static dt_atomic_int _autoapply_changes;
+
+static void _autoapply_free(gpointer data)
+{
+  dt_presets_autoapply_t *p = (dt_presets_autoapply_t *)data;
+  g_free(p->name);
+  g_free(p->operation);
+  g_free(p->model);
+  g_free(p->maker);
+  g_free(p->lens);
+  for(int k = 0; k < DT_PRESETS_HISTORY_COLUMNS; k++) sqlite3_value_free(p->history[k]);
+  free(p);
+}
+
+// called from the triggers on the preset tables. this runs inside of sqlite, so it must not take locks.
+static void _autoapply_changed(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+  dt_atomic_add_int(&_autoapply_changes, 1);
+  sqlite3_result_null(context);
+}
+
+static void _autoapply_create_triggers(sqlite3 *db)
+{
+  sqlite3_create_function(db, "dt_presets_autoapply_changed", 0, SQLITE_UTF8, NULL, _autoapply_changed, NULL,
+                          NULL);
+  const char *tables[2] = { "data.presets", "main.legacy_presets" };
+  const char *events[3] = { "INSERT", "UPDATE", "DELETE" };
+  for(int t = 0; t < 2; t++)
+    for(int e = 0; e < 3; e++)
+    {
+      // temporary triggers live in this connection only and may watch tables of any attached database
+      gchar *query = g_strdup_printf("CREATE TEMP TRIGGER IF NOT EXISTS presets_autoapply_%d_%d"
+                                     " AFTER %s ON %s"
+                                     " BEGIN SELECT dt_presets_autoapply_changed(); END",
+                                     t, e, events[e], tables[t]);
+      sqlite3_exec(db, query, NULL, NULL, NULL);
+      g_free(query);
+    }
+}
+
+// LENGTH() of a text column
+static int _text_length(const unsigned char *s)
+{
+  if(!s) return -1;
+  int len = 0;
+  for(; *s; s++)
+    if((*s & 0xc0) != 0x80) len++;
+  return len;
+}
+
+static gchar *_column_text(sqlite3_stmt *stmt, const int col)
+{
+  return g_strdup((const gchar *)sqlite3_column_text(stmt, col));
+}
+
+static void _column_range(sqlite3_stmt *stmt, const int col, double *min, double *max, gboolean *ranges)
+{
+  // a number is less than any text or blob, so such a lower bound never matches and an upper bound always
+  const int tmin = sqlite3_column_type(stmt, col);
+  const int tmax = sqlite3_column_type(stmt, col + 1);
+  if(tmin != SQLITE_INTEGER && tmin != SQLITE_FLOAT) *ranges = FALSE;
+  if(tmax == SQLITE_NULL) *ranges = FALSE;
+  *min = sqlite3_column_double(stmt, col);
+  *max = (tmax == SQLITE_TEXT || tmax == SQLITE_BLOB) ? INFINITY : sqlite3_column_double(stmt, col + 1);
+}
+
+static gint _autoapply_sort(gconstpointer a, gconstpointer b)
+{
+  // ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens), in the order of the table
+  const dt_presets_autoapply_t *pa = *(const dt_presets_autoapply_t **)a;
+  const dt_presets_autoapply_t *pb = *(const dt_presets_autoapply_t **)b;
+  if(pa->has_writeprotect != pb->has_writeprotect) return pa->has_writeprotect ? -1 : 1;
+  if(pa->writeprotect != pb->writeprotect) return pa->writeprotect > pb->writeprotect ? -1 : 1;
+  if(pa->len_model != pb->len_model) return pa->len_model - pb->len_model;
+  if(pa->len_maker != pb->len_maker) return pa->len_maker - pb->len_maker;
+  if(pa->len_lens != pb->len_lens) return pa->len_lens - pb->len_lens;
+  return (pa->rowid > pb->rowid) - (pa->rowid < pb->rowid);
+}
+
+static void _autoapply_read(sqlite3 *db, GPtrArray *index, const gboolean legacy)
+{
+  gchar *query = g_strdup_printf("SELECT rowid, name, operation, autoapply, model, maker, lens,"
+                                 "       iso_min, iso_max, exposure_min, exposure_max,"
+                                 "       aperture_min, aperture_max, focal_length_min, focal_length_max,"
+                                 "       format, writeprotect,"
+                                 "       op_version, operation, op_params, enabled,"
+                                 "       blendop_params, blendop_version, multi_priority, multi_name"
+                                 " FROM %s"
+                                 " WHERE autoapply=1 OR name IN (?1, ?2)"
+                                 " ORDER BY rowid",
+                                 legacy ? "main.legacy_presets" : "data.presets");
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+  // the workflow defaults are applied by name
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, _("display-referred default"), -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, _("scene-referred default"), -1, SQLITE_TRANSIENT);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_presets_autoapply_t *p = (dt_presets_autoapply_t *)calloc(1, sizeof(dt_presets_autoapply_t));
+    p->legacy = legacy;
+    p->rowid = sqlite3_column_int64(stmt, 0);
+    p->name = _column_text(stmt, 1);
+    p->operation = _column_text(stmt, 2);
+    p->autoapply = sqlite3_column_type(stmt, 3) != SQLITE_NULL && sqlite3_column_double(stmt, 3) == 1.0;
+    p->model = _column_text(stmt, 4);
+    p->maker = _column_text(stmt, 5);
+    p->lens = _column_text(stmt, 6);
+    p->ranges = TRUE;
+    for(int k = 0; k < 4; k++) _column_range(stmt, 7 + 2 * k, &p->min[k], &p->max[k], &p->ranges);
+    p->has_format = sqlite3_column_type(stmt, 15) != SQLITE_NULL;
+    p->format = sqlite3_column_int64(stmt, 15);
+    p->has_writeprotect = sqlite3_column_type(stmt, 16) != SQLITE_NULL;
+    p->writeprotect = sqlite3_column_int64(stmt, 16);
+    p->len_model = _text_length((const unsigned char *)p->model);
+    p->len_maker = _text_length((const unsigned char *)p->maker);
+    p->len_lens = _text_length((const unsigned char *)p->lens);
+    for(int k = 0; k < DT_PRESETS_HISTORY_COLUMNS; k++)
+      p->history[k] = sqlite3_value_dup(sqlite3_column_value(stmt, 17 + k));
+    g_ptr_array_add(index, p);
+  }
+  sqlite3_finalize(stmt);
+  g_free(query);
+}
+
+// returns the index, up to date. to be called with the lock held.
+static GPtrArray *_autoapply_get_index(void)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  if(!_autoapply_triggers)
+  {
+    _autoapply_create_triggers(db);
+    _autoapply_triggers = TRUE;
+  }
+
+  // read the counter before the tables, so that a change while reading rebuilds the index once more
+  const int version = dt_atomic_get_int(&_autoapply_changes);
+  if(_autoapply_index && version == _autoapply_version) return _autoapply_index;
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  if(_autoapply_index) g_ptr_array_free(_autoapply_index, TRUE);
+  _autoapply_index = g_ptr_array_new_with_free_func(_autoapply_free);
+  _autoapply_read(db, _autoapply_index, FALSE);
+  _autoapply_read(db, _autoapply_index, TRUE);
+  g_ptr_array_sort(_autoapply_index, _autoapply_sort);
+  _autoapply_version = version;
+
+  dt_show_times_f(&start, "[presets]", "indexed %u auto-apply presets", _autoapply_index->len);
+  return _autoapply_index;
+}
+
+#ifdef HAVE_ICU
+// reads a character like sqlite does
+static uint32_t _utf8_read(const unsigned char **s)
+{
+  uint32_t c = *((*s)++);
+  if(c >= 0xc0)
+  {
+    c &= c < 0xe0 ? 0x1f : c < 0xf0 ? 0x0f : c < 0xf8 ? 0x07 : c < 0xfc ? 0x03 : c < 0xfe ? 0x01 : 0x00;
+    while((**s & 0xc0) == 0x80) c = (c << 6) + (0x3f & *((*s)++));
+  }
+  return c;
+}
+
+static void _utf8_skip(const unsigned char **s)
+{
+  if(*((*s)++) >= 0xc0)
+    while((**s & 0xc0) == 0x80) (*s)++;
+}
+
+// the LIKE of the icu extension, which replaces the one of sqlite in the library database
+static gboolean _like_icu(const unsigned char *pattern, const unsigned char *string)
+{
+  while(TRUE)
+  {
+    const uint32_t p = _utf8_read(&pattern);
+    if(p == 0) break;
+
+    if(p == '%')
+    {
+      for(; *pattern == '%' || *pattern == '_'; pattern++)
+        if(*pattern == '_')
+        {
+          if(*string == 0) return FALSE;
+          _utf8_skip(&string);
+        }
+      if(*pattern == 0) return TRUE;
+      for(; *string; _utf8_skip(&string))
+        if(_like_icu(pattern, string)) return TRUE;
+      return FALSE;
+    }
+    else if(p == '_')
+    {
+      if(*string == 0) return FALSE;
+      _utf8_skip(&string);
+    }
+    else
+    {
+      const uint32_t c = _utf8_read(&string);
+      if(u_foldCase((UChar32)c, U_FOLD_CASE_DEFAULT) != u_foldCase((UChar32)p, U_FOLD_CASE_DEFAULT))
+        return FALSE;
+    }
+  }
+  return *string == 0;
+}
+#endif
+
+gboolean dt_presets_like(const char *string, const char *pattern)
+{
+  if(!string || !pattern) return FALSE;
+#ifdef HAVE_ICU
+  return _like_icu((const unsigned char *)pattern, (const unsigned char *)string);
+#else
+  return sqlite3_strlike(pattern, string, 0) == 0;
+#endif
+}
+
+static gboolean _autoapply_match(const dt_presets_autoapply_t *p, const dt_presets_image_t *image)
+{
+  const double value[4] = { image->iso, image->exposure, image->aperture, image->focal_length };
+  if(!p->autoapply || !p->ranges || !p->has_format) return FALSE;
+  for(int k = 0; k < 4; k++)
+    if(!(value[k] >= p->min[k] && value[k] <= p->max[k])) return FALSE;
+  if(p->format != 0 && !((p->format & image->format) != 0 && (~p->format & image->excluded) != 0)) return FALSE;
+
+  return ((dt_presets_like(image->model, p->model) && dt_presets_like(image->maker, p->maker))
+          || (dt_presets_like(image->camera_alias, p->model) && dt_presets_like(image->camera_maker, p->maker)))
+         && dt_presets_like(image->lens, p->lens);
+}
+
+void dt_presets_autoapply_to_history(const int32_t imgid, const dt_presets_image_t *image, const gboolean legacy,
+                                     const char *name, const char *const *exclude)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO memory.history"
+                              " VALUES (?1, 0, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)",
+                              -1, &stmt, NULL);
+
+  g_mutex_lock(&_autoapply_lock);
+  GPtrArray *index = _autoapply_get_index();
+  for(guint i = 0; i < index->len; i++)
+  {
+    const dt_presets_autoapply_t *p = (dt_presets_autoapply_t *)g_ptr_array_index(index, i);
+    if(p->legacy != legacy || !p->operation) continue;
+
+    gboolean excluded = FALSE;
+    for(const char *const *op = exclude; *op && !excluded; op++) excluded = !strcmp(p->operation, *op);
+    if(excluded) continue;
+
+    if(!((name && p->name && !strcmp(p->name, name)) || _autoapply_match(p, image))) continue;
+
+    // later presets of an operation replace the earlier ones
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    for(int k = 0; k < DT_PRESETS_HISTORY_COLUMNS; k++) sqlite3_bind_value(stmt, 2 + k, p->history[k]);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  g_mutex_unlock(&_autoapply_lock);
+
+  sqlite3_finalize(stmt);
+}
+
+gboolean dt_presets_autoapply_params(const char *operation, const dt_presets_image_t *image, void **params,
+                                     int32_t *params_size)
+{
+  gboolean found = FALSE;
+  *params = NULL;
+  *params_size = 0;
+
+  g_mutex_lock(&_autoapply_lock);
+  GPtrArray *index = _autoapply_get_index();
+  for(guint i = 0; i < index->len && !found; i++)
+  {
+    const dt_presets_autoapply_t *p = (dt_presets_autoapply_t *)g_ptr_array_index(index, i);
+    if(p->legacy || !p->operation || strcmp(p->operation, operation) || !_autoapply_match(p, image)) continue;
+
+    // op_params, see _autoapply_read()
+    sqlite3_value *value = p->history[2];
+    *params_size = sqlite3_value_bytes(value);
+    if(*params_size)
+    {
+      *params = g_malloc(*params_size);
+      memcpy(*params, sqlite3_value_blob(value), *params_size);
+    }
+    found = TRUE;
+  }
+  g_mutex_unlock(&_autoapply_lock);
+
+  return found;
+}
+
+void dt_presets_autoapply_cleanup(void)
+{
+  g_mutex_lock(&_autoapply_lock);
+  if(_autoapply_index) g_ptr_array_free(_autoapply_index, TRUE);
+  _autoapply_index = NULL;
+  g_mutex_unlock(&_autoapply_lock);
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
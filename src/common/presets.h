@@ -26,6 +26,36 @@ void dt_presets_save_to_file(const int rowid, const char *preset_name, const cha
 /** load preset from file */
 int dt_presets_import_from_file(const char *preset_path);
 
+/** the properties of an image which auto-applied presets are matched against */
+typedef struct dt_presets_image_t
+{
+  const char *model, *maker;               // from exif
+  const char *camera_alias, *camera_maker; // normalized names
+  const char *lens;
+  double iso, exposure, aperture, focal_length;
+  int format;   // FOR_LDR, FOR_RAW and FOR_HDR flags of the image
+  int excluded; // FOR_NOT_MONO or FOR_NOT_COLOR
+} dt_presets_image_t;
+
+/** inserts the presets which are auto-applied to the image, or are called name, into memory.history for imgid.
+    they are taken from main.legacy_presets if legacy is set and from data.presets otherwise, without the
+    operations of the NULL terminated exclude list. a later preset of an operation is more specific and replaces
+    the earlier ones. the presets are matched in memory, against an index of the preset tables which is rebuilt
+    when they change. */
+void dt_presets_autoapply_to_history(const int32_t imgid, const dt_presets_image_t *image, const gboolean legacy,
+                                     const char *name, const char *const *exclude);
+
+/** finds the op_params of the first preset of operation in data.presets which is auto-applied to the image.
+    returns FALSE if there is none, params are to be freed with g_free(). */
+gboolean dt_presets_autoapply_params(const char *operation, const dt_presets_image_t *image, void **params,
+                                     int32_t *params_size);
+
+/** SQL LIKE of the library database: case insensitive match of string against pattern with the % and _
+    wildcards */
+gboolean dt_presets_like(const char *string, const char *pattern);
+
+void dt_presets_autoapply_cleanup(void);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
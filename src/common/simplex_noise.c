@@ -0,0 +1,156 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/simplex_noise.h"
+#include "common/darktable.h"
+
+#include <math.h>
+
+// the contributions of the corners are computed unconditionally and then masked, which needs non trapping
+// math to be if-converted and vectorized. contracting to fma changes which side of a cell border points
+// fall on, so it's kept off for results which don't depend on the instruction set.
+#ifdef __GNUC__
+#pragma GCC optimize ("no-trapping-math", "no-math-errno", "fp-contract=off")
+#endif
+
+// pixels per chunk of a row. the coordinates are reduced by the period in double precision at the start of
+// every chunk, so they stay small in single precision.
+#define CHUNK 64
+
+static const int _perm[256]
+    = { 151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233, 7,   225, 140, 36,  103, 30,
+        69,  142, 8,   99,  37,  240, 21,  10,  23,  190, 6,   148, 247, 120, 234, 75,  0,   26,  197, 62,
+        94,  252, 219, 203, 117, 35,  11,  32,  57,  177, 33,  88,  237, 149, 56,  87,  174, 20,  125, 136,
+        171, 168, 68,  175, 74,  165, 71,  134, 139, 48,  27,  166, 77,  146, 158, 231, 83,  111, 229, 122,
+        60,  211, 133, 230, 220, 105, 92,  41,  55,  46,  245, 40,  244, 102, 143, 54,  65,  25,  63,  161,
+        1,   216, 80,  73,  209, 76,  132, 187, 208, 89,  18,  169, 200, 196, 135, 130, 116, 188, 159, 86,
+        164, 100, 109, 198, 173, 186, 3,   64,  52,  217, 226, 250, 124, 123, 5,   202, 38,  147, 118, 126,
+        255, 82,  85,  212, 207, 206, 59,  227, 47,  16,  58,  17,  182, 189, 28,  42,  223, 183, 170, 213,
+        119, 248, 152, 2,   44,  154, 163, 70,  221, 153, 101, 155, 167, 43,  172, 9,   129, 22,  39,  253,
+        19,  98,  108, 110, 79,  113, 224, 232, 178, 185, 112, 104, 218, 246, 97,  228, 251, 34,  242, 193,
+        238, 210, 144, 12,  191, 179, 162, 241, 81,  51,  145, 235, 249, 14,  239, 107, 49,  192, 214, 31,
+        181, 199, 106, 157, 184, 84,  204, 176, 115, 121, 50,  45,  127, 4,   150, 254, 138, 236, 205, 93,
+        222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156, 180 };
+
+// see: http://eternallyconfuzzled.com/tuts/algorithms/jsw_tut_hashing.aspx
+// this is the modified bernstein
+uint32_t dt_simplex_noise_seed(const char *s)
+{
+  uint32_t h = 0;
+  while(*s) h = 33 * h ^ *s++;
+  return h;
+}
+
+// floorf() doesn't vectorize before sse4.1
+static inline __attribute__((always_inline)) int _floor(const float x)
+{
+  const int i = (int)x;
+  return i - (x < i);
+}
+
+// gradient index of a lattice point, the table lookups wrap around like the usual doubled table does
+static inline __attribute__((always_inline)) int _gradient(const int i, const int j, const int k)
+{
+  return _perm[(i + _perm[(j + _perm[k & 255]) & 255]) & 255] % 12;
+}
+
+static inline __attribute__((always_inline)) float _corner(const int g, const float x, const float y, const float z)
+{
+  // dot product with gradient g of the 12 midpoints of the edges of a cube: (+-1,+-1,0) for g < 4, (+-1,0,+-1)
+  // for g < 8 and (0,+-1,+-1) above, computed instead of looked up to save the gathers
+  const float u = g < 8 ? x : y;
+  const float v = g < 4 ? y : z;
+  const float d = (1 - (g & 1) * 2) * u + (1 - (g & 2)) * v;
+  const float t = 0.6f - x * x - y * y - z * z;
+  const float t2 = t * t;
+  return t < 0.0f ? 0.0f : t2 * t2 * d;
+}
+
+// Stefan Gustavson's reference implementation in single precision, without branches so that loops over it
+// vectorize
+static inline __attribute__((always_inline)) float _simplex_noise(const float xin, const float yin, const float zin)
+{
+  const float F3 = 1.0f / 3.0f;
+  const float G3 = 1.0f / 6.0f;
+
+  // skew the input space to determine which simplex cell we're in
+  const float s = (xin + yin + zin) * F3;
+  const int i = _floor(xin + s);
+  const int j = _floor(yin + s);
+  const int k = _floor(zin + s);
+  const float t = (i + j + k) * G3;
+  // the x,y,z distances from the cell origin
+  const float x0 = xin - (i - t);
+  const float y0 = yin - (j - t);
+  const float z0 = zin - (k - t);
+
+  // offsets of the second and third corner of the simplex: one step along the axis with the largest
+  // distance, then one along the second largest
+  const int i1 = (x0 >= y0) & (x0 >= z0);
+  const int j1 = (x0 < y0) & (y0 >= z0);
+  const int k1 = 1 - i1 - j1;
+  const int i2 = (x0 >= y0) | (x0 >= z0);
+  const int j2 = (x0 < y0) | (y0 >= z0);
+  const int k2 = 2 - i2 - j2;
+
+  const float x1 = x0 - i1 + G3;
+  const float y1 = y0 - j1 + G3;
+  const float z1 = z0 - k1 + G3;
+  const float x2 = x0 - i2 + 2.0f * G3;
+  const float y2 = y0 - j2 + 2.0f * G3;
+  const float z2 = z0 - k2 + 2.0f * G3;
+  const float x3 = x0 - 1.0f + 3.0f * G3;
+  const float y3 = y0 - 1.0f + 3.0f * G3;
+  const float z3 = z0 - 1.0f + 3.0f * G3;
+
+  const float n0 = _corner(_gradient(i, j, k), x0, y0, z0);
+  const float n1 = _corner(_gradient(i + i1, j + j1, k + k1), x1, y1, z1);
+  const float n2 = _corner(_gradient(i + i2, j + j2, k + k2), x2, y2, z2);
+  const float n3 = _corner(_gradient(i + 1, j + 1, k + 1), x3, y3, z3);
+
+  // the result is scaled to stay just inside [-1,1]
+  return 32.0f * (n0 + n1 + n2 + n3);
+}
+
+float dt_simplex_noise_3d(const float x, const float y, const float z)
+{
+  return _simplex_noise(x, y, z);
+}
+
+__DT_CLONE_TARGETS__
+void dt_simplex_noise_row_add(float *const out, const size_t n, const double x, const double dx, const double y,
+                              const double z, const float weight)
+{
+  const float yr = fmod(y, DT_SIMPLEX_NOISE_PERIOD);
+  const float zr = fmod(z, DT_SIMPLEX_NOISE_PERIOD);
+  const float dxr = dx;
+  for(size_t c = 0; c < n; c += CHUNK)
+  {
+    const float xr = fmod(x + c * dx, DT_SIMPLEX_NOISE_PERIOD);
+    const int end = MIN(n - c, CHUNK);
+    float *const restrict o = out + c;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int k = 0; k < end; k++) o[k] += weight * _simplex_noise(xr + k * dxr, yr, zr);
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
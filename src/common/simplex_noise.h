@@ -0,0 +1,50 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * single precision 3d simplex noise (Ken Perlin's improved noise on a simplex grid, with the reference
+ * permutation table), evaluated on whole rows at once so the compiler can vectorize it.
+ *
+ * the noise repeats every DT_SIMPLEX_NOISE_PERIOD units along each axis. the row functions take double
+ * coordinates and reduce them by the period before switching to single precision, so large offsets (as
+ * used to decorrelate the noise of different images) don't cost any precision.
+ *
+ * this is coherent noise, for textures like grain. for independent random values per pixel see
+ * develop/noise_generator.h.
+ */
+
+#define DT_SIMPLEX_NOISE_PERIOD 768.0
+
+/** deterministic seed from a string, e.g. the image filename (modified bernstein hash) */
+uint32_t dt_simplex_noise_seed(const char *s);
+
+/** noise at one point, in [-1, 1]. x, y and z should be reduced by the period already. */
+float dt_simplex_noise_3d(const float x, const float y, const float z);
+
+/** adds weight * noise(x + i * dx, y, z) to out[i] for i in [0, n) */
+void dt_simplex_noise_row_add(float *const out, const size_t n, const double x, const double dx, const double y,
+                              const double z, const float weight);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
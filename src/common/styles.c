@@ -590,6 +590,77 @@ gboolean dt_styles_create_from_image(const char *name, const char *description,
   return FALSE;
 }
 
+// a style being applied to a list of images: its items are read once for all the images
+typedef struct dt_styles_apply_t
+{
+  const char *name;
+  int id;
+  GList *items;
+  GList *imgs; // images the style was applied to
+} dt_styles_apply_t;
+
+static void _styles_apply_init(dt_styles_apply_t *style, const char *name)
+{
+  style->name = name;
+  style->id = dt_styles_get_id_by_name(name);
+  style->items = NULL;
+  style->imgs = NULL;
+  if(style->id == 0) return;
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT num, module, operation, op_params, enabled,"
+                              "  blendop_params, blendop_version, multi_priority, multi_name"
+                              " FROM data.style_items WHERE styleid=?1 "
+                              " ORDER BY operation, multi_priority",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, style->id);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_style_item_t *style_item = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
+
+    style_item->num = sqlite3_column_int(stmt, 0);
+    style_item->selimg_num = 0;
+    style_item->enabled = sqlite3_column_int(stmt, 4);
+    style_item->multi_priority = sqlite3_column_int(stmt, 7);
+    style_item->name = NULL;
+    style_item->operation = g_strdup((char *)sqlite3_column_text(stmt, 2));
+    style_item->multi_name = g_strdup((char *)sqlite3_column_text(stmt, 8));
+    style_item->module_version = sqlite3_column_int(stmt, 1);
+    style_item->blendop_version = sqlite3_column_int(stmt, 6);
+    style_item->params_size = sqlite3_column_bytes(stmt, 3);
+    style_item->params = (void *)malloc(style_item->params_size);
+    memcpy(style_item->params, (void *)sqlite3_column_blob(stmt, 3), style_item->params_size);
+    style_item->blendop_params_size = sqlite3_column_bytes(stmt, 5);
+    style_item->blendop_params = (void *)malloc(style_item->blendop_params_size);
+    memcpy(style_item->blendop_params, (void *)sqlite3_column_blob(stmt, 5), style_item->blendop_params_size);
+    style_item->iop_order = 0;
+
+    style->items = g_list_prepend(style->items, style_item);
+  }
+  sqlite3_finalize(stmt);
+  style->items = g_list_reverse(style->items);  // list was built in reverse order, so un-reverse it
+}
+
+// tags the images the style was applied to at once and frees the style
+static void _styles_apply_cleanup(dt_styles_apply_t *style)
+{
+  if(style->imgs)
+  {
+    guint tagid = 0;
+    gchar ntag[512] = { 0 };
+    g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", style->name);
+    if(dt_tag_new(ntag, &tagid)) dt_tag_attach_images(tagid, style->imgs, FALSE);
+  }
+  g_list_free(style->imgs);
+  g_list_free_full(style->items, dt_style_item_free);
+  style->imgs = NULL;
+  style->items = NULL;
+}
+
+static int32_t _styles_apply_to_image_ext(const dt_styles_apply_t *style, const gboolean duplicate,
+                                          const int32_t imgid, const gboolean bulk);
+
 void dt_styles_apply_to_list(const char *name, const GList *list, gboolean duplicate)
 {
   gboolean selected = FALSE;
@@ -608,6 +679,10 @@ void dt_styles_apply_to_list(const char *name, const GList *list, gboolean dupli
   const gboolean is_overwrite = mode == (DT_STYLE_HISTORY_OVERWRITE);
   dt_undo_lt_history_t *hist = NULL;
 
+  dt_styles_apply_t style;
+  _styles_apply_init(&style, name);
+  GList *changed = NULL;
+
   for(const GList *l = list; l; l = g_list_next(l))
   {
     const int imgid = GPOINTER_TO_INT(l->data);
@@ -621,7 +696,12 @@ void dt_styles_apply_to_list(const char *name, const GList *list, gboolean dupli
       dt_history_delete_on_image_ext(imgid, FALSE);
     }
 
-    dt_styles_apply_to_image(name, duplicate, imgid);
+    const int32_t newimgid = _styles_apply_to_image_ext(&style, duplicate, imgid, TRUE);
+    if(newimgid > 0)
+    {
+      style.imgs = g_list_prepend(style.imgs, GINT_TO_POINTER(newimgid));
+      changed = g_list_prepend(changed, GINT_TO_POINTER(newimgid));
+    }
 
     if(is_overwrite)
     {
@@ -635,6 +715,9 @@ void dt_styles_apply_to_list(const char *name, const GList *list, gboolean dupli
 
   dt_undo_end_group(darktable.undo);
 
+  _styles_apply_cleanup(&style);
+  dt_history_bulk_finish(g_list_reverse(changed));
+
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
 
   if(!selected) dt_control_log(_("no image selected!"));
@@ -667,6 +750,13 @@ void dt_multiple_styles_apply_to_list(GList *styles, const GList *list, gboolean
 
   const int mode = dt_conf_get_int("plugins/lighttable/style/applymode");
 
+  const int styles_cnt = g_list_length(styles);
+  dt_styles_apply_t *apply = (dt_styles_apply_t *)calloc(styles_cnt, sizeof(dt_styles_apply_t));
+  int k = 0;
+  for(GList *style = styles; style; style = g_list_next(style))
+    _styles_apply_init(&apply[k++], (char *)style->data);
+  GList *changed = NULL;
+
   /* for each selected image apply style */
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
   for(const GList *l = list; l; l = g_list_next(l))
@@ -675,16 +765,25 @@ void dt_multiple_styles_apply_to_list(GList *styles, const GList *list, gboolean
     if(mode == DT_STYLE_HISTORY_OVERWRITE)
       dt_history_delete_on_image_ext(imgid, FALSE);
 
-    for (GList *style = styles; style; style = g_list_next(style))
+    gboolean applied = FALSE;
+    for(k = 0; k < styles_cnt; k++)
     {
-      dt_styles_apply_to_image((char*)style->data, duplicate, imgid);
+      const int32_t newimgid = _styles_apply_to_image_ext(&apply[k], duplicate, imgid, TRUE);
+      if(newimgid <= 0) continue;
+      apply[k].imgs = g_list_prepend(apply[k].imgs, GINT_TO_POINTER(newimgid));
+      // every style gets its own duplicate, otherwise the image is changed once
+      if(duplicate || !applied) changed = g_list_prepend(changed, GINT_TO_POINTER(newimgid));
+      applied = TRUE;
     }
   }
   dt_undo_end_group(darktable.undo);
 
+  for(k = 0; k < styles_cnt; k++) _styles_apply_cleanup(&apply[k]);
+  free(apply);
+  dt_history_bulk_finish(g_list_reverse(changed));
+
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
 
-  const guint styles_cnt = g_list_length(styles);
   dt_control_log(ngettext("style successfully applied!", "styles successfully applied!", styles_cnt));
 }
 
@@ -802,149 +901,134 @@ void dt_styles_apply_style_item(dt_develop_t *dev, dt_style_item_t *style_item,
   }
 }
 
-void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid)
+// applies the style to imgid, or to a duplicate of it. returns the id of the changed image, -1 on failure.
+// in bulk mode the tags, sidecar file and thumbnail of the image are left to the caller.
+static int32_t _styles_apply_to_image_ext(const dt_styles_apply_t *style, const gboolean duplicate,
+                                          const int32_t imgid, const gboolean bulk)
 {
-  int id = 0;
-  sqlite3_stmt *stmt;
+  if(style->id == 0) return -1;
 
-  if((id = dt_styles_get_id_by_name(name)) != 0)
+  int32_t newimgid;
+  /* check if we should make a duplicate before applying style */
+  if(duplicate)
   {
-    int32_t newimgid;
-    /* check if we should make a duplicate before applying style */
-    if(duplicate)
-    {
-      newimgid = dt_image_duplicate(imgid);
-      if(newimgid != -1)
-        dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL, TRUE, TRUE);
-    }
-    else
-      newimgid = imgid;
+    newimgid = dt_image_duplicate(imgid);
+    if(newimgid != -1)
+      dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL, TRUE, TRUE);
+  }
+  else
+    newimgid = imgid;
 
-    // now deal with the history
-    GList *modules_used = NULL;
+  // now deal with the history
+  GList *modules_used = NULL;
 
-    dt_develop_t _dev_dest = { 0 };
+  dt_develop_t _dev_dest = { 0 };
 
-    dt_develop_t *dev_dest = &_dev_dest;
+  dt_develop_t *dev_dest = &_dev_dest;
 
-    dt_dev_init(dev_dest, FALSE);
+  dt_dev_init(dev_dest, FALSE);
 
-    dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
-    dev_dest->image_storage.id = imgid;
+  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+  dev_dest->image_storage.id = imgid;
 
-    // now let's deal with the iop-order (possibly merging style & target lists)
-    GList *iop_list = dt_styles_module_order_list(name);
-    if(iop_list)
-    {
-      // the style has an iop-order, we need to merge the multi-instance from target image
-      // get target image iop-order list:
-      GList *img_iop_order_list = dt_ioppr_get_iop_order_list(newimgid, FALSE);
-      // get multi-instance modules if any:
-      GList *mi = dt_ioppr_extract_multi_instances_list(img_iop_order_list);
-      // if some where found merge them with the style list
-      if(mi) iop_list = dt_ioppr_merge_multi_instance_iop_order_list(iop_list, mi);
-      // finally we have the final list for the image
-      dt_ioppr_write_iop_order_list(iop_list, newimgid);
-      g_list_free_full(iop_list, g_free);
-      g_list_free_full(img_iop_order_list, g_free);
-    }
+  // now let's deal with the iop-order (possibly merging style & target lists)
+  GList *iop_list = dt_styles_module_order_list(style->name);
+  if(iop_list)
+  {
+    // the style has an iop-order, we need to merge the multi-instance from target image
+    // get target image iop-order list:
+    GList *img_iop_order_list = dt_ioppr_get_iop_order_list(newimgid, FALSE);
+    // get multi-instance modules if any:
+    GList *mi = dt_ioppr_extract_multi_instances_list(img_iop_order_list);
+    // if some where found merge them with the style list
+    if(mi) iop_list = dt_ioppr_merge_multi_instance_iop_order_list(iop_list, mi);
+    // finally we have the final list for the image
+    dt_ioppr_write_iop_order_list(iop_list, newimgid);
+    g_list_free_full(iop_list, g_free);
+    g_list_free_full(img_iop_order_list, g_free);
+  }
 
-    dt_dev_read_history_ext(dev_dest, newimgid, TRUE);
+  dt_dev_read_history_ext(dev_dest, newimgid, TRUE);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image ");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image ");
 
-    dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
+  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 1");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 1");
 
-    if (DT_IOP_ORDER_INFO)
-      fprintf(stderr,"\n^^^^^ Apply style on image %i, history size %i",imgid,dev_dest->history_end);
+  if (DT_IOP_ORDER_INFO)
+    fprintf(stderr,"\n^^^^^ Apply style on image %i, history size %i",imgid,dev_dest->history_end);
 
-    // go through all entries in style
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT num, module, operation, op_params, enabled,"
-                                "  blendop_params, blendop_version, multi_priority, multi_name"
-                                " FROM data.style_items WHERE styleid=?1 "
-                                " ORDER BY operation, multi_priority",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
-    GList *si_list = NULL;
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      dt_style_item_t *style_item = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
-
-      style_item->num = sqlite3_column_int(stmt, 0);
-      style_item->selimg_num = 0;
-      style_item->enabled = sqlite3_column_int(stmt, 4);
-      style_item->multi_priority = sqlite3_column_int(stmt, 7);
-      style_item->name = NULL;
-      style_item->operation = g_strdup((char *)sqlite3_column_text(stmt, 2));
-      style_item->multi_name = g_strdup((char *)sqlite3_column_text(stmt, 8));
-      style_item->module_version = sqlite3_column_int(stmt, 1);
-      style_item->blendop_version = sqlite3_column_int(stmt, 6);
-      style_item->params_size = sqlite3_column_bytes(stmt, 3);
-      style_item->params = (void *)malloc(style_item->params_size);
-      memcpy(style_item->params, (void *)sqlite3_column_blob(stmt, 3), style_item->params_size);
-      style_item->blendop_params_size = sqlite3_column_bytes(stmt, 5);
-      style_item->blendop_params = (void *)malloc(style_item->blendop_params_size);
-      memcpy(style_item->blendop_params, (void *)sqlite3_column_blob(stmt, 5), style_item->blendop_params_size);
-      style_item->iop_order = 0;
-
-      si_list = g_list_prepend(si_list, style_item);
-    }
-    sqlite3_finalize(stmt);
-    si_list = g_list_reverse(si_list);  // list was built in reverse order, so un-reverse it
+  // go through all entries in style. the multi priorities and iop orders are set for the instances in the
+  // image, so work on a shallow copy of the items.
+  GList *si_list = NULL;
+  for(const GList *l = style->items; l; l = g_list_next(l))
+  {
+    dt_style_item_t *style_item = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
+    memcpy(style_item, l->data, sizeof(dt_style_item_t));
+    si_list = g_list_prepend(si_list, style_item);
+  }
+  si_list = g_list_reverse(si_list);
 
-    dt_ioppr_update_for_style_items(dev_dest, si_list, FALSE);
+  dt_ioppr_update_for_style_items(dev_dest, si_list, FALSE);
 
-    for(GList *l = si_list; l; l = g_list_next(l))
-    {
-      dt_style_item_t *style_item = (dt_style_item_t *)l->data;
-      dt_styles_apply_style_item(dev_dest, style_item, &modules_used, FALSE);
-    }
+  for(GList *l = si_list; l; l = g_list_next(l))
+  {
+    dt_style_item_t *style_item = (dt_style_item_t *)l->data;
+    dt_styles_apply_style_item(dev_dest, style_item, &modules_used, FALSE);
+  }
 
-    g_list_free_full(si_list, dt_style_item_free);
+  g_list_free_full(si_list, free);
 
-    if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv --> look for written history below\n");
+  if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv --> look for written history below\n");
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 2");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 2");
 
-    dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
-    hist->imgid = newimgid;
-    dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
+  dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
+  hist->imgid = newimgid;
+  dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
 
-    // write history and forms to db
-    dt_dev_write_history_ext(dev_dest, newimgid);
+  // write history and forms to db
+  dt_dev_write_history_ext(dev_dest, newimgid);
 
-    dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
-    dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-    dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
-                   dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
-    dt_undo_end_group(darktable.undo);
+  dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+  dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
+                 dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+  dt_undo_end_group(darktable.undo);
 
-    dt_dev_cleanup(dev_dest);
+  dt_dev_cleanup(dev_dest);
 
-    g_list_free(modules_used);
+  g_list_free(modules_used);
 
+  if(bulk)
+  {
+    dt_history_bulk_changed(newimgid);
+  }
+  else
+  {
     /* add tag */
     guint tagid = 0;
     gchar ntag[512] = { 0 };
-    g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
+    g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", style->name);
     if(dt_tag_new(ntag, &tagid)) dt_tag_attach(tagid, newimgid, FALSE, FALSE);
     if(dt_tag_new("darktable|changed", &tagid))
     {
       dt_tag_attach(tagid, newimgid, FALSE, FALSE);
       dt_image_cache_set_change_timestamp(darktable.image_cache, imgid);
     }
+  }
 
-    /* if current image in develop reload history */
-    if(dt_dev_is_current_image(darktable.develop, newimgid))
-    {
-      dt_dev_reload_history_items(darktable.develop);
-      dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
-      dt_dev_modules_update_multishow(darktable.develop);
-    }
+  /* if current image in develop reload history */
+  if(dt_dev_is_current_image(darktable.develop, newimgid))
+  {
+    dt_dev_reload_history_items(darktable.develop);
+    dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+    dt_dev_modules_update_multishow(darktable.develop);
+  }
 
+  if(!bulk)
+  {
     /* update xmp file */
     dt_image_synch_xmp(newimgid);
 
@@ -961,6 +1045,16 @@ void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const
     /* redraw center view to update visible mipmaps */
     DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, newimgid);
   }
+
+  return newimgid;
+}
+
+void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid)
+{
+  dt_styles_apply_t style;
+  _styles_apply_init(&style, name);
+  _styles_apply_to_image_ext(&style, duplicate, imgid, FALSE);
+  _styles_apply_cleanup(&style);
 }
 
 void dt_styles_delete_by_name_adv(const char *name, const gboolean raise)
@@ -23,6 +23,7 @@
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "develop/masks.h"
+#include "develop/pixelpipe.h"
 #include "develop/tiling.h"
 #include <math.h>
 
@@ -281,7 +282,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
   const float opacity = fminf(fmaxf(0.0f, (d->opacity / 100.0f)), 1.0f);
 
   // allocate space for blend mask
-  float *const restrict _mask = dt_alloc_align_float(buffsize);
+  float *const restrict _mask = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, buffsize);
   if(!_mask)
   {
     dt_control_log(_("could not allocate buffer for blending"));
@@ -396,7 +397,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
         default:
           assert(0);
       }
-      float *const restrict mask_bak = dt_alloc_align_float(buffsize);
+      float *const restrict mask_bak = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, buffsize);
       if(mask_bak)
       {
         memcpy(mask_bak, mask, sizeof(*mask_bak) * buffsize);
@@ -404,7 +405,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
                                                                       : (float *const restrict)ovoid;
         if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN)
         {
-          float *const restrict guide_tmp = dt_alloc_align_float(buffsize * ch);
+          float *const restrict guide_tmp = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, buffsize * ch);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
         dt_omp_firstprivate(ch, guide_tmp, ivoid, iwidth, oheight, owidth, xoffs, yoffs)
@@ -418,8 +419,8 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
           guide = guide_tmp;
         }
         guided_filter(guide, mask_bak, mask, owidth, oheight, ch, w, sqrt_eps, guide_weight, 0.f, 1.f);
-        if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN) dt_free_align(guide);
-        dt_free_align(mask_bak);
+        if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN) dt_dev_pixelpipe_pool_free(piece->pipe, guide);
+        dt_dev_pixelpipe_pool_free(piece->pipe, mask_bak);
       }
     }
     if(mask_blur)
@@ -503,12 +504,14 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
   // TODO: should we skip raster masks?
   if(piece->pipe->store_all_raster_masks || dt_iop_is_raster_mask_used(self, 0))
   {
+    // the raster mask outlives this run, it is not ours to recycle any more
+    dt_dev_pixelpipe_pool_detach(piece->pipe, _mask);
     g_hash_table_replace(piece->raster_masks, GINT_TO_POINTER(0), _mask);
   }
   else
   {
     g_hash_table_remove(piece->raster_masks, GINT_TO_POINTER(0));
-    dt_free_align(_mask);
+    dt_dev_pixelpipe_pool_free(piece->pipe, _mask);
   }
 }
 
@@ -578,7 +581,7 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
   const float opacity = fminf(fmaxf(0.0f, (d->opacity / 100.0f)), 1.0f);
 
   // allocate space for blend mask
-  float *_mask = dt_alloc_align_float(buffsize);
+  float *_mask = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, buffsize);
   if(!_mask)
   {
     dt_control_log(_("could not allocate buffer for blending"));
@@ -947,12 +950,13 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
       err = dt_opencl_copy_device_to_host(devid, mask, dev_mask_1, owidth, oheight, sizeof(float));
       if(err != CL_SUCCESS) goto error;
     }
+    dt_dev_pixelpipe_pool_detach(piece->pipe, _mask);
     g_hash_table_replace(piece->raster_masks, GINT_TO_POINTER(0), _mask);
     }
   else
   {
     g_hash_table_remove(piece->raster_masks, GINT_TO_POINTER(0));
-    dt_free_align(_mask);
+    dt_dev_pixelpipe_pool_free(piece->pipe, _mask);
   }
 
   dt_opencl_release_mem_object(dev_blendif_params);
@@ -965,7 +969,7 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
   return TRUE;
 
 error:
-  dt_free_align(_mask);
+  dt_dev_pixelpipe_pool_free(piece->pipe, _mask);
   dt_opencl_release_mem_object(dev_blendif_params);
   dt_opencl_release_mem_object(dev_boost_factors);
   dt_opencl_release_mem_object(dev_mask_1);
@@ -31,6 +31,7 @@
 #include "common/imageio.h"
 #include "common/mipmap_cache.h"
 #include "common/opencl.h"
+#include "common/presets.h"
 #include "common/tags.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -40,12 +41,21 @@
 #include "develop/imageop.h"
 #include "develop/lightroom.h"
 #include "develop/masks.h"
+#include "develop/prefetch.h"
 #include "gui/gtk.h"
 #include "gui/presets.h"
 
 #define DT_DEV_AVERAGE_DELAY_START 250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START 50
 #define DT_DEV_AVERAGE_DELAY_COUNT 5
+// progressive rendering of the center view: downscale factor of the coarse pass, and the minimum
+// average processing time (in ms) of the full pipe for which it is worth it
+#define DT_DEV_PROGRESSIVE_FACTOR 4
+#define DT_DEV_PROGRESSIVE_MIN_DELAY 500
+// adaptive resolution of the center view: largest reduction factor, and the time (in ms) without parameter
+// changes after which the interaction is considered finished
+#define DT_DEV_ADAPTIVE_MAX_REDUCTION 4.0f
+#define DT_DEV_ADAPTIVE_IDLE 300
 #define DT_IOP_ORDER_INFO (darktable.unmuted & DT_DEBUG_IOPORDER)
 
 void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
@@ -57,6 +67,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->average_delay = DT_DEV_AVERAGE_DELAY_START;
   dev->preview_average_delay = DT_DEV_PREVIEW_AVERAGE_DELAY_START;
   dev->preview2_average_delay = DT_DEV_PREVIEW_AVERAGE_DELAY_START;
+  dev->adaptive.reduction = 1.0f;
   dev->gui_leaving = 0;
   dev->gui_synch = 0;
   dt_pthread_mutex_init(&dev->history_mutex, NULL);
@@ -73,6 +84,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->preview2_loading = dev->preview_input_changed = dev->preview2_input_changed = FALSE;
   dev->image_invalid_cnt = 0;
   dev->pipe = dev->preview_pipe = dev->preview2_pipe = NULL;
+  dev->shared_cache = NULL;
   dt_pthread_mutex_init(&dev->pipe_mutex, NULL);
   dt_pthread_mutex_init(&dev->preview_pipe_mutex, NULL);
   dt_pthread_mutex_init(&dev->preview2_pipe_mutex, NULL);
@@ -92,6 +104,9 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
     dt_dev_pixelpipe_init(dev->pipe);
     dt_dev_pixelpipe_init_preview(dev->preview_pipe);
     dt_dev_pixelpipe_init_preview2(dev->preview2_pipe);
+    dev->prefetch = dt_dev_prefetch_init();
+    const size_t shared_cache_size = dt_conf_get_int("pixelpipe_shared_cache_size");
+    if(shared_cache_size) dev->shared_cache = dt_dev_pixelpipe_shared_cache_new(shared_cache_size << 20);
     dev->histogram_pre_tonecurve = (uint32_t *)calloc(4 * 256, sizeof(uint32_t));
     dev->histogram_pre_levels = (uint32_t *)calloc(4 * 256, sizeof(uint32_t));
 
@@ -160,6 +175,8 @@ void dt_dev_cleanup(dt_develop_t *dev)
     dt_dev_pixelpipe_cleanup(dev->preview2_pipe);
     free(dev->preview2_pipe);
   }
+  dt_dev_prefetch_cleanup(dev->prefetch);
+  dt_dev_pixelpipe_shared_cache_free(dev->shared_cache);
   while(dev->history)
   {
     dt_dev_free_history_item(((dt_dev_history_item_t *)dev->history->data));
@@ -496,6 +513,73 @@ restart:
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW2_PIPE_FINISHED);
 }
 
+void dt_dev_adaptive_interaction(dt_develop_t *dev)
+{
+  dev->adaptive.target = MAX(0, dt_conf_get_int("darkroom/ui/adaptive_latency"));
+  dev->adaptive.last_interaction = dt_get_wtime();
+}
+
+void dt_dev_adaptive_print_stats(const dt_develop_t *dev)
+{
+  const dt_dev_adaptive_t *a = &dev->adaptive;
+  dt_print(DT_DEBUG_PERF,
+           "[dev_adaptive] last run %.1f ms, target %.0f ms, next reduction 1/%.2f, %u runs, %u reduced, "
+           "%u restored\n",
+           a->last_delay, a->target, a->reduction, a->runs, a->reduced_runs, a->restores);
+}
+
+static gboolean _dev_adaptive_interacting(const dt_develop_t *dev)
+{
+  return dev->gui_attached && dev->adaptive.target > 0
+         && (dt_get_wtime() - dev->adaptive.last_interaction) * 1000.0 < DT_DEV_ADAPTIVE_IDLE;
+}
+
+// processing time is roughly proportional to the number of pixels, i.e. to 1 / reduction^2
+static void _dev_adaptive_update(dt_develop_t *dev, const float delay, const float reduction)
+{
+  dt_dev_adaptive_t *a = &dev->adaptive;
+  a->last_delay = delay;
+  a->runs++;
+  if(reduction > 1.0f) a->reduced_runs++;
+  if(a->target <= 0 || delay <= 0.0f) return;
+
+  const float wanted = reduction * sqrtf(delay / a->target);
+  // damped, so that a single slow or fast frame does not make the resolution jump around
+  a->reduction = CLAMPS(0.5f * (a->reduction + wanted), 1.0f, DT_DEV_ADAPTIVE_MAX_REDUCTION);
+}
+
+// in the gui thread, once the interaction is over: render the center view again at full resolution
+static gboolean _dev_adaptive_restore(gpointer user_data)
+{
+  dt_develop_t *dev = (dt_develop_t *)user_data;
+  if(_dev_adaptive_interacting(dev)) return G_SOURCE_CONTINUE;
+
+  dev->adaptive.restore_pending = FALSE;
+  if(!dev->gui_leaving && dev->pipe->backbuf_reduction > 1.0f)
+  {
+    dev->adaptive.restores++;
+    dt_dev_invalidate(dev);
+    dt_control_queue_redraw_center();
+  }
+  return G_SOURCE_REMOVE;
+}
+
+// should the full pipe show a coarse rendering before the real one? only if that one is going to take a while
+// and the coarse pass still has more detail than the preview pipe which is shown in the meantime otherwise.
+static gboolean _dev_want_coarse_pass(const dt_develop_t *dev, const dt_dev_pixelpipe_change_t pipe_changed,
+                                      const float scale)
+{
+  if(!dev->gui_attached || dev->average_delay < DT_DEV_PROGRESSIVE_MIN_DELAY) return FALSE;
+  // dragging a slider of the focused module only re-runs the end of the pipe from cache, keep that fast path
+  if(!dev->image_loading && !(pipe_changed & (DT_DEV_PIPE_SYNCH | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_ZOOMED)))
+    return FALSE;
+  if(!dt_conf_get_bool("darkroom/ui/progressive_rendering")) return FALSE;
+
+  const float preview_scale = dev->pipe->processed_width > 0
+    ? (float)dev->preview_pipe->processed_width / dev->pipe->processed_width : 0.0f;
+  return scale / DT_DEV_PROGRESSIVE_FACTOR > preview_scale * darktable.gui->ppd;
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -601,8 +685,33 @@ restart:
   x = MAX(0, scale * dev->pipe->processed_width  * (.5 + zoom_x) - wd / 2);
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
+  // while parameters are being changed, render at the resolution that keeps up with the target latency
+  const float reduction = _dev_adaptive_interacting(dev) ? dev->adaptive.reduction : 1.0f;
+
+  // otherwise coarse pass first, if that gets interrupted the real run below will notice as well
+  if(reduction == 1.0f && _dev_want_coarse_pass(dev, pipe_changed, scale))
+  {
+    const float coarse_scale = scale / DT_DEV_PROGRESSIVE_FACTOR;
+    dt_get_times(&start);
+    if(!dt_dev_pixelpipe_process(dev->pipe, dev, x / DT_DEV_PROGRESSIVE_FACTOR, y / DT_DEV_PROGRESSIVE_FACTOR,
+                                 wd / DT_DEV_PROGRESSIVE_FACTOR, ht / DT_DEV_PROGRESSIVE_FACTOR, coarse_scale)
+       && dev->pipe->changed == DT_DEV_PIPE_UNCHANGED)
+    {
+      dt_show_times(&start, "[dev_process_image] coarse pixel pipeline processing");
+      // the center view stretches this one until the real one is there
+      dt_pthread_mutex_lock(&dev->pipe->backbuf_mutex);
+      dev->pipe->backbuf_scale = scale;
+      dev->pipe->backbuf_reduction = DT_DEV_PROGRESSIVE_FACTOR;
+      dev->pipe->backbuf_zoom_x = zoom_x;
+      dev->pipe->backbuf_zoom_y = zoom_y;
+      dt_pthread_mutex_unlock(&dev->pipe->backbuf_mutex);
+      dt_control_queue_redraw_center();
+    }
+  }
+
   dt_get_times(&start);
-  if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
+  if(dt_dev_pixelpipe_process(dev->pipe, dev, x / reduction, y / reduction, wd / reduction, ht / reduction,
+                              scale / reduction))
   {
     // interrupted because image changed?
     if(dev->image_force_reload)
@@ -619,15 +728,31 @@ restart:
       goto restart;
   }
   dt_show_times(&start, "[dev_process_image] pixel pipeline processing");
-  dt_dev_average_delay_update(&start, &dev->average_delay);
+  // reduced runs would drag the average down and trigger coarse passes less often than they should
+  if(reduction == 1.0f) dt_dev_average_delay_update(&start, &dev->average_delay);
+
+  dt_times_t end;
+  dt_get_times(&end);
+  _dev_adaptive_update(dev, (end.clock - start.clock) * 1000.0, reduction);
+  dt_dev_adaptive_print_stats(dev);
 
   // maybe we got zoomed/panned in the meantime?
   if(dev->pipe->changed != DT_DEV_PIPE_UNCHANGED) goto restart;
 
   // cool, we got a new image!
+  dt_pthread_mutex_lock(&dev->pipe->backbuf_mutex);
   dev->pipe->backbuf_scale = scale;
+  dev->pipe->backbuf_reduction = reduction;
   dev->pipe->backbuf_zoom_x = zoom_x;
   dev->pipe->backbuf_zoom_y = zoom_y;
+  dt_pthread_mutex_unlock(&dev->pipe->backbuf_mutex);
+
+  // come back for the full resolution once the user is done
+  if(reduction > 1.0f && !dev->adaptive.restore_pending)
+  {
+    dev->adaptive.restore_pending = TRUE;
+    g_timeout_add(DT_DEV_ADAPTIVE_IDLE, _dev_adaptive_restore, dev);
+  }
 
   dev->image_status = DT_DEV_PIXELPIPE_VALID;
   dev->image_loading = FALSE;
@@ -953,6 +1078,7 @@ void _dev_add_history_item(dt_develop_t *dev, dt_iop_module_t *module, gboolean
   if(dev->gui_attached)
   {
     _dev_add_history_item_ext(dev, module, enable, new_item, FALSE, FALSE);
+    dt_dev_adaptive_interaction(dev);
   }
 #if 0
   {
@@ -1328,8 +1454,11 @@ void dt_dev_write_history_ext(dt_develop_t *dev, const int imgid)
 
   // write the current iop-order-list for this image
 
-  dt_ioppr_write_iop_order_list(dev->iop_order_list, imgid);
-  dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
+  // the hash is computed from what we just wrote, unless the module order could not be written
+  if(dt_ioppr_write_iop_order_list(dev->iop_order_list, imgid))
+    dt_history_hash_write_from_dev(dev, imgid, DT_HISTORY_HASH_CURRENT);
+  else
+    dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
 
   dt_unlock_image(imgid);
 }
@@ -1478,31 +1607,9 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
     }
   }
 
-  // select all presets from one of the following table and add them into memory.history. Note that
+  // select all presets from one of the preset tables and add them into memory.history. Note that
   // this is appended to possibly already present default modules.
-  const char *preset_table[2] = { "data.presets", "main.legacy_presets" };
-  const int legacy = (image->flags & DT_IMAGE_NO_LEGACY_PRESETS) ? 0 : 1;
-  char query[1024];
-  snprintf(query, sizeof(query),
-           "INSERT INTO memory.history"
-           " SELECT ?1, 0, op_version, operation, op_params,"
-           "       enabled, blendop_params, blendop_version, multi_priority, multi_name"
-           " FROM %s"
-           " WHERE ( (autoapply=1"
-           "          AND ((?2 LIKE model AND ?3 LIKE maker) OR (?4 LIKE model AND ?5 LIKE maker))"
-           "          AND ?6 LIKE lens AND ?7 BETWEEN iso_min AND iso_max"
-           "          AND ?8 BETWEEN exposure_min AND exposure_max"
-           "          AND ?9 BETWEEN aperture_min AND aperture_max"
-           "          AND ?10 BETWEEN focal_length_min AND focal_length_max"
-           "          AND (format = 0 OR (format&?11 != 0 AND ~format&?12 != 0)))"
-           "        OR (name = ?13))"
-           "   AND operation NOT IN"
-           "        ('ioporder', 'metadata', 'modulegroups', 'export', 'tagging', 'collect', '%s')"
-           " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
-           preset_table[legacy],
-           is_display_referred?"":"basecurve");
-  // query for all modules at once:
-  sqlite3_stmt *stmt;
+  const gboolean legacy = (image->flags & DT_IMAGE_NO_LEGACY_PRESETS) ? FALSE : TRUE;
   const char *workflow_preset = has_matrix && is_display_referred
                                 ? _("display-referred default")
                                 : (has_matrix && is_scene_referred
@@ -1517,23 +1624,20 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
   if(dt_image_monochrome_flags(image)) excluded |= FOR_NOT_MONO;
   else excluded |= FOR_NOT_COLOR;
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, image->exif_model, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, image->exif_maker, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, image->camera_alias, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, image->camera_maker, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 6, image->exif_lens, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, fmaxf(0.0f, fminf(1000000, image->exif_exposure)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, fmaxf(0.0f, fminf(1000000, image->exif_aperture)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, fmaxf(0.0f, fminf(1000000, image->exif_focal_length)));
-  // 0: dontcare, 1: ldr, 2: raw plus monochrome & color
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 11, iformat);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 12, excluded);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 13, workflow_preset, -1, SQLITE_TRANSIENT);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  const dt_presets_image_t preset_image = { .model = image->exif_model,
+                                            .maker = image->exif_maker,
+                                            .camera_alias = image->camera_alias,
+                                            .camera_maker = image->camera_maker,
+                                            .lens = image->exif_lens,
+                                            .iso = fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso)),
+                                            .exposure = fmaxf(0.0f, fminf(1000000, image->exif_exposure)),
+                                            .aperture = fmaxf(0.0f, fminf(1000000, image->exif_aperture)),
+                                            .focal_length = fmaxf(0.0f, fminf(1000000, image->exif_focal_length)),
+                                            .format = iformat,
+                                            .excluded = excluded };
+  const char *exclude[] = { "ioporder", "metadata", "modulegroups", "export", "tagging", "collect",
+                            is_display_referred ? "" : "basecurve", NULL };
+  dt_presets_autoapply_to_history(imgid, &preset_image, legacy, workflow_preset, exclude);
 
   // now we want to auto-apply the iop-order list if one corresponds and none are
   // still applied. Note that we can already have an iop-order list set when
@@ -1541,40 +1645,15 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
 
   if(!dt_ioppr_has_iop_order_list(imgid))
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT op_params"
-                                " FROM data.presets"
-                                " WHERE autoapply=1"
-                                "       AND ((?2 LIKE model AND ?3 LIKE maker) OR (?4 LIKE model AND ?5 LIKE maker))"
-                                "       AND ?6 LIKE lens AND ?7 BETWEEN iso_min AND iso_max"
-                                "       AND ?8 BETWEEN exposure_min AND exposure_max"
-                                "       AND ?9 BETWEEN aperture_min AND aperture_max"
-                                "       AND ?10 BETWEEN focal_length_min AND focal_length_max"
-                                "       AND (format = 0 OR (format&?11 != 0 AND ~format&?12 != 0))"
-                                "       AND operation = 'ioporder'"
-                                " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, image->exif_model, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, image->exif_maker, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, image->camera_alias, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, image->camera_maker, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 6, image->exif_lens, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso)));
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, fmaxf(0.0f, fminf(1000000, image->exif_exposure)));
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, fmaxf(0.0f, fminf(1000000, image->exif_aperture)));
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, fmaxf(0.0f, fminf(1000000, image->exif_focal_length)));
-    // 0: dontcare, 1: ldr, 2: raw plus monochrome & color
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 11, iformat);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 12, excluded);
-    if(sqlite3_step(stmt) == SQLITE_ROW)
+    void *params = NULL;
+    int32_t params_len = 0;
+    if(dt_presets_autoapply_params("ioporder", &preset_image, &params, &params_len))
     {
-      const char *params = (char *)sqlite3_column_blob(stmt, 0);
-      const int32_t params_len = sqlite3_column_bytes(stmt, 0);
       GList *iop_list = dt_ioppr_deserialize_iop_order_list(params, params_len);
       dt_ioppr_write_iop_order_list(iop_list, imgid);
       g_list_free_full(iop_list, free);
       dt_ioppr_set_default_iop_order(dev, imgid);
+      g_free(params);
     }
     else
     {
@@ -1588,7 +1667,6 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
       g_list_free_full(iop_list, free);
       dt_ioppr_set_default_iop_order(dev, imgid);
     }
-    sqlite3_finalize(stmt);
   }
 
   image->flags |= DT_IMAGE_AUTO_PRESETS_APPLIED | DT_IMAGE_NO_LEGACY_PRESETS;
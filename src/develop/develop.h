@@ -137,6 +137,21 @@ typedef struct dt_dev_proxy_exposure_t
   float (*get_black)(struct dt_iop_module_t *exp);
 } dt_dev_proxy_exposure_t;
 
+/* latency adaptive resolution of the center view: while parameters are being changed, the full pipe renders
+   at a reduced resolution chosen to keep its processing time around the target latency, and the center view
+   stretches the result. full resolution is restored once the interaction stops. */
+typedef struct dt_dev_adaptive_t
+{
+  float target;             // target latency in ms, 0 disables
+  float reduction;          // reduction factor used for the next interactive run, >= 1
+  double last_interaction;  // dt_get_wtime() of the last parameter change
+  gboolean restore_pending; // a full resolution run has been scheduled
+
+  // statistics, printed with -d perf
+  float last_delay;         // processing time of the last full pipe run in ms
+  uint32_t runs, reduced_runs, restores;
+} dt_dev_adaptive_t;
+
 struct dt_dev_pixelpipe_t;
 typedef struct dt_develop_t
 {
@@ -154,6 +169,7 @@ typedef struct dt_develop_t
   uint32_t average_delay;
   uint32_t preview_average_delay;
   uint32_t preview2_average_delay;
+  dt_dev_adaptive_t adaptive;
   struct dt_iop_module_t *gui_module; // this module claims gui expose/event callbacks.
   float preview_downsampling;         // < 1.0: optionally downsample preview
 
@@ -162,6 +178,10 @@ typedef struct dt_develop_t
 
   // image processing pipeline with caching
   struct dt_dev_pixelpipe_t *pipe, *preview_pipe, *preview2_pipe;
+  // previews of the neighbouring images, computed while idle
+  struct dt_dev_prefetch_t *prefetch;
+  // early module outputs shared between the center view and the second window
+  struct dt_dev_pixelpipe_shared_cache_t *shared_cache;
   dt_pthread_mutex_t pipe_mutex, preview_pipe_mutex,
       preview2_pipe_mutex; // these are locked while the pipes are still in use
 
@@ -348,6 +368,11 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached);
 void dt_dev_cleanup(dt_develop_t *dev);
 
 float dt_dev_get_preview_downsampling();
+
+/** a parameter has been changed interactively, let the adaptive resolution of the center view kick in */
+void dt_dev_adaptive_interaction(dt_develop_t *dev);
+/** print the statistics of the adaptive resolution controller */
+void dt_dev_adaptive_print_stats(const dt_develop_t *dev);
 void dt_dev_process_image_job(dt_develop_t *dev);
 void dt_dev_process_preview_job(dt_develop_t *dev);
 void dt_dev_process_preview2_job(dt_develop_t *dev);
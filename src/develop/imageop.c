@@ -27,6 +27,7 @@
 #include "common/interpolation.h"
 #include "common/iop_group.h"
 #include "common/module.h"
+#include "common/numa.h"
 #include "common/history.h"
 #include "common/opencl.h"
 #include "common/usermanual_url.h"
@@ -1757,6 +1758,10 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
   if(module->flags() & IOP_FLAGS_ALLOW_TILING)
     piece->process_tiling_ready = 1;
 
+  // assume a pointwise module can be fused with its neighbours, commit_params can overwrite this.
+  if(module->process_pixels)
+    piece->process_pointwise_ready = 1;
+
   if(darktable.unmuted & DT_DEBUG_PARAMS && module->so->get_introspection())
     _iop_validate_params(module->so->get_introspection()->field, params, TRUE);
 
@@ -2520,6 +2525,73 @@ int dt_iop_breakpoint(struct dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe)
   return 0;
 }
 
+gboolean dt_iop_cancelled(const dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  if(dt_atomic_get_int(&pipe->shutdown)) return TRUE;
+
+  // only the darkroom pipes get restarted with new parameters, same conditions as dt_iop_breakpoint()
+  const dt_develop_t *dev = piece->module->dev;
+  if(!dev || !dev->gui_attached) return FALSE;
+  if(pipe != dev->pipe && pipe != dev->preview_pipe && pipe != dev->preview2_pipe) return FALSE;
+  if(dev->gui_leaving || (pipe == dev->pipe && dev->image_force_reload)) return TRUE;
+
+  const dt_dev_pixelpipe_change_t changed = pipe->changed;
+  if(changed == DT_DEV_PIPE_UNCHANGED) return FALSE;
+  // zoom and pan do not change the preview buffers
+  return changed != DT_DEV_PIPE_ZOOMED || pipe == dev->pipe;
+}
+
+void dt_iop_set_incomplete(dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_atomic_set_int(&piece->incomplete, 1);
+}
+
+// cost assumed before a module has been measured, about that of a simple per pixel module
+#define DT_IOP_DEFAULT_CPU_COST 0.01f
+// least amount of work per thread to make up for waking it up, in seconds
+#define DT_IOP_MIN_THREAD_WORK 0.0005
+// regions below this size give too noisy timings to learn from, in megapixels
+#define DT_IOP_MIN_COST_SAMPLE 0.05
+
+int dt_iop_get_num_threads(const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  // an export job bound to a numa node only has the cores of that node
+  const int node_cpus = dt_numa_thread_cpus();
+  const int max_threads
+      = MAX(1, node_cpus ? MIN(node_cpus, darktable.num_openmp_threads) : darktable.num_openmp_threads);
+  if(max_threads == 1 || !piece->pipe->adaptive_threads) return max_threads;
+
+  return dt_iop_share_threads(max_threads, dt_dev_pixelpipe_count_active(), piece->module->so->cpu_cost, roi);
+}
+
+int dt_iop_share_threads(const int max_threads, const int active_pipes, const float cpu_cost,
+                         const dt_iop_roi_t *roi)
+{
+  // share the cores between the pipes running right now (center view, preview, thumbnails, export)
+  const int active = MAX(1, active_pipes);
+  const int share = MAX(1, (max_threads + active / 2) / active);
+
+  const float cost = cpu_cost > 0.0f ? cpu_cost : DT_IOP_DEFAULT_CPU_COST;
+  const double work = (double)roi->width * roi->height * 1e-6 * cost;
+  const double wanted = ceil(work / DT_IOP_MIN_THREAD_WORK);
+
+  return (int)CLAMP(wanted, 1.0, (double)share);
+}
+
+void dt_iop_update_cpu_cost(const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi, const int nthreads,
+                            const double seconds)
+{
+  const double mpix = (double)roi->width * roi->height * 1e-6;
+  if(mpix < DT_IOP_MIN_COST_SAMPLE || seconds <= 0.0) return;
+
+  // thread-seconds per megapixel. cost depends on the parameters too (radii, iterations), so follow
+  // changes with a moving average. concurrent updates from several pipes may lose a sample, that's fine.
+  dt_iop_module_so_t *so = piece->module->so;
+  const float sample = (float)(seconds * MAX(1, nthreads) / mpix);
+  so->cpu_cost = so->cpu_cost > 0.0f ? 0.8f * so->cpu_cost + 0.2f * sample : sample;
+}
+
 void dt_iop_nap(int32_t usec)
 {
   if(usec <= 0) return;
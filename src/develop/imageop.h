@@ -104,7 +104,9 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_NO_MASKS           = 1 << 10, // The module doesn't support masks (used with SUPPORT_BLENDING)
   IOP_FLAGS_FENCE              = 1 << 11, // No module can be moved pass this one
   IOP_FLAGS_ALLOW_FAST_PIPE    = 1 << 12, // Module can work with a fast pipe
-  IOP_FLAGS_UNSAFE_COPY        = 1 << 13  // Unsafe to copy as part of history
+  IOP_FLAGS_UNSAFE_COPY        = 1 << 13, // Unsafe to copy as part of history
+  IOP_FLAGS_TILING_CONCURRENT  = 1 << 14, // process() is reentrant and may run on several tiles at the same time
+  IOP_FLAGS_GUI_STATE          = 1 << 15  // process() on the full pipe updates the gui or shows gui state
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -167,6 +169,9 @@ typedef struct dt_iop_module_so_t
   GtkWidget *widget;
   /** button used to show/hide this module in the plugin list. */
   dt_iop_module_state_t state;
+  /** measured cost of process() on the CPU in thread-seconds per megapixel, 0 while unknown. shared by all
+   * instances and pipes, see dt_iop_get_num_threads(). */
+  float cpu_cost;
 
   void (*process_plain)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                       const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
@@ -387,6 +392,25 @@ void dt_iop_cleanup_histogram(gpointer data, gpointer user_data);
 /** let plugins have breakpoints: */
 int dt_iop_breakpoint(struct dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe);
 
+/** cancellation token for long running process() implementations: returns TRUE once the result of the
+    current run of the pipe is going to be thrown away (shutdown, or parameters changed in darkroom).
+    cheap enough to be polled once per block of rows. a module which then skips part of its work must say so
+    with dt_iop_set_incomplete(), a complete output is kept even if the pipe restarts. */
+gboolean dt_iop_cancelled(const struct dt_dev_pixelpipe_iop_t *piece);
+/** tells the pipe that process() skipped part of the output after dt_iop_cancelled(), so it is not cached */
+void dt_iop_set_incomplete(struct dt_dev_pixelpipe_iop_t *piece);
+
+/** number of openmp threads worth using for one invocation of this piece on roi: few pixels or a cheap module
+    do not amortize the fork/join of a large team, and pipes running at the same time share the cores. */
+int dt_iop_get_num_threads(const struct dt_dev_pixelpipe_iop_t *piece, const struct dt_iop_roi_t *roi);
+/** the adaptive part of dt_iop_get_num_threads(): threads for roi out of max_threads shared by active_pipes,
+    at cpu_cost thread-seconds per megapixel (0 while unknown). between 1 and the share of the pipe. */
+int dt_iop_share_threads(const int max_threads, const int active_pipes, const float cpu_cost,
+                         const struct dt_iop_roi_t *roi);
+/** feed the wall time of a process() call with nthreads threads back into dt_iop_get_num_threads() */
+void dt_iop_update_cpu_cost(const struct dt_dev_pixelpipe_iop_t *piece, const struct dt_iop_roi_t *roi,
+                            const int nthreads, const double seconds);
+
 /** allow plugins to relinquish CPU and go to sleep for some time */
 void dt_iop_nap(int32_t usec);
 
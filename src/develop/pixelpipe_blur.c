@@ -0,0 +1,110 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_blur.h"
+#include "common/bilateral.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe_cache.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <string.h>
+
+static inline uint64_t _hash_bytes(uint64_t hash, const void *data, const size_t size)
+{
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+uint64_t dt_dev_pixelpipe_blur_key(dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi, const char *what,
+                                   const void *params, const size_t size)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  if(!pipe->blur_cache) return 0;
+
+  // the input of the module, as it comes out of the pipe's own cache
+  uint64_t hash = dt_dev_pixelpipe_cache_basichash_prior(pipe->image.id, pipe, piece->module);
+  hash = dt_dev_pixelpipe_shared_cache_hash(pipe, hash);
+  hash = _hash_bytes(hash, roi, sizeof(dt_iop_roi_t));
+  hash = _hash_bytes(hash, what, strlen(what));
+  return _hash_bytes(hash, params, size);
+}
+
+gboolean dt_dev_pixelpipe_blur_get(dt_dev_pixelpipe_iop_t *piece, const uint64_t key, float *const out,
+                                   const size_t size)
+{
+  dt_dev_pixelpipe_shared_cache_t *cache = piece->pipe->blur_cache;
+  dt_iop_buffer_dsc_t dsc;
+  return cache && !dt_dev_pixelpipe_shared_cache_copy(cache, key, out, size, &dsc);
+}
+
+void dt_dev_pixelpipe_blur_put(dt_dev_pixelpipe_iop_t *piece, const uint64_t key, const float *const out,
+                               const size_t size)
+{
+  dt_dev_pixelpipe_shared_cache_t *cache = piece->pipe->blur_cache;
+  // the lines are plain float buffers, the format of the pipe's buffers doesn't matter for them
+  if(cache) dt_dev_pixelpipe_shared_cache_put(cache, key, out, size, &piece->dsc_in);
+}
+
+gboolean dt_dev_pixelpipe_blur_gaussian_4c(dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi,
+                                           const float *const in, float *const out, const float *const max,
+                                           const float *const min, const float sigma,
+                                           const dt_gaussian_order_t order)
+{
+  const struct
+  {
+    float max[4], min[4];
+    float sigma;
+    int order;
+  } params = { { max[0], max[1], max[2], max[3] }, { min[0], min[1], min[2], min[3] }, sigma, order };
+  const size_t size = sizeof(float) * 4 * roi->width * roi->height;
+  const uint64_t key = dt_dev_pixelpipe_blur_key(piece, roi, "gaussian", &params, sizeof(params));
+  if(dt_dev_pixelpipe_blur_get(piece, key, out, size)) return TRUE;
+
+  dt_gaussian_t *g = dt_gaussian_init(roi->width, roi->height, 4, max, min, sigma, order);
+  if(!g) return FALSE;
+  dt_gaussian_blur_4c(g, in, out);
+  dt_gaussian_free(g);
+
+  dt_dev_pixelpipe_blur_put(piece, key, out, size);
+  return TRUE;
+}
+
+gboolean dt_dev_pixelpipe_blur_bilateral(dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi,
+                                         const float *const in, float *const out, const float sigma_s,
+                                         const float sigma_r)
+{
+  const float params[2] = { sigma_s, sigma_r };
+  const size_t size = sizeof(float) * 4 * roi->width * roi->height;
+  const uint64_t key = dt_dev_pixelpipe_blur_key(piece, roi, "bilateral", params, sizeof(params));
+  if(dt_dev_pixelpipe_blur_get(piece, key, out, size)) return TRUE;
+
+  dt_bilateral_t *b = dt_bilateral_init(roi->width, roi->height, sigma_s, sigma_r);
+  if(!b) return FALSE;
+  dt_bilateral_splat(b, in);
+  dt_bilateral_blur(b);
+  dt_bilateral_slice(b, in, out, -1.0f);
+  dt_bilateral_free(b);
+
+  dt_dev_pixelpipe_blur_put(piece, key, out, size);
+  return TRUE;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
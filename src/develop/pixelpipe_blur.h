@@ -0,0 +1,64 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/gaussian.h"
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_iop_t;
+struct dt_iop_roi_t;
+
+/**
+ * blurs of module inputs, kept in a small cache of the darkroom pipes. modules like shadows and highlights
+ * or soften spend most of their time blurring their input, which doesn't change while only their blending
+ * parameters are being tuned, so the blur is looked up by the hash of the module's input, the region of
+ * interest and everything that goes into the blur. the input of each module in the pipe is different, so
+ * a blur is only ever found again by the module which put it.
+ *
+ * other pipes (export, thumbnails) don't have the cache, there the functions below just blur.
+ */
+
+/** key of a blur of the input of the piece in the given roi. what names the kind of blur or how the blurred
+    buffer is derived from the input, params holds all parameters of both. */
+uint64_t dt_dev_pixelpipe_blur_key(struct dt_dev_pixelpipe_iop_t *piece, const struct dt_iop_roi_t *const roi,
+                                   const char *what, const void *params, const size_t size);
+/** copies a cached blur to out. returns FALSE if there is none, then the caller has to compute it. */
+gboolean dt_dev_pixelpipe_blur_get(struct dt_dev_pixelpipe_iop_t *piece, const uint64_t key, float *const out,
+                                   const size_t size);
+/** stores a copy of the blur in out for later runs */
+void dt_dev_pixelpipe_blur_put(struct dt_dev_pixelpipe_iop_t *piece, const uint64_t key, const float *const out,
+                               const size_t size);
+
+/** dt_gaussian_blur_4c() of the input of the piece. returns FALSE if the blur could not be set up. */
+gboolean dt_dev_pixelpipe_blur_gaussian_4c(struct dt_dev_pixelpipe_iop_t *piece,
+                                           const struct dt_iop_roi_t *const roi, const float *const in,
+                                           float *const out, const float *const max, const float *const min,
+                                           const float sigma, const dt_gaussian_order_t order);
+/** the base layer (detail = -1) of the bilateral filter of the Lab input of the piece. returns FALSE if
+    the filter could not be set up. */
+gboolean dt_dev_pixelpipe_blur_bilateral(struct dt_dev_pixelpipe_iop_t *piece,
+                                         const struct dt_iop_roi_t *const roi, const float *const in,
+                                         float *const out, const float sigma_s, const float sigma_r);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -17,6 +17,7 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/numa.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
@@ -50,6 +51,7 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
     if(size)
     { // allow 0 initial buffer size (yet unknown dimensions)
       cache->data[k] = (void *)dt_alloc_align(64, size);
+      dt_numa_first_touch(darktable.numa, cache->data[k], size);
       if(!cache->data[k]) goto alloc_memory_fail;
 #ifdef _DEBUG
       memset(cache->data[k], 0x5d, size);
@@ -222,6 +224,7 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
     {
       dt_free_align(cache->data[max]);
       cache->data[max] = (void *)dt_alloc_align(64, size);
+      dt_numa_first_touch(darktable.numa, cache->data[max], size);
       cache->size[max] = size;
     }
     *data = cache->data[max];
@@ -303,6 +306,181 @@ void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
 }
 
+typedef struct dt_dev_pixelpipe_shared_line_t
+{
+  uint64_t hash;
+  void *data;
+  size_t size;
+  dt_iop_buffer_dsc_t dsc;
+  int users;      // pipes copying from this line right now
+  gboolean dead;  // flushed while in use, the last user frees it
+} dt_dev_pixelpipe_shared_line_t;
+
+static void _shared_line_free(dt_dev_pixelpipe_shared_cache_t *cache, dt_dev_pixelpipe_shared_line_t *line)
+{
+  cache->memory -= line->size;
+  dt_free_align(line->data);
+  free(line);
+}
+
+// returns the line with the given hash and makes it the most recently used one. call with the lock held.
+static dt_dev_pixelpipe_shared_line_t *_shared_line_find(dt_dev_pixelpipe_shared_cache_t *cache,
+                                                         const uint64_t hash)
+{
+  for(GList *l = cache->lines; l; l = g_list_next(l))
+  {
+    dt_dev_pixelpipe_shared_line_t *line = (dt_dev_pixelpipe_shared_line_t *)l->data;
+    if(line->hash != hash) continue;
+    if(l != cache->lines)
+    {
+      cache->lines = g_list_remove_link(cache->lines, l);
+      cache->lines = g_list_concat(l, cache->lines);
+    }
+    return line;
+  }
+  return NULL;
+}
+
+dt_dev_pixelpipe_shared_cache_t *dt_dev_pixelpipe_shared_cache_new(const size_t limit)
+{
+  dt_dev_pixelpipe_shared_cache_t *cache
+      = (dt_dev_pixelpipe_shared_cache_t *)calloc(1, sizeof(dt_dev_pixelpipe_shared_cache_t));
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->limit = limit;
+  return cache;
+}
+
+void dt_dev_pixelpipe_shared_cache_free(dt_dev_pixelpipe_shared_cache_t *cache)
+{
+  if(!cache) return;
+  // all pipes are gone by now, so there are no users left
+  dt_dev_pixelpipe_shared_cache_flush(cache);
+  dt_pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+void dt_dev_pixelpipe_shared_cache_flush(dt_dev_pixelpipe_shared_cache_t *cache)
+{
+  if(!cache) return;
+  dt_pthread_mutex_lock(&cache->lock);
+  for(GList *l = cache->lines; l; l = g_list_next(l))
+  {
+    dt_dev_pixelpipe_shared_line_t *line = (dt_dev_pixelpipe_shared_line_t *)l->data;
+    if(line->users)
+      line->dead = TRUE;
+    else
+      _shared_line_free(cache, line);
+  }
+  g_list_free(cache->lines);
+  cache->lines = NULL;
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+uint64_t dt_dev_pixelpipe_shared_cache_hash(struct dt_dev_pixelpipe_t *pipe, const uint64_t hash)
+{
+  // the second window processes its input exactly like the center view, other pipes do not
+  const int type = (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) ? DT_DEV_PIXELPIPE_FULL
+                                                           : (pipe->type & DT_DEV_PIXELPIPE_ANY);
+  const struct
+  {
+    int type, iwidth, iheight;
+    float iscale;
+  } input = { type, pipe->iwidth, pipe->iheight, pipe->iscale };
+
+  uint64_t shared_hash = hash;
+  const char *str = (const char *)&input;
+  for(size_t i = 0; i < sizeof(input); i++) shared_hash = ((shared_hash << 5) + shared_hash) ^ str[i];
+  return shared_hash;
+}
+
+int dt_dev_pixelpipe_shared_cache_available(dt_dev_pixelpipe_shared_cache_t *cache, const uint64_t hash)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  int available = 0;
+  for(GList *l = cache->lines; l && !available; l = g_list_next(l))
+    available = ((dt_dev_pixelpipe_shared_line_t *)l->data)->hash == hash;
+  dt_pthread_mutex_unlock(&cache->lock);
+  return available;
+}
+
+int dt_dev_pixelpipe_shared_cache_copy(dt_dev_pixelpipe_shared_cache_t *cache, const uint64_t hash,
+                                       void *data, const size_t size, dt_iop_buffer_dsc_t *dsc)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->queries++;
+  dt_dev_pixelpipe_shared_line_t *line = _shared_line_find(cache, hash);
+  if(!line || line->size != size)
+  {
+    dt_pthread_mutex_unlock(&cache->lock);
+    return 1;
+  }
+  line->users++;
+  cache->hits++;
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  // the line can't be dropped while we are using it, so copy without holding the lock
+  memcpy(data, line->data, size);
+  *dsc = line->dsc;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  line->users--;
+  if(line->dead && !line->users) _shared_line_free(cache, line);
+  dt_pthread_mutex_unlock(&cache->lock);
+  return 0;
+}
+
+void dt_dev_pixelpipe_shared_cache_put(dt_dev_pixelpipe_shared_cache_t *cache, const uint64_t hash,
+                                       const void *data, const size_t size, const dt_iop_buffer_dsc_t *dsc)
+{
+  if(size > cache->limit) return;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  if(_shared_line_find(cache, hash))
+  {
+    // the other pipe was first
+    dt_pthread_mutex_unlock(&cache->lock);
+    return;
+  }
+  // make room, starting with the least recently used lines
+  GList *l = g_list_last(cache->lines);
+  while(l && cache->memory + size > cache->limit)
+  {
+    GList *prev = g_list_previous(l);
+    dt_dev_pixelpipe_shared_line_t *line = (dt_dev_pixelpipe_shared_line_t *)l->data;
+    if(!line->users)
+    {
+      _shared_line_free(cache, line);
+      cache->lines = g_list_delete_link(cache->lines, l);
+    }
+    l = prev;
+  }
+  const gboolean fits = cache->memory + size <= cache->limit;
+  // reserve the memory before letting go of the lock
+  if(fits) cache->memory += size;
+  dt_pthread_mutex_unlock(&cache->lock);
+  if(!fits) return;
+
+  dt_dev_pixelpipe_shared_line_t *line
+      = (dt_dev_pixelpipe_shared_line_t *)calloc(1, sizeof(dt_dev_pixelpipe_shared_line_t));
+  line->data = dt_alloc_align(64, size);
+  if(!line->data)
+  {
+    dt_pthread_mutex_lock(&cache->lock);
+    cache->memory -= size;
+    dt_pthread_mutex_unlock(&cache->lock);
+    free(line);
+    return;
+  }
+  memcpy(line->data, data, size);
+  line->hash = hash;
+  line->size = size;
+  line->dsc = *dsc;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->lines = g_list_prepend(cache->lines, line);
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include "common/dtpthread.h"
+
+#include <glib.h>
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
@@ -95,6 +98,42 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
+/**
+ * cache lines shared between the pixelpipes of one darkroom. the center view and the second window both
+ * process the full resolution raw, and up to demosaic usually with the same region of interest, so each of
+ * them publishes the output of these early modules here and the other one copies it instead of processing
+ * the module again. unlike the cache above it is thread safe, and the memory it keeps is bounded: least
+ * recently used lines are dropped first.
+ */
+typedef struct dt_dev_pixelpipe_shared_cache_t
+{
+  dt_pthread_mutex_t lock;
+  GList *lines;     // of dt_dev_pixelpipe_shared_line_t, most recently used first
+  size_t memory;    // bytes held by the lines
+  size_t limit;     // memory budget in bytes
+  // profiling:
+  uint64_t queries;
+  uint64_t hits;
+} dt_dev_pixelpipe_shared_cache_t;
+
+dt_dev_pixelpipe_shared_cache_t *dt_dev_pixelpipe_shared_cache_new(const size_t limit);
+void dt_dev_pixelpipe_shared_cache_free(dt_dev_pixelpipe_shared_cache_t *cache);
+/** drops all lines which are not being read right now */
+void dt_dev_pixelpipe_shared_cache_flush(dt_dev_pixelpipe_shared_cache_t *cache);
+
+/** extends a hash from dt_dev_pixelpipe_cache_fullhash() by what makes the pipe's input and processing
+    differ from those of other pipes */
+uint64_t dt_dev_pixelpipe_shared_cache_hash(struct dt_dev_pixelpipe_t *pipe, const uint64_t hash);
+/** test availability of a line */
+int dt_dev_pixelpipe_shared_cache_available(dt_dev_pixelpipe_shared_cache_t *cache, const uint64_t hash);
+/** copies the line with the given hash to data and dsc. returns non-zero if it is not there (any more). */
+int dt_dev_pixelpipe_shared_cache_copy(dt_dev_pixelpipe_shared_cache_t *cache, const uint64_t hash,
+                                       void *data, const size_t size, struct dt_iop_buffer_dsc_t *dsc);
+/** stores a copy of data under the given hash, if it fits into the memory budget */
+void dt_dev_pixelpipe_shared_cache_put(dt_dev_pixelpipe_shared_cache_t *cache, const uint64_t hash,
+                                       const void *data, const size_t size,
+                                       const struct dt_iop_buffer_dsc_t *dsc);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -132,11 +132,21 @@ int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t
   return res;
 }
 
+static void _init_blur_cache(dt_dev_pixelpipe_t *pipe)
+{
+  // each of the three darkroom pipes has its own, together they stay within 3/8 of the host memory limit
+  size_t size = MAX(0, dt_conf_get_int("pixelpipe_blur_cache_size"));
+  const int limit = dt_conf_get_int("host_memory_limit");
+  if(limit > 0) size = MIN(size, (size_t)limit / 8);
+  if(size) pipe->blur_cache = dt_dev_pixelpipe_shared_cache_new(size << 20);
+}
+
 int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
   const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 8);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
+  _init_blur_cache(pipe);
   return res;
 }
 
@@ -145,6 +155,7 @@ int dt_dev_pixelpipe_init_preview2(dt_dev_pixelpipe_t *pipe)
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
   const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW2;
+  _init_blur_cache(pipe);
   return res;
 }
 
@@ -153,6 +164,7 @@ int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
   const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 8);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
+  _init_blur_cache(pipe);
   return res;
 }
 
@@ -163,11 +175,14 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processed_width = pipe->backbuf_width = pipe->iwidth = 0;
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
+  pipe->blur_cache = NULL;
   pipe->backbuf_size = size;
   if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
   pipe->cache_obsolete = 0;
+  dt_dev_pixelpipe_pool_init(&(pipe->pool), (size_t)MAX(0, dt_conf_get_int("pixelpipe_pool_size")) << 20);
   pipe->backbuf = NULL;
   pipe->backbuf_scale = 0.0f;
+  pipe->backbuf_reduction = 1.0f;
   pipe->backbuf_zoom_x = 0.0f;
   pipe->backbuf_zoom_y = 0.0f;
 
@@ -193,6 +208,8 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
   pipe->store_all_raster_masks = FALSE;
+  pipe->fuse_pointwise = FALSE;
+  pipe->adaptive_threads = FALSE;
   pipe->work_profile_info = NULL;
   pipe->input_profile_info = NULL;
   pipe->output_profile_info = NULL;
@@ -228,6 +245,9 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  dt_dev_pixelpipe_pool_cleanup(&(pipe->pool));
+  dt_dev_pixelpipe_shared_cache_free(pipe->blur_cache);
+  pipe->blur_cache = NULL;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -319,6 +339,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     piece->hash = 0;
     piece->process_cl_ready = 0;
     piece->process_tiling_ready = 0;
+    piece->process_pointwise_ready = 0;
     piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
     memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
     memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
@@ -512,14 +533,14 @@ static void histogram_collect_cl(int devid, dt_dev_pixelpipe_iop_t *piece, cl_me
   if(buffer && bufsize >= (size_t)roi->width * roi->height * 4 * sizeof(float))
     pixel = buffer;
   else
-    pixel = tmpbuf = dt_alloc_align_float((size_t)4 * roi->width * roi->height);
+    pixel = tmpbuf = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, (size_t)4 * roi->width * roi->height);
 
   if(!pixel) return;
 
   cl_int err = dt_opencl_copy_device_to_host(devid, pixel, img, roi->width, roi->height, sizeof(float) * 4);
   if(err != CL_SUCCESS)
   {
-    if(tmpbuf) dt_free_align(tmpbuf);
+    dt_dev_pixelpipe_pool_free(piece->pipe, tmpbuf);
     return;
   }
 
@@ -543,7 +564,7 @@ static void histogram_collect_cl(int devid, dt_dev_pixelpipe_iop_t *piece, cl_me
       piece->module->histogram_middle_grey, dt_ioppr_get_pipe_work_profile_info(piece->pipe));
   dt_histogram_max_helper(&piece->histogram_stats, cst, piece->module->histogram_cst, histogram, histogram_max);
 
-  if(tmpbuf) dt_free_align(tmpbuf);
+  dt_dev_pixelpipe_pool_free(piece->pipe, tmpbuf);
 }
 #endif
 
@@ -703,7 +724,7 @@ static void pixelpipe_picker_cl(int devid, dt_iop_module_t *module, dt_dev_pixel
   if(buffer && bufsize >= size * bpp)
     pixel = buffer;
   else
-    pixel = tmpbuf = dt_alloc_align(64, size * bpp);
+    pixel = tmpbuf = dt_dev_pixelpipe_pool_alloc(piece->pipe, size * bpp);
 
   if(pixel == NULL) return;
 
@@ -739,119 +760,102 @@ static void pixelpipe_picker_cl(int devid, dt_iop_module_t *module, dt_dev_pixel
   }
 
 error:
-  dt_free_align(tmpbuf);
+  dt_dev_pixelpipe_pool_free(piece->pipe, tmpbuf);
 }
 #endif
 
-static void _pixelpipe_pick_from_image(const float *const pixel, const dt_iop_roi_t *roi_in,
-                                       cmsHTRANSFORM xform_rgb2lab, cmsHTRANSFORM xform_rgb2rgb,
-                                       const float *const pick_box, const float *const pick_point,
-                                       const int pick_size, float *pick_color_rgb_min, float *pick_color_rgb_max,
-                                       float *pick_color_rgb_mean, float *pick_color_lab_min,
-                                       float *pick_color_lab_max, float *pick_color_lab_mean)
+// a color picked from the output of gamma, for the primary colorpicker or a live sample
+typedef struct dt_pixelpipe_pick_t
 {
-  float picked_color_rgb_min[3] = { 0.0f };
-  float picked_color_rgb_max[3] = { 0.0f };
-  float picked_color_rgb_mean[3] = { 0.0f };
-
-  for(int k = 0; k < 3; k++) picked_color_rgb_min[k] = FLT_MAX;
-  for(int k = 0; k < 3; k++) picked_color_rgb_max[k] = FLT_MIN;
-
-  int box[4] = { 0 };
-  int point[2] = { 0 };
-
-  for(int k = 0; k < 4; k += 2)
-    box[k] = MIN(roi_in->width - 1, MAX(0, pick_box[k] * roi_in->width));
-  for(int k = 1; k < 4; k += 2)
-    box[k] = MIN(roi_in->height - 1, MAX(0, pick_box[k] * roi_in->height));
-  point[0] = MIN(roi_in->width - 1, MAX(0, pick_point[0] * roi_in->width));
-  point[1] = MIN(roi_in->height - 1, MAX(0, pick_point[1] * roi_in->height));
+  dt_color_picker_box_t stats;
+  float *rgb[3]; // mean, min, max
+  float *lab[3];
+} dt_pixelpipe_pick_t;
+
+// converted colors of the boxes picked last. the samples are picked again on every update of the preview
+// pipe, mostly from the same input when only some of them moved, so only the new boxes need a pass.
+typedef struct dt_pixelpipe_pick_cache_t
+{
+  int box[4];
+  float rgb[9];
+  float lab[9];
+  gboolean has_lab;
+} dt_pixelpipe_pick_cache_t;
 
-  float rgb[3] = { 0.0f };
+static uint64_t _pick_cache_hash = 0;
+static GArray *_pick_cache = NULL;
 
-  const float w = 1.0 / ((box[3] - box[1] + 1) * (box[2] - box[0] + 1));
+static uint64_t _pick_hash_string(uint64_t hash, const char *str)
+{
+  for(; str && *str; str++) hash = ((hash << 5) + hash) ^ *str;
+  return ((hash << 5) + hash) ^ 0xff;
+}
 
+static void _pixelpipe_pick_add(GArray *picks, const dt_iop_roi_t *roi_in, const float *const pick_box,
+                                const float *const pick_point, const int pick_size, float *rgb_mean,
+                                float *rgb_min, float *rgb_max, float *lab_mean, float *lab_min, float *lab_max)
+{
+  dt_pixelpipe_pick_t pick = { .rgb = { rgb_mean, rgb_min, rgb_max }, .lab = { lab_mean, lab_min, lab_max } };
+  int *const box = pick.stats.box;
   if(pick_size == DT_COLORPICKER_SIZE_BOX)
   {
-    for(int j = box[1]; j <= box[3]; j++)
-      for(int i = box[0]; i <= box[2]; i++)
-      {
-        for(int k = 0; k < 3; k++)
-        {
-          picked_color_rgb_min[k]
-              = MIN(picked_color_rgb_min[k], pixel[4 * (roi_in->width * j + i) + k]);
-          picked_color_rgb_max[k]
-              = MAX(picked_color_rgb_max[k], pixel[4 * (roi_in->width * j + i) + k]);
-          rgb[k] += w * pixel[4 * (roi_in->width * j + i) + k];
-        }
-      }
-    for(int k = 0; k < 3; k++) picked_color_rgb_mean[k] = rgb[k];
+    for(int k = 0; k < 4; k += 2) box[k] = MIN(roi_in->width - 1, MAX(0, pick_box[k] * roi_in->width));
+    for(int k = 1; k < 4; k += 2) box[k] = MIN(roi_in->height - 1, MAX(0, pick_box[k] * roi_in->height));
   }
   else
   {
-    for(int i = 0; i < 3; i++)
-      picked_color_rgb_mean[i] = picked_color_rgb_min[i]
-          = picked_color_rgb_max[i] = pixel[4 * (roi_in->width * point[1] + point[0]) + i];
+    box[0] = box[2] = MIN(roi_in->width - 1, MAX(0, pick_point[0] * roi_in->width));
+    box[1] = box[3] = MIN(roi_in->height - 1, MAX(0, pick_point[1] * roi_in->height));
   }
+  g_array_append_val(picks, pick);
+}
 
-  // Converting the display RGB values to histogram RGB
-  if(xform_rgb2rgb)
-  {
-    // Preparing the data for transformation
-    float rgb_ddata[9] = { 0.0f };
+static void _pixelpipe_pick_set(const dt_pixelpipe_pick_t *const pick, const dt_pixelpipe_pick_cache_t *const c)
+{
+  for(int n = 0; n < 3; n++)
     for(int i = 0; i < 3; i++)
     {
-      rgb_ddata[i] = picked_color_rgb_mean[i];
-      rgb_ddata[i + 3] = picked_color_rgb_min[i];
-      rgb_ddata[i + 6] = picked_color_rgb_max[i];
+      pick->rgb[n][i] = c->rgb[3 * n + i];
+      if(c->has_lab) pick->lab[n][i] = c->lab[3 * n + i];
     }
+}
 
-    float rgb_odata[9] = { 0.0f };
-    cmsDoTransform(xform_rgb2rgb, rgb_ddata, rgb_odata, 3);
-
-    for(int i = 0; i < 3; i++)
+// picks the primary colorpicker and the live samples from the display rgb input of gamma in one pass over
+// the image, and converts them to the histogram profile and to Lab
+static void _pixelpipe_pick_samples(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const float *const input,
+                                    const dt_iop_roi_t *roi_in, const int pos, const gboolean live_samples,
+                                    const gboolean primary)
+{
+  GArray *picks = g_array_new(FALSE, FALSE, sizeof(dt_pixelpipe_pick_t));
+  if(live_samples)
+  {
+    for(GSList *samples = darktable.lib->proxy.colorpicker.live_samples; samples; samples = g_slist_next(samples))
     {
-      pick_color_rgb_mean[i] = rgb_odata[i];
-      pick_color_rgb_min[i] = rgb_odata[i + 3];
-      pick_color_rgb_max[i] = rgb_odata[i + 6];
+      dt_colorpicker_sample_t *sample = samples->data;
+      if(sample->locked) continue;
+
+      _pixelpipe_pick_add(picks, roi_in, sample->box, sample->point, sample->size,
+                          sample->picked_color_rgb_mean, sample->picked_color_rgb_min,
+                          sample->picked_color_rgb_max, sample->picked_color_lab_mean,
+                          sample->picked_color_lab_min, sample->picked_color_lab_max);
     }
   }
-  else
+  if(primary)
   {
-    for(int i = 0; i < 3; i++)
-    {
-      pick_color_rgb_mean[i] = picked_color_rgb_mean[i];
-      pick_color_rgb_min[i] = picked_color_rgb_min[i];
-      pick_color_rgb_max[i] = picked_color_rgb_max[i];
-    }
+    _pixelpipe_pick_add(picks, roi_in, dev->gui_module->color_picker_box, dev->gui_module->color_picker_point,
+                        darktable.lib->proxy.colorpicker.size, darktable.lib->proxy.colorpicker.picked_color_rgb_mean,
+                        darktable.lib->proxy.colorpicker.picked_color_rgb_min,
+                        darktable.lib->proxy.colorpicker.picked_color_rgb_max,
+                        darktable.lib->proxy.colorpicker.picked_color_lab_mean,
+                        darktable.lib->proxy.colorpicker.picked_color_lab_min,
+                        darktable.lib->proxy.colorpicker.picked_color_lab_max);
   }
-
-  // Converting the RGB values to Lab
-  if(xform_rgb2lab)
+  if(picks->len == 0)
   {
-    // Preparing the data for transformation
-    float rgb_data[9] = { 0.0f };
-    for(int i = 0; i < 3; i++)
-    {
-      rgb_data[i] = picked_color_rgb_mean[i];
-      rgb_data[i + 3] = picked_color_rgb_min[i];
-      rgb_data[i + 6] = picked_color_rgb_max[i];
-    }
-
-    float Lab_data[9] = { 0.0f };
-    cmsDoTransform(xform_rgb2lab, rgb_data, Lab_data, 3);
-
-    for(int i = 0; i < 3; i++)
-    {
-      pick_color_lab_mean[i] = Lab_data[i];
-      pick_color_lab_min[i] = Lab_data[i + 3];
-      pick_color_lab_max[i] = Lab_data[i + 6];
-    }
+    g_array_free(picks, TRUE);
+    return;
   }
-}
 
-static void _pixelpipe_pick_live_samples(const float *const input, const dt_iop_roi_t *roi_in)
-{
   cmsHPROFILE display_profile = NULL;
   cmsHPROFILE histogram_profile = NULL;
   cmsHPROFILE lab_profile = NULL;
@@ -864,8 +868,55 @@ static void _pixelpipe_pick_live_samples(const float *const input, const dt_iop_
   dt_ioppr_get_histogram_profile_type(&histogram_type, &histogram_filename);
   if(histogram_filename == NULL) histogram_filename = _histogram_filename;
 
-  if(darktable.color_profiles->display_type == DT_COLORSPACE_DISPLAY || histogram_type == DT_COLORSPACE_DISPLAY)
-    pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
+  const gboolean display = darktable.color_profiles->display_type == DT_COLORSPACE_DISPLAY
+                           || histogram_type == DT_COLORSPACE_DISPLAY;
+  if(display) pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
+
+  // the input and the profiles decide whether the boxes picked last are still valid
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi_in, pipe, pos - 1);
+  hash = ((hash << 5) + hash) ^ darktable.color_profiles->display_type;
+  hash = _pick_hash_string(hash, darktable.color_profiles->display_filename);
+  hash = ((hash << 5) + hash) ^ histogram_type;
+  hash = _pick_hash_string(hash, histogram_filename);
+  if(display)
+  {
+    // the system display profile changes without changing its name
+    const unsigned char *data = (const unsigned char *)darktable.color_profiles->xprofile_data;
+    for(size_t i = 0; data && i < darktable.color_profiles->xprofile_size; i++)
+      hash = ((hash << 5) + hash) ^ data[i];
+  }
+
+  // boxes picked last time are reused, the others are picked now. only the boxes asked for this time are
+  // kept for the next one.
+  GArray *cache = g_array_new(FALSE, FALSE, sizeof(dt_pixelpipe_pick_cache_t));
+  GArray *todo = g_array_new(FALSE, FALSE, sizeof(int));
+  for(int k = 0; k < picks->len; k++)
+  {
+    const dt_pixelpipe_pick_t *const pick = &g_array_index(picks, dt_pixelpipe_pick_t, k);
+    gboolean cached = FALSE;
+    for(int n = 0; _pick_cache && hash == _pick_cache_hash && n < _pick_cache->len && !cached; n++)
+    {
+      const dt_pixelpipe_pick_cache_t *const c = &g_array_index(_pick_cache, dt_pixelpipe_pick_cache_t, n);
+      if(!memcmp(c->box, pick->stats.box, sizeof(c->box)))
+      {
+        _pixelpipe_pick_set(pick, c);
+        g_array_append_val(cache, *c);
+        cached = TRUE;
+      }
+    }
+    if(!cached) g_array_append_val(todo, k);
+  }
+  if(_pick_cache) g_array_free(_pick_cache, TRUE);
+  _pick_cache = cache;
+  _pick_cache_hash = hash;
+
+  if(todo->len == 0)
+  {
+    if(display) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
+    g_array_free(todo, TRUE);
+    g_array_free(picks, TRUE);
+    return;
+  }
 
   const dt_colorspaces_color_profile_t *d_profile = dt_colorspaces_get_profile(darktable.color_profiles->display_type,
                                                        darktable.color_profiles->display_filename,
@@ -892,79 +943,50 @@ static void _pixelpipe_pick_live_samples(const float *const input, const dt_iop_
   if(display_profile && histogram_profile)
     xform_rgb2rgb = cmsCreateTransform(display_profile, TYPE_RGB_FLT, histogram_profile, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC, 0);
 
-  if(darktable.color_profiles->display_type == DT_COLORSPACE_DISPLAY || histogram_type == DT_COLORSPACE_DISPLAY)
-    pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
-
-  dt_colorpicker_sample_t *sample = NULL;
+  if(display) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
-  for(GSList *samples = darktable.lib->proxy.colorpicker.live_samples; samples; samples = g_slist_next(samples))
-  {
-    sample = samples->data;
+  // one pass for all the boxes
+  const int count = todo->len;
+  dt_color_picker_box_t *stats = malloc(sizeof(dt_color_picker_box_t) * count);
+  for(int k = 0; k < count; k++)
+    stats[k] = g_array_index(picks, dt_pixelpipe_pick_t, g_array_index(todo, int, k)).stats;
+  dt_color_picker_boxes_4ch(input, roi_in->width, stats, count);
 
-    if(sample->locked)
+  // mean, min and max of all boxes converted at once
+  float *const rgb = malloc(sizeof(float) * 9 * count);
+  float *const rgb_out = malloc(sizeof(float) * 9 * count);
+  float *const lab = calloc(9 * count, sizeof(float));
+  for(int k = 0; k < count; k++)
+    for(int i = 0; i < 3; i++)
     {
-      continue;
+      rgb[9 * k + i] = stats[k].mean[i];
+      rgb[9 * k + 3 + i] = stats[k].min[i];
+      rgb[9 * k + 6 + i] = stats[k].max[i];
     }
+  if(xform_rgb2rgb)
+    cmsDoTransform(xform_rgb2rgb, rgb, rgb_out, 3 * count);
+  else
+    memcpy(rgb_out, rgb, sizeof(float) * 9 * count);
+  if(xform_rgb2lab) cmsDoTransform(xform_rgb2lab, rgb, lab, 3 * count);
 
-    _pixelpipe_pick_from_image(input, roi_in, xform_rgb2lab, xform_rgb2rgb,
-        sample->box, sample->point, sample->size,
-        sample->picked_color_rgb_min, sample->picked_color_rgb_max, sample->picked_color_rgb_mean,
-        sample->picked_color_lab_min, sample->picked_color_lab_max, sample->picked_color_lab_mean);
-  }
-
-  if(xform_rgb2lab) cmsDeleteTransform(xform_rgb2lab);
-  if(xform_rgb2rgb) cmsDeleteTransform(xform_rgb2rgb);
-}
-
-static void _pixelpipe_pick_primary_colorpicker(dt_develop_t *dev, const float *const input, const dt_iop_roi_t *roi_in)
-{
-  cmsHPROFILE display_profile = NULL;
-  cmsHPROFILE histogram_profile = NULL;
-  cmsHPROFILE lab_profile = NULL;
-  cmsHTRANSFORM xform_rgb2lab = NULL;
-  cmsHTRANSFORM xform_rgb2rgb = NULL;
-  dt_colorspaces_color_profile_type_t histogram_type = DT_COLORSPACE_SRGB;
-  const gchar *histogram_filename = NULL;
-  const gchar _histogram_filename[1] = { 0 };
-
-  dt_ioppr_get_histogram_profile_type(&histogram_type, &histogram_filename);
-  if(histogram_filename == NULL) histogram_filename = _histogram_filename;
-
-  if(darktable.color_profiles->display_type == DT_COLORSPACE_DISPLAY || histogram_type == DT_COLORSPACE_DISPLAY)
-    pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
-
-  const dt_colorspaces_color_profile_t *d_profile = dt_colorspaces_get_profile(darktable.color_profiles->display_type,
-                                                       darktable.color_profiles->display_filename,
-                                                       DT_PROFILE_DIRECTION_OUT | DT_PROFILE_DIRECTION_DISPLAY);
-  if(d_profile) display_profile = d_profile->profile;
-
-  if((histogram_type != darktable.color_profiles->display_type)
-     || (histogram_type == DT_COLORSPACE_FILE
-         && strcmp(histogram_filename, darktable.color_profiles->display_filename)))
+  for(int k = 0; k < count; k++)
   {
-    const dt_colorspaces_color_profile_t *d_histogram = dt_colorspaces_get_profile(histogram_type,
-                                                         histogram_filename,
-                                                         DT_PROFILE_DIRECTION_OUT | DT_PROFILE_DIRECTION_DISPLAY);
-    if(d_histogram) histogram_profile = d_histogram->profile;
+    dt_pixelpipe_pick_cache_t c = { .has_lab = xform_rgb2lab != NULL };
+    memcpy(c.rgb, rgb_out + 9 * k, sizeof(c.rgb));
+    memcpy(c.lab, lab + 9 * k, sizeof(c.lab));
+    _pixelpipe_pick_set(&g_array_index(picks, dt_pixelpipe_pick_t, g_array_index(todo, int, k)), &c);
+    // keep the box as it was requested, the stats have it sorted
+    memcpy(c.box, g_array_index(picks, dt_pixelpipe_pick_t, g_array_index(todo, int, k)).stats.box,
+           sizeof(c.box));
+    g_array_append_val(_pick_cache, c);
   }
 
-  lab_profile = dt_colorspaces_get_profile(DT_COLORSPACE_LAB, "", DT_PROFILE_DIRECTION_ANY)->profile;
-
-  // display rgb --> lab
-  if(display_profile && lab_profile)
-    xform_rgb2lab = cmsCreateTransform(display_profile, TYPE_RGB_FLT, lab_profile, TYPE_Lab_FLT, INTENT_PERCEPTUAL, 0);
-
-  // display rgb --> histogram rgb
-  if(display_profile && histogram_profile)
-    xform_rgb2rgb = cmsCreateTransform(display_profile, TYPE_RGB_FLT, histogram_profile, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC, 0);
-
-  if(darktable.color_profiles->display_type == DT_COLORSPACE_DISPLAY || histogram_type == DT_COLORSPACE_DISPLAY)
-    pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
-
-  _pixelpipe_pick_from_image(input, roi_in, xform_rgb2lab, xform_rgb2rgb,
-      dev->gui_module->color_picker_box, dev->gui_module->color_picker_point, darktable.lib->proxy.colorpicker.size,
-      darktable.lib->proxy.colorpicker.picked_color_rgb_min, darktable.lib->proxy.colorpicker.picked_color_rgb_max, darktable.lib->proxy.colorpicker.picked_color_rgb_mean,
-      darktable.lib->proxy.colorpicker.picked_color_lab_min, darktable.lib->proxy.colorpicker.picked_color_lab_max, darktable.lib->proxy.colorpicker.picked_color_lab_mean);
+  free(lab);
+  free(rgb_out);
+  free(rgb);
+  free(stats);
+  g_array_free(todo, TRUE);
+  g_array_free(picks, TRUE);
 
   if(xform_rgb2lab) cmsDeleteTransform(xform_rgb2lab);
   if(xform_rgb2rgb) cmsDeleteTransform(xform_rgb2rgb);
@@ -1056,6 +1078,16 @@ static void collect_histogram_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev
   return;
 }
 
+int dt_dev_pixelpipe_discard_incomplete(dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece, void *output)
+{
+  // the module may have given up half way (see dt_iop_cancelled()), never keep such a buffer in the cache.
+  // a complete output stays, it is still valid when the pipe restarts because of a later module.
+  if(!dt_atomic_get_int(&pipe->shutdown) && !dt_atomic_get_int(&piece->incomplete)) return 0;
+
+  dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), output);
+  return 1;
+}
+
 static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
                                     float *input, dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
                                     void **output, dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
@@ -1088,6 +1120,12 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
 
   const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
   const size_t bpp = dt_iop_buffer_dsc_to_bpp(*out_format);
+  // pick the team size for this module and region, the module's parallel loops inherit it
+  const int nthreads = dt_iop_get_num_threads(piece, roi_out);
+  const int prev_threads = dt_set_team_threads(nthreads);
+  const double process_start = dt_get_wtime();
+  dt_atomic_set_int(&piece->incomplete, 0);
+
   /* process module on cpu. use tiling if needed and possible. */
   if(piece->process_tiling_ready
      && !dt_tiling_piece_fits_host_memory(MAX(roi_in->width, roi_out->width),
@@ -1105,13 +1143,15 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
     *pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
   }
 
+  const double process_time = dt_get_wtime() - process_start;
+  dt_set_team_threads(prev_threads);
+
   // and save the output colorspace
   pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
 
-  if(dt_atomic_get_int(&pipe->shutdown))
-  {
-    return 1;
-  }
+  if(dt_dev_pixelpipe_discard_incomplete(pipe, piece, *output)) return 1;
+
+  if(pipe->adaptive_threads) dt_iop_update_cpu_cost(piece, roi_out, nthreads, process_time);
 
   // Lab color picking for module
   if(_request_color_pick(pipe, dev, module))
@@ -1155,7 +1195,9 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
     return 1;
 
   /* process blending on CPU */
+  const int prev_blend_threads = dt_set_team_threads(nthreads);
   dt_develop_blend_process(module, piece, input, *output, roi_in, roi_out);
+  dt_set_team_threads(prev_blend_threads);
   *pixelpipe_flow |= (PIXELPIPE_FLOW_BLENDED_ON_CPU);
   *pixelpipe_flow &= ~(PIXELPIPE_FLOW_BLENDED_ON_GPU);
 
@@ -1166,6 +1208,239 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   return 0; //no errors
 }
 
+// the center view and the second window share the output of the modules up to demosaic while both are
+// shown: these are processed at full resolution and often with the same roi in both pipes.
+static dt_dev_pixelpipe_shared_cache_t *_shared_cache(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
+                                                      const dt_iop_module_t *module)
+{
+  if(!dev->shared_cache || !dev->second_window.second_wnd) return NULL;
+  if(pipe != dev->pipe && pipe != dev->preview2_pipe) return NULL;
+  // the mask display is not part of the hash and can differ between the two windows
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return NULL;
+  // without a module, tell if the pipe uses the shared cache at all
+  if(module && module->iop_order > dt_ioppr_get_iop_order(pipe->iop_order_list, "demosaic", 0)) return NULL;
+  return dev->shared_cache;
+}
+
+// the center view has to run modules which update their gui while processing (hotpixels, cacorrect) or show gui
+// state in their output (the dual demosaic mask) itself. the second window can still take their output.
+static gboolean _shared_cache_readable(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_module_t *module)
+{
+  return pipe != dev->pipe || !(module->flags() & IOP_FLAGS_GUI_STATE);
+}
+
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+// number of pixels handed to process_pixels() at once, small enough to stay in L2 cache
+#define DT_PIXELPIPE_POINTWISE_SPAN 2048
+
+static inline gboolean _piece_is_skipped(const dt_develop_t *dev, dt_iop_module_t *module,
+                                         const dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled
+         || (dev->gui_module && dev->gui_module->operation_tags_filter() & module->operation_tags());
+}
+
+// can this piece be evaluated per pixel as part of a fused run?
+static gboolean _piece_is_pointwise(dt_dev_pixelpipe_t *pipe, const dt_develop_t *dev, dt_iop_module_t *module,
+                                    dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+
+  if(!module->process_pixels || !piece->process_pointwise_ready || piece->colors != 4) return FALSE;
+  // blending needs the module input and output at the same time
+  if(bp && (bp->mask_mode & DEVELOP_MASK_ENABLED)) return FALSE;
+  if(piece->request_histogram & DT_REQUEST_ON) return FALSE;
+  // the focused module keeps its own cache line, so that moving a slider only re-runs this module
+  // (this also keeps color pickers and mask display out of fused runs)
+  if(dev->gui_attached && module == dev->gui_module) return FALSE;
+  if(module->input_colorspace(module, pipe, piece) != module->output_colorspace(module, pipe, piece))
+    return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  return !memcmp(&roi_in, roi, sizeof(dt_iop_roi_t));
+}
+
+void dt_dev_pixelpipe_process_pointwise(const dt_develop_t *dev, GList *first_module, GList *first_piece,
+                                        GList *last_module, const float *const in, float *const out,
+                                        const size_t npixels, const int max_threads)
+{
+  const size_t nspans = (npixels + DT_PIXELPIPE_POINTWISE_SPAN - 1) / DT_PIXELPIPE_POINTWISE_SPAN;
+  const int nthreads = (int)MIN((size_t)MAX(max_threads, 1), MAX(nspans, 1));
+#ifdef _OPENMP
+#pragma omp parallel for default(none) num_threads(nthreads) \
+  dt_omp_firstprivate(nspans, npixels, in, out, first_module, first_piece, last_module, dev) \
+  schedule(static)
+#endif
+  for(size_t s = 0; s < nspans; s++)
+  {
+    const size_t offset = s * DT_PIXELPIPE_POINTWISE_SPAN;
+    const size_t n = MIN(npixels - offset, DT_PIXELPIPE_POINTWISE_SPAN);
+    const float *span_in = in + 4 * offset;
+    float *const span_out = out + 4 * offset;
+    for(GList *m = first_module, *p = first_piece; m != last_module; m = g_list_next(m), p = g_list_next(p))
+    {
+      dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+      if(_piece_is_skipped(dev, module, piece)) continue;
+      module->process_pixels(module, piece, span_in, span_out, n);
+      // the following modules of the run work in place
+      span_in = span_out;
+    }
+  }
+}
+
+// find the run of pointwise modules ending at the given one. returns the number of modules in the run
+// and sets *prev_modules, *prev_pieces and *prev_pos to the position the input of the run comes from.
+static int _pixelpipe_pointwise_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                    GList *modules, GList *pieces, int pos,
+                                    GList **prev_modules, GList **prev_pieces, int *prev_pos)
+{
+  int count = 0;
+  dt_iop_colorspace_type_t run_cst = iop_cs_NONE;
+
+  while(modules)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+
+    if(!_piece_is_skipped(dev, module, piece))
+    {
+      if(!_piece_is_pointwise(pipe, dev, module, piece, roi)) break;
+
+      const dt_iop_colorspace_type_t cst = module->input_colorspace(module, pipe, piece);
+      if(count && cst != run_cst) break;
+      run_cst = cst;
+
+      // an intermediate result which is still in the cache is the better starting point
+      if(count)
+      {
+        uint64_t basichash = 0, hash = 0;
+        dt_dev_pixelpipe_cache_fullhash(pipe->image.id, roi, pipe, pos, &basichash, &hash);
+        if(dt_dev_pixelpipe_cache_available(&(pipe->cache), hash)) break;
+      }
+      count++;
+    }
+    modules = g_list_previous(modules);
+    pieces = g_list_previous(pieces);
+    pos--;
+  }
+
+  *prev_modules = modules;
+  *prev_pieces = pieces;
+  *prev_pos = pos;
+  return count;
+}
+
+// evaluate a run of pointwise modules in one pass: every span of pixels goes through all modules
+// of the run while it is hot in cache, and only the output of the last module is stored.
+static int _pixelpipe_process_pointwise_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                            dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                            GList *modules, GList *pieces, const uint64_t basichash,
+                                            const uint64_t hash, GList *prev_modules, GList *prev_pieces,
+                                            const int prev_pos)
+{
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out, prev_modules,
+                                  prev_pieces, prev_pos))
+    return 1;
+
+  GList *first_module = prev_modules ? g_list_next(prev_modules) : pipe->iop;
+  GList *first_piece = prev_pieces ? g_list_next(prev_pieces) : pipe->nodes;
+  GList *last_module = g_list_next(modules);
+
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+  const size_t bufsize = sizeof(float) * 4 * npixels;
+
+  // run the per-pipe bookkeeping of all modules in pipe order, as the unfused pipe would do
+  dt_iop_buffer_dsc_t dsc = *input_format;
+  gboolean transformed = FALSE;
+  gchar *run_label = NULL;
+  for(GList *m = first_module, *p = first_piece; m != last_module; m = g_list_next(m), p = g_list_next(p))
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(_piece_is_skipped(dev, module, piece)) continue;
+
+    if(!transformed)
+    {
+      // all modules of the run work in the same colorspace
+      const dt_iop_order_iccprofile_info_t *const work_profile
+          = (input_format->cst != iop_cs_RAW) ? dt_ioppr_get_pipe_work_profile_info(pipe) : NULL;
+      dt_ioppr_transform_image_colorspace(module, input, input, roi_out->width, roi_out->height,
+                                          input_format->cst, module->input_colorspace(module, pipe, piece),
+                                          &input_format->cst, work_profile);
+      dsc.cst = input_format->cst;
+      transformed = TRUE;
+    }
+
+    piece->processed_roi_in = *roi_out;
+    piece->processed_roi_out = *roi_out;
+    piece->dsc_out = piece->dsc_in = dsc;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    pipe->dsc = piece->dsc_out;
+    if(module->process_pixels_prepare) module->process_pixels_prepare(module, piece, roi_out);
+    pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+    dsc = piece->dsc_out = pipe->dsc;
+
+    gchar *module_label = dt_history_item_get_name(module);
+    gchar *label = run_label ? g_strdup_printf("%s, %s", run_label, module_label) : g_strdup(module_label);
+    g_free(run_label);
+    g_free(module_label);
+    run_label = label;
+  }
+
+  if(dt_atomic_get_int(&pipe->shutdown))
+  {
+    g_free(run_label);
+    return 1;
+  }
+
+  **out_format = dsc;
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  if(pipe->mask_display & (DT_DEV_PIXELPIPE_DISPLAY_ANY | DT_DEV_PIXELPIPE_DISPLAY_MASK))
+  {
+    // an upstream module displays its mask: pixel manipulating modules are passed through
+    memcpy(*output, input, bufsize);
+  }
+  else
+  {
+    dt_dev_pixelpipe_process_pointwise(dev, first_module, first_piece, last_module, (const float *)input,
+                                       (float *)*output, npixels,
+                                       dt_iop_get_num_threads((dt_dev_pixelpipe_iop_t *)first_piece->data,
+                                                              roi_out));
+  }
+
+  // the modules of the run can't be timed separately, share the time evenly among them
+  int fused = 0;
+  for(GList *m = first_module, *p = first_piece; m != last_module; m = g_list_next(m), p = g_list_next(p))
+    if(!_piece_is_skipped(dev, (dt_iop_module_t *)m->data, (dt_dev_pixelpipe_iop_t *)p->data)) fused++;
+  const double run_time = (dt_get_wtime() - start.clock) / MAX(fused, 1);
+  for(GList *m = first_module, *p = first_piece; m != last_module; m = g_list_next(m), p = g_list_next(p))
+    if(!_piece_is_skipped(dev, (dt_iop_module_t *)m->data, (dt_dev_pixelpipe_iop_t *)p->data))
+      ((dt_dev_pixelpipe_iop_t *)p->data)->run_time = run_time;
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "processed fused `%s' on CPU [%s]", run_label,
+                  _pipe_type_to_str(pipe->type));
+  g_free(run_label);
+
+  **out_format = pipe->dsc = dsc;
+
+  if(dt_atomic_get_int(&pipe->shutdown)) return 1;
+  return 0;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -1307,7 +1582,37 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   }
   else
   {
-    // 3b) recurse and obtain output array in &input
+    // 3b) the other darkroom pipe might have processed this module on the same input and roi already
+    dt_dev_pixelpipe_shared_cache_t *shared = _shared_cache(pipe, dev, module);
+    const uint64_t shared_hash = shared ? dt_dev_pixelpipe_shared_cache_hash(pipe, hash) : 0;
+    if(shared && _shared_cache_readable(pipe, dev, module)
+       && dt_dev_pixelpipe_shared_cache_available(shared, shared_hash))
+    {
+      (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+      if(!dt_dev_pixelpipe_shared_cache_copy(shared, shared_hash, *output, bufsize, *out_format))
+      {
+        dt_print(DT_DEBUG_DEV, "[dev_pixelpipe] took `%s' from the shared cache [%s]\n", module->op,
+                 _pipe_type_to_str(pipe->type));
+        goto post_process_collect_info;
+      }
+      // dropped in the meantime
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    }
+
+    // 3c) runs of pointwise modules are evaluated in one pass, unless they run on the GPU
+    if(pipe->fuse_pointwise && !(pipe->opencl_enabled && pipe->devid >= 0)
+       && bpp == 4 * sizeof(float)
+       && dt_tiling_piece_fits_host_memory(roi_out->width, roi_out->height, bpp, 2.0f, 0))
+    {
+      GList *prev_modules = NULL, *prev_pieces = NULL;
+      int prev_pos = 0;
+      if(_pixelpipe_pointwise_run(pipe, dev, roi_out, modules, pieces, pos, &prev_modules, &prev_pieces,
+                                  &prev_pos) > 1)
+        return _pixelpipe_process_pointwise_run(pipe, dev, output, out_format, roi_out, modules, pieces,
+                                                basichash, hash, prev_modules, prev_pieces, prev_pos);
+    }
+
+    // 3d) recurse and obtain output array in &input
 
     // get region of interest which is needed in input
     if(dt_atomic_get_int(&pipe->shutdown))
@@ -1366,6 +1671,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
     dt_times_t start;
     dt_get_times(&start);
+    const uint64_t alloc_start = dt_alloc_align_counted();
+    piece->gui_output = FALSE;
 
     dt_pixelpipe_flow_t pixelpipe_flow = (PIXELPIPE_FLOW_NONE | PIXELPIPE_FLOW_HISTOGRAM_NONE);
 
@@ -2009,6 +2316,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
                     : pixelpipe_flow & PIXELPIPE_FLOW_HISTOGRAM_ON_CPU ? "CPU" : ""));
     }
 
+    piece->run_time = dt_get_wtime() - start.clock;
+    piece->run_alloc = dt_alloc_align_counted() - alloc_start;
+
     gchar *module_label = dt_history_item_get_name(module);
     dt_show_times_f(
         &start, "[dev_pixelpipe]", "processed `%s' on %s%s%s, blended on %s [%s]", module_label,
@@ -2029,6 +2339,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // in case we get this buffer from the cache in the future, cache some stuff:
     **out_format = piece->dsc_out = pipe->dsc;
 
+    // and let the other darkroom pipe have it, unless it is on the GPU only or shows gui state
+    if(shared && *cl_mem_output == NULL && !piece->gui_output)
+      dt_dev_pixelpipe_shared_cache_put(shared, shared_hash, *output, bufsize, *out_format);
+
     if(module == darktable.develop->gui_module)
     {
       // give the input buffer to the currently focused plugin more weight.
@@ -2125,26 +2439,19 @@ post_process_collect_info:
     {
       return 1;
     }
-    // Picking RGB for the live samples and converting to Lab
-    if(dev->gui_attached && pipe == dev->preview_pipe && (strcmp(module->op, "gamma") == 0)
-       && darktable.lib->proxy.colorpicker.live_samples && input) // samples to pick
-    {
-      _pixelpipe_pick_live_samples((const float *const )input, &roi_in);
-    }
-
-    if(dt_atomic_get_int(&pipe->shutdown))
-      return 1;
-
-    // Picking RGB for primary colorpicker output and converting to Lab
+    // Picking RGB for the live samples and the primary colorpicker output and converting to Lab
     if(dev->gui_attached && pipe == dev->preview_pipe
        && (strcmp(module->op, "gamma") == 0) // only gamma provides meaningful RGB data
-       && dev->gui_module && !strcmp(dev->gui_module->op, "colorout")
-       && dev->gui_module->request_color_pick != DT_REQUEST_COLORPICK_OFF
-       && darktable.lib->proxy.colorpicker.picked_color_rgb_mean && input) // colorpicker module active
+       && input)
     {
-      _pixelpipe_pick_primary_colorpicker(dev, (const float *const )input, &roi_in);
-
-      if(module->widget) dt_control_queue_redraw_widget(module->widget);
+      const gboolean live_samples = darktable.lib->proxy.colorpicker.live_samples != NULL;
+      const gboolean primary = dev->gui_module && !strcmp(dev->gui_module->op, "colorout")
+                               && dev->gui_module->request_color_pick != DT_REQUEST_COLORPICK_OFF
+                               && darktable.lib->proxy.colorpicker.picked_color_rgb_mean; // colorpicker module active
+      if(live_samples || primary)
+        _pixelpipe_pick_samples(dev, pipe, (const float *const)input, &roi_in, pos, live_samples, primary);
+
+      if(primary && module->widget) dt_control_queue_redraw_widget(module->widget);
     }
 
     // 4) final histogram:
@@ -2163,7 +2470,7 @@ post_process_collect_info:
         // input may not be available, so we use the output from gamma
         // this may lead to some rounding errors
         // FIXME: under what circumstances would input not be available? when this iop's result is pulled in from cache?
-        float *const buf = dt_alloc_align_float((size_t)4 * roi_out->width * roi_out->height);
+        float *const buf = dt_dev_pixelpipe_pool_alloc_float(pipe, (size_t)4 * roi_out->width * roi_out->height);
         if(buf)
         {
           const uint8_t *in = (uint8_t *)(*output);
@@ -2176,7 +2483,7 @@ post_process_collect_info:
           darktable.lib->proxy.histogram.process(darktable.lib->proxy.histogram.module, buf,
                                                  roi_out->width, roi_out->height,
                                                  darktable.color_profiles->display_type, darktable.color_profiles->display_filename);
-          dt_free_align(buf);
+          dt_dev_pixelpipe_pool_free(pipe, buf);
         }
       }
       else
@@ -2284,10 +2591,38 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 }
 
 
+// pipes inside dt_dev_pixelpipe_process(), they share the cores (see dt_iop_get_num_threads())
+static dt_atomic_int _active_pipes = 0;
+
+int dt_dev_pixelpipe_count_active(void)
+{
+  return dt_atomic_get_int(&_active_pipes);
+}
+
+static int _dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width,
+                                  int height, float scale);
+
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
                              float scale)
+{
+  dt_atomic_add_int(&_active_pipes, 1);
+  const int res = _dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+  dt_atomic_sub_int(&_active_pipes, 1);
+  return res;
+}
+
+static int _dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width,
+                                  int height, float scale)
 {
   pipe->processing = 1;
+  pipe->fuse_pointwise = dt_conf_get_bool("pixelpipe_fuse_pointwise");
+  pipe->adaptive_threads = dt_conf_get_bool("omp_adaptive_threads");
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    piece->run_time = 0.0;
+    piece->run_alloc = 0;
+  }
   pipe->opencl_enabled = dt_opencl_update_settings(); // update enabled flag and profile from preferences
   pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
                                        : -1; // try to get/lock opencl resource
@@ -2303,6 +2638,19 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 
   if(pipe->devid >= 0) dt_opencl_events_reset(pipe->devid);
 
+  // page faults and scratch buffer traffic of this run, for -d perf
+  struct rusage ru_start = { 0 };
+  uint64_t pool_allocs = 0, pool_reused = 0, pool_fresh = 0;
+  if(darktable.unmuted & DT_DEBUG_PERF)
+  {
+    getrusage(RUSAGE_SELF, &ru_start);
+    dt_pthread_mutex_lock(&pipe->pool.lock);
+    pool_allocs = pipe->pool.allocs;
+    pool_reused = pipe->pool.reused;
+    pool_fresh = pipe->pool.fresh_bytes;
+    dt_pthread_mutex_unlock(&pipe->pool.lock);
+  }
+
   dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, width, height, scale };
   // printf("pixelpipe homebrew process start\n");
   if(darktable.unmuted & DT_DEBUG_DEV) dt_dev_pixelpipe_cache_print(&pipe->cache);
@@ -2320,7 +2668,13 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 restart:
 
   // check if we should obsolete caches
-  if(pipe->cache_obsolete) dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+  if(pipe->cache_obsolete)
+  {
+    dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+    dt_dev_pixelpipe_shared_cache_flush(pipe->blur_cache);
+    // the other darkroom pipe must not hand back outputs made under the old conditions either
+    if(pipe == dev->pipe || pipe == dev->preview2_pipe) dt_dev_pixelpipe_shared_cache_flush(dev->shared_cache);
+  }
   pipe->cache_obsolete = 0;
 
   // mask display off as a starting point
@@ -2420,6 +2774,34 @@ restart:
   }
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
+  if(darktable.unmuted & DT_DEBUG_PERF)
+  {
+    struct rusage ru_end = { 0 };
+    getrusage(RUSAGE_SELF, &ru_end);
+    dt_pthread_mutex_lock(&pipe->pool.lock);
+    const uint64_t allocs = pipe->pool.allocs - pool_allocs;
+    const uint64_t reused = pipe->pool.reused - pool_reused;
+    const uint64_t fresh = pipe->pool.fresh_bytes - pool_fresh;
+    const size_t retained = pipe->pool.retained;
+    const size_t peak = pipe->pool.peak;
+    dt_pthread_mutex_unlock(&pipe->pool.lock);
+    dt_print(DT_DEBUG_PERF,
+             "[dev_pixelpipe] [%s] scratch buffers: %" PRIu64 " requests, %" PRIu64 " reused, %.1f MB allocated, "
+             "%.1f MB retained, %.1f MB peak; page faults: %ld minor, %ld major (process wide)\n",
+             _pipe_type_to_str(pipe->type), allocs, reused, fresh / (1024.0 * 1024.0),
+             retained / (1024.0 * 1024.0), peak / (1024.0 * 1024.0), ru_end.ru_minflt - ru_start.ru_minflt,
+             ru_end.ru_majflt - ru_start.ru_majflt);
+    if(_shared_cache(pipe, dev, NULL))
+    {
+      dt_dev_pixelpipe_shared_cache_t *shared = dev->shared_cache;
+      dt_pthread_mutex_lock(&shared->lock);
+      dt_print(DT_DEBUG_PERF, "[dev_pixelpipe] [%s] shared cache: %" PRIu64 " of %" PRIu64
+               " queries hit, %.1f MB held\n", _pipe_type_to_str(pipe->type), shared->hits, shared->queries,
+               shared->memory / (1024.0 * 1024.0));
+      dt_pthread_mutex_unlock(&shared->lock);
+    }
+  }
+
   // printf("pixelpipe homebrew process end\n");
   pipe->processing = 0;
   return 0;
@@ -26,6 +26,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/pixelpipe_cache.h"
+#include "develop/pixelpipe_pool.h"
 
 /**
  * struct used by iop modules to connect to pixelpipe.
@@ -66,11 +67,19 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_roi_t processed_roi_in, processed_roi_out; // the actual roi that was used for processing the piece
   int process_cl_ready;       // set this to 0 in commit_params to temporarily disable the use of process_cl
   int process_tiling_ready;   // set this to 0 in commit_params to temporarily disable tiling
+  int process_pointwise_ready; // set this to 0 in commit_params to temporarily disable pointwise fusion
 
   // the following are used internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
 
   GHashTable *raster_masks; // GList* of dt_dev_pixelpipe_raster_mask_t
+
+  dt_atomic_int incomplete; // process() skipped part of its output, see dt_iop_set_incomplete()
+  gboolean gui_output;      // process() showed gui state (like a mask) in its output, which must not be shared
+
+  // profiling of the last run of the pipe, zero if the output came from the cache:
+  double run_time;   // wall time of process and blend in seconds
+  size_t run_alloc;  // bytes allocated with dt_alloc_align() meanwhile, only counted in darktable-bench
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -93,6 +102,10 @@ typedef struct dt_dev_pixelpipe_t
 {
   // store history/zoom caches
   dt_dev_pixelpipe_cache_t cache;
+  // scratch buffers reused across modules and runs
+  dt_dev_pixelpipe_pool_t pool;
+  // blurs of module inputs, only for the darkroom pipes. see develop/pixelpipe_blur.h
+  struct dt_dev_pixelpipe_shared_cache_t *blur_cache;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
   // input buffer
@@ -124,6 +137,8 @@ typedef struct dt_dev_pixelpipe_t
   size_t backbuf_size;
   int backbuf_width, backbuf_height;
   float backbuf_scale;
+  // > 1 if the backbuf was rendered at backbuf_scale / backbuf_reduction and has to be stretched for display
+  float backbuf_reduction;
   float backbuf_zoom_x, backbuf_zoom_y;
   uint64_t backbuf_hash;
   dt_pthread_mutex_t backbuf_mutex, busy_mutex;
@@ -166,6 +181,10 @@ typedef struct dt_dev_pixelpipe_t
   GList *forms;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
+  // evaluate runs of adjacent pointwise modules in a single pass?
+  gboolean fuse_pointwise;
+  // size the openmp team per module invocation, see dt_iop_get_num_threads()
+  gboolean adaptive_threads;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
@@ -215,6 +234,8 @@ void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *d
 // adjust output node according to history stack (history pop event)
 void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 
+// number of pipes currently inside dt_dev_pixelpipe_process(), over all developments
+int dt_dev_pixelpipe_count_active(void);
 // process region of interest of pixels. returns 1 if pipe was altered during processing.
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
                              int height, float scale);
@@ -222,6 +243,16 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev,
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y,
                                       int width, int height, float scale);
 
+// evaluates the pointwise modules from first_module up to (not including) last_module on npixels 4-channel
+// pixels, span by span with up to max_threads threads. their process_pixels_prepare() must have run already.
+void dt_dev_pixelpipe_process_pointwise(const struct dt_develop_t *dev, GList *first_module, GList *first_piece,
+                                        GList *last_module, const float *const in, float *const out,
+                                        const size_t npixels, const int max_threads);
+
+// after process() of piece wrote output: drops the output from the cache if the pipe is shutting down or the
+// module skipped part of its work (see dt_iop_set_incomplete()). returns 1 if it was dropped.
+int dt_dev_pixelpipe_discard_incomplete(dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece, void *output);
+
 // disable given op and all that comes after it in the pipe:
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op);
 // disable given op and all that comes before it in the pipe:
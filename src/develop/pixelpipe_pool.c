@@ -0,0 +1,162 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_pool.h"
+#include "common/darktable.h"
+#include "common/numa.h"
+#include "develop/pixelpipe_hb.h"
+
+// smallest size class, anything below is not worth pooling
+#define DT_PIPE_POOL_MIN_CLASS ((size_t)4096)
+// size classes per power of two, bounds the waste to 25%
+#define DT_PIPE_POOL_STEPS 4
+
+static size_t _size_class(const size_t size)
+{
+  if(size <= DT_PIPE_POOL_MIN_CLASS) return DT_PIPE_POOL_MIN_CLASS;
+  // largest power of two <= size
+  size_t pow2 = DT_PIPE_POOL_MIN_CLASS;
+  while(pow2 <= size / 2) pow2 *= 2;
+  const size_t step = pow2 / DT_PIPE_POOL_STEPS;
+  return (size + step - 1) / step * step;
+}
+
+static void _free_list(gpointer data)
+{
+  g_slist_free_full((GSList *)data, dt_free_align_ptr);
+}
+
+void dt_dev_pixelpipe_pool_init(dt_dev_pixelpipe_pool_t *pool, const size_t limit)
+{
+  memset(pool, 0, sizeof(*pool));
+  dt_pthread_mutex_init(&pool->lock, NULL);
+  pool->free_lists = g_hash_table_new_full(NULL, NULL, NULL, _free_list);
+  pool->live = g_hash_table_new(NULL, NULL);
+  pool->limit = limit;
+}
+
+void dt_dev_pixelpipe_pool_flush(dt_dev_pixelpipe_pool_t *pool)
+{
+  dt_pthread_mutex_lock(&pool->lock);
+  g_hash_table_remove_all(pool->free_lists);
+  pool->retained = 0;
+  dt_pthread_mutex_unlock(&pool->lock);
+}
+
+void dt_dev_pixelpipe_pool_cleanup(dt_dev_pixelpipe_pool_t *pool)
+{
+  if(!pool->free_lists) return;
+  g_hash_table_destroy(pool->free_lists);
+  // buffers still handed out belong to whoever holds them, but must not be freed as unknown later on
+  if(g_hash_table_size(pool->live))
+    dt_print(DT_DEBUG_DEV, "[pixelpipe_pool] %u buffers not released on cleanup\n", g_hash_table_size(pool->live));
+  g_hash_table_destroy(pool->live);
+  pool->free_lists = pool->live = NULL;
+  dt_pthread_mutex_destroy(&pool->lock);
+}
+
+void *dt_dev_pixelpipe_pool_alloc(dt_dev_pixelpipe_t *pipe, const size_t size)
+{
+  if(!pipe || !pipe->pool.free_lists) return dt_alloc_align(64, size);
+  dt_dev_pixelpipe_pool_t *pool = &pipe->pool;
+  const size_t cls = _size_class(size);
+
+  dt_pthread_mutex_lock(&pool->lock);
+  void *buf = NULL;
+  GSList *list = g_hash_table_lookup(pool->free_lists, GSIZE_TO_POINTER(cls));
+  if(list)
+  {
+    buf = list->data;
+    list = g_slist_delete_link(list, list);
+    g_hash_table_steal(pool->free_lists, GSIZE_TO_POINTER(cls));
+    if(list) g_hash_table_insert(pool->free_lists, GSIZE_TO_POINTER(cls), list);
+    pool->retained -= cls;
+    pool->reused++;
+  }
+  else
+  {
+    // don't hold the lock over the allocation itself
+    dt_pthread_mutex_unlock(&pool->lock);
+    buf = dt_alloc_align(64, cls);
+    if(!buf) return NULL;
+    // place it on the node of an export job bound to one
+    dt_numa_first_touch(darktable.numa, buf, cls);
+    dt_pthread_mutex_lock(&pool->lock);
+    pool->fresh_bytes += cls;
+  }
+  pool->allocs++;
+  pool->in_use += cls;
+  pool->peak = MAX(pool->peak, pool->in_use + pool->retained);
+  g_hash_table_insert(pool->live, buf, GSIZE_TO_POINTER(cls));
+  dt_pthread_mutex_unlock(&pool->lock);
+  return buf;
+}
+
+void dt_dev_pixelpipe_pool_free(dt_dev_pixelpipe_t *pipe, void *buf)
+{
+  if(!buf) return;
+  if(!pipe || !pipe->pool.free_lists)
+  {
+    dt_free_align(buf);
+    return;
+  }
+  dt_dev_pixelpipe_pool_t *pool = &pipe->pool;
+
+  dt_pthread_mutex_lock(&pool->lock);
+  gpointer value = NULL;
+  if(!g_hash_table_lookup_extended(pool->live, buf, NULL, &value))
+  {
+    // not one of ours
+    dt_pthread_mutex_unlock(&pool->lock);
+    dt_free_align(buf);
+    return;
+  }
+  const size_t cls = GPOINTER_TO_SIZE(value);
+  g_hash_table_remove(pool->live, buf);
+  pool->in_use -= cls;
+  if(pool->retained + cls > pool->limit)
+  {
+    dt_pthread_mutex_unlock(&pool->lock);
+    dt_free_align(buf);
+    return;
+  }
+  GSList *list = g_hash_table_lookup(pool->free_lists, GSIZE_TO_POINTER(cls));
+  g_hash_table_steal(pool->free_lists, GSIZE_TO_POINTER(cls));
+  g_hash_table_insert(pool->free_lists, GSIZE_TO_POINTER(cls), g_slist_prepend(list, buf));
+  pool->retained += cls;
+  dt_pthread_mutex_unlock(&pool->lock);
+}
+
+void dt_dev_pixelpipe_pool_detach(dt_dev_pixelpipe_t *pipe, void *buf)
+{
+  if(!buf || !pipe || !pipe->pool.free_lists) return;
+  dt_dev_pixelpipe_pool_t *pool = &pipe->pool;
+
+  dt_pthread_mutex_lock(&pool->lock);
+  gpointer value = NULL;
+  if(g_hash_table_lookup_extended(pool->live, buf, NULL, &value))
+  {
+    pool->in_use -= GPOINTER_TO_SIZE(value);
+    g_hash_table_remove(pool->live, buf);
+  }
+  dt_pthread_mutex_unlock(&pool->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,72 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_t;
+
+/**
+ * pool of temporary buffers owned by a pixelpipe, for the scratch buffers of the pipe itself (histograms,
+ * pickers, blending masks) and of the modules. buffers are rounded up to a size class and kept after being
+ * released, so that the next request of the same class (in a later module or a later run of the pipe) does
+ * not have to go through mmap, page faults and zeroing again. the memory kept around is bounded by a
+ * retention limit; buffers which do not fit are given back to the system right away.
+ */
+
+typedef struct dt_dev_pixelpipe_pool_t
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *free_lists; // size class -> GSList of released buffers
+  GHashTable *live;   // buffer -> size class, for buffers handed out
+  size_t retained;    // bytes in the free lists
+  size_t limit;       // retention limit in bytes
+  // profiling:
+  uint64_t allocs;
+  uint64_t reused;
+  uint64_t fresh_bytes;
+  size_t peak;        // maximum of retained + handed out bytes
+  size_t in_use;
+} dt_dev_pixelpipe_pool_t;
+
+void dt_dev_pixelpipe_pool_init(dt_dev_pixelpipe_pool_t *pool, const size_t limit);
+void dt_dev_pixelpipe_pool_cleanup(dt_dev_pixelpipe_pool_t *pool);
+/** give back all released buffers to the system */
+void dt_dev_pixelpipe_pool_flush(dt_dev_pixelpipe_pool_t *pool);
+
+/** returns a 64 byte aligned, uninitialized buffer of at least size bytes. pipe may be NULL, then this
+    is just dt_alloc_align(). */
+void *dt_dev_pixelpipe_pool_alloc(struct dt_dev_pixelpipe_t *pipe, const size_t size);
+static inline float *dt_dev_pixelpipe_pool_alloc_float(struct dt_dev_pixelpipe_t *pipe, const size_t nfloats)
+{
+  return (float *)__builtin_assume_aligned(dt_dev_pixelpipe_pool_alloc(pipe, nfloats * sizeof(float)), 64);
+}
+/** releases a buffer obtained from dt_dev_pixelpipe_pool_alloc() on the same pipe. NULL is fine. */
+void dt_dev_pixelpipe_pool_free(struct dt_dev_pixelpipe_t *pipe, void *buf);
+/** hands a buffer from the pool over to the caller, who will dt_free_align() it eventually. used for masks which
+    end up outliving the module, for instance as raster masks. */
+void dt_dev_pixelpipe_pool_detach(struct dt_dev_pixelpipe_t *pipe, void *buf);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,367 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/prefetch.h"
+#include "common/darktable.h"
+#include "common/debug.h"
+#include "common/history.h"
+#include "common/mipmap_cache.h"
+#include "control/conf.h"
+#include "control/control.h"
+#include "control/jobs.h"
+#include "develop/develop.h"
+#include "develop/pixelpipe.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct dt_dev_prefetch_entry_t
+{
+  int32_t imgid;
+  float downsampling;
+  // dimensions of the 8-bit output and of the preview pipe it came from
+  int width, height;
+  int processed_width, processed_height;
+  // current history hash of the image when the preview was rendered, NULL if it had none
+  guint8 *history_hash;
+  int history_hash_len;
+  uint8_t *buf;
+} dt_dev_prefetch_entry_t;
+
+typedef struct dt_dev_prefetch_job_t
+{
+  dt_develop_t *dev;
+  int32_t imgid;
+  float downsampling;
+} dt_dev_prefetch_job_t;
+
+static size_t _entry_size(const dt_dev_prefetch_entry_t *entry)
+{
+  return sizeof(uint8_t) * 4 * entry->width * entry->height;
+}
+
+static void _entry_free(dt_dev_prefetch_entry_t *entry)
+{
+  if(!entry) return;
+  dt_free_align(entry->buf);
+  free(entry->history_hash);
+  free(entry);
+}
+
+// the current history hash of the image from the database, to be freed by the caller
+static guint8 *_history_hash(const int32_t imgid, int *len)
+{
+  dt_history_hash_values_t hash;
+  dt_history_hash_read(imgid, &hash);
+  free(hash.basic);
+  free(hash.auto_apply);
+  *len = hash.current ? hash.current_len : 0;
+  return hash.current;
+}
+
+// was the entry rendered from the given history?
+static gboolean _entry_matches(const dt_dev_prefetch_entry_t *entry, const guint8 *history_hash,
+                               const int history_hash_len)
+{
+  return entry->history_hash_len == history_hash_len
+         && (!history_hash_len || !memcmp(entry->history_hash, history_hash, history_hash_len));
+}
+
+// memory cap of the side cache in bytes, 0 disables prefetching altogether
+static size_t _cache_limit(void)
+{
+  return (size_t)MAX(0, dt_conf_get_int("darkroom/ui/prefetch_cache_size")) * 1024 * 1024;
+}
+
+// with the lock held
+static GList *_find(dt_dev_prefetch_t *prefetch, const int32_t imgid)
+{
+  for(GList *l = prefetch->entries; l; l = g_list_next(l))
+    if(((dt_dev_prefetch_entry_t *)l->data)->imgid == imgid) return l;
+  return NULL;
+}
+
+// with the lock held
+static void _remove(dt_dev_prefetch_t *prefetch, GList *link)
+{
+  dt_dev_prefetch_entry_t *entry = (dt_dev_prefetch_entry_t *)link->data;
+  prefetch->used -= _entry_size(entry);
+  prefetch->entries = g_list_delete_link(prefetch->entries, link);
+  _entry_free(entry);
+}
+
+// with the lock held: add a new entry in front, evicting the least recently used ones beyond the limit
+static void _insert(dt_dev_prefetch_t *prefetch, dt_dev_prefetch_entry_t *entry, const size_t limit)
+{
+  GList *old = _find(prefetch, entry->imgid);
+  if(old) _remove(prefetch, old);
+
+  prefetch->entries = g_list_prepend(prefetch->entries, entry);
+  prefetch->used += _entry_size(entry);
+
+  while(prefetch->used > limit && prefetch->entries)
+    _remove(prefetch, g_list_last(prefetch->entries));
+}
+
+dt_dev_prefetch_t *dt_dev_prefetch_init(void)
+{
+  dt_dev_prefetch_t *prefetch = (dt_dev_prefetch_t *)calloc(1, sizeof(dt_dev_prefetch_t));
+  dt_pthread_mutex_init(&prefetch->lock, NULL);
+  return prefetch;
+}
+
+void dt_dev_prefetch_cleanup(dt_dev_prefetch_t *prefetch)
+{
+  if(!prefetch) return;
+  dt_dev_prefetch_flush(prefetch);
+  g_list_free(prefetch->pending);
+  dt_pthread_mutex_destroy(&prefetch->lock);
+  free(prefetch);
+}
+
+void dt_dev_prefetch_flush(dt_dev_prefetch_t *prefetch)
+{
+  if(!prefetch) return;
+  dt_pthread_mutex_lock(&prefetch->lock);
+  g_list_free_full(prefetch->entries, (GDestroyNotify)_entry_free);
+  prefetch->entries = NULL;
+  prefetch->used = 0;
+  dt_pthread_mutex_unlock(&prefetch->lock);
+}
+
+void dt_dev_prefetch_forget(dt_dev_prefetch_t *prefetch, const int32_t imgid)
+{
+  if(!prefetch) return;
+  dt_pthread_mutex_lock(&prefetch->lock);
+  GList *link = _find(prefetch, imgid);
+  if(link) _remove(prefetch, link);
+  dt_pthread_mutex_unlock(&prefetch->lock);
+}
+
+static int32_t _prefetch_job_run(dt_job_t *job)
+{
+  dt_dev_prefetch_job_t *params = dt_control_job_get_params(job);
+  dt_develop_t *dev = params->dev;
+  dt_dev_prefetch_t *prefetch = dev->prefetch;
+  const int32_t imgid = params->imgid;
+
+  // only run while the darkroom has nothing better to do
+  if(dev->image_status != DT_DEV_PIXELPIPE_VALID || dev->preview_status != DT_DEV_PIXELPIPE_VALID
+     || dev->gui_leaving)
+    goto done;
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  // warm up the mipmap cache with the full raw, the center view will need it first.
+  // the mipmap cache enforces its own memory limit for these.
+  dt_mipmap_buffer_t full;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &full, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  const gboolean loaded = full.buf != NULL;
+  dt_mipmap_cache_release(darktable.mipmap_cache, &full);
+  if(!loaded || dev->image_status != DT_DEV_PIXELPIPE_VALID) goto done;
+
+  // now run a preview pipe, the same way dt_dev_process_preview_job() would
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
+  if(!buf.buf || !buf.width || !buf.height)
+  {
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    goto done;
+  }
+
+  // read before the history itself, an edit in the meantime then makes the entry stale rather than wrong
+  int history_hash_len = 0;
+  guint8 *history_hash = _history_hash(imgid, &history_hash_len);
+
+  dt_develop_t pdev;
+  dt_dev_init(&pdev, 0);
+  dt_dev_load_image(&pdev, imgid);
+
+  dt_dev_pixelpipe_t pipe;
+  if(dt_dev_pixelpipe_init_preview(&pipe))
+  {
+    dt_dev_pixelpipe_set_input(&pipe, &pdev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+    dt_dev_pixelpipe_create_nodes(&pipe, &pdev);
+    dt_dev_pixelpipe_synch_all(&pipe, &pdev);
+    dt_dev_pixelpipe_get_dimensions(&pipe, &pdev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                    &pipe.processed_height);
+
+    const float ds = params->downsampling;
+    if(!dt_dev_pixelpipe_process(&pipe, &pdev, 0, 0, pipe.processed_width * ds, pipe.processed_height * ds, ds)
+       && pipe.backbuf)
+    {
+      dt_dev_prefetch_entry_t *entry = (dt_dev_prefetch_entry_t *)calloc(1, sizeof(dt_dev_prefetch_entry_t));
+      entry->imgid = imgid;
+      entry->downsampling = ds;
+      entry->width = pipe.backbuf_width;
+      entry->height = pipe.backbuf_height;
+      entry->processed_width = pipe.processed_width;
+      entry->processed_height = pipe.processed_height;
+      entry->history_hash = history_hash;
+      entry->history_hash_len = history_hash_len;
+      history_hash = NULL;
+      entry->buf = dt_alloc_align(64, _entry_size(entry));
+      if(entry->buf)
+      {
+        dt_pthread_mutex_lock(&pipe.backbuf_mutex);
+        memcpy(entry->buf, pipe.backbuf, _entry_size(entry));
+        dt_pthread_mutex_unlock(&pipe.backbuf_mutex);
+
+        dt_pthread_mutex_lock(&prefetch->lock);
+        _insert(prefetch, entry, _cache_limit());
+        dt_pthread_mutex_unlock(&prefetch->lock);
+        entry = NULL;
+      }
+      _entry_free(entry);
+    }
+    dt_dev_pixelpipe_cleanup(&pipe);
+  }
+
+  dt_dev_cleanup(&pdev);
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  free(history_hash);
+
+  dt_show_times_f(&start, "[dev_prefetch]", "to prefetch image %d", imgid);
+
+done:
+  dt_pthread_mutex_lock(&prefetch->lock);
+  prefetch->pending = g_list_remove(prefetch->pending, GINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&prefetch->lock);
+  return 0;
+}
+
+// image id at the given offset from imgid in the current collection, or -1
+static int32_t _neighbour(const int32_t imgid, const int diff)
+{
+  int32_t id = -1;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT imgid FROM memory.collected_images "
+                              "WHERE rowid=(SELECT rowid FROM memory.collected_images WHERE imgid=?1)+?2",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, diff);
+  if(sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  return id;
+}
+
+void dt_dev_prefetch_neighbours(dt_develop_t *dev)
+{
+  dt_dev_prefetch_t *prefetch = dev->prefetch;
+  if(!prefetch || !dev->gui_attached || !_cache_limit()) return;
+  if(dev->image_status != DT_DEV_PIXELPIPE_VALID || dev->preview_status != DT_DEV_PIXELPIPE_VALID) return;
+
+  const int32_t current = dev->image_storage.id;
+  // next image first, that is where people usually go
+  const int diffs[2] = { 1, -1 };
+  for(int k = 0; k < 2; k++)
+  {
+    const int32_t imgid = _neighbour(current, diffs[k]);
+    if(imgid <= 0 || imgid == current) continue;
+
+    int history_hash_len = 0;
+    guint8 *history_hash = _history_hash(imgid, &history_hash_len);
+    dt_pthread_mutex_lock(&prefetch->lock);
+    // the image may have been edited since it was prefetched, e.g. by pasting a history in lighttable
+    GList *link = _find(prefetch, imgid);
+    if(link && !_entry_matches((dt_dev_prefetch_entry_t *)link->data, history_hash, history_hash_len))
+    {
+      _remove(prefetch, link);
+      link = NULL;
+    }
+    const gboolean known = link || g_list_find(prefetch->pending, GINT_TO_POINTER(imgid));
+    if(!known) prefetch->pending = g_list_prepend(prefetch->pending, GINT_TO_POINTER(imgid));
+    dt_pthread_mutex_unlock(&prefetch->lock);
+    free(history_hash);
+    if(known) continue;
+
+    dt_job_t *job = dt_control_job_create(&_prefetch_job_run, "prefetch image %d", imgid);
+    dt_dev_prefetch_job_t *params = job ? (dt_dev_prefetch_job_t *)calloc(1, sizeof(dt_dev_prefetch_job_t)) : NULL;
+    if(!params)
+    {
+      if(job) dt_control_job_dispose(job);
+      dt_pthread_mutex_lock(&prefetch->lock);
+      prefetch->pending = g_list_remove(prefetch->pending, GINT_TO_POINTER(imgid));
+      dt_pthread_mutex_unlock(&prefetch->lock);
+      continue;
+    }
+    params->dev = dev;
+    params->imgid = imgid;
+    params->downsampling = dev->preview_downsampling;
+    dt_control_job_set_params(job, params, free);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+  }
+}
+
+gboolean dt_dev_prefetch_take(dt_dev_prefetch_t *prefetch, dt_dev_pixelpipe_t *preview_pipe,
+                              const int32_t imgid, const float downsampling)
+{
+  if(!prefetch) return FALSE;
+
+  int history_hash_len = 0;
+  guint8 *history_hash = _history_hash(imgid, &history_hash_len);
+
+  dt_pthread_mutex_lock(&prefetch->lock);
+  GList *link = _find(prefetch, imgid);
+  dt_dev_prefetch_entry_t *entry = link ? (dt_dev_prefetch_entry_t *)link->data : NULL;
+  // drop stale entries: other preview size, or the history changed since
+  if(entry
+     && (entry->downsampling != downsampling || !_entry_matches(entry, history_hash, history_hash_len)))
+  {
+    _remove(prefetch, link);
+    entry = NULL;
+  }
+  else if(entry)
+  {
+    prefetch->used -= _entry_size(entry);
+    prefetch->entries = g_list_delete_link(prefetch->entries, link);
+  }
+  dt_pthread_mutex_unlock(&prefetch->lock);
+  free(history_hash);
+  if(!entry) return FALSE;
+
+  // the preview pipe is going to replace this soon, it is only shown in the meantime
+  dt_pthread_mutex_lock(&preview_pipe->backbuf_mutex);
+  if(preview_pipe->output_backbuf == NULL || preview_pipe->output_backbuf_width != entry->width
+     || preview_pipe->output_backbuf_height != entry->height)
+  {
+    g_free(preview_pipe->output_backbuf);
+    preview_pipe->output_backbuf_width = entry->width;
+    preview_pipe->output_backbuf_height = entry->height;
+    preview_pipe->output_backbuf = g_malloc0(_entry_size(entry));
+  }
+  if(preview_pipe->output_backbuf)
+  {
+    memcpy(preview_pipe->output_backbuf, entry->buf, _entry_size(entry));
+    preview_pipe->output_imgid = imgid;
+    preview_pipe->processed_width = entry->processed_width;
+    preview_pipe->processed_height = entry->processed_height;
+  }
+  const gboolean success = preview_pipe->output_backbuf != NULL;
+  dt_pthread_mutex_unlock(&preview_pipe->backbuf_mutex);
+
+  dt_print(DT_DEBUG_DEV, "[dev_prefetch] using prefetched preview for image %d\n", imgid);
+  _entry_free(entry);
+  return success;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,60 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+
+#include <glib.h>
+#include <stdint.h>
+
+struct dt_develop_t;
+struct dt_dev_pixelpipe_t;
+
+/*
+ * idle time prefetching for darkroom: once the center view is done, the images before and after the current
+ * one in the filmstrip get their full raw loaded into the mipmap cache and their preview pipe run in the
+ * background. the results end up in a small side cache so that switching images can show the preview at once.
+ */
+typedef struct dt_dev_prefetch_t
+{
+  dt_pthread_mutex_t lock;
+  GList *entries;   // dt_dev_prefetch_entry_t, most recently used first
+  GList *pending;   // image ids with a job in flight
+  size_t used;      // bytes held by the entries
+} dt_dev_prefetch_t;
+
+dt_dev_prefetch_t *dt_dev_prefetch_init(void);
+void dt_dev_prefetch_cleanup(dt_dev_prefetch_t *prefetch);
+
+/** drop all prefetched previews, e.g. when leaving darkroom */
+void dt_dev_prefetch_flush(dt_dev_prefetch_t *prefetch);
+/** drop the prefetched preview of this image, it is being edited */
+void dt_dev_prefetch_forget(dt_dev_prefetch_t *prefetch, const int32_t imgid);
+
+/** queue background jobs for the neighbours of the current image, if the darkroom pipes are idle */
+void dt_dev_prefetch_neighbours(struct dt_develop_t *dev);
+
+/** move a prefetched preview of imgid into the output buffer of the preview pipe. a preview of another size or
+    of an older history is dropped instead. returns TRUE on success. */
+gboolean dt_dev_prefetch_take(dt_dev_prefetch_t *prefetch, struct dt_dev_pixelpipe_t *preview_pipe,
+                              const int32_t imgid, const float downsampling);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -579,6 +579,168 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
 }
 
 
+#ifdef _OPENMP
+/* number of tiles which may be processed at the same time by modules supporting it */
+static int _concurrent_tiles(void)
+{
+  const int concurrent = dt_conf_get_int("tiling_concurrent_tiles");
+  return CLAMPI(concurrent, 1, dt_get_team_threads());
+}
+
+/* state shared by the workers of _process_tiles_ptp_concurrent() */
+typedef struct _ptp_tiles_t
+{
+  struct dt_iop_module_t *self;
+  struct dt_dev_pixelpipe_iop_t *piece;
+  const void *ivoid;
+  void *ovoid;
+  const dt_iop_roi_t *roi_in, *roi_out;
+  int in_bpp, out_bpp, width, height, tile_wd, tile_ht, tiles_y, tiles, overlap, threads_per_tile;
+  size_t ipitch, opitch, isize, osize;
+  char *input, *output;
+  dt_atomic_int next;
+} _ptp_tiles_t;
+
+typedef struct _ptp_worker_t
+{
+  _ptp_tiles_t *t;
+  int worker;
+} _ptp_worker_t;
+
+/* takes tiles from the shared counter until there are none left. each worker has its own pair of tile buffers
+   and runs the module's parallel loops with its share of the threads. */
+static void *_ptp_tiles_worker(void *arg)
+{
+  const _ptp_worker_t *const w = (_ptp_worker_t *)arg;
+  _ptp_tiles_t *const t = w->t;
+  const dt_iop_roi_t *const roi_in = t->roi_in;
+  const dt_iop_roi_t *const roi_out = t->roi_out;
+  const int in_bpp = t->in_bpp, out_bpp = t->out_bpp, overlap = t->overlap;
+
+  const int prev_threads = dt_set_team_threads(t->threads_per_tile);
+
+  char *const tile_in = t->input + t->isize * w->worker;
+  char *const tile_out = t->output + t->osize * w->worker;
+
+  for(int k = dt_atomic_add_int(&t->next, 1); k < t->tiles; k = dt_atomic_add_int(&t->next, 1))
+  {
+    const size_t tx = k / t->tiles_y;
+    const size_t ty = k % t->tiles_y;
+    const size_t wd = tx * t->tile_wd + t->width > roi_in->width ? roi_in->width - tx * t->tile_wd : t->width;
+    const size_t ht = ty * t->tile_ht + t->height > roi_in->height ? roi_in->height - ty * t->tile_ht : t->height;
+
+    /* no need to process end-tiles that are smaller than the total overlap area */
+    if((wd <= 2 * overlap && tx > 0) || (ht <= 2 * overlap && ty > 0)) continue;
+
+    /* the pipe is going to discard the output anyway */
+    if(dt_iop_cancelled(t->piece))
+    {
+      dt_iop_set_incomplete(t->piece);
+      continue;
+    }
+
+    dt_iop_roi_t iroi = { roi_in->x + tx * t->tile_wd, roi_in->y + ty * t->tile_ht, wd, ht, roi_in->scale };
+    dt_iop_roi_t oroi = { roi_out->x + tx * t->tile_wd, roi_out->y + ty * t->tile_ht, wd, ht, roi_out->scale };
+
+    const size_t ioffs = (ty * t->tile_ht) * t->ipitch + (tx * t->tile_wd) * in_bpp;
+    size_t ooffs = (ty * t->tile_ht) * t->opitch + (tx * t->tile_wd) * out_bpp;
+
+    for(size_t j = 0; j < ht; j++)
+      memcpy(tile_in + j * wd * in_bpp, (char *)t->ivoid + ioffs + j * t->ipitch, wd * in_bpp);
+
+    t->self->process(t->self, t->piece, tile_in, tile_out, &iroi, &oroi);
+
+    /* only copy back the "good" part of the tile. unlike the sequential loop, where the next tile overwrites
+       it, the trailing overlap must be left out as well: the tiles finish in any order. */
+    size_t origin[] = { 0, 0 };
+    size_t region[] = { wd, ht };
+    if(tx > 0)
+    {
+      origin[0] += overlap;
+      region[0] -= overlap;
+      ooffs += (size_t)overlap * out_bpp;
+    }
+    if(ty > 0)
+    {
+      origin[1] += overlap;
+      region[1] -= overlap;
+      ooffs += (size_t)overlap * t->opitch;
+    }
+    if(tx * t->tile_wd + wd < roi_in->width) region[0] -= overlap;
+    if(ty * t->tile_ht + ht < roi_in->height) region[1] -= overlap;
+
+    for(size_t j = 0; j < region[1]; j++)
+      memcpy((char *)t->ovoid + ooffs + j * t->opitch, tile_out + ((j + origin[1]) * wd + origin[0]) * out_bpp,
+             region[0] * out_bpp);
+  }
+
+  dt_set_team_threads(prev_threads);
+  return NULL;
+}
+
+/* process the tiles of _default_process_tiling_ptp() several at a time, each one with a smaller thread team.
+   this is only done for modules which declare their process() to be reentrant (IOP_FLAGS_TILING_CONCURRENT),
+   in particular they must not change processed_maximum. the tiles run on plain threads next to the pipe's
+   own one instead of a nested OpenMP region, so the module's parallel loops are top level regions of their
+   thread and no process wide OpenMP setting has to be touched. returns FALSE if buffers or threads could
+   not be set up. */
+static int _process_tiles_ptp_concurrent(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                         const void *const ivoid, void *const ovoid,
+                                         const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                                         const int in_bpp, const int out_bpp, const int width, const int height,
+                                         const int tile_wd, const int tile_ht, const int tiles_x,
+                                         const int tiles_y, const int overlap, const int concurrent)
+{
+  _ptp_tiles_t t = { .self = self, .piece = piece, .ivoid = ivoid, .ovoid = ovoid,
+                     .roi_in = roi_in, .roi_out = roi_out, .in_bpp = in_bpp, .out_bpp = out_bpp,
+                     .width = width, .height = height, .tile_wd = tile_wd, .tile_ht = tile_ht,
+                     .tiles_y = tiles_y, .tiles = tiles_x * tiles_y, .overlap = overlap,
+                     .threads_per_tile = MAX(1, dt_get_team_threads() / concurrent),
+                     .ipitch = (size_t)roi_in->width * in_bpp, .opitch = (size_t)roi_out->width * out_bpp,
+                     .isize = (size_t)width * height * in_bpp, .osize = (size_t)width * height * out_bpp };
+  dt_atomic_set_int(&t.next, 0);
+
+  /* one pair of tile buffers per concurrent tile */
+  t.input = dt_alloc_align(64, t.isize * concurrent);
+  t.output = dt_alloc_align(64, t.osize * concurrent);
+  if(t.input == NULL || t.output == NULL)
+  {
+    dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc buffers for %d concurrent tiles in "
+                           "module '%s'\n", concurrent, self->op);
+    dt_free_align(t.input);
+    dt_free_align(t.output);
+    return FALSE;
+  }
+
+  dt_print(DT_DEBUG_DEV,
+           "[default_process_tiling_ptp] processing %d tiles concurrently with %d threads each for module '%s'\n",
+           concurrent, t.threads_per_tile, self->op);
+
+  piece->pipe->tiling = 1;
+
+  /* the calling thread is worker 0, the others get threads of their own */
+  _ptp_worker_t workers[concurrent];
+  pthread_t threads[concurrent];
+  int started = 1;
+  for(int k = 0; k < concurrent; k++) workers[k] = (_ptp_worker_t){ .t = &t, .worker = k };
+  for(; started < concurrent; started++)
+    if(dt_pthread_create(&threads[started], _ptp_tiles_worker, &workers[started])) break;
+
+  if(started < concurrent)
+    dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could only start %d of %d tile workers for module '%s'\n",
+             started, concurrent, self->op);
+
+  _ptp_tiles_worker(&workers[0]);
+  for(int k = 1; k < started; k++) pthread_join(threads[k], NULL);
+
+  piece->pipe->tiling = 0;
+
+  dt_free_align(t.input);
+  dt_free_align(t.output);
+  return TRUE;
+}
+#endif
+
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
 static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                         const void *const ivoid, void *const ovoid,
@@ -624,7 +786,17 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   singlebuffer = fmax(singlebuffer, 2.0f * 1024.0f * 1024.0f);
   const float factor = fmax(tiling.factor, 1.0f);
   const float maxbuf = fmax(tiling.maxbuf, 1.0f);
-  singlebuffer = fmax(available / factor, singlebuffer);
+
+  /* tiles processed at the same time share the available memory */
+  int concurrent = 1;
+#ifdef _OPENMP
+  if(self->flags() & IOP_FLAGS_TILING_CONCURRENT) concurrent = _concurrent_tiles();
+  /* each of them also needs its own fixed overhead (per-thread tables and such), one is accounted for above */
+  while(concurrent > 1 && available - (concurrent - 1) * tiling.overhead < concurrent * factor * singlebuffer)
+    concurrent--;
+  available = fmax(available - (concurrent - 1) * tiling.overhead, 0);
+#endif
+  singlebuffer = fmax(available / (factor * concurrent), singlebuffer);
 
   int width = roi_in->width;
   int height = roi_in->height;
@@ -700,6 +872,14 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
            "[default_process_tiling_ptp] (%d x %d) tiles with max dimensions %d x %d and overlap %d\n",
            tiles_x, tiles_y, width, height, overlap);
 
+#ifdef _OPENMP
+  concurrent = _min(concurrent, tiles_x * tiles_y);
+  if(concurrent > 1
+     && _process_tiles_ptp_concurrent(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp, width, height,
+                                      tile_wd, tile_ht, tiles_x, tiles_y, overlap, concurrent))
+    return;
+#endif
+
   /* reserve input and output buffers for tiles */
   input = dt_alloc_align(64, (size_t)width * height * in_bpp);
   if(input == NULL)
@@ -735,6 +915,9 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
       /* no need to process end-tiles that are smaller than the total overlap area */
       if((wd <= 2 * overlap && tx > 0) || (ht <= 2 * overlap && ty > 0)) continue;
 
+      /* the pipe is going to discard the output anyway */
+      if(dt_iop_cancelled(piece)) goto cancelled;
+
       /* origin and region of effective part of tile, which we want to store later */
       size_t origin[] = { 0, 0, 0 };
       size_t region[] = { wd, ht, 1 };
@@ -817,6 +1000,14 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   piece->pipe->tiling = 0;
   return;
 
+cancelled:
+  dt_iop_set_incomplete(piece);
+  dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] cancelled in module '%s'\n", self->op);
+  if(input != NULL) dt_free_align(input);
+  if(output != NULL) dt_free_align(output);
+  piece->pipe->tiling = 0;
+  return;
+
 error:
   dt_control_log(_("tiling failed for module '%s'. output might be garbled."), self->op);
 // fall through
@@ -995,6 +1186,9 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
     {
       piece->pipe->tiling = 1;
 
+      /* the pipe is going to discard the output anyway */
+      if(dt_iop_cancelled(piece)) goto cancelled;
+
       /* the output dimensions of the good part of this specific tile */
       size_t wd = (tx + 1) * tile_wd > roi_out->width ? roi_out->width - tx * tile_wd : tile_wd;
       size_t ht = (ty + 1) * tile_ht > roi_out->height ? roi_out->height - ty * tile_ht : tile_ht;
@@ -1158,6 +1352,14 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   piece->pipe->tiling = 0;
   return;
 
+cancelled:
+  dt_iop_set_incomplete(piece);
+  dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] cancelled in module '%s'\n", self->op);
+  if(input != NULL) dt_free_align(input);
+  if(output != NULL) dt_free_align(output);
+  piece->pipe->tiling = 0;
+  return;
+
 error:
   dt_control_log(_("tiling failed for module '%s'. output might be garbled."), self->op);
 // fall through
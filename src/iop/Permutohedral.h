@@ -242,10 +242,11 @@ public:
       if(e.keyIdx == -1)
       {
         if(!create) return -1; // Return not found.
-        // Double hash table size if necessary
+        // Double hash table size if necessary, the key goes to another slot then
         if(filled >= maxFill())
         {
           grow();
+          return lookupOffset(key, create);
         }
         // need to create an entry. Store the given key.
         keys[filled] = key;
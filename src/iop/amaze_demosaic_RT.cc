@@ -477,6 +477,12 @@ void amaze_demosaic_RT(dt_dev_pixelpipe_iop_t *piece, const float *const in,
     {
       for(int left = winx - 16; left < winx + width; left += ts - 32)
       {
+        // the pipe will discard our output, skip the remaining tiles
+        if(dt_iop_cancelled(piece))
+        {
+          dt_iop_set_incomplete(piece);
+          continue;
+        }
         memset(&nyquist[3 * tsh], 0, sizeof(unsigned char) * (ts - 6) * tsh);
         // location of tile bottom edge
         int bottom = MIN(top + ts, winy + height + 16);
@@ -31,6 +31,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/imageop_gui.h"
+#include "develop/noise_generator.h"
 #include "develop/tiling.h"
 #include "dtgtk/button.h"
 #include "dtgtk/resetlabel.h"
@@ -45,6 +46,7 @@
 #include <assert.h>
 #include <gtk/gtk.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -71,6 +73,7 @@
 #define LSD_DENSITY_TH 0.7                  // LSD: minimal density of region points in rectangle
 #define LSD_N_BINS 1024                     // LSD: number of bins in pseudo-ordering of gradient modulus
 #define LSD_GAMMA 0.45                      // gamma correction to apply on raw images prior to line detection
+#define LSD_PYRAMID_SIZE 384                // lines are detected on the smallest pyramid level with a shorter side of at least this many pixels
 #define RANSAC_RUNS 400                     // how many iterations to run in ransac
 #define RANSAC_EPSILON 2                    // starting value for ransac epsilon (in -log10 units)
 #define RANSAC_EPSILON_STEP 1               // step size of epsilon optimization (log10 units)
@@ -361,6 +364,26 @@ typedef struct dt_iop_ashift_fit_params_t
   float shear_range;
 } dt_iop_ashift_fit_params_t;
 
+// structural data of an image, everything outlier removal and fit need without the gui
+typedef struct dt_iop_ashift_structure_t
+{
+  dt_iop_ashift_line_t *lines;
+  int lines_count;
+  int vertical_count;
+  int horizontal_count;
+  float vertical_weight;
+  float horizontal_weight;
+  int width;
+  int height;
+  int x_off;
+  int y_off;
+  int isflipped;
+  float rotation_range;
+  float lensshift_v_range;
+  float lensshift_h_range;
+  float shear_range;
+} dt_iop_ashift_structure_t;
+
 typedef struct dt_iop_ashift_cropfit_params_t
 {
   int width;
@@ -1146,35 +1169,35 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
 }
 
 // simple conversion of rgb image into greyscale variant suitable for line segment detection
-// the lsd routines expect input as *double, roughly in the range [0.0; 256.0]
-static void rgb2grey256(const float *const in, double *const out, const int width, const int height)
+// the lsd routines expect input roughly in the range [0.0; 256.0]
+static void rgb2grey256(const float *const in, float *const out, const int width, const int height)
 {
   const size_t npixels = (size_t)width * height;
 
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
+#pragma omp parallel for simd default(none) \
   dt_omp_firstprivate(npixels) \
   dt_omp_sharedconst(in, out) \
   schedule(static)
 #endif
-  for(int index = 0; index < npixels; index++)
+  for(size_t index = 0; index < npixels; index++)
   {
-    out[index] = (0.3f * in[4*index+0] + 0.59f * in[4*index+1] + 0.11f * in[4*index+2]) * 256.0;
+    out[index] = (0.3f * in[4*index+0] + 0.59f * in[4*index+1] + 0.11f * in[4*index+2]) * 256.0f;
   }
 }
 
 // sobel edge enhancement in one direction
-static void edge_enhance_1d(const double *in, double *out, const int width, const int height,
+static void edge_enhance_1d(const float *in, float *out, const int width, const int height,
                             dt_iop_ashift_enhance_t dir)
 {
   // Sobel kernels for both directions
-  const double hkernel[3][3] = { { 1.0, 0.0, -1.0 }, { 2.0, 0.0, -2.0 }, { 1.0, 0.0, -1.0 } };
-  const double vkernel[3][3] = { { 1.0, 2.0, 1.0 }, { 0.0, 0.0, 0.0 }, { -1.0, -2.0, -1.0 } };
+  const float hkernel[3][3] = { { 1.0f, 0.0f, -1.0f }, { 2.0f, 0.0f, -2.0f }, { 1.0f, 0.0f, -1.0f } };
+  const float vkernel[3][3] = { { 1.0f, 2.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { -1.0f, -2.0f, -1.0f } };
   const int kwidth = 3;
   const int khwidth = kwidth / 2;
 
   // select kernel
-  const double *kernel = (dir == ASHIFT_ENHANCE_HORIZONTAL) ? (const double *)hkernel : (const double *)vkernel;
+  const float *kernel = (dir == ASHIFT_ENHANCE_HORIZONTAL) ? (const float *)hkernel : (const float *)vkernel;
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
@@ -1185,11 +1208,11 @@ static void edge_enhance_1d(const double *in, double *out, const int width, cons
   // loop over image pixels and perform sobel convolution
   for(int j = khwidth; j < height - khwidth; j++)
   {
-    const double *inp = in + (size_t)j * width + khwidth;
-    double *outp = out + (size_t)j * width + khwidth;
+    const float *inp = in + (size_t)j * width + khwidth;
+    float *outp = out + (size_t)j * width + khwidth;
     for(int i = khwidth; i < width - khwidth; i++, inp++, outp++)
     {
-      double sum = 0.0f;
+      float sum = 0.0f;
       for(int jj = 0; jj < kwidth; jj++)
       {
         const int k = jj * kwidth;
@@ -1213,7 +1236,7 @@ static void edge_enhance_1d(const double *in, double *out, const int width, cons
   for(int j = 0; j < height; j++)
     for(int i = 0; i < width; i++)
     {
-      double val = out[j * width + i];
+      float val = out[j * width + i];
 
       if(j < khwidth)
         val = out[(khwidth - j) * width + i];
@@ -1232,15 +1255,15 @@ static void edge_enhance_1d(const double *in, double *out, const int width, cons
 }
 
 // edge enhancement in both directions
-static int edge_enhance(const double *in, double *out, const int width, const int height)
+static int edge_enhance(const float *in, float *out, const int width, const int height)
 {
-  double *Gx = NULL;
-  double *Gy = NULL;
+  float *Gx = NULL;
+  float *Gy = NULL;
 
-  Gx = malloc(sizeof(double) * width * height);
+  Gx = dt_alloc_align_float((size_t)width * height);
   if(Gx == NULL) goto error;
 
-  Gy = malloc(sizeof(double) * width * height);
+  Gy = dt_alloc_align_float((size_t)width * height);
   if(Gy == NULL) goto error;
 
   // perform edge enhancement in both directions
@@ -1249,26 +1272,137 @@ static int edge_enhance(const double *in, double *out, const int width, const in
 
 // calculate absolute values
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
+#pragma omp parallel for simd default(none) \
   dt_omp_firstprivate(height, width) \
   shared(Gx, Gy, out) \
   schedule(static)
 #endif
   for(size_t k = 0; k < (size_t)width * height; k++)
   {
-    out[k] = sqrt(Gx[k] * Gx[k] + Gy[k] * Gy[k]);
+    out[k] = sqrtf(Gx[k] * Gx[k] + Gy[k] * Gy[k]);
   }
 
-  free(Gx);
-  free(Gy);
+  dt_free_align(Gx);
+  dt_free_align(Gy);
   return TRUE;
 
 error:
-  if(Gx) free(Gx);
-  if(Gy) free(Gy);
+  if(Gx) dt_free_align(Gx);
+  if(Gy) dt_free_align(Gy);
   return FALSE;
 }
 
+// next level of the image pyramid for line detection: average of 2x2 blocks
+static void downsample2(const float *const in, float *const out, const int width, const int height)
+{
+  const int owidth = width / 2;
+  const int oheight = height / 2;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, width, owidth, oheight) \
+  schedule(static)
+#endif
+  for(int j = 0; j < oheight; j++)
+  {
+    const float *const in0 = in + (size_t)2 * j * width;
+    const float *const in1 = in0 + width;
+    float *const o = out + (size_t)j * owidth;
+    for(int i = 0; i < owidth; i++)
+      o[i] = 0.25f * (in0[2 * i] + in0[2 * i + 1] + in1[2 * i] + in1[2 * i + 1]);
+  }
+}
+
+// bilinear sample of a single channel image at pixel coordinates (pixel centers at integers)
+static inline float sample_bilinear(const float *const in, const int width, const int height, const float x,
+                                    const float y)
+{
+  const float xc = CLAMP(x, 0.0f, width - 1.001f);
+  const float yc = CLAMP(y, 0.0f, height - 1.001f);
+  const int i = xc;
+  const int j = yc;
+  const float fx = xc - i;
+  const float fy = yc - j;
+  const float *const p = in + (size_t)j * width + i;
+  return (1.0f - fy) * ((1.0f - fx) * p[0] + fx * p[1]) + fy * ((1.0f - fx) * p[width] + fx * p[width + 1]);
+}
+
+// coarse to fine: a line found on a coarser pyramid level is moved onto the edge in the full resolution
+// gradient magnitude. the edge is searched for across the line at every pixel along it, its position is
+// interpolated from the neighbouring magnitudes, and the line is fitted to these positions by weighted
+// total least squares. the end points are projected onto the fitted line. lines without a clear edge are
+// kept as they are.
+static void refine_line(const float *const mag, const int width, const int height, float *const x1,
+                        float *const y1, float *const x2, float *const y2, const float radius)
+{
+  const float dx = *x2 - *x1;
+  const float dy = *y2 - *y1;
+  const float length = sqrtf(dx * dx + dy * dy);
+  if(length < 2.0f) return;
+
+  const float d[2] = { dx / length, dy / length };
+  const float n[2] = { -d[1], d[0] };
+  const int r = CLAMP((int)ceilf(radius), 2, 4);
+
+  double sw = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, syy = 0.0;
+  int count = 0;
+  for(float t = 0.5f; t < length; t += 1.0f)
+  {
+    // like the lsd output, line coordinates have the origin at the center of the first pixel
+    const float cx = *x1 + t * d[0];
+    const float cy = *y1 + t * d[1];
+    float m[9];
+    int best = 0;
+    for(int s = -r; s <= r; s++)
+    {
+      m[s + r] = sample_bilinear(mag, width, height, cx + s * n[0], cy + s * n[1]);
+      if(m[s + r] > m[best]) best = s + r;
+    }
+    // no maximum inside the search window
+    if(best == 0 || best == 2 * r) continue;
+
+    const float denom = m[best - 1] - 2.0f * m[best] + m[best + 1];
+    const float delta = denom < 0.0f ? 0.5f * (m[best - 1] - m[best + 1]) / denom : 0.0f;
+    const float s = best - r + delta;
+    const double w = m[best];
+    const double px = cx + s * n[0];
+    const double py = cy + s * n[1];
+    sw += w;
+    sx += w * px;
+    sy += w * py;
+    sxx += w * px * px;
+    sxy += w * px * py;
+    syy += w * py * py;
+    count++;
+  }
+
+  // need the edge along most of the line
+  if(count < MAX(3, length * 0.5f) || sw <= 0.0) return;
+
+  const double mx = sx / sw;
+  const double my = sy / sw;
+  const double cxx = sxx / sw - mx * mx;
+  const double cxy = sxy / sw - mx * my;
+  const double cyy = syy / sw - my * my;
+  // direction of the line: eigenvector of the largest eigenvalue of the covariance
+  const double phi = 0.5 * atan2(2.0 * cxy, cxx - cyy);
+  float e[2] = { cos(phi), sin(phi) };
+  if(e[0] * d[0] + e[1] * d[1] < 0.0f)
+  {
+    e[0] = -e[0];
+    e[1] = -e[1];
+  }
+
+  // don't follow a different edge
+  if(e[0] * d[0] + e[1] * d[1] < cosf(2.0f * M_PI / 180.0f)) return;
+
+  const float t1 = (*x1 - mx) * e[0] + (*y1 - my) * e[1];
+  const float t2 = (*x2 - mx) * e[0] + (*y2 - my) * e[1];
+  *x1 = mx + t1 * e[0];
+  *y1 = my + t1 * e[1];
+  *x2 = mx + t2 * e[0];
+  *y2 = my + t2 * e[1];
+}
+
 // XYZ -> sRGB matrix
 static void XYZ_to_sRGB(const float *XYZ, float *sRGB)
 {
@@ -1364,7 +1498,10 @@ static int line_detect(float *in, const int width, const int height, const int x
                        const float scale, dt_iop_ashift_line_t **alines, int *lcount, int *vcount, int *hcount,
                        float *vweight, float *hweight, dt_iop_ashift_enhance_t enhance, const int is_raw)
 {
-  double *greyscale = NULL;
+  float *greyscale = NULL;
+  float *detect = NULL;
+  float *magnitude = NULL;
+  double *lsd_in = NULL;
   double *lsd_lines = NULL;
   dt_iop_ashift_line_t *ashift_lines = NULL;
 
@@ -1386,24 +1523,57 @@ static int line_detect(float *in, const int width, const int height, const int x
   }
 
   // allocate intermediate buffers
-  greyscale = malloc(sizeof(double) * width * height);
+  greyscale = dt_alloc_align_float((size_t)width * height);
   if(greyscale == NULL) goto error;
 
   // convert to greyscale image
   rgb2grey256(in, greyscale, width, height);
 
+  // pick the level of the image pyramid to detect lines on: halve the image as long as the shorter
+  // side stays above LSD_PYRAMID_SIZE
+  int level = 0;
+  while((MIN(width, height) >> (level + 1)) >= LSD_PYRAMID_SIZE) level++;
+
+  int lwidth = width;
+  int lheight = height;
+  detect = greyscale;
+  for(int l = 0; l < level; l++)
+  {
+    float *next = dt_alloc_align_float((size_t)(lwidth / 2) * (lheight / 2));
+    if(next == NULL) goto error;
+    downsample2(detect, next, lwidth, lheight);
+    if(detect != greyscale) dt_free_align(detect);
+    detect = next;
+    lwidth /= 2;
+    lheight /= 2;
+  }
+  const float lscale = 1 << level;
+  const float lshift = 0.5f * (lscale - 1.0f);
+
+  // the full resolution gradient magnitude to refine the lines in
+  if(level > 0)
+  {
+    magnitude = dt_alloc_align_float((size_t)width * height);
+    if(magnitude == NULL || !edge_enhance(greyscale, magnitude, width, height)) goto error;
+  }
+
   // if requested perform an additional edge enhancement step
   if(enhance & ASHIFT_ENHANCE_EDGES)
   {
-    (void)edge_enhance(greyscale, greyscale, width, height);
+    (void)edge_enhance(detect, detect, lwidth, lheight);
   }
 
+  // the lsd routines work in double precision
+  lsd_in = malloc(sizeof(double) * lwidth * lheight);
+  if(lsd_in == NULL) goto error;
+  for(size_t k = 0; k < (size_t)lwidth * lheight; k++) lsd_in[k] = detect[k];
+
   // call the line segment detector LSD;
   // LSD stores the number of found lines in lines_count.
   // it returns structural details as vector 'double lines[7 * lines_count]'
   int lines_count;
 
-  lsd_lines = LineSegmentDetection(&lines_count, greyscale, width, height,
+  lsd_lines = LineSegmentDetection(&lines_count, lsd_in, lwidth, lheight,
                                    LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT,
                                    LSD_ANG_TH, LSD_LOG_EPS, LSD_DENSITY_TH,
                                    LSD_N_BINS, NULL, NULL, NULL);
@@ -1418,10 +1588,13 @@ static int line_detect(float *in, const int width, const int height, const int x
 
     for(int n = 0; n < lines_count; n++)
     {
-      float x1 = lsd_lines[n * 7 + 0];
-      float y1 = lsd_lines[n * 7 + 1];
-      float x2 = lsd_lines[n * 7 + 2];
-      float y2 = lsd_lines[n * 7 + 3];
+      // back to full resolution. lsd has the origin at the center of pixel (0,0), and the center of a
+      // downsampled pixel is the center of the lscale x lscale block of full resolution pixels it averages.
+      float x1 = lscale * lsd_lines[n * 7 + 0] + lshift;
+      float y1 = lscale * lsd_lines[n * 7 + 1] + lshift;
+      float x2 = lscale * lsd_lines[n * 7 + 2] + lshift;
+      float y2 = lscale * lsd_lines[n * 7 + 3] + lshift;
+      const float line_width = lsd_lines[n * 7 + 4] * lscale;
 
       // check for lines running along image borders and skip them.
       // these would likely be false-positives which could result
@@ -1432,6 +1605,8 @@ static int line_detect(float *in, const int width, const int height, const int x
          (fabsf(y1 - y2) < 1 && fminf(y1, y2) > height - 3))
         continue;
 
+      if(level > 0) refine_line(magnitude, width, height, &x1, &y1, &x2, &y2, line_width);
+
       // line position in absolute coordinates
       float px1 = x_off + x1;
       float py1 = y_off + y1;
@@ -1461,7 +1636,7 @@ static int line_detect(float *in, const int width, const int height, const int x
 
       // length and width of rectangle (see LSD)
       ashift_lines[lct].length = sqrt((px2 - px1) * (px2 - px1) + (py2 - py1) * (py2 - py1));
-      ashift_lines[lct].width = lsd_lines[n * 7 + 4] / scale;
+      ashift_lines[lct].width = line_width / scale;
 
       // ...  and weight (= length * width * angle precision)
       const float weight = ashift_lines[lct].length * ashift_lines[lct].width * lsd_lines[n * 7 + 5];
@@ -1524,12 +1699,19 @@ static int line_detect(float *in, const int width, const int height, const int x
 
   // free intermediate buffers
   free(lsd_lines);
-  free(greyscale);
+  free(lsd_in);
+  if(detect != greyscale) dt_free_align(detect);
+  dt_free_align(magnitude);
+  dt_free_align(greyscale);
   return lct > 0 ? TRUE : FALSE;
 
 error:
+  free(ashift_lines);
   free(lsd_lines);
-  free(greyscale);
+  free(lsd_in);
+  if(detect != greyscale) dt_free_align(detect);
+  dt_free_align(magnitude);
+  dt_free_align(greyscale);
   return FALSE;
 }
 
@@ -1632,22 +1814,108 @@ static int quickperm(int *a, int *p, const int N, int *i)
   return TRUE;
 }
 
-// Fisher-Yates shuffle
-static void shuffle(int *a, const int N)
+// Fisher-Yates shuffle of the first n elements, drawn from all N
+static void shuffle(int *a, const int n, const int N, uint32_t state[4])
 {
-  for(int i = 0; i < N; i++)
+  for(int i = 0; i < n; i++)
   {
-    int j = i + rand() % (N - i);
+    const int j = i + MIN((int)(xoshiro128plus(state) * (N - i)), N - i - 1);
     swap(&a[j], &a[i]);
   }
 }
 
+// random number generator of ransac run r, seeded by the run and not by the thread so that
+// the result doesn't depend on the number of threads
+static inline void ransac_seed(uint32_t state[4], const int r)
+{
+  state[0] = splitmix32(r + 1);
+  state[1] = splitmix32((uint64_t)(r + 1) * 7919);
+  state[2] = splitmix32(1337);
+  state[3] = splitmix32(666);
+}
+
 // factorial function
 static int fact(const int n)
 {
   return (n == 1 ? 1 : n * fact(n - 1));
 }
 
+// evaluate the model built out of the first two lines of index_set, see ransac() below.
+// marks the lines that fit the model in inout and counts the others in *eliminated.
+// returns the quality of the model or a negative value if the two lines don't give a valid one.
+static float ransac_model(const dt_iop_ashift_line_t *lines, const int *index_set, int *inout,
+                          const int set_count, const float total_weight, const float epsilon,
+                          const int xmin, const int xmax, const int ymin, const int ymax,
+                          int *eliminated)
+{
+  // summed quality evaluation of this run
+  float quality = 0.0f;
+
+  // we build a model ouf of the first two lines
+  const float *L1 = lines[index_set[0]].L;
+  const float *L2 = lines[index_set[1]].L;
+
+  // get intersection point (ideally a vantage point)
+  float V[3];
+  vec3prodn(V, L1, L2);
+
+  // catch special cases:
+  // a) L1 and L2 are identical -> V is NULL -> no valid vantage point
+  // b) vantage point lies inside image frame (no chance to correct for this case)
+  if(vec3isnull(V) ||
+     (fabsf(V[2]) > 0.0f &&
+      V[0]/V[2] >= xmin &&
+      V[1]/V[2] >= ymin &&
+      V[0]/V[2] <= xmax &&
+      V[1]/V[2] <= ymax))
+  {
+    // no valid model
+    return -1.0f;
+  }
+
+  // valid model
+
+  // normalize V so that x^2 + y^2 + z^2 = 1
+  vec3norm(V, V);
+
+  // the two lines constituting the model are part of the set
+  inout[0] = 1;
+  inout[1] = 1;
+
+  // go through all remaining lines, check if they are within the model, and
+  // mark that fact in inout[].
+  // summarize a quality parameter for all lines within the model
+  int count = 0;
+  for(int n = 2; n < set_count; n++)
+  {
+    // L is normalized so that x^2 + y^2 = 1
+    const float *L3 = lines[index_set[n]].L;
+
+    // we take the absolute value of the dot product of V and L as a measure
+    // of the "distance" between point and line. Note that this is not the real euclidean
+    // distance but - with the given normalization - just a pragmatically selected number
+    // that goes to zero if V lies on L and increases the more V and L are apart
+    const float d = fabsf(vec3scalar(V, L3));
+
+    // depending on d we either include or exclude the point from the set
+    inout[n] = (d < epsilon) ? 1 : 0;
+
+    if(inout[n] == 1)
+    {
+      // a quality parameter that depends 1/3 on the number of lines within the model,
+      // 1/3 on their weight, and 1/3 on their weighted distance d to the vantage point
+      quality += 0.33f / (float)set_count
+                 + 0.33f * lines[index_set[n]].weight / total_weight
+                 + 0.33f * (1.0f - d / epsilon) * (float)set_count * lines[index_set[n]].weight / total_weight;
+    }
+    else
+      count++;
+  }
+  *eliminated = count;
+
+  return quality;
+}
+
 // We use a pseudo-RANSAC algorithm to elminiate ouliers from our set of lines. The
 // original RANSAC works on linear optimization problems. Our model is nonlinear. We
 // take advantage of the fact that lines interesting for our model are vantage lines
@@ -1664,6 +1932,9 @@ static int fact(const int n)
 // note: the actual percentage of outliers removed in the final run will be lower because we
 // will finally look for the best quality model with the optimized epsilon and that quality value also
 // encloses the number of good lines
+// The runs are independent of each other, so the dry runs of each self-tuning step and the
+// random sampling runs are distributed over the threads, each run drawing its model from its own
+// random number generator.
 static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout_set,
                   const int set_count, const float total_weight, const int xmin, const int xmax,
                   const int ymin, const int ymax)
@@ -1681,131 +1952,150 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout
   // in a number of dry runs
   float epsilon = powf(10.0f, -RANSAC_EPSILON);
   float epsilon_step = RANSAC_EPSILON_STEP;
-  // some accounting variables for self-tuning
-  int lines_eliminated = 0;
-  int valid_runs = 0;
 
-  // number of runs to optimize epsilon
-  const int optiruns = RANSAC_OPTIMIZATION_STEPS * RANSAC_OPTIMIZATION_DRY_RUNS;
-  // go for complete permutations on small set sizes, else for random sample consensus
-  const int riter = (set_count > RANSAC_HURDLE) ? RANSAC_RUNS : fact(set_count);
+  for(int step = 0; step < RANSAC_OPTIMIZATION_STEPS; step++)
+  {
+    // some accounting variables for self-tuning
+    int lines_eliminated = 0;
+    int valid_runs = 0;
 
-  // some data needed for quickperm
-  int *perm = malloc(sizeof(int) * (set_count + 1));
-  for(int n = 0; n < set_count + 1; n++) perm[n] = n;
-  int piter = 1;
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+    dt_omp_firstprivate(lines, index_set, set_count, set_size, total_weight, epsilon, xmin, xmax, ymin, ymax, step) \
+    reduction(+ : lines_eliminated, valid_runs)
+#endif
+    {
+      int *set = malloc(set_size);
+      int *inout = malloc(set_size);
 
-  // inout holds good/bad qualification for each line
-  int *inout = malloc(set_size);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for(int r = 0; r < RANSAC_OPTIMIZATION_DRY_RUNS; r++)
+      {
+        uint32_t state[4];
+        ransac_seed(state, step * RANSAC_OPTIMIZATION_DRY_RUNS + r);
+        memcpy(set, index_set, set_size);
+        shuffle(set, 2, set_count, state);
+
+        int eliminated = 0;
+        if(ransac_model(lines, set, inout, set_count, total_weight, epsilon, xmin, xmax, ymin, ymax,
+                        &eliminated) >= 0.0f)
+        {
+          lines_eliminated += eliminated;
+          valid_runs++;
+        }
+      }
 
-  for(int r = 0; r < optiruns + riter; r++)
-  {
-    // get random or systematic variation of index set
-    if(set_count > RANSAC_HURDLE || r < optiruns)
-      shuffle(index_set, set_count);
-    else
-      (void)quickperm(index_set, perm, set_count, &piter);
+      free(inout);
+      free(set);
+    }
 
-    // summed quality evaluation of this run
-    float quality = 0.0f;
-
-    // we build a model ouf of the first two lines
-    const float *L1 = lines[index_set[0]].L;
-    const float *L2 = lines[index_set[1]].L;
-
-    // get intersection point (ideally a vantage point)
-    float V[3];
-    vec3prodn(V, L1, L2);
-
-    // catch special cases:
-    // a) L1 and L2 are identical -> V is NULL -> no valid vantage point
-    // b) vantage point lies inside image frame (no chance to correct for this case)
-    if(vec3isnull(V) ||
-       (fabsf(V[2]) > 0.0f &&
-        V[0]/V[2] >= xmin &&
-        V[1]/V[2] >= ymin &&
-        V[0]/V[2] <= xmax &&
-        V[1]/V[2] <= ymax))
+    // at the end of each self-tuning step
+    if(valid_runs > 0)
     {
-      // no valid model
-      quality = 0.0f;
+#ifdef ASHIFT_DEBUG
+      printf("ransac self-tuning (step %d): epsilon %f", step, epsilon);
+#endif
+      // average ratio of lines that we eliminated with the given epsilon
+      float ratio = 100.0f * (float)lines_eliminated / ((float)set_count * valid_runs);
+      // adjust epsilon accordingly
+      if(ratio < RANSAC_ELIMINATION_RATIO)
+        epsilon = powf(10.0f, log10(epsilon) - epsilon_step);
+      else if(ratio > RANSAC_ELIMINATION_RATIO)
+        epsilon = powf(10.0f, log10(epsilon) + epsilon_step);
+#ifdef ASHIFT_DEBUG
+      printf(" (elimination ratio %f) -> %f\n", ratio, epsilon);
+#endif
+      // reduce step-size for next optimization round
+      epsilon_step /= 2.0f;
     }
-    else
-    {
-      // valid model
+  }
 
-      // normalize V so that x^2 + y^2 + z^2 = 1
-      vec3norm(V, V);
+  if(set_count > RANSAC_HURDLE)
+  {
+    // random sample consensus. the best model of each thread is merged into the overall best one,
+    // ties go to the earlier run as they would in sequential order.
+    int best_run = INT_MAX;
 
-      // the two lines constituting the model are part of the set
-      inout[0] = 1;
-      inout[1] = 1;
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+    dt_omp_firstprivate(lines, index_set, set_count, set_size, total_weight, epsilon, xmin, xmax, ymin, ymax) \
+    shared(best_set, best_inout, best_quality, best_run)
+#endif
+    {
+      int *set = malloc(set_size);
+      int *inout = malloc(set_size);
+      int *thread_set = malloc(set_size);
+      int *thread_inout = calloc(1, set_size);
+      float thread_quality = 0.0f;
+      int thread_run = INT_MAX;
 
-      // go through all remaining lines, check if they are within the model, and
-      // mark that fact in inout[].
-      // summarize a quality parameter for all lines within the model
-      for(int n = 2; n < set_count; n++)
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for(int r = 0; r < RANSAC_RUNS; r++)
       {
-        // L is normalized so that x^2 + y^2 = 1
-        const float *L3 = lines[index_set[n]].L;
-
-        // we take the absolute value of the dot product of V and L as a measure
-        // of the "distance" between point and line. Note that this is not the real euclidean
-        // distance but - with the given normalization - just a pragmatically selected number
-        // that goes to zero if V lies on L and increases the more V and L are apart
-        const float d = fabsf(vec3scalar(V, L3));
-
-        // depending on d we either include or exclude the point from the set
-        inout[n] = (d < epsilon) ? 1 : 0;
+        uint32_t state[4];
+        ransac_seed(state, RANSAC_OPTIMIZATION_STEPS * RANSAC_OPTIMIZATION_DRY_RUNS + r);
+        memcpy(set, index_set, set_size);
+        shuffle(set, 2, set_count, state);
 
-        float q;
+        int eliminated = 0;
+        const float quality = ransac_model(lines, set, inout, set_count, total_weight, epsilon,
+                                           xmin, xmax, ymin, ymax, &eliminated);
 
-        if(inout[n] == 1)
+        // check against the best model found so far
+        if(quality > thread_quality)
         {
-          // a quality parameter that depends 1/3 on the number of lines within the model,
-          // 1/3 on their weight, and 1/3 on their weighted distance d to the vantage point
-          q = 0.33f / (float)set_count
-              + 0.33f * lines[index_set[n]].weight / total_weight
-              + 0.33f * (1.0f - d / epsilon) * (float)set_count * lines[index_set[n]].weight / total_weight;
+          memcpy(thread_set, set, set_size);
+          memcpy(thread_inout, inout, set_size);
+          thread_quality = quality;
+          thread_run = r;
         }
-        else
-        {
-          q = 0.0f;
-          lines_eliminated++;
-        }
-
-        quality += q;
       }
-      valid_runs++;
-    }
 
-    if(r < optiruns)
-    {
-      // on last run of each self-tuning step
-      if((r % RANSAC_OPTIMIZATION_DRY_RUNS) == (RANSAC_OPTIMIZATION_DRY_RUNS - 1) && (valid_runs > 0))
-      {
-#ifdef ASHIFT_DEBUG
-        printf("ransac self-tuning (run %d): epsilon %f", r, epsilon);
-#endif
-        // average ratio of lines that we eliminated with the given epsilon
-        float ratio = 100.0f * (float)lines_eliminated / ((float)set_count * valid_runs);
-        // adjust epsilon accordingly
-        if(ratio < RANSAC_ELIMINATION_RATIO)
-          epsilon = powf(10.0f, log10(epsilon) - epsilon_step);
-        else if(ratio > RANSAC_ELIMINATION_RATIO)
-          epsilon = powf(10.0f, log10(epsilon) + epsilon_step);
-#ifdef ASHIFT_DEBUG
-        printf(" (elimination ratio %f) -> %f\n", ratio, epsilon);
+#ifdef _OPENMP
+#pragma omp critical
 #endif
-        // reduce step-size for next optimization round
-        epsilon_step /= 2.0f;
-        lines_eliminated = 0;
-        valid_runs = 0;
+      {
+        if(thread_quality > best_quality || (thread_quality == best_quality && thread_run < best_run))
+        {
+          memcpy(best_set, thread_set, set_size);
+          memcpy(best_inout, thread_inout, set_size);
+          best_quality = thread_quality;
+          best_run = thread_run;
+        }
       }
+
+      free(thread_inout);
+      free(thread_set);
+      free(inout);
+      free(set);
     }
-    else
+  }
+  else
+  {
+    // complete permutations on small set sizes
+    const int riter = fact(set_count);
+
+    // some data needed for quickperm
+    int *perm = malloc(sizeof(int) * (set_count + 1));
+    for(int n = 0; n < set_count + 1; n++) perm[n] = n;
+    int piter = 1;
+
+    // inout holds good/bad qualification for each line
+    int *inout = malloc(set_size);
+
+    for(int r = 0; r < riter; r++)
     {
-      // in the "real" runs check against the best model found so far
+      (void)quickperm(index_set, perm, set_count, &piter);
+
+      int eliminated = 0;
+      const float quality = ransac_model(lines, index_set, inout, set_count, total_weight, epsilon,
+                                         xmin, xmax, ymin, ymax, &eliminated);
+
+      // check against the best model found so far
       if(quality > best_quality)
       {
         memcpy(best_set, index_set, set_size);
@@ -1814,22 +2104,21 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout
       }
     }
 
+    free(inout);
+    free(perm);
+  }
+
 #ifdef ASHIFT_DEBUG
-    // report some statistics
-    int count = 0, lastcount = 0;
-    for(int n = 0; n < set_count; n++) count += best_inout[n];
-    for(int n = 0; n < set_count; n++) lastcount += inout[n];
-    printf("ransac run %d: best qual %.6f, eps %.6f, line count %d of %d (this run: qual %.5f, count %d (%2f%%))\n", r,
-           best_quality, epsilon, count, set_count, quality, lastcount, 100.0f * lastcount / (float)set_count);
+  // report some statistics
+  int count = 0;
+  for(int n = 0; n < set_count; n++) count += best_inout[n];
+  printf("ransac: best qual %.6f, eps %.6f, line count %d of %d\n", best_quality, epsilon, count, set_count);
 #endif
-  }
 
   // store back best set
   memcpy(index_set, best_set, set_size);
   memcpy(inout_set, best_inout, set_size);
 
-  free(inout);
-  free(perm);
   free(best_inout);
   free(best_set);
 }
@@ -1837,34 +2126,32 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout
 
 // try to clean up structural data by eliminating outliers and thereby increasing
 // the chance of a convergent fitting
-static int remove_outliers(dt_iop_module_t *module)
+static int remove_outliers(dt_iop_ashift_structure_t *st)
 {
-  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)module->gui_data;
-
-  const int width = g->lines_in_width;
-  const int height = g->lines_in_height;
-  const int xmin = g->lines_x_off;
-  const int ymin = g->lines_y_off;
+  const int width = st->width;
+  const int height = st->height;
+  const int xmin = st->x_off;
+  const int ymin = st->y_off;
   const int xmax = xmin + width;
   const int ymax = ymin + height;
 
   // holds the index set of lines we want to work on
-  int *lines_set = malloc(sizeof(int) * g->lines_count);
+  int *lines_set = malloc(sizeof(int) * st->lines_count);
   // holds the result of ransac
-  int *inout_set = malloc(sizeof(int) * g->lines_count);
+  int *inout_set = malloc(sizeof(int) * st->lines_count);
 
   // some accounting variables
   int vnb = 0, vcount = 0;
   int hnb = 0, hcount = 0;
 
   // just to be on the safe side
-  if(g->lines == NULL) goto error;
+  if(st->lines == NULL) goto error;
 
   // generate index list for the vertical lines
-  for(int n = 0; n < g->lines_count; n++)
+  for(int n = 0; n < st->lines_count; n++)
   {
     // is this a selected vertical line?
-    if((g->lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_VERTICAL_SELECTED)
+    if((st->lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_VERTICAL_SELECTED)
       continue;
 
     lines_set[vnb] = n;
@@ -1874,7 +2161,7 @@ static int remove_outliers(dt_iop_module_t *module)
 
   // it only makes sense to call ransac if we have more than two lines
   if(vnb > 2)
-    ransac(g->lines, lines_set, inout_set, vnb, g->vertical_weight,
+    ransac(st->lines, lines_set, inout_set, vnb, st->vertical_weight,
            xmin, xmax, ymin, ymax);
 
   // adjust line selected flag according to the ransac results
@@ -1883,21 +2170,20 @@ static int remove_outliers(dt_iop_module_t *module)
     const int m = lines_set[n];
     if(inout_set[n] == 1)
     {
-      g->lines[m].type |= ASHIFT_LINE_SELECTED;
+      st->lines[m].type |= ASHIFT_LINE_SELECTED;
       vcount++;
     }
     else
-      g->lines[m].type &= ~ASHIFT_LINE_SELECTED;
+      st->lines[m].type &= ~ASHIFT_LINE_SELECTED;
   }
   // update number of vertical lines
-  g->vertical_count = vcount;
-  g->lines_version++;
+  st->vertical_count = vcount;
 
   // now generate index list for the horizontal lines
-  for(int n = 0; n < g->lines_count; n++)
+  for(int n = 0; n < st->lines_count; n++)
   {
     // is this a selected horizontal line?
-    if((g->lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_HORIZONTAL_SELECTED)
+    if((st->lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_HORIZONTAL_SELECTED)
       continue;
 
     lines_set[hnb] = n;
@@ -1907,7 +2193,7 @@ static int remove_outliers(dt_iop_module_t *module)
 
   // it only makes sense to call ransac if we have more than two lines
   if(hnb > 2)
-    ransac(g->lines, lines_set, inout_set, hnb, g->horizontal_weight,
+    ransac(st->lines, lines_set, inout_set, hnb, st->horizontal_weight,
            xmin, xmax, ymin, ymax);
 
   // adjust line selected flag according to the ransac results
@@ -1916,15 +2202,14 @@ static int remove_outliers(dt_iop_module_t *module)
     const int m = lines_set[n];
     if(inout_set[n] == 1)
     {
-      g->lines[m].type |= ASHIFT_LINE_SELECTED;
+      st->lines[m].type |= ASHIFT_LINE_SELECTED;
       hcount++;
     }
     else
-      g->lines[m].type &= ~ASHIFT_LINE_SELECTED;
+      st->lines[m].type &= ~ASHIFT_LINE_SELECTED;
   }
   // update number of horizontal lines
-  g->horizontal_count = hcount;
-  g->lines_version++;
+  st->horizontal_count = hcount;
 
   free(inout_set);
   free(lines_set);
@@ -2086,11 +2371,10 @@ static double model_fitness(double *params, void *data)
 }
 
 // setup all data structures for fitting and call NM simplex
-static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_ashift_fitaxis_t dir)
+static dt_iop_ashift_nmsresult_t nmsfit(const dt_iop_ashift_structure_t *st, dt_iop_ashift_params_t *p,
+                                        dt_iop_ashift_fitaxis_t dir)
 {
-  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)module->gui_data;
-
-  if(!g->lines) return NMS_NOT_ENOUGH_LINES;
+  if(!st->lines) return NMS_NOT_ENOUGH_LINES;
   if(dir == ASHIFT_FIT_NONE) return NMS_SUCCESS;
 
   double params[4];
@@ -2099,10 +2383,10 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
 
   // initialize fit parameters
   dt_iop_ashift_fit_params_t fit;
-  fit.lines = g->lines;
-  fit.lines_count = g->lines_count;
-  fit.width = g->lines_in_width;
-  fit.height = g->lines_in_height;
+  fit.lines = st->lines;
+  fit.lines_count = st->lines_count;
+  fit.width = st->width;
+  fit.height = st->height;
   fit.f_length_kb = (p->mode == ASHIFT_MODE_GENERIC) ? DEFAULT_F_LENGTH : p->f_length * p->crop_factor;
   fit.orthocorr = (p->mode == ASHIFT_MODE_GENERIC) ? 0.0f : p->orthocorr;
   fit.aspect = (p->mode == ASHIFT_MODE_GENERIC) ? 1.0f : p->aspect;
@@ -2110,10 +2394,10 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
   fit.lensshift_v = p->lensshift_v;
   fit.lensshift_h = p->lensshift_h;
   fit.shear = p->shear;
-  fit.rotation_range = g->rotation_range;
-  fit.lensshift_v_range = g->lensshift_v_range;
-  fit.lensshift_h_range = g->lensshift_h_range;
-  fit.shear_range = g->shear_range;
+  fit.rotation_range = st->rotation_range;
+  fit.lensshift_v_range = st->lensshift_v_range;
+  fit.lensshift_h_range = st->lensshift_h_range;
+  fit.shear_range = st->shear_range;
   fit.linetype = ASHIFT_LINE_RELEVANT | ASHIFT_LINE_SELECTED;
   fit.linemask = ASHIFT_LINE_MASK;
   fit.params_count = 0;
@@ -2126,7 +2410,7 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
      (mdir & ASHIFT_FIT_LENS_BOTH) != 0)
   {
     // flip all directions
-    mdir ^= g->isflipped ? ASHIFT_FIT_FLIP : 0;
+    mdir ^= st->isflipped ? ASHIFT_FIT_FLIP : 0;
     // special case that needs to be corrected
     mdir |= (mdir & ASHIFT_FIT_LINES_BOTH) == 0 ? ASHIFT_FIT_LINES_BOTH : 0;
   }
@@ -2177,16 +2461,16 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
   {
     // we use vertical lines for fitting
     fit.linetype |= ASHIFT_LINE_DIRVERT;
-    fit.weight += g->vertical_weight;
-    enough_lines = enough_lines && (g->vertical_count >= MINIMUM_FITLINES);
+    fit.weight += st->vertical_weight;
+    enough_lines = enough_lines && (st->vertical_count >= MINIMUM_FITLINES);
   }
 
   if(mdir & ASHIFT_FIT_LINES_HOR)
   {
     // we use horizontal lines for fitting
     fit.linetype |= 0;
-    fit.weight += g->horizontal_weight;
-    enough_lines = enough_lines && (g->horizontal_count >= MINIMUM_FITLINES);
+    fit.weight += st->horizontal_weight;
+    enough_lines = enough_lines && (st->horizontal_count >= MINIMUM_FITLINES);
   }
 
   // this needs to come after ASHIFT_FIT_LINES_VERT and ASHIFT_FIT_LINES_HOR
@@ -2717,6 +3001,26 @@ static void crop_adjust(dt_iop_module_t *module, const dt_iop_ashift_params_t *c
   return;
 }
 
+// structural data as currently held by the gui
+static void gui_structure(const dt_iop_ashift_gui_data_t *g, dt_iop_ashift_structure_t *st)
+{
+  st->lines = g->lines;
+  st->lines_count = g->lines_count;
+  st->vertical_count = g->vertical_count;
+  st->horizontal_count = g->horizontal_count;
+  st->vertical_weight = g->vertical_weight;
+  st->horizontal_weight = g->horizontal_weight;
+  st->width = g->lines_in_width;
+  st->height = g->lines_in_height;
+  st->x_off = g->lines_x_off;
+  st->y_off = g->lines_y_off;
+  st->isflipped = g->isflipped;
+  st->rotation_range = g->rotation_range;
+  st->lensshift_v_range = g->lensshift_v_range;
+  st->lensshift_h_range = g->lensshift_h_range;
+  st->shear_range = g->shear_range;
+}
+
 // helper function to start analysis for structural data and report about errors
 static int do_get_structure(dt_iop_module_t *module, dt_iop_ashift_params_t *p,
                             dt_iop_ashift_enhance_t enhance)
@@ -2748,7 +3052,14 @@ static int do_get_structure(dt_iop_module_t *module, dt_iop_ashift_params_t *p,
     goto error;
   }
 
-  if(!remove_outliers(module))
+  dt_iop_ashift_structure_t st;
+  gui_structure(g, &st);
+  const int removed = remove_outliers(&st);
+  g->vertical_count = st.vertical_count;
+  g->horizontal_count = st.horizontal_count;
+  g->lines_version++;
+
+  if(!removed)
   {
     dt_control_log(_("could not run outlier removal"));
 #ifdef ASHIFT_DEBUG
@@ -2799,7 +3110,9 @@ static int do_fit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_ash
 
   g->fitting = 1;
 
-  dt_iop_ashift_nmsresult_t res = nmsfit(module, p, dir);
+  dt_iop_ashift_structure_t st;
+  gui_structure(g, &st);
+  dt_iop_ashift_nmsresult_t res = nmsfit(&st, p, dir);
 
   switch(res)
   {
@@ -85,7 +85,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_TILING_CONCURRENT | IOP_FLAGS_SUPPORTS_BLENDING;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -208,7 +208,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   else
   {
     for(int k = 0; k < 5; k++) sigma[k] = 1.0f / sigma[k];
-    PermutohedralLattice<5, 4> lattice((size_t)roi_in->width * roi_in->height, dt_get_num_threads());
+    // one hash table per thread of our team, which is smaller when tiles are processed concurrently
+    PermutohedralLattice<5, 4> lattice((size_t)roi_in->width * roi_in->height, dt_get_team_threads());
 
 // splat into the lattice
 #ifdef _OPENMP
@@ -297,8 +298,10 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   sigma[0] = data->sigma[0] * roi_in->scale / piece->iscale;
   sigma[1] = data->sigma[1] * roi_in->scale / piece->iscale;
   const int rad = (int)(3.0 * fmaxf(sigma[0], sigma[1]) + 1.0);
+  const int threads = dt_get_team_threads();
   tiling->factor = 2.0 /*input+output*/ + 80.0/16/*worst-case hashtable*/ + 52.0/16/*replay buffer*/;
-  tiling->overhead = 0;
+  // the hash tables of all threads start out with 32k entries and 16k keys and values
+  tiling->overhead = (size_t)threads * ((1 << 15) * sizeof(int) + (1 << 14) * 2 * 16);
   tiling->overlap = rad;
   tiling->xalign = 1;
   tiling->yalign = 1;
@@ -28,6 +28,7 @@
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe_blur.h"
 #include "develop/tiling.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -128,33 +129,46 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const float scale = 1.0f / exp2f(-1.0f * (fmin(100.0f, data->strength + 1.0f) / 100.0f));
 
   const float threshold = data->threshold;
-/* get the thresholded lights into buffer */
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(npixels, scale, threshold) \
-  shared(blurlightness) \
-  dt_omp_sharedconst(in) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < npixels; k++)
-  {
-    const float L = in[4*k] * scale;
-    blurlightness[k] = (L > threshold) ? L : 0.0f;
-  }
 
   /* horizontal blur into memchannel lightness */
   const int range = 2 * radius + 1;
   const int hr = range / 2;
 
-  dt_box_mean(blurlightness, roi_out->height, roi_out->width, 1, hr, BOX_ITERATIONS);
+  // the blurred lights don't depend on anything else, so they can be reused from an earlier run
+  const struct
+  {
+    float scale, threshold;
+    int hr;
+  } params = { scale, threshold, hr };
+  const size_t size = sizeof(float) * npixels;
+  const uint64_t key = dt_dev_pixelpipe_blur_key(piece, roi_in, "bloom", &params, sizeof(params));
+  if(!dt_dev_pixelpipe_blur_get(piece, key, blurlightness, size))
+  {
+    /* get the thresholded lights into buffer */
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) \
+      dt_omp_firstprivate(npixels, scale, threshold) \
+      shared(blurlightness) \
+      dt_omp_sharedconst(in) \
+      schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++)
+    {
+      const float L = in[4*k] * scale;
+      blurlightness[k] = (L > threshold) ? L : 0.0f;
+    }
+
+    dt_box_mean(blurlightness, roi_out->height, roi_out->width, 1, hr, BOX_ITERATIONS);
+    dt_dev_pixelpipe_blur_put(piece, key, blurlightness, size);
+  }
 
-/* screen blend lightness with original */
+  /* screen blend lightness with original */
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(npixels) \
-  shared(blurlightness) \
-  dt_omp_sharedconst(in, out) \
-  schedule(static)
+  #pragma omp parallel for default(none) \
+    dt_omp_firstprivate(npixels) \
+    shared(blurlightness) \
+    dt_omp_sharedconst(in, out) \
+    schedule(static)
 #endif
   for(size_t k = 0; k < npixels; k++)
   {
@@ -32,9 +32,6 @@
 #include <gtk/gtk.h>
 #include <stdlib.h>
 
-#if defined(__SSE__)
-#include <xmmintrin.h>
-#endif
 
 // this is the version of the modules parameters,
 // and includes version information about compile-time dt
@@ -42,6 +39,12 @@ DT_MODULE_INTROSPECTION(2, dt_iop_cacorrect_params_t)
 
 #pragma GCC diagnostic ignored "-Wshadow"
 
+// the corrections are computed for every pixel and then selected, which needs non trapping math for the
+// selections to be if-converted and the loops vectorized
+#ifdef __GNUC__
+#pragma GCC optimize ("no-trapping-math")
+#endif
+
 typedef enum dt_iop_cacorrect_errror_t
 {
   CACORRECT_ERROR_NO = 0,
@@ -77,6 +80,12 @@ typedef struct dt_iop_cacorrect_data_t
 {
   uint32_t avoidshift;
   uint32_t iterations;
+  // the CA shift polynomials fitted in each iteration of the last run. they only depend on the input and
+  // the roi, so reprocessing with the same ones skips the diagnostic pass.
+  uint64_t fit_hash;
+  uint32_t fit_iterations; // 0 if there is no valid fit
+  int fit_polyord[CACORRETC_MULTI_5];
+  double fitparams[CACORRETC_MULTI_5][2][2][16];
 } dt_iop_cacorrect_data_t;
 
 // this returns a translatable name
@@ -103,7 +112,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_GUI_STATE;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -134,84 +143,6 @@ int legacy_params(dt_iop_module_t *self, const void *const old_params, const int
 #define INLINE inline
 #endif
 
-#ifdef __SSE2__
-
-typedef __m128i vmask;
-typedef __m128 vfloat;
-
-#define ZEROV _mm_setzero_ps()
-#define F2V(a) _mm_set1_ps((a))
-#define STVFU(x, y) _mm_storeu_ps(&x, y)
-#define LVFU(x) _mm_loadu_ps(&x)
-
-#define STC2VFU(a, v)                                                                                        \
-  {                                                                                                          \
-    __m128 TST1V = _mm_loadu_ps(&a);                                                                         \
-    __m128 TST2V = _mm_unpacklo_ps(v, v);                                                                    \
-    vmask cmask = _mm_set_epi32(0xffffffff, 0, 0xffffffff, 0);                                               \
-    _mm_storeu_ps(&a, vself(cmask, TST1V, TST2V));                                                           \
-    TST1V = _mm_loadu_ps((&a) + 4);                                                                          \
-    TST2V = _mm_unpackhi_ps(v, v);                                                                           \
-    _mm_storeu_ps((&a) + 4, vself(cmask, TST1V, TST2V));                                                     \
-  }
-
-static INLINE vfloat LC2VFU(float *a)
-{
-  // Load 8 floats from a and combine a[0],a[2],a[4] and a[6] into a vector of 4 floats
-  vfloat a1 = _mm_loadu_ps(a);
-  vfloat a2 = _mm_loadu_ps((a) + 4);
-  return _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(2, 0, 2, 0));
-}
-static INLINE vfloat SQRV(vfloat a)
-{
-  return a * a;
-}
-static INLINE vfloat vmul2f(vfloat a)
-{
-  // fastest way to multiply by 2
-  return a + a;
-}
-static INLINE vfloat vcast_vf_f(float f)
-{
-  return _mm_set_ps(f, f, f, f);
-}
-static INLINE vmask vorm(vmask x, vmask y)
-{
-  return _mm_or_si128(x, y);
-}
-static INLINE vmask vandm(vmask x, vmask y)
-{
-  return _mm_and_si128(x, y);
-}
-static INLINE vmask vandnotm(vmask x, vmask y)
-{
-  return _mm_andnot_si128(x, y);
-}
-static INLINE vfloat vabsf(vfloat f)
-{
-  return (vfloat)vandnotm((vmask)vcast_vf_f(-0.0f), (vmask)f);
-}
-static INLINE vfloat vself(vmask mask, vfloat x, vfloat y)
-{
-  return (vfloat)vorm(vandm(mask, (vmask)x), vandnotm(mask, (vmask)y));
-}
-static INLINE float vhadd(vfloat a)
-{
-  // returns a[0] + a[1] + a[2] + a[3]
-  a += _mm_movehl_ps(a, a);
-  return _mm_cvtss_f32(_mm_add_ss(a, _mm_shuffle_ps(a, a, 1)));
-}
-static INLINE vfloat vintpf(vfloat a, vfloat b, vfloat c)
-{
-  // calculate a * b + (1 - a) * c (interpolate two values)
-  // following is valid:
-  // vintpf(a, b+x, c+x) = vintpf(a, b, c) + x
-  // vintpf(a, b*x, c*x) = vintpf(a, b, c) * x
-  return a * (b - c) + c;
-}
-
-#endif // __SSE2__
-
 static INLINE float SQR(float x)
 {
   //      return std::pow(x,2); Slower than:
@@ -357,6 +288,7 @@ static inline void pixSort(float *a, float *b)
   There is no "maths background" so i chose this after a lot of testing.
 */
 #define CA_SIZE_MINIMUM (1600)
+__DT_CLONE_TARGETS__
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const i, void *const o,
                     const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -416,6 +348,12 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
         return;
       }
 
+  // hash of the input and the roi to check for a fit to reuse
+  uint64_t hash = dt_dev_pixelpipe_cache_basichash_prior(piece->pipe->image.id, piece->pipe, self);
+  const char *roi_str = (const char *)roi_in;
+  for(size_t k = 0; k < sizeof(dt_iop_roi_t); k++) hash = ((hash << 5) + hash) ^ roi_str[k];
+  const gboolean refit = d->fit_iterations != iterations || d->fit_hash != hash;
+
   if(avoidshift)
   {
     const size_t buffsize = h_width * h_height;
@@ -497,6 +435,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     const size_t buffersize = sizeof(float) * 3 * ts * ts + 6 * sizeof(float) * ts * tsh + 8 * 64 + 63;
     char *buffer = (char *)malloc(buffersize);
     char *data = (char *)(((uintptr_t)buffer + (uintptr_t)63) / 64 * 64);
+    // only the rgb data has to be cleared for each tile, the filters are written before they are read
+    const size_t rgbsize = 3 * sizeof(float) * ts * ts + 2 * 64;
 
     // shift the beginning of all arrays but the first by 64 bytes to avoid cache miss conflicts on CPUs which
     // have <=4-way associative L1-Cache
@@ -532,7 +472,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       for(int top = -border; top < height; top += ts - border2)
         for(int left = -border; left < width; left += ts - border2)
         {
-          memset(buffer, 0, buffersize);
+          memset(data, 0, rgbsize);
           const int vblock = ((top + border) / (ts - border2)) + 1;
           const int hblock = ((left + border) / (ts - border2)) + 1;
           const int bottom = MIN(top + ts, height + border);
@@ -646,41 +586,12 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 // end of initialization
 
 
-#ifdef __SSE2__
-          vfloat onev = F2V(1.f);
-          vfloat epsv = F2V(eps);
-#endif
           for(int rr = 3; rr < rr1 - 3; rr++)
           {
             int row = rr + top;
             int cc = 3 + (FC(rr, 3, filters) & 1);
             int indx = rr * ts + cc;
             int c = FC(rr, cc, filters);
-#ifdef __SSE2__
-            for(; cc < cc1 - 9; cc += 8, indx += 8)
-            {
-              // compute directional weights using image gradients
-              vfloat wtuv = onev / SQRV(epsv + vabsf(LC2VFU(&rgb[1][indx + v1]) - LC2VFU(&rgb[1][indx - v1]))
-                                        + vabsf(LC2VFU(&rgb[c][indx]) - LC2VFU(&rgb[c][indx - v2]))
-                                        + vabsf(LC2VFU(&rgb[1][indx - v1]) - LC2VFU(&rgb[1][indx - v3])));
-              vfloat wtdv = onev / SQRV(epsv + vabsf(LC2VFU(&rgb[1][indx - v1]) - LC2VFU(&rgb[1][indx + v1]))
-                                        + vabsf(LC2VFU(&rgb[c][indx]) - LC2VFU(&rgb[c][indx + v2]))
-                                        + vabsf(LC2VFU(&rgb[1][indx + v1]) - LC2VFU(&rgb[1][indx + v3])));
-              vfloat wtlv = onev / SQRV(epsv + vabsf(LC2VFU(&rgb[1][indx + 1]) - LC2VFU(&rgb[1][indx - 1]))
-                                        + vabsf(LC2VFU(&rgb[c][indx]) - LC2VFU(&rgb[c][indx - 2]))
-                                        + vabsf(LC2VFU(&rgb[1][indx - 1]) - LC2VFU(&rgb[1][indx - 3])));
-              vfloat wtrv = onev / SQRV(epsv + vabsf(LC2VFU(&rgb[1][indx - 1]) - LC2VFU(&rgb[1][indx + 1]))
-                                        + vabsf(LC2VFU(&rgb[c][indx]) - LC2VFU(&rgb[c][indx + 2]))
-                                        + vabsf(LC2VFU(&rgb[1][indx + 1]) - LC2VFU(&rgb[1][indx + 3])));
-
-              // store in rgb array the interpolated G value at R/B grid points using directional weighted
-              // average
-              STC2VFU(rgb[1][indx], (wtuv * LC2VFU(&rgb[1][indx - v1]) + wtdv * LC2VFU(&rgb[1][indx + v1])
-                                     + wtlv * LC2VFU(&rgb[1][indx - 1]) + wtrv * LC2VFU(&rgb[1][indx + 1]))
-                                        / (wtuv + wtdv + wtlv + wtrv));
-            }
-
-#endif
             for(; cc < cc1 - 3; cc += 2, indx += 2)
             {
               // compute directional weights using image gradients
@@ -706,77 +617,48 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
             if(row > -1 && row < height)
             {
-              for(int col = MAX(left + 3, 0), indx = rr * ts + 3 - (left < 0 ? (left + 3) : 0);
-                  col < MIN(cc1 + left - 3, width); col++, indx++)
-              {
-                Gtmp[row * width + col] = rgb[1][indx];
-              }
+              const int col = MAX(left + 3, 0);
+              const int count = MIN(cc1 + left - 3, width) - col;
+              if(count > 0)
+                memcpy(Gtmp + (size_t)row * width + col, rgb[1] + rr * ts + col - left, sizeof(float) * count);
             }
           }
+
+          // the rest of the diagnostic pass only serves the fit
+          if(!refit) continue;
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-#ifdef __SSE2__
-          vfloat zd25v = F2V(0.25f);
-#endif
           for(int rr = 4; rr < rr1 - 4; rr++)
           {
-            int cc = 4 + (FC(rr, 2, filters) & 1), indx = rr * ts + cc, c = FC(rr, cc, filters);
-#ifdef __SSE2__
-            for(; cc < cc1 - 10; cc += 8, indx += 8)
-            {
-              vfloat rgb1v = LC2VFU(&rgb[1][indx]);
-              vfloat rgbcv = LC2VFU(&rgb[c][indx]);
-              vfloat temp1v
-                  = vabsf(vabsf((rgb1v - rgbcv) - (LC2VFU(&rgb[1][indx + v4]) - LC2VFU(&rgb[c][indx + v4])))
-                          + vabsf(LC2VFU(&rgb[1][indx - v4]) - LC2VFU(&rgb[c][indx - v4]) - rgb1v + rgbcv)
-                          - vabsf(LC2VFU(&rgb[1][indx - v4]) - LC2VFU(&rgb[c][indx - v4])
-                                  - LC2VFU(&rgb[1][indx + v4]) + LC2VFU(&rgb[c][indx + v4])));
-              STVFU(rbhpfv[indx >> 1], temp1v);
-              vfloat temp2v
-                  = vabsf(vabsf((rgb1v - rgbcv) - (LC2VFU(&rgb[1][indx + 4]) - LC2VFU(&rgb[c][indx + 4])))
-                          + vabsf(LC2VFU(&rgb[1][indx - 4]) - LC2VFU(&rgb[c][indx - 4]) - rgb1v + rgbcv)
-                          - vabsf(LC2VFU(&rgb[1][indx - 4]) - LC2VFU(&rgb[c][indx - 4])
-                                  - LC2VFU(&rgb[1][indx + 4]) + LC2VFU(&rgb[c][indx + 4])));
-              STVFU(rbhpfh[indx >> 1], temp2v);
-
-              // low and high pass 1D filters of G in vertical/horizontal directions
-              rgb1v = vmul2f(rgb1v);
-              vfloat glpfvv = zd25v * (rgb1v + LC2VFU(&rgb[1][indx + v2]) + LC2VFU(&rgb[1][indx - v2]));
-              vfloat glpfhv = zd25v * (rgb1v + LC2VFU(&rgb[1][indx + 2]) + LC2VFU(&rgb[1][indx - 2]));
-              rgbcv = vmul2f(rgbcv);
-              STVFU(rblpfv[indx >> 1],
-                    epsv + vabsf(glpfvv
-                                 - zd25v * (rgbcv + LC2VFU(&rgb[c][indx + v2]) + LC2VFU(&rgb[c][indx - v2]))));
-              STVFU(rblpfh[indx >> 1],
-                    epsv + vabsf(glpfhv
-                                 - zd25v * (rgbcv + LC2VFU(&rgb[c][indx + 2]) + LC2VFU(&rgb[c][indx - 2]))));
-              STVFU(grblpfv[indx >> 1],
-                    glpfvv + zd25v * (rgbcv + LC2VFU(&rgb[c][indx + v2]) + LC2VFU(&rgb[c][indx - v2])));
-              STVFU(grblpfh[indx >> 1],
-                    glpfhv + zd25v * (rgbcv + LC2VFU(&rgb[c][indx + 2]) + LC2VFU(&rgb[c][indx - 2])));
-            }
-
+            const int cc = 4 + (FC(rr, 2, filters) & 1), c = FC(rr, cc, filters);
+            const float *const g = rgb[1];
+            const float *const rb = rgb[c];
+            // the index into the half size buffers is counted separately so it's seen as linear
+            const int indx0 = rr * ts + cc;
+#ifdef _OPENMP
+#pragma omp simd
 #endif
-            for(; cc < cc1 - 4; cc += 2, indx += 2)
+            for(int k = 0; k < (cc1 - 3 - cc) / 2; k++)
             {
-              rbhpfv[indx >> 1] = fabsf(
-                  fabsf((rgb[1][indx] - rgb[c][indx]) - (rgb[1][indx + v4] - rgb[c][indx + v4]))
-                  + fabsf((rgb[1][indx - v4] - rgb[c][indx - v4]) - (rgb[1][indx] - rgb[c][indx]))
-                  - fabsf((rgb[1][indx - v4] - rgb[c][indx - v4]) - (rgb[1][indx + v4] - rgb[c][indx + v4])));
-              rbhpfh[indx >> 1] = fabsf(
-                  fabsf((rgb[1][indx] - rgb[c][indx]) - (rgb[1][indx + 4] - rgb[c][indx + 4]))
-                  + fabsf((rgb[1][indx - 4] - rgb[c][indx - 4]) - (rgb[1][indx] - rgb[c][indx]))
-                  - fabsf((rgb[1][indx - 4] - rgb[c][indx - 4]) - (rgb[1][indx + 4] - rgb[c][indx + 4])));
+              const int indx = indx0 + 2 * k, indx2 = (indx0 >> 1) + k;
+              rbhpfv[indx2] = fabsf(
+                  fabsf((g[indx] - rb[indx]) - (g[indx + v4] - rb[indx + v4]))
+                  + fabsf((g[indx - v4] - rb[indx - v4]) - (g[indx] - rb[indx]))
+                  - fabsf((g[indx - v4] - rb[indx - v4]) - (g[indx + v4] - rb[indx + v4])));
+              rbhpfh[indx2] = fabsf(
+                  fabsf((g[indx] - rb[indx]) - (g[indx + 4] - rb[indx + 4]))
+                  + fabsf((g[indx - 4] - rb[indx - 4]) - (g[indx] - rb[indx]))
+                  - fabsf((g[indx - 4] - rb[indx - 4]) - (g[indx + 4] - rb[indx + 4])));
 
               // low and high pass 1D filters of G in vertical/horizontal directions
-              float glpfv = 0.25f * (2.f * rgb[1][indx] + rgb[1][indx + v2] + rgb[1][indx - v2]);
-              float glpfh = 0.25f * (2.f * rgb[1][indx] + rgb[1][indx + 2] + rgb[1][indx - 2]);
-              rblpfv[indx >> 1]
-                  = eps + fabsf(glpfv - 0.25f * (2.f * rgb[c][indx] + rgb[c][indx + v2] + rgb[c][indx - v2]));
-              rblpfh[indx >> 1]
-                  = eps + fabsf(glpfh - 0.25f * (2.f * rgb[c][indx] + rgb[c][indx + 2] + rgb[c][indx - 2]));
-              grblpfv[indx >> 1]
-                  = glpfv + 0.25f * (2.f * rgb[c][indx] + rgb[c][indx + v2] + rgb[c][indx - v2]);
-              grblpfh[indx >> 1] = glpfh + 0.25f * (2.f * rgb[c][indx] + rgb[c][indx + 2] + rgb[c][indx - 2]);
+              float glpfv = 0.25f * (2.f * g[indx] + g[indx + v2] + g[indx - v2]);
+              float glpfh = 0.25f * (2.f * g[indx] + g[indx + 2] + g[indx - 2]);
+              rblpfv[indx2]
+                  = eps + fabsf(glpfv - 0.25f * (2.f * rb[indx] + rb[indx + v2] + rb[indx - v2]));
+              rblpfh[indx2]
+                  = eps + fabsf(glpfh - 0.25f * (2.f * rb[indx] + rb[indx + 2] + rb[indx - 2]));
+              grblpfv[indx2]
+                  = glpfv + 0.25f * (2.f * rb[indx] + rb[indx + v2] + rb[indx - v2]);
+              grblpfh[indx2] = glpfh + 0.25f * (2.f * rb[indx] + rb[indx + 2] + rb[indx - 2]);
             }
           }
 
@@ -791,118 +673,58 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
             }
           }
 
-#ifdef __SSE2__
-          vfloat zd3125v = F2V(0.3125f);
-          vfloat zd09375v = F2V(0.09375f);
-          vfloat zd1v = F2V(0.1f);
-          vfloat zd125v = F2V(0.125f);
-#endif
 
           // along line segments, find the point along each segment that minimizes the colour variance
           // averaged over the tile; evaluate for up/down and left/right away from R/B grid point
           for(int rr = 8; rr < rr1 - 8; rr++)
           {
-            int cc = 8 + (FC(rr, 2, filters) & 1);
-            int indx = rr * ts + cc;
-            int c = FC(rr, cc, filters);
-#ifdef __SSE2__
-            vfloat coeff00v = ZEROV;
-            vfloat coeff01v = ZEROV;
-            vfloat coeff02v = ZEROV;
-            vfloat coeff10v = ZEROV;
-            vfloat coeff11v = ZEROV;
-            vfloat coeff12v = ZEROV;
-            for(; cc < cc1 - 14; cc += 8, indx += 8)
-            {
-
-              // in linear interpolation, colour differences are a quadratic function of interpolation
-              // position;
-              // solve for the interpolation position that minimizes colour difference variance over the tile
-
-              // vertical
-              vfloat gdiffv
-                  = zd3125v * (LC2VFU(&rgb[1][indx + ts]) - LC2VFU(&rgb[1][indx - ts]))
-                    + zd09375v * (LC2VFU(&rgb[1][indx + ts + 1]) - LC2VFU(&rgb[1][indx - ts + 1])
-                                  + LC2VFU(&rgb[1][indx + ts - 1]) - LC2VFU(&rgb[1][indx - ts - 1]));
-              vfloat deltgrbv = LC2VFU(&rgb[c][indx]) - LC2VFU(&rgb[1][indx]);
-
-              vfloat gradwtv
-                  = vabsf(zd25v * LVFU(rbhpfv[indx >> 1])
-                          + zd125v * (LVFU(rbhpfv[(indx >> 1) + 1]) + LVFU(rbhpfv[(indx >> 1) - 1])))
-                    * (LVFU(grblpfv[(indx >> 1) - v1]) + LVFU(grblpfv[(indx >> 1) + v1]))
-                    / (epsv + zd1v * (LVFU(grblpfv[(indx >> 1) - v1]) + LVFU(grblpfv[(indx >> 1) + v1]))
-                       + LVFU(rblpfv[(indx >> 1) - v1]) + LVFU(rblpfv[(indx >> 1) + v1]));
-
-              coeff00v += gradwtv * deltgrbv * deltgrbv;
-              coeff01v += gradwtv * gdiffv * deltgrbv;
-              coeff02v += gradwtv * gdiffv * gdiffv;
-
-              // horizontal
-              gdiffv = zd3125v * (LC2VFU(&rgb[1][indx + 1]) - LC2VFU(&rgb[1][indx - 1]))
-                       + zd09375v * (LC2VFU(&rgb[1][indx + 1 + ts]) - LC2VFU(&rgb[1][indx - 1 + ts])
-                                     + LC2VFU(&rgb[1][indx + 1 - ts]) - LC2VFU(&rgb[1][indx - 1 - ts]));
-
-              gradwtv = vabsf(zd25v * LVFU(rbhpfh[indx >> 1])
-                              + zd125v * (LVFU(rbhpfh[(indx >> 1) + v1]) + LVFU(rbhpfh[(indx >> 1) - v1])))
-                        * (LVFU(grblpfh[(indx >> 1) - 1]) + LVFU(grblpfh[(indx >> 1) + 1]))
-                        / (epsv + zd1v * (LVFU(grblpfh[(indx >> 1) - 1]) + LVFU(grblpfh[(indx >> 1) + 1]))
-                           + LVFU(rblpfh[(indx >> 1) - 1]) + LVFU(rblpfh[(indx >> 1) + 1]));
-
-              coeff10v += gradwtv * deltgrbv * deltgrbv;
-              coeff11v += gradwtv * gdiffv * deltgrbv;
-              coeff12v += gradwtv * gdiffv * gdiffv;
-
-              //  In Mathematica,
-              //  f[x_]=Expand[Total[Flatten[
-              //  ((1-x) RotateLeft[Gint,shift1]+x
-              //  RotateLeft[Gint,shift2]-cfapad)^2[[dv;;-1;;2,dh;;-1;;2]]]]];
-              //  extremum = -.5Coefficient[f[x],x]/Coefficient[f[x],x^2]
-            }
-            coeff[0][0][c >> 1] += vhadd(coeff00v);
-            coeff[0][1][c >> 1] += vhadd(coeff01v);
-            coeff[0][2][c >> 1] += vhadd(coeff02v);
-            coeff[1][0][c >> 1] += vhadd(coeff10v);
-            coeff[1][1][c >> 1] += vhadd(coeff11v);
-            coeff[1][2][c >> 1] += vhadd(coeff12v);
-
+            const int cc = 8 + (FC(rr, 2, filters) & 1), c = FC(rr, cc, filters);
+            const float *const g = rgb[1];
+            const float *const rb = rgb[c];
+            // sums of the row, kept in registers
+            float cv0 = 0.f, cv1 = 0.f, cv2 = 0.f, ch0 = 0.f, ch1 = 0.f, ch2 = 0.f;
+            const int indx0 = rr * ts + cc;
+#ifdef _OPENMP
+#pragma omp simd reduction(+ : cv0, cv1, cv2, ch0, ch1, ch2)
 #endif
-            for(; cc < cc1 - 8; cc += 2, indx += 2)
+            for(int k = 0; k < (cc1 - 7 - cc) / 2; k++)
             {
+              const int indx = indx0 + 2 * k, indx2 = (indx0 >> 1) + k;
 
               // in linear interpolation, colour differences are a quadratic function of interpolation
               // position;
               // solve for the interpolation position that minimizes colour difference variance over the tile
 
               // vertical
-              float gdiff = 0.3125f * (rgb[1][indx + ts] - rgb[1][indx - ts])
-                            + 0.09375f * (rgb[1][indx + ts + 1] - rgb[1][indx - ts + 1]
-                                          + rgb[1][indx + ts - 1] - rgb[1][indx - ts - 1]);
-              float deltgrb = (rgb[c][indx] - rgb[1][indx]);
+              float gdiff = 0.3125f * (g[indx + ts] - g[indx - ts])
+                            + 0.09375f * (g[indx + ts + 1] - g[indx - ts + 1]
+                                          + g[indx + ts - 1] - g[indx - ts - 1]);
+              float deltgrb = (rb[indx] - g[indx]);
 
-              float gradwt = fabsf(0.25f * rbhpfv[indx >> 1]
-                                   + 0.125f * (rbhpfv[(indx >> 1) + 1] + rbhpfv[(indx >> 1) - 1]))
-                             * (grblpfv[(indx >> 1) - v1] + grblpfv[(indx >> 1) + v1])
-                             / (eps + 0.1f * (grblpfv[(indx >> 1) - v1] + grblpfv[(indx >> 1) + v1])
-                                + rblpfv[(indx >> 1) - v1] + rblpfv[(indx >> 1) + v1]);
+              float gradwt = fabsf(0.25f * rbhpfv[indx2]
+                                   + 0.125f * (rbhpfv[indx2 + 1] + rbhpfv[indx2 - 1]))
+                             * (grblpfv[indx2 - v1] + grblpfv[indx2 + v1])
+                             / (eps + 0.1f * (grblpfv[indx2 - v1] + grblpfv[indx2 + v1])
+                                + rblpfv[indx2 - v1] + rblpfv[indx2 + v1]);
 
-              coeff[0][0][c >> 1] += gradwt * deltgrb * deltgrb;
-              coeff[0][1][c >> 1] += gradwt * gdiff * deltgrb;
-              coeff[0][2][c >> 1] += gradwt * gdiff * gdiff;
+              cv0 += gradwt * deltgrb * deltgrb;
+              cv1 += gradwt * gdiff * deltgrb;
+              cv2 += gradwt * gdiff * gdiff;
 
               // horizontal
-              gdiff = 0.3125f * (rgb[1][indx + 1] - rgb[1][indx - 1])
-                      + 0.09375f * (rgb[1][indx + 1 + ts] - rgb[1][indx - 1 + ts] + rgb[1][indx + 1 - ts]
-                                    - rgb[1][indx - 1 - ts]);
+              gdiff = 0.3125f * (g[indx + 1] - g[indx - 1])
+                      + 0.09375f * (g[indx + 1 + ts] - g[indx - 1 + ts] + g[indx + 1 - ts]
+                                    - g[indx - 1 - ts]);
 
-              gradwt = fabsf(0.25f * rbhpfh[indx >> 1]
-                             + 0.125f * (rbhpfh[(indx >> 1) + v1] + rbhpfh[(indx >> 1) - v1]))
-                       * (grblpfh[(indx >> 1) - 1] + grblpfh[(indx >> 1) + 1])
-                       / (eps + 0.1f * (grblpfh[(indx >> 1) - 1] + grblpfh[(indx >> 1) + 1])
-                          + rblpfh[(indx >> 1) - 1] + rblpfh[(indx >> 1) + 1]);
+              gradwt = fabsf(0.25f * rbhpfh[indx2]
+                             + 0.125f * (rbhpfh[indx2 + v1] + rbhpfh[indx2 - v1]))
+                       * (grblpfh[indx2 - 1] + grblpfh[indx2 + 1])
+                       / (eps + 0.1f * (grblpfh[indx2 - 1] + grblpfh[indx2 + 1])
+                          + rblpfh[indx2 - 1] + rblpfh[indx2 + 1]);
 
-              coeff[1][0][c >> 1] += gradwt * deltgrb * deltgrb;
-              coeff[1][1][c >> 1] += gradwt * gdiff * deltgrb;
-              coeff[1][2][c >> 1] += gradwt * gdiff * gdiff;
+              ch0 += gradwt * deltgrb * deltgrb;
+              ch1 += gradwt * gdiff * deltgrb;
+              ch2 += gradwt * gdiff * gdiff;
 
               //  In Mathematica,
               //  f[x_]=Expand[Total[Flatten[
@@ -910,6 +732,12 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
               //  RotateLeft[Gint,shift2]-cfapad)^2[[dv;;-1;;2,dh;;-1;;2]]]]];
               //  extremum = -.5Coefficient[f[x],x]/Coefficient[f[x],x^2]
             }
+            coeff[0][0][c >> 1] += cv0;
+            coeff[0][1][c >> 1] += cv1;
+            coeff[0][2][c >> 1] += cv2;
+            coeff[1][0][c >> 1] += ch0;
+            coeff[1][1][c >> 1] += ch1;
+            coeff[1][2][c >> 1] += ch2;
           }
 
           for(int c = 0; c < 2; c++)
@@ -953,6 +781,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 #ifdef _OPENMP
 #pragma omp critical(cadetectpass2)
 #endif
+      if(refit)
       {
         for(int dir = 0; dir < 2; dir++)
           for(int c = 0; c < 2; c++)
@@ -970,186 +799,202 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 #pragma omp single
 #endif
       {
-        for(int dir = 0; dir < 2; dir++)
-          for(int c = 0; c < 2; c++)
-          {
-            if(blockdenom[dir][c])
-            {
-              blockvar[dir][c]
-                  = blocksqave[dir][c] / blockdenom[dir][c] - SQR(blockave[dir][c] / blockdenom[dir][c]);
-            }
-            else
-            {
-              processpasstwo = FALSE;
-              if(g) g->error = CACORRECT_ERROR_MATH;
-              fprintf(stderr, "blockdenom vanishes");
-              break;
-            }
-          }
-
-        // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-
-        // now prepare for CA correction pass
-        // first, fill border blocks of blockshift array
-        if(processpasstwo)
+        if(!refit)
+        {
+          // reuse the fit of the last run
+          polyord = d->fit_polyord[it];
+          numpar = polyord * polyord;
+          memcpy(fitparams, d->fitparams[it], sizeof(fitparams));
+          if(g && polyord == 2) g->error = CACORRECT_ERROR_LIN;
+        }
+        else
         {
-          for(int vblock = 1; vblock < vblsz - 1; vblock++)
-          { // left and right sides
+          for(int dir = 0; dir < 2; dir++)
             for(int c = 0; c < 2; c++)
             {
-              for(int i = 0; i < 2; i++)
+              if(blockdenom[dir][c])
               {
-                blockshifts[vblock * hblsz][c][i] = blockshifts[(vblock)*hblsz + 2][c][i];
-                blockshifts[vblock * hblsz + hblsz - 1][c][i] = blockshifts[(vblock)*hblsz + hblsz - 3][c][i];
+                blockvar[dir][c]
+                    = blocksqave[dir][c] / blockdenom[dir][c] - SQR(blockave[dir][c] / blockdenom[dir][c]);
               }
-            }
-          }
-
-          for(int hblock = 0; hblock < hblsz; hblock++)
-          { // top and bottom sides
-            for(int c = 0; c < 2; c++)
-            {
-              for(int i = 0; i < 2; i++)
+              else
               {
-                blockshifts[hblock][c][i] = blockshifts[2 * hblsz + hblock][c][i];
-                blockshifts[(vblsz - 1) * hblsz + hblock][c][i]
-                    = blockshifts[(vblsz - 3) * hblsz + hblock][c][i];
+                processpasstwo = FALSE;
+                if(g) g->error = CACORRECT_ERROR_MATH;
+                fprintf(stderr, "blockdenom vanishes");
+                break;
               }
             }
-          }
 
-          // end of filling border pixels of blockshift array
+          // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-          // initialize fit arrays
-          double polymat[2][2][256], shiftmat[2][2][16];
-
-          for(int i = 0; i < 256; i++)
-          {
-            polymat[0][0][i] = polymat[0][1][i] = polymat[1][0][i] = polymat[1][1][i] = 0;
-          }
-
-          for(int i = 0; i < 16; i++)
+          // now prepare for CA correction pass
+          // first, fill border blocks of blockshift array
+          if(processpasstwo)
           {
-            shiftmat[0][0][i] = shiftmat[0][1][i] = shiftmat[1][0][i] = shiftmat[1][1][i] = 0;
-          }
-
-          int numblox[2] = { 0, 0 };
-
-          for(int vblock = 1; vblock < vblsz - 1; vblock++)
-            for(int hblock = 1; hblock < hblsz - 1; hblock++)
-            {
-              // block 3x3 median of blockshifts for robustness
+            for(int vblock = 1; vblock < vblsz - 1; vblock++)
+            { // left and right sides
               for(int c = 0; c < 2; c++)
               {
-                float bstemp[2];
-                for(int dir = 0; dir < 2; dir++)
+                for(int i = 0; i < 2; i++)
                 {
-                  // temporary storage for median filter
-                  float p[9];
-                  p[0] = blockshifts[(vblock - 1) * hblsz + hblock - 1][c][dir];
-                  p[1] = blockshifts[(vblock - 1) * hblsz + hblock][c][dir];
-                  p[2] = blockshifts[(vblock - 1) * hblsz + hblock + 1][c][dir];
-                  p[3] = blockshifts[(vblock)*hblsz + hblock - 1][c][dir];
-                  p[4] = blockshifts[(vblock)*hblsz + hblock][c][dir];
-                  p[5] = blockshifts[(vblock)*hblsz + hblock + 1][c][dir];
-                  p[6] = blockshifts[(vblock + 1) * hblsz + hblock - 1][c][dir];
-                  p[7] = blockshifts[(vblock + 1) * hblsz + hblock][c][dir];
-                  p[8] = blockshifts[(vblock + 1) * hblsz + hblock + 1][c][dir];
-                  pixSort(&p[1], &p[2]);
-                  pixSort(&p[4], &p[5]);
-                  pixSort(&p[7], &p[8]);
-                  pixSort(&p[0], &p[1]);
-                  pixSort(&p[3], &p[4]);
-                  pixSort(&p[6], &p[7]);
-                  pixSort(&p[1], &p[2]);
-                  pixSort(&p[4], &p[5]);
-                  pixSort(&p[7], &p[8]);
-                  pixSort(&p[0], &p[3]);
-                  pixSort(&p[5], &p[8]);
-                  pixSort(&p[4], &p[7]);
-                  pixSort(&p[3], &p[6]);
-                  pixSort(&p[1], &p[4]);
-                  pixSort(&p[2], &p[5]);
-                  pixSort(&p[4], &p[7]);
-                  pixSort(&p[4], &p[2]);
-                  pixSort(&p[6], &p[4]);
-                  pixSort(&p[4], &p[2]);
-                  bstemp[dir] = p[4];
+                  blockshifts[vblock * hblsz][c][i] = blockshifts[(vblock)*hblsz + 2][c][i];
+                  blockshifts[vblock * hblsz + hblsz - 1][c][i] = blockshifts[(vblock)*hblsz + hblsz - 3][c][i];
                 }
+              }
+            }
 
-                // now prepare coefficient matrix; use only data points within caautostrength/2 std devs of
-                // zero
-                if(SQR(bstemp[0]) > caautostrength * blockvar[0][c]
-                   || SQR(bstemp[1]) > caautostrength * blockvar[1][c])
+            for(int hblock = 0; hblock < hblsz; hblock++)
+            { // top and bottom sides
+              for(int c = 0; c < 2; c++)
+              {
+                for(int i = 0; i < 2; i++)
                 {
-                  continue;
+                  blockshifts[hblock][c][i] = blockshifts[2 * hblsz + hblock][c][i];
+                  blockshifts[(vblsz - 1) * hblsz + hblock][c][i]
+                      = blockshifts[(vblsz - 3) * hblsz + hblock][c][i];
                 }
+              }
+            }
 
-                numblox[c]++;
+            // end of filling border pixels of blockshift array
 
-                for(int dir = 0; dir < 2; dir++)
+            // initialize fit arrays
+            double polymat[2][2][256], shiftmat[2][2][16];
+
+            for(int i = 0; i < 256; i++)
+            {
+              polymat[0][0][i] = polymat[0][1][i] = polymat[1][0][i] = polymat[1][1][i] = 0;
+            }
+
+            for(int i = 0; i < 16; i++)
+            {
+              shiftmat[0][0][i] = shiftmat[0][1][i] = shiftmat[1][0][i] = shiftmat[1][1][i] = 0;
+            }
+
+            int numblox[2] = { 0, 0 };
+
+            for(int vblock = 1; vblock < vblsz - 1; vblock++)
+              for(int hblock = 1; hblock < hblsz - 1; hblock++)
+              {
+                // block 3x3 median of blockshifts for robustness
+                for(int c = 0; c < 2; c++)
                 {
-                  double powVblockInit = 1.0;
-                  for(int i = 0; i < polyord; i++)
+                  float bstemp[2];
+                  for(int dir = 0; dir < 2; dir++)
+                  {
+                    // temporary storage for median filter
+                    float p[9];
+                    p[0] = blockshifts[(vblock - 1) * hblsz + hblock - 1][c][dir];
+                    p[1] = blockshifts[(vblock - 1) * hblsz + hblock][c][dir];
+                    p[2] = blockshifts[(vblock - 1) * hblsz + hblock + 1][c][dir];
+                    p[3] = blockshifts[(vblock)*hblsz + hblock - 1][c][dir];
+                    p[4] = blockshifts[(vblock)*hblsz + hblock][c][dir];
+                    p[5] = blockshifts[(vblock)*hblsz + hblock + 1][c][dir];
+                    p[6] = blockshifts[(vblock + 1) * hblsz + hblock - 1][c][dir];
+                    p[7] = blockshifts[(vblock + 1) * hblsz + hblock][c][dir];
+                    p[8] = blockshifts[(vblock + 1) * hblsz + hblock + 1][c][dir];
+                    pixSort(&p[1], &p[2]);
+                    pixSort(&p[4], &p[5]);
+                    pixSort(&p[7], &p[8]);
+                    pixSort(&p[0], &p[1]);
+                    pixSort(&p[3], &p[4]);
+                    pixSort(&p[6], &p[7]);
+                    pixSort(&p[1], &p[2]);
+                    pixSort(&p[4], &p[5]);
+                    pixSort(&p[7], &p[8]);
+                    pixSort(&p[0], &p[3]);
+                    pixSort(&p[5], &p[8]);
+                    pixSort(&p[4], &p[7]);
+                    pixSort(&p[3], &p[6]);
+                    pixSort(&p[1], &p[4]);
+                    pixSort(&p[2], &p[5]);
+                    pixSort(&p[4], &p[7]);
+                    pixSort(&p[4], &p[2]);
+                    pixSort(&p[6], &p[4]);
+                    pixSort(&p[4], &p[2]);
+                    bstemp[dir] = p[4];
+                  }
+
+                  // now prepare coefficient matrix; use only data points within caautostrength/2 std devs of
+                  // zero
+                  if(SQR(bstemp[0]) > caautostrength * blockvar[0][c]
+                     || SQR(bstemp[1]) > caautostrength * blockvar[1][c])
                   {
-                    double powHblockInit = 1.0;
-                    for(int j = 0; j < polyord; j++)
+                    continue;
+                  }
+
+                  numblox[c]++;
+
+                  for(int dir = 0; dir < 2; dir++)
+                  {
+                    double powVblockInit = 1.0;
+                    for(int i = 0; i < polyord; i++)
                     {
-                      double powVblock = powVblockInit;
-                      for(int m = 0; m < polyord; m++)
+                      double powHblockInit = 1.0;
+                      for(int j = 0; j < polyord; j++)
                       {
-                        double powHblock = powHblockInit;
-                        for(int n = 0; n < polyord; n++)
+                        double powVblock = powVblockInit;
+                        for(int m = 0; m < polyord; m++)
                         {
-                          polymat[c][dir][numpar * (polyord * i + j) + (polyord * m + n)]
-                              += powVblock * powHblock * blockwt[vblock * hblsz + hblock];
-                          powHblock *= hblock;
+                          double powHblock = powHblockInit;
+                          for(int n = 0; n < polyord; n++)
+                          {
+                            polymat[c][dir][numpar * (polyord * i + j) + (polyord * m + n)]
+                                += powVblock * powHblock * blockwt[vblock * hblsz + hblock];
+                            powHblock *= hblock;
+                          }
+                          powVblock *= vblock;
                         }
-                        powVblock *= vblock;
+                        shiftmat[c][dir][(polyord * i + j)]
+                            += powVblockInit * powHblockInit * bstemp[dir] * blockwt[vblock * hblsz + hblock];
+                        powHblockInit *= hblock;
                       }
-                      shiftmat[c][dir][(polyord * i + j)]
-                          += powVblockInit * powHblockInit * bstemp[dir] * blockwt[vblock * hblsz + hblock];
-                      powHblockInit *= hblock;
-                    }
-                    powVblockInit *= vblock;
-                  } // monomials
-                }   // dir
-              }     // c
-            }       // blocks
-
-          numblox[1] = MIN(numblox[0], numblox[1]);
-
-          // if too few data points, restrict the order of the fit to linear
-          if(numblox[1] < 32)
-          {
-            polyord = 2;
-            numpar = 4;
+                      powVblockInit *= vblock;
+                    } // monomials
+                  }   // dir
+                }     // c
+              }       // blocks
 
-            if(g) g->error = CACORRECT_ERROR_LIN;
+            numblox[1] = MIN(numblox[0], numblox[1]);
 
-            if(numblox[1] < 10)
+            // if too few data points, restrict the order of the fit to linear
+            if(numblox[1] < 32)
             {
-              if(g) g->error = CACORRECT_ERROR_MATH;
-              fprintf(stderr, ", numblox = %d \n", numblox[1]);
-              processpasstwo = FALSE;
-            }
-          }
+              polyord = 2;
+              numpar = 4;
 
-          if(processpasstwo)
+              if(g) g->error = CACORRECT_ERROR_LIN;
 
-            // fit parameters to blockshifts
-            for(int c = 0; c < 2; c++)
-              for(int dir = 0; dir < 2; dir++)
+              if(numblox[1] < 10)
               {
-                if(!LinEqSolve(numpar, polymat[c][dir], shiftmat[c][dir], fitparams[c][dir]))
+                if(g) g->error = CACORRECT_ERROR_MATH;
+                fprintf(stderr, ", numblox = %d \n", numblox[1]);
+                processpasstwo = FALSE;
+              }
+            }
+
+            if(processpasstwo)
+
+              // fit parameters to blockshifts
+              for(int c = 0; c < 2; c++)
+                for(int dir = 0; dir < 2; dir++)
                 {
-                  if(g) g->error = CACORRECT_ERROR_MATH;
-                  fprintf(stderr, ", correction pass failed -- can't solve linear equations for colour %d direction %d", c, dir);
-                  processpasstwo = FALSE;
+                  if(!LinEqSolve(numpar, polymat[c][dir], shiftmat[c][dir], fitparams[c][dir]))
+                  {
+                    if(g) g->error = CACORRECT_ERROR_MATH;
+                    fprintf(stderr, ", correction pass failed -- can't solve linear equations for colour %d direction %d", c, dir);
+                    processpasstwo = FALSE;
+                  }
                 }
-              }
-        }
+          }
 
+          if(processpasstwo)
+          {
+            d->fit_polyord[it] = polyord;
+            memcpy(d->fitparams[it], fitparams, sizeof(fitparams));
+          }
+        }
         // fitparams[polyord*i+j] gives the coefficients of (vblock^i hblock^j) in a polynomial fit for i,j<=4
       }
       // end of initialization for CA correction pass
@@ -1166,7 +1011,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       for(int top = -border; top < height; top += ts - border2)
         for(int left = -border; left < width; left += ts - border2)
         {
-          memset(buffer, 0, buffersize);
+          memset(data, 0, rgbsize);
           float lblockshifts[2][2];
           const int vblock = ((top + border) / (ts - border2)) + 1;
           const int hblock = ((left + border) / (ts - border2)) + 1;
@@ -1348,46 +1193,31 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
           for(int rr = 4; rr < rr1 - 4; rr++)
           {
-            int cc = 4 + (FC(rr, 2, filters) & 1);
-            int c = FC(rr, cc, filters);
-#ifdef __SSE2__
-            vfloat shifthfracv = F2V(shifthfrac[c]);
-            vfloat shiftvfracv = F2V(shiftvfrac[c]);
-            for(; cc < cc1 - 10; cc += 8)
-            {
-              // perform CA correction using colour ratios or colour differences
-              vfloat Ginthfloorv
-                  = vintpf(shifthfracv, LC2VFU(&rgb[1][(rr + shiftvfloor[c]) * ts + cc + shifthceil[c]]),
-                           LC2VFU(&rgb[1][(rr + shiftvfloor[c]) * ts + cc + shifthfloor[c]]));
-              vfloat Ginthceilv
-                  = vintpf(shifthfracv, LC2VFU(&rgb[1][(rr + shiftvceil[c]) * ts + cc + shifthceil[c]]),
-                           LC2VFU(&rgb[1][(rr + shiftvceil[c]) * ts + cc + shifthfloor[c]]));
-              // Gint is bilinear interpolation of G at CA shift point
-              vfloat Gintv = vintpf(shiftvfracv, Ginthceilv, Ginthfloorv);
-
-              // determine R/B at grid points using colour differences at shift point plus interpolated G
-              // value at grid point
-              // but first we need to interpolate G-R/G-B to grid points...
-              STVFU(grbdiff[((rr)*ts + cc) >> 1], Gintv - LC2VFU(&rgb[c][(rr)*ts + cc]));
-              STVFU(gshift[((rr)*ts + cc) >> 1], Gintv);
-            }
-
+            const int cc = 4 + (FC(rr, 2, filters) & 1), c = FC(rr, cc, filters);
+            const float *const g = rgb[1];
+            const float *const rb = rgb[c];
+            // offsets of the G values around the CA shift point
+            const int offff = shiftvfloor[c] * ts + shifthfloor[c], offfc = shiftvfloor[c] * ts + shifthceil[c];
+            const int offcf = shiftvceil[c] * ts + shifthfloor[c], offcc = shiftvceil[c] * ts + shifthceil[c];
+            const float hfrac = shifthfrac[c], vfrac = shiftvfrac[c];
+            const int indx0 = rr * ts + cc;
+#ifdef _OPENMP
+#pragma omp simd
 #endif
-            for(; cc < cc1 - 4; cc += 2)
+            for(int k = 0; k < (cc1 - 3 - cc) / 2; k++)
             {
+              const int indx = indx0 + 2 * k, indx2 = (indx0 >> 1) + k;
               // perform CA correction using colour ratios or colour differences
-              float Ginthfloor = intp(shifthfrac[c], rgb[1][(rr + shiftvfloor[c]) * ts + cc + shifthceil[c]],
-                                      rgb[1][(rr + shiftvfloor[c]) * ts + cc + shifthfloor[c]]);
-              float Ginthceil = intp(shifthfrac[c], rgb[1][(rr + shiftvceil[c]) * ts + cc + shifthceil[c]],
-                                     rgb[1][(rr + shiftvceil[c]) * ts + cc + shifthfloor[c]]);
+              float Ginthfloor = intp(hfrac, g[indx + offfc], g[indx + offff]);
+              float Ginthceil = intp(hfrac, g[indx + offcc], g[indx + offcf]);
               // Gint is bilinear interpolation of G at CA shift point
-              float Gint = intp(shiftvfrac[c], Ginthceil, Ginthfloor);
+              float Gint = intp(vfrac, Ginthceil, Ginthfloor);
 
               // determine R/B at grid points using colour differences at shift point plus interpolated G
               // value at grid point
               // but first we need to interpolate G-R/G-B to grid points...
-              grbdiff[((rr)*ts + cc) >> 1] = Gint - rgb[c][(rr)*ts + cc];
-              gshift[((rr)*ts + cc) >> 1] = Gint;
+              grbdiff[indx2] = Gint - rb[indx];
+              gshift[indx2] = Gint;
             }
           }
 
@@ -1396,65 +1226,56 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
           shiftvfrac[0] /= 2.f;
           shiftvfrac[2] /= 2.f;
 
-          // this loop does not deserve vectorization in mainly because the most expensive part with the
-          // divisions does not happen often (less than 1/10 in my tests)
+          // the gradient weighted interpolation is only needed where the colour differences change too much
+          // (less than 1/10 of the pixels in my tests), but computing it everywhere keeps the loop free of
+          // branches, so it vectorizes
           for(int rr = 8; rr < rr1 - 8; rr++)
-            for(int cc = 8 + (FC(rr, 2, filters) & 1), c = FC(rr, cc, filters), indx = rr * ts + cc;
-                cc < cc1 - 8; cc += 2, indx += 2)
+          {
+            const int cc = 8 + (FC(rr, 2, filters) & 1), c = FC(rr, cc, filters);
+            const float *const g = rgb[1];
+            float *const rb = rgb[c];
+            // offsets of the colour differences around the grid point in the half size buffers
+            const int offh = -GRBdir[1][c] / 2, offv = -GRBdir[0][c] * (ts / 2);
+            const float hfrac = shifthfrac[c], vfrac = shiftvfrac[c];
+            const int indx0 = rr * ts + cc;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+            for(int k = 0; k < (cc1 - 7 - cc) / 2; k++)
             {
+              const int indx = indx0 + 2 * k, indx2 = (indx0 >> 1) + k;
 
-              float grbdiffold = rgb[1][indx] - rgb[c][indx];
+              const float grbdiffold = g[indx] - rb[indx];
 
               // interpolate colour difference from optical R/B locations to grid locations
-              float grbdiffinthfloor
-                  = intp(shifthfrac[c], grbdiff[(indx - GRBdir[1][c]) >> 1], grbdiff[indx >> 1]);
-              float grbdiffinthceil
-                  = intp(shifthfrac[c], grbdiff[((rr - GRBdir[0][c]) * ts + cc - GRBdir[1][c]) >> 1],
-                         grbdiff[((rr - GRBdir[0][c]) * ts + cc) >> 1]);
+              const float grbdiffinthfloor = intp(hfrac, grbdiff[indx2 + offh], grbdiff[indx2]);
+              const float grbdiffinthceil = intp(hfrac, grbdiff[indx2 + offv + offh], grbdiff[indx2 + offv]);
               // grbdiffint is bilinear interpolation of G-R/G-B at grid point
-              float grbdiffint = intp(shiftvfrac[c], grbdiffinthceil, grbdiffinthfloor);
+              const float grbdiffintl = intp(vfrac, grbdiffinthceil, grbdiffinthfloor);
 
               // now determine R/B at grid points using interpolated colour differences and interpolated G
               // value at grid point
-              float RBint = rgb[1][indx] - grbdiffint;
-
-              if(fabsf(RBint - rgb[c][indx]) < 0.25f * (RBint + rgb[c][indx]))
-              {
-                if(fabsf(grbdiffold) > fabsf(grbdiffint))
-                {
-                  rgb[c][indx] = RBint;
-                }
-              }
-              else
-              {
-
-                // gradient weights using difference from G at CA shift points and G at grid points
-                float p0 = 1.0f / (eps + fabsf(rgb[1][indx] - gshift[indx >> 1]));
-                float p1 = 1.0f / (eps + fabsf(rgb[1][indx] - gshift[(indx - GRBdir[1][c]) >> 1]));
-                float p2 = 1.0f / (eps + fabsf(rgb[1][indx] - gshift[((rr - GRBdir[0][c]) * ts + cc) >> 1]));
-                float p3
-                    = 1.0f / (eps + fabsf(rgb[1][indx]
-                                          - gshift[((rr - GRBdir[0][c]) * ts + cc - GRBdir[1][c]) >> 1]));
-
-                grbdiffint = (p0 * grbdiff[indx >> 1] + p1 * grbdiff[(indx - GRBdir[1][c]) >> 1]
-                              + p2 * grbdiff[((rr - GRBdir[0][c]) * ts + cc) >> 1]
-                              + p3 * grbdiff[((rr - GRBdir[0][c]) * ts + cc - GRBdir[1][c]) >> 1])
-                             / (p0 + p1 + p2 + p3);
-
-                // now determine R/B at grid points using interpolated colour differences and interpolated G
-                // value at grid point
-                if(fabsf(grbdiffold) > fabsf(grbdiffint))
-                {
-                  rgb[c][indx] = rgb[1][indx] - grbdiffint;
-                }
-              }
-
-              // if colour difference interpolation overshot the correction, just desaturate
-              if(grbdiffold * grbdiffint < 0)
-              {
-                rgb[c][indx] = rgb[1][indx] - 0.5f * (grbdiffold + grbdiffint);
-              }
+              const float RBint = g[indx] - grbdiffintl;
+
+              // gradient weights using difference from G at CA shift points and G at grid points
+              const float p0 = 1.0f / (eps + fabsf(g[indx] - gshift[indx2]));
+              const float p1 = 1.0f / (eps + fabsf(g[indx] - gshift[indx2 + offh]));
+              const float p2 = 1.0f / (eps + fabsf(g[indx] - gshift[indx2 + offv]));
+              const float p3 = 1.0f / (eps + fabsf(g[indx] - gshift[indx2 + offv + offh]));
+              const float grbdiffintw = (p0 * grbdiff[indx2] + p1 * grbdiff[indx2 + offh]
+                                         + p2 * grbdiff[indx2 + offv] + p3 * grbdiff[indx2 + offv + offh])
+                                        / (p0 + p1 + p2 + p3);
+              const float grbdiffint
+                  = fabsf(RBint - rb[indx]) < 0.25f * (RBint + rb[indx]) ? grbdiffintl : grbdiffintw;
+
+              // only correct where that reduces the colour difference. if colour difference interpolation
+              // overshot the correction, just desaturate
+              const float corrected = g[indx] - grbdiffint;
+              const float desaturated = g[indx] - 0.5f * (grbdiffold + grbdiffint);
+              const float out = fabsf(grbdiffold) > fabsf(grbdiffint) ? corrected : rb[indx];
+              rb[indx] = grbdiffold * grbdiffint < 0 ? desaturated : out;
             }
+          }
 
           // copy CA corrected results to temporary image matrix
           for(int rr = border; rr < rr1 - border; rr++)
@@ -1492,6 +1313,12 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
   }
 
+  if(refit)
+  {
+    d->fit_hash = hash;
+    d->fit_iterations = processpasstwo ? iterations : 0;
+  }
+
   if(avoidshift && processpasstwo)
   {
     // to avoid or at least reduce the colour shift caused by raw ca correction we compute the per pixel difference factors
@@ -1642,11 +1469,12 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   free(piece->data);
-  piece->data = malloc(sizeof(dt_iop_cacorrect_data_t));
+  piece->data = calloc(1, sizeof(dt_iop_cacorrect_data_t));
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  free(piece->data);
   piece->data = NULL;
 }
 
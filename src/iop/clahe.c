@@ -25,6 +25,7 @@
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe.h"
 #include "dtgtk/resetlabel.h"
 #include "gui/gtk.h"
 #include "iop/iop_api.h"
@@ -91,7 +92,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const int ch = piece->colors;
 
   // PASS1: Get a luminance map of image...
-  float *luminance = (float *)malloc(sizeof(float) * ((size_t)roi_out->width * roi_out->height));
+  float *luminance = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, (size_t)roi_out->width * roi_out->height);
 // double lsmax=0.0,lsmin=1.0;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
@@ -248,7 +249,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   dt_free_align(dest_buf);
 
   // Cleanup
-  free(luminance);
+  dt_dev_pixelpipe_pool_free(piece->pipe, luminance);
 
 #undef BINS
 }
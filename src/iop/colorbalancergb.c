@@ -118,6 +118,11 @@ typedef struct dt_iop_colorbalancergb_data_t
   float max_chroma;
   gboolean lut_inited;
   struct dt_iop_order_iccprofile_info_t *work_profile;
+  // pipe RGB to grading RGB and back, set up for each run from the current profile
+  float input_matrix[3][4];
+  float output_matrix[3][4];
+  float white_grading_RGB[4];
+  gboolean matrices_ready;
 } dt_iop_colorbalancergb_data_t;
 
 const char *name()
@@ -242,12 +247,12 @@ static void mat3mul4(float *dst, const float *const m1, const float *const m2)
 }
 
 
-void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+// matrices between the pipe RGB and grading RGB for the current working profile
+static gboolean _prepare_matrices(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
 {
   dt_iop_colorbalancergb_data_t *d = (dt_iop_colorbalancergb_data_t *)piece->data;
   const struct dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_current_profile_info(self, piece->pipe);
-  if(work_profile == NULL) return; // no point
+  if(work_profile == NULL) return FALSE; // no point
 
   float DT_ALIGNED_ARRAY RGB_to_XYZ[3][4];
   float DT_ALIGNED_ARRAY XYZ_to_RGB[3][4];
@@ -269,18 +274,162 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
                                        {-0.08217531f,  0.05979694f,  1.27957582f, 0.f } };
 
   // Premultiply the pipe RGB -> XYZ and XYZ -> grading RGB matrices to spare 2 matrix products per pixel
-  float DT_ALIGNED_ARRAY input_matrix[3][4];
-  float DT_ALIGNED_ARRAY output_matrix[3][4];
-  mat3mul4((float *)input_matrix, (float *)XYZ_to_gradRGB, (float *)RGB_to_XYZ);
-  mat3mul4((float *)output_matrix, (float *)XYZ_to_RGB, (float *)gradRGB_to_XYZ);
+  mat3mul4((float *)d->input_matrix, (float *)XYZ_to_gradRGB, (float *)RGB_to_XYZ);
+  mat3mul4((float *)d->output_matrix, (float *)XYZ_to_RGB, (float *)gradRGB_to_XYZ);
 
   // Test white point of the current space in grading RGB
   const float white_pipe_RGB[4] = { 1.f, 1.f, 1.f };
-  float white_grading_RGB[4] = { 0.f };
-  dot_product(white_pipe_RGB, input_matrix, white_grading_RGB);
+  float *const white_grading_RGB = d->white_grading_RGB;
+  dot_product(white_pipe_RGB, d->input_matrix, white_grading_RGB);
   const float sum_white = white_grading_RGB[0] + white_grading_RGB[1] + white_grading_RGB[2];
   for_four_channels(c) white_grading_RGB[c] /= sum_white;
 
+  return TRUE;
+}
+
+static inline void _colorbalance_pixel(const dt_iop_colorbalancergb_data_t *const d,
+                                       const float input_matrix[3][4], const float output_matrix[3][4],
+                                       const float white_grading_RGB[4], const float *const gamut_LUT,
+                                       const float *const global, const float *const highlights,
+                                       const float *const shadows, const float *const midtones,
+                                       const float *const chroma, const float *const saturation,
+                                       const float *const purity, const float *const pix_in,
+                                       float *const pix_out)
+{
+  float DT_ALIGNED_PIXEL Ych[4] = { 0.f };
+  float DT_ALIGNED_PIXEL RGB[4] = { 0.f };
+
+  for(size_t c = 0; c < 4; ++c) Ych[c] = fmaxf(pix_in[c], 0.0f);
+  dot_product(Ych, input_matrix, RGB);
+  gradingRGB_to_Ych(RGB, Ych, white_grading_RGB);
+
+  // Sanitize input : no negative luminance
+  float Y = fmaxf(Ych[0], 0.f);
+  const int is_black = (Y == 0.f);
+
+  // Opacities for luma masks
+  const float x_offset = (Y - 0.1845f) / 0.1845f;
+
+  const float alpha = 1.f / (1.f + expf(x_offset * d->shadows_weight));         // opacity of shadows
+  const float gamma = expf(-0.1845f * x_offset * x_offset / (d->shadows_weight * d->highlights_weight));
+  const float beta = 1.f / (1.f + expf(- x_offset * d->highlights_weight));     // opacity of highlights
+  const float DT_ALIGNED_PIXEL opacities[4] = { alpha, gamma, beta, 0.f };
+  const float alpha_comp = 1.f - alpha;
+  const float beta_comp = 1.f - beta;
+
+  // Hue shift - do it now because we need the gamut limit at output hue right after
+  Ych[2] += d->hue_angle;
+
+  // Get max allowed chroma in working RGB gamut at current output hue
+  const float max_chroma_h = (is_black) ? 0.f : gamut_LUT[CLAMP((size_t)(LUT_ELEM / 2. * (Ych[2] + M_PI) / M_PI), 0, LUT_ELEM - 1)];
+  float C = (is_black) ? 0.f : fminf(Ych[1], max_chroma_h);
+
+  // Linear chroma : distance to achromatic at constant luminance in scene-referred
+  // - in case we desaturate, we do so by a constant factor
+  // - in case we resaturate, we normalize the correction by the max chroma allowed at current hue
+  //   to prevent users from pushing saturated colors outside of gamut while the low-sat ones
+  //   are still muted.
+  const float chroma_boost = d->chroma_global + scalar_product(opacities, chroma);
+  const float chroma_norm = (chroma_boost > 0.f) ? max_chroma_h / d->max_chroma : 1.f;
+  const float chroma_factor = fmaxf(1.f + chroma_boost * chroma_norm, 0.f);
+  Ych[1] = fminf(C * chroma_factor, max_chroma_h);
+  Ych_to_gradingRGB(Ych, RGB, white_grading_RGB);
+
+  /* Color balance */
+  for(size_t c = 0; c < 4; ++c)
+  {
+    // global : offset
+    RGB[c] = RGB[c] + global[c];
+
+    //  highlights, shadows : 2 slopes with masking
+    RGB[c] *= beta_comp * (alpha_comp + alpha * shadows[c]) + beta * highlights[c];
+    // factorization of : (RGB[c] * (1.f - alpha) + RGB[c] * d->shadows[c] * alpha) * (1.f - beta)  + RGB[c] * d->highlights[c] * beta;
+
+    // midtones : power with sign preservation
+    const float sign = (RGB[c] < 0.f) ? -1.f : 1.f;
+    RGB[c] = sign * powf(fabsf(RGB[c]) / d->midtones_weight, midtones[c]) * d->midtones_weight;
+  }
+
+  // for the Y midtones power (gamma), we need to go in Ych again because RGB doesn't preserve color
+  gradingRGB_to_Ych(RGB, Ych, white_grading_RGB);
+  Y = Ych[0] = powf(fmaxf(Ych[0] / d->midtones_weight, 0.f), d->midtones_Y) * d->midtones_weight;
+  Ych_to_gradingRGB(Ych, RGB, white_grading_RGB);
+
+  /* Perceptual color adjustments */
+
+   // grading RGB to CIE 1931 XYZ 2° D65
+  const float RGB_to_XYZ_D65[3][4] = { { 1.64004888f, -0.10969806f, 0.49329934f, 0.f },
+                                       { 0.61055787f, 0.47749658f, -0.08730269f, 0.f },
+                                       { -0.10698534f, 0.07785058f, 1.66590006f, 0.f } };
+
+  const float XYZ_to_RGB_D65[3][4] = { { 0.54392489f, 0.14993776f, -0.15320716f, 0.f },
+                                       { -0.68327274f, 1.88816348f, 0.30127843f, 0.f },
+                                       { 0.06686186f, -0.07860825f, 0.57635773f, 0.f } };
+
+  // Go to JzAzBz for perceptual saturation
+  // We can't use gradingRGB_to_XYZ() since it also does chromatic adaptation to D50
+  // and JzAzBz uses D65, same as grading RGB. So we use the matrices above instead
+  float DT_ALIGNED_PIXEL Jab[4] = { 0.f };
+  dot_product(RGB, RGB_to_XYZ_D65, Ych);
+  dt_XYZ_2_JzAzBz(Ych, Jab);
+
+  // Convert to JCh
+  float JC[2] = { Jab[0], hypotf(Jab[1], Jab[2]) };               // brightness/chroma vector
+  const float h = (JC[1] == 0.f) ? 0.f : atan2f(Jab[2], Jab[1]);  // hue : (a, b) angle
+
+  // Project JC to S, the saturation eigenvector, with orthogonal vector O.
+  // Note : O should be = (C * cosf(T) - J * sinf(T)) = 0 since S is the eigenvector,
+  // so we add the chroma projected along the orthogonal axis to get some control value
+  const float T = atan2f(JC[1], JC[0]); // angle of the eigenvector over the hue plane
+  const float sin_T = sinf(T);
+  const float cos_T = cosf(T);
+  const float DT_ALIGNED_PIXEL M_rot_dir[2][2] = { {  cos_T,  sin_T },
+                                                   { -sin_T,  cos_T } };
+  const float DT_ALIGNED_PIXEL M_rot_inv[2][2] = { {  cos_T, -sin_T },
+                                                   {  sin_T,  cos_T } };
+  float SO[2];
+
+  // Purity & Saturation : mix of chroma and luminance
+  const float boosts[2] = { 1.f + d->purity_global + scalar_product(opacities, purity),     // move in S direction
+                            d->saturation_global + scalar_product(opacities, saturation) }; // move in O direction
+
+  SO[0] = fmaxf(JC[0] * M_rot_dir[0][0] + JC[1] * M_rot_dir[0][1] * boosts[0], 0.f);
+  SO[1] = JC[0] * fminf(fmaxf(T * boosts[1], -T), DT_M_PI_F / 2.f - T);
+
+  // Project back to JCh, that is rotate back of -T angle
+  JC[0] = fmaxf(SO[0] * M_rot_inv[0][0] + SO[1] * M_rot_inv[0][1], 0.f);
+  JC[1] = fmaxf(SO[0] * M_rot_inv[1][0] + SO[1] * M_rot_inv[1][1], 0.f);
+
+  // Project back to JzAzBz
+  Jab[0] = JC[0];
+  Jab[1] = JC[1] * cosf(h);
+  Jab[2] = JC[1] * sinf(h);
+
+  dt_JzAzBz_2_XYZ(Jab, Ych);
+  dot_product(Ych, XYZ_to_RGB_D65, RGB);
+  gradingRGB_to_Ych(RGB, Ych, white_grading_RGB);
+
+  /* Gamut mapping */
+  const float out_max_chroma_h = gamut_LUT[CLAMP((size_t)(LUT_ELEM / 2. * (Ych[2] + M_PI) / M_PI), 0, LUT_ELEM - 1)];
+  Ych[1] = fminf(Ych[1], out_max_chroma_h);
+
+  Ych_to_gradingRGB(Ych, RGB, white_grading_RGB);
+  dot_product(RGB, output_matrix, pix_out);
+  for(size_t c = 0; c < 3; ++c) pix_out[c] = fmaxf(pix_out[c], 0.f);
+  // pix_out may be pix_in when running fused with other pointwise modules, it is only written here
+  pix_out[3] = pix_in[3];
+}
+
+void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_colorbalancergb_data_t *d = (dt_iop_colorbalancergb_data_t *)piece->data;
+  if(!_prepare_matrices(self, piece)) return; // no point
+
+  const float(*const input_matrix)[4] = d->input_matrix;
+  const float(*const output_matrix)[4] = d->output_matrix;
+  const float *const restrict white_grading_RGB = d->white_grading_RGB;
+
   const float *const restrict in = __builtin_assume_aligned(((const float *const restrict)ivoid), 64);
   float *const restrict out = __builtin_assume_aligned(((float *const restrict)ovoid), 64);
   const float *const restrict gamut_LUT = __builtin_assume_aligned(((const float *const restrict)d->gamut_LUT), 64);
@@ -301,132 +450,34 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 #endif
   for(size_t k = 0; k < (size_t)4 * roi_in->width * roi_out->height; k += 4)
   {
-    const float *const restrict pix_in = __builtin_assume_aligned(in + k, 16);
-    float *const restrict pix_out = __builtin_assume_aligned(out + k, 16);
-
-    float DT_ALIGNED_PIXEL Ych[4] = { 0.f };
-    float DT_ALIGNED_PIXEL RGB[4] = { 0.f };
-
-    for(size_t c = 0; c < 4; ++c) Ych[c] = fmaxf(pix_in[c], 0.0f);
-    dot_product(Ych, input_matrix, RGB);
-    gradingRGB_to_Ych(RGB, Ych, white_grading_RGB);
-
-    // Sanitize input : no negative luminance
-    float Y = fmaxf(Ych[0], 0.f);
-    const int is_black = (Y == 0.f);
-
-    // Opacities for luma masks
-    const float x_offset = (Y - 0.1845f) / 0.1845f;
-
-    const float alpha = 1.f / (1.f + expf(x_offset * d->shadows_weight));         // opacity of shadows
-    const float gamma = expf(-0.1845f * x_offset * x_offset / (d->shadows_weight * d->highlights_weight));
-    const float beta = 1.f / (1.f + expf(- x_offset * d->highlights_weight));     // opacity of highlights
-    const float DT_ALIGNED_PIXEL opacities[4] = { alpha, gamma, beta, 0.f };
-    const float alpha_comp = 1.f - alpha;
-    const float beta_comp = 1.f - beta;
-
-    // Hue shift - do it now because we need the gamut limit at output hue right after
-    Ych[2] += d->hue_angle;
-
-    // Get max allowed chroma in working RGB gamut at current output hue
-    const float max_chroma_h = (is_black) ? 0.f : gamut_LUT[CLAMP((size_t)(LUT_ELEM / 2. * (Ych[2] + M_PI) / M_PI), 0, LUT_ELEM - 1)];
-    float C = (is_black) ? 0.f : fminf(Ych[1], max_chroma_h);
-
-    // Linear chroma : distance to achromatic at constant luminance in scene-referred
-    // - in case we desaturate, we do so by a constant factor
-    // - in case we resaturate, we normalize the correction by the max chroma allowed at current hue
-    //   to prevent users from pushing saturated colors outside of gamut while the low-sat ones
-    //   are still muted.
-    const float chroma_boost = d->chroma_global + scalar_product(opacities, chroma);
-    const float chroma_norm = (chroma_boost > 0.f) ? max_chroma_h / d->max_chroma : 1.f;
-    const float chroma_factor = fmaxf(1.f + chroma_boost * chroma_norm, 0.f);
-    Ych[1] = fminf(C * chroma_factor, max_chroma_h);
-    Ych_to_gradingRGB(Ych, RGB, white_grading_RGB);
-
-    /* Color balance */
-    for(size_t c = 0; c < 4; ++c)
-    {
-      // global : offset
-      RGB[c] = RGB[c] + global[c];
-
-      //  highlights, shadows : 2 slopes with masking
-      RGB[c] *= beta_comp * (alpha_comp + alpha * shadows[c]) + beta * highlights[c];
-      // factorization of : (RGB[c] * (1.f - alpha) + RGB[c] * d->shadows[c] * alpha) * (1.f - beta)  + RGB[c] * d->highlights[c] * beta;
+    _colorbalance_pixel(d, input_matrix, output_matrix, white_grading_RGB, gamut_LUT, global, highlights,
+                        shadows, midtones, chroma, saturation, purity, __builtin_assume_aligned(in + k, 16),
+                        __builtin_assume_aligned(out + k, 16));
+  }
+}
 
-      // midtones : power with sign preservation
-      const float sign = (RGB[c] < 0.f) ? -1.f : 1.f;
-      RGB[c] = sign * powf(fabsf(RGB[c]) / d->midtones_weight, midtones[c]) * d->midtones_weight;
-    }
+void process_pixels_prepare(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                            const dt_iop_roi_t *const roi)
+{
+  dt_iop_colorbalancergb_data_t *d = (dt_iop_colorbalancergb_data_t *)piece->data;
+  d->matrices_ready = _prepare_matrices(self, piece);
+}
 
-    // for the Y midtones power (gamma), we need to go in Ych again because RGB doesn't preserve color
-    gradingRGB_to_Ych(RGB, Ych, white_grading_RGB);
-    Y = Ych[0] = powf(fmaxf(Ych[0] / d->midtones_weight, 0.f), d->midtones_Y) * d->midtones_weight;
-    Ych_to_gradingRGB(Ych, RGB, white_grading_RGB);
-
-    /* Perceptual color adjustments */
-
-     // grading RGB to CIE 1931 XYZ 2° D65
-    const float RGB_to_XYZ_D65[3][4] = { { 1.64004888f, -0.10969806f, 0.49329934f, 0.f },
-                                         { 0.61055787f, 0.47749658f, -0.08730269f, 0.f },
-                                         { -0.10698534f, 0.07785058f, 1.66590006f, 0.f } };
-
-    const float XYZ_to_RGB_D65[3][4] = { { 0.54392489f, 0.14993776f, -0.15320716f, 0.f },
-                                         { -0.68327274f, 1.88816348f, 0.30127843f, 0.f },
-                                         { 0.06686186f, -0.07860825f, 0.57635773f, 0.f } };
-
-    // Go to JzAzBz for perceptual saturation
-    // We can't use gradingRGB_to_XYZ() since it also does chromatic adaptation to D50
-    // and JzAzBz uses D65, same as grading RGB. So we use the matrices above instead
-    float DT_ALIGNED_PIXEL Jab[4] = { 0.f };
-    dot_product(RGB, RGB_to_XYZ_D65, Ych);
-    dt_XYZ_2_JzAzBz(Ych, Jab);
-
-    // Convert to JCh
-    float JC[2] = { Jab[0], hypotf(Jab[1], Jab[2]) };               // brightness/chroma vector
-    const float h = (JC[1] == 0.f) ? 0.f : atan2f(Jab[2], Jab[1]);  // hue : (a, b) angle
-
-    // Project JC to S, the saturation eigenvector, with orthogonal vector O.
-    // Note : O should be = (C * cosf(T) - J * sinf(T)) = 0 since S is the eigenvector,
-    // so we add the chroma projected along the orthogonal axis to get some control value
-    const float T = atan2f(JC[1], JC[0]); // angle of the eigenvector over the hue plane
-    const float sin_T = sinf(T);
-    const float cos_T = cosf(T);
-    const float DT_ALIGNED_PIXEL M_rot_dir[2][2] = { {  cos_T,  sin_T },
-                                                     { -sin_T,  cos_T } };
-    const float DT_ALIGNED_PIXEL M_rot_inv[2][2] = { {  cos_T, -sin_T },
-                                                     {  sin_T,  cos_T } };
-    float SO[2];
-
-    // Purity & Saturation : mix of chroma and luminance
-    const float boosts[2] = { 1.f + d->purity_global + scalar_product(opacities, purity),     // move in S direction
-                              d->saturation_global + scalar_product(opacities, saturation) }; // move in O direction
-
-    SO[0] = fmaxf(JC[0] * M_rot_dir[0][0] + JC[1] * M_rot_dir[0][1] * boosts[0], 0.f);
-    SO[1] = JC[0] * fminf(fmaxf(T * boosts[1], -T), DT_M_PI_F / 2.f - T);
-
-    // Project back to JCh, that is rotate back of -T angle
-    JC[0] = fmaxf(SO[0] * M_rot_inv[0][0] + SO[1] * M_rot_inv[0][1], 0.f);
-    JC[1] = fmaxf(SO[0] * M_rot_inv[1][0] + SO[1] * M_rot_inv[1][1], 0.f);
-
-    // Project back to JzAzBz
-    Jab[0] = JC[0];
-    Jab[1] = JC[1] * cosf(h);
-    Jab[2] = JC[1] * sinf(h);
-
-    dt_JzAzBz_2_XYZ(Jab, Ych);
-    dot_product(Ych, XYZ_to_RGB_D65, RGB);
-    gradingRGB_to_Ych(RGB, Ych, white_grading_RGB);
-
-    /* Gamut mapping */
-    const float out_max_chroma_h = gamut_LUT[CLAMP((size_t)(LUT_ELEM / 2. * (Ych[2] + M_PI) / M_PI), 0, LUT_ELEM - 1)];
-    Ych[1] = fminf(Ych[1], out_max_chroma_h);
-
-    Ych_to_gradingRGB(Ych, RGB, white_grading_RGB);
-    dot_product(RGB, output_matrix, pix_out);
-    for(size_t c = 0; c < 4; ++c) pix_out[c] = fmaxf(pix_out[c], 0.f);
+void process_pixels(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                    float *const out, const size_t npixels)
+{
+  const dt_iop_colorbalancergb_data_t *const d = (dt_iop_colorbalancergb_data_t *)piece->data;
+  if(!d->matrices_ready)
+  {
+    if(in != out) memcpy(out, in, sizeof(float) * 4 * npixels);
+    return;
   }
-}
 
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+    _colorbalance_pixel(d, d->input_matrix, d->output_matrix, d->white_grading_RGB, d->gamut_LUT, d->global,
+                        d->highlights, d->shadows, d->midtones, d->chroma, d->saturation, d->purity, in + k,
+                        out + k);
+}
 
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
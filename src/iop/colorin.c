@@ -25,8 +25,10 @@
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
+#include "common/icc_lut.h"
 #include "common/image_cache.h"
 #include "common/opencl.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "develop/develop.h"
 #include "gui/gtk.h"
@@ -108,6 +110,7 @@ typedef struct dt_iop_colorin_data_t
   cmsHTRANSFORM *xform_cam_Lab;
   cmsHTRANSFORM *xform_cam_nrgb;
   cmsHTRANSFORM *xform_nrgb_Lab;
+  dt_icc_lut_t *icc_lut;        // the lcms2 transforms above baked into a 3d lut, if the profile has no matrix
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   float nmatrix[9];
@@ -1040,14 +1043,44 @@ static void process_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixelpipe_
   }
 }
 
+static void process_icc_lut(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                            void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int ch = piece->colors;
+  const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(blue_mapping, ch, d, ivoid, ovoid, roi_out) \
+  schedule(static)
+#endif
+  for(int k = 0; k < roi_out->height; k++)
+  {
+    const float *in = (const float *)ivoid + (size_t)ch * k * roi_out->width;
+    float *out = (float *)ovoid + (size_t)ch * k * roi_out->width;
+
+    if(blue_mapping)
+    {
+      for(int j = 0; j < roi_out->width; j++) apply_blue_mapping(in + 4 * j, out + 4 * j);
+      in = out;
+    }
+    dt_icc_lut_apply(d->icc_lut, in, out, roi_out->width);
+  }
+}
+
 static void process_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                           void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
   const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
   const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
 
+  if(d->icc_lut)
+  {
+    process_icc_lut(self, piece, ivoid, ovoid, roi_in, roi_out);
+  }
   // use general lcms2 fallback
-  if(blue_mapping)
+  else if(blue_mapping)
   {
     process_lcms2_bm(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
@@ -1442,8 +1475,12 @@ static void process_sse2_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
   const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
   const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
 
+  if(d->icc_lut)
+  {
+    process_icc_lut(self, piece, ivoid, ovoid, roi_in, roi_out);
+  }
   // use general lcms2 fallback
-  if(blue_mapping)
+  else if(blue_mapping)
   {
     process_sse2_lcms2_bm(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
@@ -1475,6 +1512,23 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+// the lcms2 fallback of process_lcms2_proper() for a number of pixels, to sample the lut
+static void _sample_lcms2(const float *const in, float *const out, const size_t npixels, void *data)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)data;
+  if(!d->nrgb)
+  {
+    cmsDoTransform(d->xform_cam_Lab, in, out, npixels);
+  }
+  else
+  {
+    cmsDoTransform(d->xform_cam_nrgb, in, out, npixels);
+    for(size_t k = 0; k < 4 * npixels; k += 4)
+      for(int c = 0; c < 3; c++) out[k + c] = CLAMP(out[k + c], 0.0f, 1.0f);
+    cmsDoTransform(d->xform_nrgb_Lab, out, out, npixels);
+  }
+}
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   const dt_iop_colorin_params_t *p = (dt_iop_colorin_params_t *)p1;
@@ -1529,6 +1583,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_icc_lut_free(d->icc_lut);
+  d->icc_lut = NULL;
 
   d->cmatrix[0] = d->nmatrix[0] = d->lmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
@@ -1739,6 +1795,17 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // profiles which are not matrix and curves are evaluated by lcms2 on a clipped input anyway, so the
+  // transform can as well be baked into a lut
+  if(d->xform_cam_Lab && input_color_space == cmsSigRgbData && !cmsIsMatrixShaper(d->input)
+     && dt_conf_get_bool("bake_icc_luts"))
+  {
+    const cmsHPROFILE profiles[2] = { d->input, d->nrgb };
+    gchar *key = dt_icc_lut_key(profiles, d->nrgb ? 2 : 1, p->intent, "colorin");
+    d->icc_lut = dt_icc_lut_bake(DT_ICC_LUT_RGB, DT_ICC_LUT_LEVEL, _sample_lcms2, d, key);
+    g_free(key);
+  }
+
   d->nonlinearlut = 0;
 
   // now try to initialize unbounded mode:
@@ -1775,6 +1842,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   d->xform_cam_Lab = NULL;
   d->xform_cam_nrgb = NULL;
   d->xform_nrgb_Lab = NULL;
+  d->icc_lut = NULL;
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -1796,6 +1864,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_icc_lut_free(d->icc_lut);
+  d->icc_lut = NULL;
 
   free(piece->data);
   piece->data = NULL;
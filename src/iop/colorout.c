@@ -22,6 +22,7 @@
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
+#include "common/icc_lut.h"
 #include "common/imagebuf.h"
 #include "common/iop_profile.h"
 #include "common/opencl.h"
@@ -57,6 +58,7 @@ typedef struct dt_iop_colorout_data_t
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   cmsHTRANSFORM *xform;
+  dt_icc_lut_t *icc_lut;        // xform baked into a 3d lut, if one of its profiles has no matrix
   float unbounded_coeffs[3][3]; // for extrapolation of shaper curves
 } dt_iop_colorout_data_t;
 
@@ -453,7 +455,10 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *const restrict outp = out + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, outp, roi_out->width);
+      if(d->icc_lut)
+        dt_icc_lut_apply(d->icc_lut, in, outp, roi_out->width);
+      else
+        cmsDoTransform(d->xform, in, outp, roi_out->width);
 
       if(gamutcheck)
       {
@@ -528,7 +533,10 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *outp = out + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, outp, roi_out->width);
+      if(d->icc_lut)
+        dt_icc_lut_apply(d->icc_lut, in, outp, roi_out->width);
+      else
+        cmsDoTransform(d->xform, in, outp, roi_out->width);
 
       if(gamutcheck)
       {
@@ -572,6 +580,13 @@ static cmsHPROFILE _make_clipping_profile(cmsHPROFILE profile)
   return profile;
 }
 
+// the exact transform, to sample the lut
+static void _sample_lcms2(const float *const in, float *const out, const size_t npixels, void *data)
+{
+  const dt_iop_colorout_data_t *const d = (dt_iop_colorout_data_t *)data;
+  cmsDoTransform(d->xform, in, out, npixels);
+}
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -599,6 +614,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_icc_lut_free(d->icc_lut);
+  d->icc_lut = NULL;
   d->cmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
   d->lut[1][0] = -1.0f;
@@ -754,6 +771,20 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // bake transforms through lut based profiles, which lcms2 evaluates on a clipped input anyway. the gamut
+  // check relies on the out of gamut values of the exact transform and stays with lcms2.
+  if(d->xform && d->mode != DT_PROFILE_GAMUTCHECK
+     && (!cmsIsMatrixShaper(output) || (softproof && !cmsIsMatrixShaper(softproof)))
+     && dt_conf_get_bool("bake_icc_luts"))
+  {
+    const cmsHPROFILE profiles[2] = { output, softproof };
+    gchar *extra = g_strdup_printf("colorout %u %u", transformFlags, output_format);
+    gchar *key = dt_icc_lut_key(profiles, softproof ? 2 : 1, out_intent, extra);
+    d->icc_lut = dt_icc_lut_bake(DT_ICC_LUT_LAB, DT_ICC_LUT_LEVEL, _sample_lcms2, d, key);
+    g_free(key);
+    g_free(extra);
+  }
+
   if(out_type == DT_COLORSPACE_DISPLAY || out_type == DT_COLORSPACE_DISPLAY2)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
@@ -788,6 +819,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   piece->data = calloc(1, sizeof(dt_iop_colorout_data_t));
   dt_iop_colorout_data_t *d = (dt_iop_colorout_data_t *)piece->data;
   d->xform = NULL;
+  d->icc_lut = NULL;
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -798,6 +830,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_icc_lut_free(d->icc_lut);
+  d->icc_lut = NULL;
 
   free(piece->data);
   piece->data = NULL;
@@ -30,6 +30,7 @@
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe.h"
 #include "develop/tiling.h"
 #include "dtgtk/drawingarea.h"
 #include "gui/accelerators.h"
@@ -1214,6 +1215,21 @@ static void variance_stabilizing_xform(float thrs[4], const int scale, const int
     thrs[c] = adjt[c] * sb2 / std_x[c];
 }
 
+// same as the end of dt_iop_alloc_image_buffers(), for buffers from the pixelpipe pool
+static gboolean _pool_buffers_allocated(dt_iop_module_t *self, const gboolean allocated)
+{
+  if(allocated)
+    dt_iop_set_module_trouble_message(self, NULL, NULL, NULL);
+  else
+    dt_iop_set_module_trouble_message(self, _("insufficient memory"),
+                                      _("This module was unable to allocate\n"
+                                        "all of the memory required to process\n"
+                                        "the image.  Some or all processing\n"
+                                        "has been skipped."),
+                                      "unable to allocate working memory");
+  return allocated;
+}
+
 static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
                              const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
                              const dt_iop_roi_t *const roi_out, const eaw_dn_decompose_t decompose,
@@ -1257,12 +1273,17 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     return;
   }
 
-  float *buf = NULL;
-  float *restrict precond = NULL;
-  float *restrict tmp = NULL;
+  // the preconditioned copy and the wavelet buffers are taken from the pipe's pool, they have the same size
+  // in every run
+  float *buf = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, 4 * npixels);
+  float *restrict precond = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, 4 * npixels);
+  float *restrict tmp = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, 4 * npixels);
 
-  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &precond, 4, &tmp, 4, &buf, 0))
+  if(!_pool_buffers_allocated(self, buf && precond && tmp))
   {
+    dt_dev_pixelpipe_pool_free(piece->pipe, buf);
+    dt_dev_pixelpipe_pool_free(piece->pipe, precond);
+    dt_dev_pixelpipe_pool_free(piece->pipe, tmp);
     dt_iop_copy_image_roi(out, in, piece->colors, roi_in, roi_out, TRUE);
     return;
   }
@@ -1361,9 +1382,9 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     backtransform_Y0U0V0(out, width, height, d->a[1] * compensate_p, p, d->b[1], d->bias - 0.5 * logf(in_scale), wb, toRGB);
   }
 
-  dt_free_align(buf);
-  dt_free_align(tmp);
-  dt_free_align(precond);
+  dt_dev_pixelpipe_pool_free(piece->pipe, buf);
+  dt_dev_pixelpipe_pool_free(piece->pipe, tmp);
+  dt_dev_pixelpipe_pool_free(piece->pipe, precond);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, width, height);
 
@@ -1530,8 +1551,9 @@ static void process_nlmeans_cpu(dt_dev_pixelpipe_iop_t *piece,
                                          ivoid, ovoid, roi_in, roi_out))
     return; // image has been copied through to output and module's trouble flag has been updated
 
-  float *restrict in;
-  if (!dt_iop_alloc_image_buffers(piece->module, roi_in, roi_out, 4 | DT_IMGSZ_INPUT, &in, 0))
+  // preconditioned copy of the input
+  float *restrict in = dt_dev_pixelpipe_pool_alloc_float(piece->pipe, (size_t)4 * roi_in->width * roi_in->height);
+  if(!_pool_buffers_allocated(piece->module, in != NULL))
     return;
 
   // adjust to zoom size:
@@ -1560,10 +1582,11 @@ static void process_nlmeans_cpu(dt_dev_pixelpipe_iop_t *piece,
                                       .patch_radius = P,
                                       .search_radius = K,
                                       .decimate = 0,
-                                      .norm = norm2 };
+                                      .norm = norm2,
+                                      .piece = piece };
   denoiser(in,ovoid,roi_in,roi_out,&params);
 
-  dt_free_align(in);
+  dt_dev_pixelpipe_pool_free(piece->pipe, in);
   nlmeans_backtransform(d,ovoid,roi_in,scale,compensate_p,wb,aa,bb,p);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
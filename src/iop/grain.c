@@ -24,6 +24,7 @@
 
 #include "bauhaus/bauhaus.h"
 #include "common/math.h"
+#include "common/simplex_noise.h"
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -111,186 +112,6 @@ int legacy_params(dt_iop_module_t *self, const void *const old_params, const int
 }
 
 
-static int grad3[12][3] = { { 1, 1, 0 },
-                            { -1, 1, 0 },
-                            { 1, -1, 0 },
-                            { -1, -1, 0 },
-                            { 1, 0, 1 },
-                            { -1, 0, 1 },
-                            { 1, 0, -1 },
-                            { -1, 0, -1 },
-                            { 0, 1, 1 },
-                            { 0, -1, 1 },
-                            { 0, 1, -1 },
-                            { 0, -1, -1 } };
-
-static int permutation[]
-    = { 151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233, 7,   225, 140, 36,  103, 30,
-        69,  142, 8,   99,  37,  240, 21,  10,  23,  190, 6,   148, 247, 120, 234, 75,  0,   26,  197, 62,
-        94,  252, 219, 203, 117, 35,  11,  32,  57,  177, 33,  88,  237, 149, 56,  87,  174, 20,  125, 136,
-        171, 168, 68,  175, 74,  165, 71,  134, 139, 48,  27,  166, 77,  146, 158, 231, 83,  111, 229, 122,
-        60,  211, 133, 230, 220, 105, 92,  41,  55,  46,  245, 40,  244, 102, 143, 54,  65,  25,  63,  161,
-        1,   216, 80,  73,  209, 76,  132, 187, 208, 89,  18,  169, 200, 196, 135, 130, 116, 188, 159, 86,
-        164, 100, 109, 198, 173, 186, 3,   64,  52,  217, 226, 250, 124, 123, 5,   202, 38,  147, 118, 126,
-        255, 82,  85,  212, 207, 206, 59,  227, 47,  16,  58,  17,  182, 189, 28,  42,  223, 183, 170, 213,
-        119, 248, 152, 2,   44,  154, 163, 70,  221, 153, 101, 155, 167, 43,  172, 9,   129, 22,  39,  253,
-        19,  98,  108, 110, 79,  113, 224, 232, 178, 185, 112, 104, 218, 246, 97,  228, 251, 34,  242, 193,
-        238, 210, 144, 12,  191, 179, 162, 241, 81,  51,  145, 235, 249, 14,  239, 107, 49,  192, 214, 31,
-        181, 199, 106, 157, 184, 84,  204, 176, 115, 121, 50,  45,  127, 4,   150, 254, 138, 236, 205, 93,
-        222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156, 180 };
-
-static int perm[512];
-static void _simplex_noise_init()
-{
-  for(int i = 0; i < 512; i++) perm[i] = permutation[i & 255];
-}
-static double dot(int g[], double x, double y, double z)
-{
-  return g[0] * x + g[1] * y + g[2] * z;
-}
-
-#define FASTFLOOR(x) (x > 0 ? (int)(x) : (int)(x)-1)
-
-static double _simplex_noise(double xin, double yin, double zin)
-{
-  double n0, n1, n2, n3; // Noise contributions from the four corners
-                         // Skew the input space to determine which simplex cell we're in
-  const double F3 = 1.0 / 3.0;
-  const double s = (xin + yin + zin) * F3; // Very nice and simple skew factor for 3D
-  const int i = FASTFLOOR(xin + s);
-  const int j = FASTFLOOR(yin + s);
-  const int k = FASTFLOOR(zin + s);
-  const double G3 = 1.0 / 6.0; // Very nice and simple unskew factor, too
-  const double t = (i + j + k) * G3;
-  const double X0 = i - t; // Unskew the cell origin back to (x,y,z) space
-  const double Y0 = j - t;
-  const double Z0 = k - t;
-  const double x0 = xin - X0; // The x,y,z distances from the cell origin
-  const double y0 = yin - Y0;
-  const double z0 = zin - Z0;
-  // For the 3D case, the simplex shape is a slightly irregular tetrahedron.
-  // Determine which simplex we are in.
-  int i1, j1, k1; // Offsets for second corner of simplex in (i,j,k) coords
-  int i2, j2, k2; // Offsets for third corner of simplex in (i,j,k) coords
-  if(x0 >= y0)
-  {
-    if(y0 >= z0)
-    {
-      i1 = 1; // X Y Z order
-      j1 = 0;
-      k1 = 0;
-      i2 = 1;
-      j2 = 1;
-      k2 = 0;
-    }
-    else if(x0 >= z0)
-    {
-      i1 = 1; // X Z Y order
-      j1 = 0;
-      k1 = 0;
-      i2 = 1;
-      j2 = 0;
-      k2 = 1;
-    }
-    else
-    {
-      i1 = 0; // Z X Y order
-      j1 = 0;
-      k1 = 1;
-      i2 = 1;
-      j2 = 0;
-      k2 = 1;
-    }
-  }
-  else // x0<y0
-  {
-    if(y0 < z0)
-    {
-      i1 = 0; // Z Y X order
-      j1 = 0;
-      k1 = 1;
-      i2 = 0;
-      j2 = 1;
-      k2 = 1;
-    }
-    else if(x0 < z0)
-    {
-      i1 = 0; // Y Z X order
-      j1 = 1;
-      k1 = 0;
-      i2 = 0;
-      j2 = 1;
-      k2 = 1;
-    }
-    else
-    {
-      i1 = 0; // Y X Z order
-      j1 = 1;
-      k1 = 0;
-      i2 = 1;
-      j2 = 1;
-      k2 = 0;
-    }
-  }
-  //  A step of (1,0,0) in (i,j,k) means a step of (1-c,-c,-c) in (x,y,z),
-  //  a step of (0,1,0) in (i,j,k) means a step of (-c,1-c,-c) in (x,y,z), and
-  //  a step of (0,0,1) in (i,j,k) means a step of (-c,-c,1-c) in (x,y,z), where
-  //  c = 1/6.
-  const double x1 = x0 - i1 + G3; // Offsets for second corner in (x,y,z) coords
-  const double y1 = y0 - j1 + G3;
-  const double z1 = z0 - k1 + G3;
-  const double x2 = x0 - i2 + 2.0 * G3; // Offsets for third corner in (x,y,z) coords
-  const double y2 = y0 - j2 + 2.0 * G3;
-  const double z2 = z0 - k2 + 2.0 * G3;
-  const double x3 = x0 - 1.0 + 3.0 * G3; // Offsets for last corner in (x,y,z) coords
-  const double y3 = y0 - 1.0 + 3.0 * G3;
-  const double z3 = z0 - 1.0 + 3.0 * G3;
-  // Work out the hashed gradient indices of the four simplex corners
-  const int ii = i & 255;
-  const int jj = j & 255;
-  const int kk = k & 255;
-  const int gi0 = perm[ii + perm[jj + perm[kk]]] % 12;
-  const int gi1 = perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12;
-  const int gi2 = perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]] % 12;
-  const int gi3 = perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]] % 12;
-  // Calculate the contribution from the four corners
-  double t0 = 0.6 - x0 * x0 - y0 * y0 - z0 * z0;
-  if(t0 < 0)
-    n0 = 0.0;
-  else
-  {
-    t0 *= t0;
-    n0 = t0 * t0 * dot(grad3[gi0], x0, y0, z0);
-  }
-  double t1 = 0.6 - x1 * x1 - y1 * y1 - z1 * z1;
-  if(t1 < 0)
-    n1 = 0.0;
-  else
-  {
-    t1 *= t1;
-    n1 = t1 * t1 * dot(grad3[gi1], x1, y1, z1);
-  }
-  double t2 = 0.6 - x2 * x2 - y2 * y2 - z2 * z2;
-  if(t2 < 0)
-    n2 = 0.0;
-  else
-  {
-    t2 *= t2;
-    n2 = t2 * t2 * dot(grad3[gi2], x2, y2, z2);
-  }
-  double t3 = 0.6 - x3 * x3 - y3 * y3 - z3 * z3;
-  if(t3 < 0)
-    n3 = 0.0;
-  else
-  {
-    t3 *= t3;
-    n3 = t3 * t3 * dot(grad3[gi3], x3, y3, z3);
-  }
-  // Add contributions from each corner to get the final noise value.
-  // The result is scaled to stay just inside [-1,1]
-  return 32.0 * (n0 + n1 + n2 + n3);
-}
-
 #define PRIME_LEVELS 4
 // static uint64_t _low_primes[PRIME_LEVELS] ={ 12503,14029,15649, 11369 };
 // uint64_t _mid_primes[PRIME_LEVELS] ={ 784697,875783, 536461,639259};
@@ -347,19 +168,21 @@ static double _perlin_2d_noise(double x,double y,uint32_t octaves,double persist
   return total;
 }*/
 
-static double _simplex_2d_noise(double x, double y, uint32_t octaves, double persistance, double z)
-{
-  double total = 0;
-
-  // parametrization of octaves to match power spectrum of real grain scans
-  static double f[] = {0.4910, 0.9441, 1.7280};
-  static double a[] = {0.2340, 0.7850, 1.2150};
+// parametrization of octaves to match power spectrum of real grain scans
+#define GRAIN_OCTAVES 3
+static const double grain_octave_freq[GRAIN_OCTAVES] = { 0.4910, 0.9441, 1.7280 };
+static const float grain_octave_amp[GRAIN_OCTAVES] = { 0.2340, 0.7850, 1.2150 };
 
-  for(uint32_t o = 0; o < octaves; o++)
+// adds weight * the grain noise at normalized image coordinates (x + i * dx, y) to noise[i]. the octaves are
+// simplex noise with the octave index as third coordinate.
+static void _simplex_2d_noise_row(float *const noise, const int width, const double x, const double dx,
+                                  const double y, const double zoom, const float weight)
+{
+  for(int o = 0; o < GRAIN_OCTAVES; o++)
   {
-    total += (_simplex_noise(x * f[o] / z, y * f[o] / z, o) * a[o]);
+    const double f = grain_octave_freq[o] / zoom;
+    dt_simplex_noise_row_add(noise, width, x * f, dx * f, y * f, o, weight * grain_octave_amp[o]);
   }
-  return total;
 }
 
 static float paper_resp(float exposure, float mb, float gp)
@@ -443,28 +266,18 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   return iop_cs_Lab;
 }
 
-// see: http://eternallyconfuzzled.com/tuts/algorithms/jsw_tut_hashing.aspx
-// this is the modified bernstein
-static unsigned int _hash_string(char *s)
-{
-  unsigned int h = 0;
-  while(*s) h = 33 * h ^ *s++;
-  return h;
-}
-
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
   dt_iop_grain_data_t *data = (dt_iop_grain_data_t *)piece->data;
 
-  unsigned int hash = _hash_string(piece->pipe->image.filename) % (int)fmax(roi_out->width * 0.3, 1.0);
+  const unsigned int hash
+      = dt_simplex_noise_seed(piece->pipe->image.filename) % (int)fmax(roi_out->width * 0.3, 1.0);
 
   const gboolean fastmode = (piece->pipe->type & DT_DEV_PIXELPIPE_FAST) == DT_DEV_PIXELPIPE_FAST;
   const int ch = piece->colors;
   // Apply grain to image
-  const double strength = (data->strength / 100.0);
-  const double octaves = 3;
-  // double zoom=1.0+(8*(data->scale/100.0));
+  const float strength = (data->strength / 100.0);
   const double wd = fminf(piece->buf_in.width, piece->buf_in.height);
   const double zoom = (1.0 + 8 * data->scale / 100) / 800.0;
   // in fastpipe mode, skip the downsampling for zoomed-out views
@@ -475,47 +288,51 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const float fib1 = 34.0, fib2 = 21.0;
   const float fib1div2 = fib1 / fib2;
 
+  // calculate x, y in a resolution independent way:
+  // wx,wy: worldspace in full image pixel coords,
+  // x,y: normalized to shorter side of image, so with pixel aspect = 1.
+  const double x0 = roi_out->x / roi_out->scale / wd + hash;
+  const double dx = 1.0 / roi_out->scale / wd;
+  const int width = roi_out->width;
+
+  size_t padded_size;
+  float *const restrict noise_buf = dt_alloc_perthread_float(width, &padded_size);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, filter, filtermul, ivoid, ovoid, roi_out, strength, \
-                      wd, zoom, octaves, fib2, fib1div2) \
-  shared(data, hash)
+  dt_omp_firstprivate(ch, dx, filter, filtermul, ivoid, noise_buf, ovoid, padded_size, roi_out, strength, \
+                      wd, width, x0, zoom, fib2, fib1div2) \
+  shared(data)
 #endif
   for(int j = 0; j < roi_out->height; j++)
   {
-    float *in = ((float *)ivoid) + (size_t)roi_out->width * j * ch;
-    float *out = ((float *)ovoid) + (size_t)roi_out->width * j * ch;
+    const float *in = ((float *)ivoid) + (size_t)width * j * ch;
+    float *out = ((float *)ovoid) + (size_t)width * j * ch;
     const double wy = (roi_out->y + j) / roi_out->scale;
     const double y = wy / wd;
-    // y: normalized to shorter side of image, so with pixel aspect = 1.
 
-    for(int i = 0; i < roi_out->width; i++)
+    // noise of the whole row first, so that it's evaluated on vectors of pixels
+    float *const restrict noise = dt_get_perthread(noise_buf, padded_size);
+    memset(noise, 0, sizeof(float) * width);
+    if(filter)
     {
-      // calculate x, y in a resolution independent way:
-      // wx,wy: worldspace in full image pixel coords:
-      const double wx = (roi_out->x + i) / roi_out->scale;
-      // x: normalized to shorter side of image, so with pixel aspect = 1.
-      const double x = wx / wd;
-      //  double noise=_perlin_2d_noise(x, y, octaves,0.25, zoom)*1.5;
-      double noise = 0.0;
-      if(filter)
-      {
-        // if zoomed out a lot, use rank-1 lattice downsampling
-        for(int l = 0; l < fib2; l++)
-        {
-          float px = l / fib2, py = l * fib1div2;
-          py -= (int)py;
-          float dx = px * filtermul, dy = py * filtermul;
-          noise += (1.0 / fib2) * _simplex_2d_noise(x + dx + hash, y + dy, octaves, 1.0, zoom);
-        }
-      }
-      else
+      // if zoomed out a lot, use rank-1 lattice downsampling
+      for(int l = 0; l < fib2; l++)
       {
-        noise = _simplex_2d_noise(x + hash, y, octaves, 1.0, zoom);
+        float px = l / fib2, py = l * fib1div2;
+        py -= (int)py;
+        const double fx = px * filtermul, fy = py * filtermul;
+        _simplex_2d_noise_row(noise, width, x0 + fx, dx, y + fy, zoom, 1.0f / fib2);
       }
+    }
+    else
+    {
+      _simplex_2d_noise_row(noise, width, x0, dx, y, zoom, 1.0f);
+    }
 
-      out[0] = in[0] + dt_lut_lookup_2d_1c(data->grain_lut, (noise * strength) * GRAIN_LIGHTNESS_STRENGTH_SCALE, in[0] / 100.0f);
+    for(int i = 0; i < width; i++)
+    {
+      out[0] = in[0] + dt_lut_lookup_2d_1c(data->grain_lut, (noise[i] * strength) * GRAIN_LIGHTNESS_STRENGTH_SCALE, in[0] / 100.0f);
       out[1] = in[1];
       out[2] = in[2];
       out[3] = in[3];
@@ -524,6 +341,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       in += ch;
     }
   }
+
+  dt_free_align(noise_buf);
 }
 
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
@@ -561,11 +380,6 @@ void gui_update(struct dt_iop_module_t *self)
   dt_bauhaus_slider_set(g->midtones_bias, p->midtones_bias);
 }
 
-void init_global(struct dt_iop_module_so_t *self)
-{
-  _simplex_noise_init();
-}
-
 void gui_init(struct dt_iop_module_t *self)
 {
   dt_iop_grain_gui_data_t *g = IOP_GUI_ALLOC(grain);
@@ -30,6 +30,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe_blur.h"
 #include "develop/tiling.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -284,20 +285,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   /* the blend code at the end assumes at least 4 channels, and we never get more than four */
   assert(piece->colors == ch);
 
-/* create inverted image and then blur */
-/* since we use only the L channel, pack the values together instead of every fourth float */
-/* to reduce cache pressure and memory bandwidth during the blur operation */
   const size_t npixels = (size_t)roi_out->height * roi_out->width;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(npixels) \
-  dt_omp_sharedconst(in) \
-  shared(out) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < (size_t)npixels; k++)
-    out[k] = 100.0f - LCLIP(in[4 * k]); // only L in Lab space
-
   const int rad = MAX_RADIUS * (fmin(100.0, data->sharpness + 1) / 100.0);
   const int radius = MIN(MAX_RADIUS, ceilf(rad * roi_in->scale / piece->iscale));
 
@@ -305,7 +293,27 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const int range = 2 * radius + 1;
   const int hr = range / 2;
 
-  dt_box_mean(out, roi_out->height, roi_out->width, 1, hr, BOX_ITERATIONS);
+  // the blurred L channel only depends on the sharpness, changing the contrast reuses it
+  const size_t size = sizeof(float) * npixels;
+  const uint64_t key = dt_dev_pixelpipe_blur_key(piece, roi_in, "highpass", &hr, sizeof(hr));
+  if(!dt_dev_pixelpipe_blur_get(piece, key, out, size))
+  {
+    /* create inverted image and then blur */
+    /* since we use only the L channel, pack the values together instead of every fourth float */
+    /* to reduce cache pressure and memory bandwidth during the blur operation */
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) \
+      dt_omp_firstprivate(npixels) \
+      dt_omp_sharedconst(in) \
+      shared(out) \
+      schedule(static)
+#endif
+    for(size_t k = 0; k < (size_t)npixels; k++)
+      out[k] = 100.0f - LCLIP(in[4 * k]); // only L in Lab space
+
+    dt_box_mean(out, roi_out->height, roi_out->width, 1, hr, BOX_ITERATIONS);
+    dt_dev_pixelpipe_blur_put(piece, key, out, size);
+  }
 
   const float contrast_scale = ((data->contrast / 100.0) * 7.5);
   /* Blend the inverted blurred L channel with the original input.  Because we packed the L values */
@@ -314,11 +322,11 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   /* We can only do the final 3/4 in parallel here, because updating the first quarter in one thread */
   /* would clobber values still needed by other threads. */
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, contrast_scale, npixels) \
-  dt_omp_sharedconst(in) \
-  shared(out, data) \
-  schedule(static)
+  #pragma omp parallel for default(none) \
+    dt_omp_firstprivate(ch, contrast_scale, npixels) \
+    dt_omp_sharedconst(in) \
+    shared(out, data) \
+    schedule(static)
 #endif
   for(size_t k = npixels - 1; k > npixels/4; k--)
   {
@@ -187,6 +187,17 @@ DEFAULT(void, process_tiling, struct dt_iop_module_t *self, struct dt_dev_pixelp
                                void *const o, const struct dt_iop_roi_t *const roi_in,
                                const struct dt_iop_roi_t *const roi_out, const int bpp);
 
+/** optional pointwise variant of process() for modules whose output pixel only depends on the same input pixel.
+  * the pixelpipe may then evaluate a run of adjacent such modules in a single pass over the buffer.
+  * process_pixels_prepare() is called once per run on the pipe thread and may update piece->pipe->dsc,
+  * process_pixels() is then called concurrently on disjoint spans of npixels 4-channel float pixels.
+  * in and out may point to the same memory. modules that change the colorspace, analyse the whole buffer or
+  * parallelise inside their own kernels (colorin, colorout, channelmixerrgb, filmicrgb, lut3d) don't qualify. */
+OPTIONAL(void, process_pixels_prepare, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                       const struct dt_iop_roi_t *const roi);
+OPTIONAL(void, process_pixels, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                               const float *const in, float *const out, const size_t npixels);
+
 #if defined(__SSE__)
 /** a variant process(), that can contain SSE2 intrinsics. */
 /** can be provided by each IOP. */
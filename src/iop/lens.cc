@@ -126,6 +126,21 @@ typedef struct dt_iop_lensfun_global_data_t
   int kernel_lens_vignette;
 } dt_iop_lensfun_global_data_t;
 
+// distortion of a regular grid of points, for an image of the given size. transforming single points, rois and
+// masks interpolates between the nodes, lensfun only samples the nodes.
+typedef struct dt_iop_lensfun_grid_t
+{
+  float width, height; // image size passed to lensfun
+  int modflags;        // corrections lensfun actually does
+  lfModifier *modifier;
+  int step;            // distance of the nodes in pixels
+  int gw, gh;          // number of nodes per row and column
+  float *fwd;          // 6 floats per node: input coordinates of the red, green and blue channels
+  float *inv;          // 2 floats per node: output coordinates of the input coordinate of the node
+} dt_iop_lensfun_grid_t;
+
+#define DT_IOP_LENSFUN_GRIDS 4
+
 typedef struct dt_iop_lensfun_data_t
 {
   lfLens *lens;
@@ -140,6 +155,9 @@ typedef struct dt_iop_lensfun_data_t
   gboolean do_nan_checks;
   gboolean tca_override;
   lfLensCalibTCA custom_tca;
+  dt_pthread_mutex_t grid_lock;
+  dt_iop_lensfun_grid_t *grids[DT_IOP_LENSFUN_GRIDS]; // built on demand for the sizes asked for
+  int next_grid;
 } dt_iop_lensfun_data_t;
 
 
@@ -367,6 +385,206 @@ static lfModifier * get_modifier(int *mods_done, int w, int h, const dt_iop_lens
   return mod;
 }
 
+// largest distance in pixels between the interpolated grid and lensfun, and the node distances tried
+#define DT_IOP_LENSFUN_GRID_ERROR 0.1f
+#define DT_IOP_LENSFUN_GRID_STEP_MAX 32
+#define DT_IOP_LENSFUN_GRID_STEP_MIN 8
+
+#define DT_IOP_LENSFUN_MODIFY_GEOMETRY (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)
+
+// bilinear interpolation of n floats per node. returns FALSE outside of the grid and next to nodes which lensfun
+// can't map.
+static inline gboolean _grid_interpolate(const float *const nodes, const int n, const int step, const int gw,
+                                         const int gh, const float x, const float y, float *const out)
+{
+  const float fx = x / step, fy = y / step;
+  if(!(fx >= 0.0f && fy >= 0.0f && fx < gw - 1 && fy < gh - 1)) return FALSE;
+  const int i = (int)fx, j = (int)fy;
+  const float u = fx - i, v = fy - j;
+  const float *const n00 = nodes + (size_t)n * ((size_t)j * gw + i);
+  const float *const n01 = n00 + n;
+  const float *const n10 = n00 + (size_t)n * gw;
+  const float *const n11 = n10 + n;
+  gboolean finite = TRUE;
+  for(int c = 0; c < n; c++)
+  {
+    out[c] = (1.0f - v) * ((1.0f - u) * n00[c] + u * n01[c]) + v * ((1.0f - u) * n10[c] + u * n11[c]);
+    finite = finite && isfinite(out[c]);
+  }
+  return finite;
+}
+
+// input coordinates of the red, green and blue channels of an output coordinate, like
+// lfModifier::ApplySubpixelGeometryDistortion() of a single pixel
+static inline void _grid_distort(const dt_iop_lensfun_grid_t *const g, const float x, const float y,
+                                 float *const out)
+{
+  if(!g->fwd || !_grid_interpolate(g->fwd, 6, g->step, g->gw, g->gh, x, y, out))
+    g->modifier->ApplySubpixelGeometryDistortion(x, y, 1, 1, out);
+}
+
+// lensfun does not provide a back-transform routine. So we do it iteratively by assuming that
+// a back-transform at one point is just moving the same distance in the opposite direction. This
+// is of course not fully correct so we do adjust iteratively the transformation by checking that
+// the back transformed points are when transformed very close to the original point.
+//
+// Again, not perfect but better than having back-transform be equivalent to the transform routine above.
+static gboolean _grid_solve(const dt_iop_lensfun_grid_t *const g, const float x, const float y,
+                            const float tolerance, float *const p)
+{
+  float p1 = x;
+  float p2 = y;
+  float buf[6];
+  gboolean converged = FALSE;
+  // just loop 10 times max to find the best position. checking that the convergence is
+  // often after 2 or 3 loops.
+  for(int k = 0; k < 10; k++)
+  {
+    _grid_distort(g, p1, p2, buf);
+    const float dist1 = x - buf[0];
+    const float dist2 = y - buf[3];
+    converged = fabsf(dist1) < tolerance && fabsf(dist2) < tolerance;
+    if(converged) break;
+    p1 += dist1;
+    p2 += dist2;
+  }
+  p[0] = p1;
+  p[1] = p2;
+  return converged;
+}
+
+// output coordinate of an input coordinate, the inverse of the red x and green y coordinates of _grid_distort()
+static inline void _grid_undistort(const dt_iop_lensfun_grid_t *const g, const float x, const float y,
+                                   float *const p)
+{
+  if(!g->inv || !_grid_interpolate(g->inv, 2, g->step, g->gw, g->gh, x, y, p)) _grid_solve(g, x, y, .5f, p);
+}
+
+// samples lensfun at nodes step pixels apart and returns the largest error of the interpolation in the centers
+// of the cells, against lensfun for the distortion and against the iteration for its inverse
+static float _grid_sample(dt_iop_lensfun_grid_t *const g, const int step)
+{
+  dt_free_align(g->fwd);
+  dt_free_align(g->inv);
+  g->fwd = g->inv = NULL;
+  g->step = step;
+  g->gw = (int)(g->width / step) + 2;
+  g->gh = (int)(g->height / step) + 2;
+  const int gw = g->gw;
+  const size_t nodes = (size_t)g->gw * g->gh;
+  float *const fwd = dt_alloc_align_float(6 * nodes);
+  float *const inv = dt_alloc_align_float(2 * nodes);
+  if(!fwd || !inv)
+  {
+    dt_free_align(fwd);
+    dt_free_align(inv);
+    return INFINITY;
+  }
+
+  const lfModifier *const modifier = g->modifier;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(fwd, gw, modifier, nodes, step) schedule(static)
+#endif
+  for(size_t k = 0; k < nodes; k++)
+    modifier->ApplySubpixelGeometryDistortion((k % gw) * step, (k / gw) * step, 1, 1, fwd + 6 * k);
+  g->fwd = fwd;
+
+  // the inverse is solved on the forward grid, to a tighter tolerance than single points are. where the
+  // iteration doesn't converge the points are solved one by one, as without the grid.
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(g, gw, inv, nodes, step) schedule(static)
+#endif
+  for(size_t k = 0; k < nodes; k++)
+    if(!_grid_solve(g, (k % gw) * step, (k / gw) * step, .01f, inv + 2 * k)) inv[2 * k] = inv[2 * k + 1] = NAN;
+  g->inv = inv;
+
+  const size_t cells = (size_t)(g->gw - 1) * (g->gh - 1);
+  float err = 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(cells, g, gw, modifier, step) \
+  reduction(max : err) schedule(static)
+#endif
+  for(size_t k = 0; k < cells; k++)
+  {
+    const float x = (k % (gw - 1) + 0.5f) * step;
+    const float y = (k / (gw - 1) + 0.5f) * step;
+    float exact[6], approx[6], p[2];
+    modifier->ApplySubpixelGeometryDistortion(x, y, 1, 1, exact);
+    // where lensfun returns NaN the grid falls back to it anyway
+    if(_grid_interpolate(g->fwd, 6, step, gw, g->gh, x, y, approx))
+      for(int c = 0; c < 6; c++)
+        if(isfinite(exact[c])) err = fmaxf(err, fabsf(exact[c] - approx[c]));
+    if(_grid_interpolate(g->inv, 2, step, gw, g->gh, x, y, p))
+    {
+      float solved[2];
+      if(_grid_solve(g, x, y, .01f, solved))
+        err = fmaxf(err, fmaxf(fabsf(solved[0] - p[0]), fabsf(solved[1] - p[1])));
+    }
+  }
+  return err;
+}
+
+static void _grid_free(dt_iop_lensfun_grid_t *g)
+{
+  if(!g) return;
+  delete g->modifier;
+  dt_free_align(g->fwd);
+  dt_free_align(g->inv);
+  free(g);
+}
+
+static dt_iop_lensfun_grid_t *_grid_new(const dt_iop_lensfun_data_t *const d, const float w, const float h)
+{
+  dt_iop_lensfun_grid_t *g = (dt_iop_lensfun_grid_t *)calloc(1, sizeof(dt_iop_lensfun_grid_t));
+  g->width = w;
+  g->height = h;
+  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+  g->modifier = get_modifier(&g->modflags, w, h, d, LF_MODIFY_ALL);
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  if(!(g->modflags & DT_IOP_LENSFUN_MODIFY_GEOMETRY)) return g;
+
+  dt_times_t start;
+  dt_get_times(&start);
+  for(int step = DT_IOP_LENSFUN_GRID_STEP_MAX; step >= DT_IOP_LENSFUN_GRID_STEP_MIN; step /= 2)
+  {
+    const float err = _grid_sample(g, step);
+    if(err <= DT_IOP_LENSFUN_GRID_ERROR)
+    {
+      dt_show_times_f(&start, "[lens]", "%dx%d grid for %.0fx%.0f, error %.3f", g->gw, g->gh, w, h, err);
+      return g;
+    }
+  }
+
+  // the lens distorts too much for the grid, every point is mapped by lensfun then
+  dt_free_align(g->fwd);
+  dt_free_align(g->inv);
+  g->fwd = g->inv = NULL;
+  return g;
+}
+
+// the grid for an image of the given size, built if it isn't cached. to be called with d->grid_lock held,
+// the grid is valid until it is released.
+static const dt_iop_lensfun_grid_t *_get_grid(dt_iop_lensfun_data_t *const d, const float w, const float h)
+{
+  for(int k = 0; k < DT_IOP_LENSFUN_GRIDS; k++)
+    if(d->grids[k] && d->grids[k]->width == w && d->grids[k]->height == h) return d->grids[k];
+
+  _grid_free(d->grids[d->next_grid]);
+  dt_iop_lensfun_grid_t *g = d->grids[d->next_grid] = _grid_new(d, w, h);
+  d->next_grid = (d->next_grid + 1) % DT_IOP_LENSFUN_GRIDS;
+  return g;
+}
+
+static void _grids_free(dt_iop_lensfun_data_t *const d)
+{
+  for(int k = 0; k < DT_IOP_LENSFUN_GRIDS; k++)
+  {
+    _grid_free(d->grids[k]);
+    d->grids[k] = NULL;
+  }
+  d->next_grid = 0;
+}
+
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -854,47 +1072,21 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   return;
 }
 
-// lensfun does not provide a back-transform routine. So we do it iteratively by assuming that
-// a back-transform at one point is just moving the same distance in the opposite direction. This
-// is of course not fully correct so we do adjust iteratively the transformation by checking that
-// the back transformed points are when transformed very close to the original point.
-//
-// Again, not perfect but better than having back-transform be equivalent to the transform routine above.
 int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count)
 {
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return 0;
 
   const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
-  int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+  dt_pthread_mutex_lock(&d->grid_lock);
+  const dt_iop_lensfun_grid_t *grid = _get_grid(d, orig_w, orig_h);
 
-  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+  if(grid->modflags & DT_IOP_LENSFUN_MODIFY_GEOMETRY)
   {
-    float *buf = (float *)malloc(sizeof(float) * 2 * 3);
-    for(size_t i = 0; i < points_count * 2; i += 2)
-    {
-      float p1 = points[i];
-      float p2 = points[i + 1];
-      // just loop 10 times max to find the best position. checking that the convergence is
-      // often after 2 or 3 loops.
-      for(int k=0; k<10; k++)
-      {
-        modifier->ApplySubpixelGeometryDistortion(p1, p2, 1, 1, buf);
-        const float dist1 = points[i]     - buf[0];
-        const float dist2 = points[i + 1] - buf[3];
-        if(fabsf(dist1) < .5f && fabsf(dist2) < .5f) break; // we have converged
-        p1 += dist1;
-        p2 += dist2;
-      }
-
-      points[i]     = p1;
-      points[i + 1] = p2;
-    }
-    free(buf);
+    for(size_t i = 0; i < points_count * 2; i += 2) _grid_undistort(grid, points[i], points[i + 1], points + i);
   }
 
-  delete modifier;
+  dt_pthread_mutex_unlock(&d->grid_lock);
   return 1;
 }
 
@@ -906,22 +1098,21 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return 0;
 
   const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
-  int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+  dt_pthread_mutex_lock(&d->grid_lock);
+  const dt_iop_lensfun_grid_t *grid = _get_grid(d, orig_w, orig_h);
 
-  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+  if(grid->modflags & DT_IOP_LENSFUN_MODIFY_GEOMETRY)
   {
-    float *buf = (float *)malloc(sizeof(float) * 2 * 3);
+    float buf[6];
     for(size_t i = 0; i < points_count * 2; i += 2)
     {
-      modifier->ApplySubpixelGeometryDistortion(points[i], points[i + 1], 1, 1, buf);
+      _grid_distort(grid, points[i], points[i + 1], buf);
       points[i] = buf[0];
       points[i + 1] = buf[3];
     }
-    free(buf);
   }
 
-  delete modifier;
+  dt_pthread_mutex_unlock(&d->grid_lock);
   return 1;
 }
 
@@ -929,7 +1120,7 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  const dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
+  dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
 
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f)
   {
@@ -938,57 +1129,46 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
   }
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-  int modflags;
-  lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, /*LF_MODIFY_TCA |*/ LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE);
+  dt_pthread_mutex_lock(&d->grid_lock);
+  const dt_iop_lensfun_grid_t *const grid = _get_grid(d, orig_w, orig_h);
 
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
-
-  if(!(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
+  // the green channel which is used for the mask is not changed by the tca correction
+  if(!(grid->modflags & (LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
   {
+    dt_pthread_mutex_unlock(&d->grid_lock);
     dt_iop_image_copy_by_size(out, in, roi_out->width, roi_out->height, 1);
-    delete modifier;
     return;
   }
 
   const struct dt_interpolation *const interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP);
 
-  // acquire temp memory for distorted pixel coords
-  const size_t bufsize = (size_t)roi_out->width * 2 * 3;
-  size_t padded_bufsize;
-  float *const buf = dt_alloc_perthread_float(bufsize, &padded_bufsize);
-
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(padded_bufsize, d, in, interpolation, out, roi_in, roi_out) \
-  dt_omp_sharedconst(buf) \
-  shared(modifier) \
+  dt_omp_firstprivate(d, grid, in, interpolation, out, roi_in, roi_out) \
   schedule(static)
 #endif
   for(int y = 0; y < roi_out->height; y++)
   {
-    float *bufptr = (float*)dt_get_perthread(buf, padded_bufsize);
-    modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
-
     // reverse transform the global coords from lf to our buffer
     float *_out = out + (size_t)y * roi_out->width;
-    for(int x = 0; x < roi_out->width; x++, bufptr += 6, _out++)
+    for(int x = 0; x < roi_out->width; x++, _out++)
     {
-      if(d->do_nan_checks && (!isfinite(bufptr[2]) || !isfinite(bufptr[3])))
+      float buf[6];
+      _grid_distort(grid, roi_out->x + x, roi_out->y + y, buf);
+      if(d->do_nan_checks && (!isfinite(buf[2]) || !isfinite(buf[3])))
       {
         *_out = 0.0f;
         continue;
       }
 
       // take green channel distortion also for alpha channel
-      const float pi0 = bufptr[2] - roi_in->x;
-      const float pi1 = bufptr[3] - roi_in->y;
+      const float pi0 = buf[2] - roi_in->x;
+      const float pi1 = buf[3] - roi_in->y;
       *_out = dt_interpolation_compute_sample(interpolation, in, pi0, pi1, roi_in->width, roi_in->height, 1,
                                               roi_in->width);
     }
   }
-  dt_free_align(buf);
-  delete modifier;
+  dt_pthread_mutex_unlock(&d->grid_lock);
 }
 
 void modify_roi_out(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, dt_iop_roi_t *roi_out,
@@ -1007,10 +1187,10 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return;
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
-  int modflags;
-  lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+  dt_pthread_mutex_lock(&d->grid_lock);
+  const dt_iop_lensfun_grid_t *grid = _get_grid(d, orig_w, orig_h);
 
-  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+  if(grid->modflags & DT_IOP_LENSFUN_MODIFY_GEOMETRY)
   {
     const int xoff = roi_in->x;
     const int yoff = roi_in->y;
@@ -1022,60 +1202,41 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
     const int ystep = (height < 0) ? -1 : 1;
 
     float xm = FLT_MAX, xM = -FLT_MAX, ym = FLT_MAX, yM = -FLT_MAX;
-    const size_t nbpoints = 2 * awidth + 2 * aheight;
-
-    float *const buf = (float *)dt_alloc_align(64, sizeof(float) * nbpoints * 2 * 3);
 
-#ifdef _OPENMP
-#pragma omp parallel default(none) \
-    dt_omp_firstprivate(aheight, awidth, buf, height, nbpoints, width, xoff, \
-                        xstep, yoff, ystep) \
-    shared(modifier) reduction(min : xm, ym) reduction(max : xM, yM)
-#endif
+    // walk along the borders of the roi
+    for(int k = 0; k < 2 * awidth + 2 * aheight; k++)
     {
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-      for(int i = 0; i < awidth; i++)
-        modifier->ApplySubpixelGeometryDistortion(xoff + i * xstep, yoff, 1, 1, buf + 6 * i);
-
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-      for(int i = 0; i < awidth; i++)
-        modifier->ApplySubpixelGeometryDistortion(xoff + i * xstep, yoff + (height - 1), 1, 1, buf + 6 * (awidth + i));
-
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-      for(int j = 0; j < aheight; j++)
-        modifier->ApplySubpixelGeometryDistortion(xoff, yoff + j * ystep, 1, 1, buf + 6 * (2 * awidth + j));
-
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-      for(int j = 0; j < aheight; j++)
-        modifier->ApplySubpixelGeometryDistortion(xoff + (width - 1), yoff + j * ystep, 1, 1, buf + 6 * (2 * awidth + aheight + j));
-
-#ifdef _OPENMP
-#pragma omp barrier
-#endif
-
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-      for(size_t k = 0; k < nbpoints; k++)
+      float px, py;
+      if(k < awidth)
       {
-        const float x = buf[6 * k + 0];
-        const float y = buf[6 * k + 3];
-        xm = isnan(x) ? xm : MIN(xm, x);
-        xM = isnan(x) ? xM : MAX(xM, x);
-        ym = isnan(y) ? ym : MIN(ym, y);
-        yM = isnan(y) ? yM : MAX(yM, y);
+        px = xoff + k * xstep;
+        py = yoff;
+      }
+      else if(k < 2 * awidth)
+      {
+        px = xoff + (k - awidth) * xstep;
+        py = yoff + (height - 1);
+      }
+      else if(k < 2 * awidth + aheight)
+      {
+        px = xoff;
+        py = yoff + (k - 2 * awidth) * ystep;
+      }
+      else
+      {
+        px = xoff + (width - 1);
+        py = yoff + (k - 2 * awidth - aheight) * ystep;
       }
-    }
 
-    dt_free_align(buf);
+      float buf[6];
+      _grid_distort(grid, px, py, buf);
+      const float x = buf[0];
+      const float y = buf[3];
+      xm = isnan(x) ? xm : MIN(xm, x);
+      xM = isnan(x) ? xM : MAX(xM, x);
+      ym = isnan(y) ? ym : MIN(ym, y);
+      yM = isnan(y) ? yM : MAX(yM, y);
+    }
 
     // LensFun can return NAN coords, so we need to handle them carefully.
     if(!isfinite(xm) || !(0 <= xm && xm < orig_w)) xm = 0;
@@ -1095,7 +1256,7 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
     roi_in->width = CLAMP(roi_in->width, 1, (int)ceilf(orig_w) - roi_in->x);
     roi_in->height = CLAMP(roi_in->height, 1, (int)ceilf(orig_h) - roi_in->y);
   }
-  delete modifier;
+  dt_pthread_mutex_unlock(&d->grid_lock);
 }
 
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
@@ -1114,6 +1275,10 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
 
+  // the grids are sampled again for the new parameters when they are needed
+  dt_pthread_mutex_lock(&d->grid_lock);
+  _grids_free(d);
+
   dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)self->global_data;
   lfDatabase *dt_iop_lensfun_db = (lfDatabase *)gd->db;
   const lfCamera *camera = NULL;
@@ -1201,17 +1366,22 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   {
     d->do_nan_checks = FALSE;
   }
+  dt_pthread_mutex_unlock(&d->grid_lock);
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   piece->data = calloc(1, sizeof(dt_iop_lensfun_data_t));
+  dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
+  dt_pthread_mutex_init(&d->grid_lock, NULL);
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
 
+  _grids_free(d);
+  dt_pthread_mutex_destroy(&d->grid_lock);
   if(d->lens)
   {
     delete d->lens;
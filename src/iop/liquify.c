@@ -28,6 +28,7 @@
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "develop/imageop_gui.h"
+#include "develop/tiling.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
 #include "iop/iop_api.h"
@@ -51,6 +52,8 @@ DT_MODULE_INTROSPECTION(1, dt_iop_liquify_params_t)
 const int   LOOKUP_OVERSAMPLE = 10;
 const int   INTERPOLATION_POINTS = 100; // when interpolating bezier
 const float STAMP_RELOCATION = 0.1;     // how many radii to move stamp forward when following a path
+const float MAP_CACHE_RADIUS = 32.0f;   // pixels of the smallest radius in the cached distortion map
+const size_t MAP_CACHE_MAX_SIZE = 1 << 22; // pixels of the cached distortion map, larger ones are stamped per roi
 
 #define CONF_RADIUS "plugins/darkroom/liquify/radius"
 #define CONF_ANGLE "plugins/darkroom/liquify/angle"
@@ -261,6 +264,24 @@ typedef struct
   int warp_kernel;
 } dt_iop_liquify_global_data_t;
 
+// distortion map of all paths over the whole piece. the maps of the rois are interpolated from it, so that
+// zooming and panning don't stamp all paths again.
+typedef struct
+{
+  uint64_t hash;                // of the warps and the size of the piece
+  gboolean valid;
+  gboolean per_roi;             // the map would exceed MAP_CACHE_MAX_SIZE, the rois are stamped one by one
+  float scale;                  // of the map relative to the piece at scale 1
+  cairo_rectangle_int_t extent; // in piece coordinates at this scale
+  float complex *map;           // NULL if no warp touches the piece or per_roi is set
+} dt_liquify_map_cache_t;
+
+typedef struct
+{
+  dt_iop_liquify_params_t params; // first, piece->data is used as the params
+  dt_liquify_map_cache_t cache;
+} dt_iop_liquify_data_t;
+
 typedef struct
 {
   dt_iop_liquify_params_t params;
@@ -1188,24 +1209,152 @@ static float complex *create_global_distortion_map(const cairo_rectangle_int_t *
   return map;
 }
 
+static GList *_scale_warps(const GList *warps, const float scale)
+{
+  GList *l = NULL;
+  for(const GList *i = warps; i; i = g_list_next(i))
+  {
+    dt_liquify_warp_t *w = malloc(sizeof(dt_liquify_warp_t));
+    *w = *((dt_liquify_warp_t *)i->data);
+    w->point *= scale;
+    w->strength *= scale;
+    w->radius *= scale;
+    l = g_list_prepend(l, w);
+  }
+  return g_list_reverse(l);
+}
+
+static uint64_t _warps_hash(const GList *warps, const dt_dev_pixelpipe_iop_t *piece)
+{
+  uint64_t hash = 5381;
+  const int size[2] = { piece->buf_in.width, piece->buf_in.height };
+  for(size_t k = 0; k < sizeof(size); k++) hash = ((hash << 5) + hash) ^ ((const char *)size)[k];
+  for(const GList *i = warps; i; i = g_list_next(i))
+  {
+    const dt_liquify_warp_t *w = (const dt_liquify_warp_t *)i->data;
+    const float v[8] = { crealf(w->point), cimagf(w->point), crealf(w->strength), cimagf(w->strength),
+                         crealf(w->radius), cimagf(w->radius), w->control1, w->control2 };
+    const int t[2] = { w->type, w->status };
+    for(size_t k = 0; k < sizeof(v); k++) hash = ((hash << 5) + hash) ^ ((const char *)v)[k];
+    for(size_t k = 0; k < sizeof(t); k++) hash = ((hash << 5) + hash) ^ ((const char *)t)[k];
+  }
+  return hash;
+}
+
+// stamps the warps, given at scale 1, into the cached map at the given scale, over the whole piece. a map of
+// more than MAP_CACHE_MAX_SIZE pixels is not built, per_roi is set instead.
+static void _build_cached_map(dt_liquify_map_cache_t *cache, const GList *warps,
+                              const dt_dev_pixelpipe_iop_t *piece, const uint64_t hash, const float scale)
+{
+  dt_free_align((void *)cache->map);
+  cache->map = NULL;
+  cache->hash = hash;
+  cache->scale = scale;
+  cache->valid = TRUE;
+
+  GList *scaled = _scale_warps(warps, scale);
+  const dt_iop_roi_t piece_roi = { .x = 0, .y = 0,
+                                   .width = ceilf(piece->buf_in.width * scale),
+                                   .height = ceilf(piece->buf_in.height * scale) };
+  GSList *in_piece = _get_map_extent(&piece_roi, scaled, &cache->extent);
+  cache->per_roi = (size_t)cache->extent.width * cache->extent.height > MAP_CACHE_MAX_SIZE;
+  if(!cache->per_roi) cache->map = create_global_distortion_map(&cache->extent, in_piece, FALSE);
+  g_slist_free(in_piece);
+  g_list_free_full(scaled, free);
+}
+
+static inline float complex _cached_map_at(const dt_liquify_map_cache_t *cache, const int x, const int y)
+{
+  if(x < 0 || y < 0 || x >= cache->extent.width || y >= cache->extent.height) return 0.0f;
+  return cache->map[(size_t)y * cache->extent.width + x];
+}
+
+// bilinear interpolation of the cached map to the given extent at the given scale
+static float complex *_sample_cached_map(const dt_liquify_map_cache_t *cache,
+                                         const cairo_rectangle_int_t *extent, const float scale)
+{
+  float complex *map = dt_alloc_align(64, sizeof(float complex) * extent->width * extent->height);
+  const float f = cache->scale / scale;
+  const float m = scale / cache->scale;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(cache, extent, f, m, map) schedule(static)
+#endif
+  for(int y = 0; y < extent->height; y++)
+  {
+    const float cy = (y + extent->y) * f - cache->extent.y;
+    const int j = floorf(cy);
+    const float v = cy - j;
+    float complex *row = map + (size_t)y * extent->width;
+    for(int x = 0; x < extent->width; x++)
+    {
+      const float cx = (x + extent->x) * f - cache->extent.x;
+      const int i = floorf(cx);
+      const float u = cx - i;
+      row[x] = m * ((1.0f - v) * ((1.0f - u) * _cached_map_at(cache, i, j) + u * _cached_map_at(cache, i + 1, j))
+                    + v * ((1.0f - u) * _cached_map_at(cache, i, j + 1) + u * _cached_map_at(cache, i + 1, j + 1)));
+    }
+  }
+  return map;
+}
+
 static float complex *build_global_distortion_map(struct dt_iop_module_t *module,
                                                    const dt_dev_pixelpipe_iop_t *piece,
                                                    const dt_iop_roi_t *roi_in,
                                                    const dt_iop_roi_t *roi_out,
                                                    cairo_rectangle_int_t *map_extent)
 {
+  dt_liquify_map_cache_t *cache = &((dt_iop_liquify_data_t *)piece->data)->cache;
+
   // copy params
   dt_iop_liquify_params_t copy_params;
   memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
 
-  distort_paths_raw_to_piece(module, piece->pipe, roi_in->scale, &copy_params, FALSE);
+  // the paths at scale 1, the maps of all scales are interpolated from the same cached map
+  distort_paths_raw_to_piece(module, piece->pipe, 1.0f, &copy_params, FALSE);
 
   GList *interpolated = interpolate_paths(&copy_params);
-  GSList *interpolated_in_roi = _get_map_extent(roi_out, interpolated, map_extent);
+  GList *scaled = _scale_warps(interpolated, roi_in->scale);
+  GSList *interpolated_in_roi = _get_map_extent(roi_out, scaled, map_extent);
+
+  if(interpolated_in_roi == NULL || map_extent->width * map_extent->height == 0)
+  {
+    g_slist_free(interpolated_in_roi);
+    g_list_free_full(scaled, free);
+    g_list_free_full(interpolated, free);
+    return NULL;
+  }
 
-  float complex *map = create_global_distortion_map(map_extent, interpolated_in_roi, FALSE);
+  // the cached map needs as much resolution as the roi, but not more than for the smallest radius to span
+  // MAP_CACHE_RADIUS pixels: the warps taper off smoothly over their radius. a map of a higher resolution
+  // serves the roi as well.
+  float min_radius = FLT_MAX;
+  for(const GList *i = interpolated; i; i = g_list_next(i))
+  {
+    const dt_liquify_warp_t *w = (const dt_liquify_warp_t *)i->data;
+    min_radius = fminf(min_radius, cabsf(w->radius - w->point));
+  }
+  const float scale = fminf(roi_in->scale, fminf(1.0f, MAP_CACHE_RADIUS / min_radius));
+  const uint64_t hash = _warps_hash(interpolated, piece);
+
+  // a map which was too large may fit at another scale
+  if(!cache->valid || cache->hash != hash || cache->scale < scale || (cache->per_roi && cache->scale != scale))
+  {
+    dt_times_t start;
+    dt_get_times(&start);
+    _build_cached_map(cache, interpolated, piece, hash, scale);
+    dt_show_times_f(&start, "[liquify]", "distortion map of %dx%d at scale %.3f%s", cache->extent.width,
+                    cache->extent.height, cache->scale, cache->per_roi ? " stamped per roi" : "");
+  }
+
+  float complex *map = NULL;
+  if(cache->per_roi)
+    map = create_global_distortion_map(map_extent, interpolated_in_roi, FALSE);
+  else if(cache->map)
+    map = _sample_cached_map(cache, map_extent, roi_in->scale);
 
   g_slist_free(interpolated_in_roi);
+  g_list_free_full(scaled, free);
   g_list_free_full(interpolated, free);
   return map;
 }
@@ -1279,6 +1428,20 @@ void modify_roi_in(struct dt_iop_module_t *module,
   cairo_region_destroy(roi_in_region);
 }
 
+void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                     const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
+                     struct dt_develop_tiling_t *tiling)
+{
+  // input, output and the distortion map of the roi, which covers at most roi_in with a float complex each.
+  // the cached map of the whole piece is kept across calls and may be rebuilt at up to MAP_CACHE_MAX_SIZE.
+  tiling->factor = 2.0f + 0.5f;
+  tiling->maxbuf = 1.0f;
+  tiling->overhead = sizeof(float complex) * MAP_CACHE_MAX_SIZE;
+  tiling->overlap = 0;
+  tiling->xalign = 1;
+  tiling->yalign = 1;
+}
+
 static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count, gboolean inverted)
 {
   const float scale = piece->iscale;
@@ -1657,11 +1820,13 @@ void init(dt_iop_module_t *module)
 
 void init_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(module->params_size);
+  piece->data = calloc(1, sizeof(dt_iop_liquify_data_t));
 }
 
 void cleanup_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  dt_free_align((void *)d->cache.map);
   free(piece->data);
   piece->data = NULL;
 }
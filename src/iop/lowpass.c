@@ -31,6 +31,7 @@
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe_blur.h"
 #include "develop/tiling.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -371,8 +372,6 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   float *out = (float *)ovoid;
 
 
-  const int width = roi_in->width;
-  const int height = roi_in->height;
   const int ch = piece->colors;
 
   const float radius = fmax(0.1f, data->radius);
@@ -391,23 +390,15 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   if(data->lowpass_algo == LOWPASS_ALGO_GAUSSIAN)
   {
-    dt_gaussian_t *g = dt_gaussian_init(width, height, ch, Labmax, Labmin, sigma, order);
-    if(!g) return;
-    dt_gaussian_blur_4c(g, in, out);
-    dt_gaussian_free(g);
+    if(!dt_dev_pixelpipe_blur_gaussian_4c(piece, roi_in, in, out, Labmax, Labmin, sigma, order)) return;
   }
   else
   {
     const float sigma_r = 100.0f; // d->sigma_r; // does not depend on scale
     const float sigma_s = sigma;
-    const float detail = -1.0f; // we want the bilateral base layer
 
-    dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
-    if(!b) return;
-    dt_bilateral_splat(b, in);
-    dt_bilateral_blur(b);
-    dt_bilateral_slice(b, in, out, detail);
-    dt_bilateral_free(b);
+    // we want the bilateral base layer
+    if(!dt_dev_pixelpipe_blur_bilateral(piece, roi_in, in, out, sigma_s, sigma_r)) return;
   }
 
   // some aliased pointers for compilers that don't yet understand operators on __m128
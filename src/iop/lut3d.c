@@ -25,6 +25,7 @@
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
+#include "common/dtpthread.h"
 #include "common/iop_profile.h"
 #include "develop/imageop.h"
 #include "develop/imageop_gui.h"
@@ -33,6 +34,7 @@
 #include "gui/accelerators.h"
 #include "iop/iop_api.h"
 
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <libgen.h>
 #include <png.h>
@@ -50,6 +52,10 @@ DT_MODULE_INTROSPECTION(3, dt_iop_lut3d_params_t)
 #define DT_IOP_LUT3D_MAX_LUTNAME 128
 #define DT_IOP_LUT3D_CLUT_LEVEL 48
 #define DT_IOP_LUT3D_MAX_KEYPOINTS 2048
+// memory kept for parsed luts which no pipe uses right now
+#define DT_IOP_LUT3D_CACHE_SIZE (128 << 20)
+#define DT_IOP_LUT3D_BINARY_MAGIC "dtlut3d"
+#define DT_IOP_LUT3D_BINARY_VERSION 1
 
 typedef enum dt_iop_lut3d_colorspace_t
 {
@@ -100,10 +106,21 @@ typedef enum dt_lut3d_cols_t
 
 const char invalid_filepath_prefix[] = "INVALID >> ";
 
+// a parsed clut, shared by all pipes using the same lut
+typedef struct dt_iop_lut3d_clut_t
+{
+  gchar *key;           // NULL if the lut can't be identified, the clut is then private to one piece
+  float *clut;
+  uint16_t level;
+  int users;
+  GMappedFile *mapped;  // if not NULL clut points into this binary cache file
+} dt_iop_lut3d_clut_t;
+
 typedef struct dt_iop_lut3d_data_t
 {
   dt_iop_lut3d_params_t params;
-  float *clut;  // cube lut pointer
+  dt_iop_lut3d_clut_t *entry;
+  const float *clut;  // cube lut pointer
   uint16_t level; // cube_size
 } dt_iop_lut3d_data_t;
 
@@ -113,6 +130,8 @@ typedef struct dt_iop_lut3d_global_data_t
   int kernel_lut3d_trilinear;
   int kernel_lut3d_pyramid;
   int kernel_lut3d_none;
+  dt_pthread_mutex_t lock;
+  GList *cluts;  // dt_iop_lut3d_clut_t, most recently used first
 } dt_iop_lut3d_global_data_t;
 
 #ifdef HAVE_GMIC
@@ -201,6 +220,7 @@ int legacy_params(dt_iop_module_t *self, const void *const old_params, const int
   return 1;
 }
 // From `HaldCLUT_correct.c' by Eskil Steenberg (http://www.quelsolaar.com) (BSD licensed)
+__DT_CLONE_TARGETS__
 void correct_pixel_trilinear(const float *const in, float *const out,
                              const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
 {
@@ -212,18 +232,15 @@ void correct_pixel_trilinear(const float *const in, float *const out,
 #endif
   for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
   {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
+    const float *const input = in + k;
+    float *const output = out + k;
 
     int rgbi[3], i, j;
     float tmp[6];
     float rgbd[3];
 
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
+    // clamp into locals, in may be the read-only input of the module
+    for(int c = 0; c < 3; ++c) rgbd[c] = fminf(fmaxf(input[c], 0.0f), 1.0f) * (float)(level - 1);
 
     rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
     rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
@@ -279,6 +296,7 @@ void correct_pixel_trilinear(const float *const in, float *const out,
 
 // from OpenColorIO
 // https://github.com/imageworks/OpenColorIO/blob/master/src/OpenColorIO/ops/Lut3D/Lut3DOp.cpp
+__DT_CLONE_TARGETS__
 void correct_pixel_tetrahedral(const float *const in, float *const out,
                                const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
 {
@@ -290,16 +308,13 @@ void correct_pixel_tetrahedral(const float *const in, float *const out,
 #endif
   for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
   {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
+    const float *const input = in + k;
+    float *const output = out + k;
 
     int rgbi[3];
     float rgbd[3];
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
+    // clamp into locals, in may be the read-only input of the module
+    for(int c = 0; c < 3; ++c) rgbd[c] = fminf(fmaxf(input[c], 0.0f), 1.0f) * (float)(level - 1);
 
     rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
     rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
@@ -309,64 +324,35 @@ void correct_pixel_tetrahedral(const float *const in, float *const out,
     rgbd[1] = rgbd[1] - rgbi[1]; // delta green
     rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
 
-  // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    const int i000 = color * 3;                     // P000
-    const int i100 = i000 + 3;                      // P100
-    const int i010 = (color + level) * 3;           // P010
-    const int i110 = i010 + 3;                      // P110
-    const int i001 = (color + level2) * 3;          // P001
-    const int i101 = i001 + 3;                      // P101
-    const int i011 = (color + level + level2) * 3;  // P011
-    const int i111 = i011 + 3;                      // P111
-
-    if (rgbd[0] > rgbd[1])
-    {
-      if (rgbd[1] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[1])*clut[i100] + (rgbd[1]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[1])*clut[i100+1] + (rgbd[1]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[1])*clut[i100+2] + (rgbd[1]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-      else if (rgbd[0] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[2])*clut[i100] + (rgbd[2]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[2])*clut[i100+1] + (rgbd[2]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[2])*clut[i100+2] + (rgbd[2]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[0])*clut[i001] + (rgbd[0]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[0])*clut[i001+1] + (rgbd[0]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[0])*clut[i001+2] + (rgbd[0]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-    }
-    else
-    {
-      if (rgbd[2] > rgbd[1])
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[1])*clut[i001] + (rgbd[1]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[1])*clut[i001+1] + (rgbd[1]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[1])*clut[i001+2] + (rgbd[1]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else if (rgbd[2] > rgbd[0])
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[2])*clut[i010] + (rgbd[2]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[2])*clut[i010+1] + (rgbd[2]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[2])*clut[i010+2] + (rgbd[2]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[0])*clut[i010] + (rgbd[0]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[0])*clut[i010+1] + (rgbd[0]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[0])*clut[i010+2] + (rgbd[0]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-    }
+    // walk from P000 to P111 along the axes in order of decreasing delta. selecting the path instead of
+    // branching into one of six tetrahedra lets the loop vectorize without divergent gathers.
+    const int r_g = rgbd[0] > rgbd[1];
+    const int g_b = rgbd[1] > rgbd[2];
+    const int r_b = rgbd[0] > rgbd[2];
+    const int b_g = rgbd[2] > rgbd[1];
+    const int b_r = rgbd[2] > rgbd[0];
+    const int first = r_g ? ((g_b || r_b) ? 0 : 2) : (b_g ? 2 : 1);
+    const int second = r_g ? (g_b ? 1 : (r_b ? 2 : 0)) : (b_g ? 1 : (b_r ? 2 : 0));
+    const int third = 3 - first - second;
+    const int step[3] = { 3, level * 3, level2 * 3 };
+
+    const int i000 = (rgbi[0] + rgbi[1] * level + rgbi[2] * level2) * 3;
+    const int i1 = i000 + step[first];
+    const int i2 = i1 + step[second];
+    const int i3 = i2 + step[third];
+    const float w0 = 1.0f - rgbd[first];
+    const float w1 = rgbd[first] - rgbd[second];
+    const float w2 = rgbd[second] - rgbd[third];
+    const float w3 = rgbd[third];
+
+    for(int c = 0; c < 3; ++c)
+      output[c] = w0 * clut[i000 + c] + w1 * clut[i1 + c] + w2 * clut[i2 + c] + w3 * clut[i3 + c];
   }
 }
 
 // from Study on the 3D Interpolation Models Used in Color Conversion
 // http://ijetch.org/papers/318-T860.pdf
+__DT_CLONE_TARGETS__
 void correct_pixel_pyramid(const float *const in, float *const out,
                            const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
 {
@@ -378,16 +364,13 @@ void correct_pixel_pyramid(const float *const in, float *const out,
 #endif
   for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
   {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
+    const float *const input = in + k;
+    float *const output = out + k;
 
     int rgbi[3];
     float rgbd[3];
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
+    // clamp into locals, in may be the read-only input of the module
+    for(int c = 0; c < 3; ++c) rgbd[c] = fminf(fmaxf(input[c], 0.0f), 1.0f) * (float)(level - 1);
 
     rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
     rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
@@ -973,7 +956,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
   dt_iop_lut3d_global_data_t *gd = (dt_iop_lut3d_global_data_t *)self->global_data;
   cl_int err = CL_SUCCESS;
-  const float *const clut = (float *)d->clut;
+  const float *const clut = d->clut;
   const int level = d->level;
   const int kernel = (d->params.interpolation == DT_IOP_TETRAHEDRAL) ? gd->kernel_lut3d_tetrahedral
     : (d->params.interpolation == DT_IOP_TRILINEAR) ? gd->kernel_lut3d_trilinear
@@ -1054,7 +1037,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const int width = roi_in->width;
   const int height = roi_in->height;
   const int ch = piece->colors;
-  const float *const clut = (float *)d->clut;
+  const float *const clut = d->clut;
   const uint16_t level = d->level;
   const int interpolation = d->params.interpolation;
   const int colorspace
@@ -1106,37 +1089,6 @@ void filepath_set_unix_separator(char *filepath)
     if (filepath[i]=='\\') filepath[i] = '/';
 }
 
-void init_global(dt_iop_module_so_t *module)
-{
-  const int program = 28; // rgbcurve.cl, from programs.conf
-  dt_iop_lut3d_global_data_t *gd
-      = (dt_iop_lut3d_global_data_t *)malloc(sizeof(dt_iop_lut3d_global_data_t));
-  module->data = gd;
-  gd->kernel_lut3d_tetrahedral = dt_opencl_create_kernel(program, "lut3d_tetrahedral");
-  gd->kernel_lut3d_trilinear = dt_opencl_create_kernel(program, "lut3d_trilinear");
-  gd->kernel_lut3d_pyramid = dt_opencl_create_kernel(program, "lut3d_pyramid");
-  gd->kernel_lut3d_none = dt_opencl_create_kernel(program, "lut3d_none");
-
-#ifdef HAVE_GMIC
-  // make sure the cache dir exists
-  char *cache_dir = g_build_filename(g_get_user_cache_dir(), "gmic", NULL);
-  char *cache_gmic_dir = dt_loc_init_generic(cache_dir, NULL, NULL);
-  g_free(cache_dir);
-  g_free(cache_gmic_dir);
-#endif // HAVE_GMIC
-}
-
-void cleanup_global(dt_iop_module_so_t *module)
-{
-  dt_iop_lut3d_global_data_t *gd = (dt_iop_lut3d_global_data_t *)module->data;
-  dt_opencl_free_kernel(gd->kernel_lut3d_tetrahedral);
-  dt_opencl_free_kernel(gd->kernel_lut3d_trilinear);
-  dt_opencl_free_kernel(gd->kernel_lut3d_pyramid);
-  dt_opencl_free_kernel(gd->kernel_lut3d_none);
-  free(module->data);
-  module->data = NULL;
-}
-
 static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
 {
   uint16_t level = 0;
@@ -1175,6 +1127,247 @@ static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
   return level;
 }
 
+static void _clut_free(gpointer data)
+{
+  dt_iop_lut3d_clut_t *e = (dt_iop_lut3d_clut_t *)data;
+  if(e->mapped)
+    g_mapped_file_unref(e->mapped);
+  else
+    dt_free_align(e->clut);
+  g_free(e->key);
+  free(e);
+}
+
+typedef struct dt_iop_lut3d_binary_header_t
+{
+  char magic[8];
+  int32_t version;
+  int32_t level;
+} dt_iop_lut3d_binary_header_t;
+
+static gchar *_clut_binary_filename(const char *const key)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, key, -1);
+  gchar *basename = g_strconcat(checksum, ".bin", NULL);
+  gchar *filename = g_build_filename(cachedir, "lut3d", basename, NULL);
+  g_free(basename);
+  g_free(checksum);
+  return filename;
+}
+
+// maps the binary copy of a lut written by a former parse, the key contains the modification time of lut files
+// so outdated copies are never found
+static gboolean _clut_read_binary(dt_iop_lut3d_clut_t *e)
+{
+  gchar *filename = _clut_binary_filename(e->key);
+  GMappedFile *mapped = g_mapped_file_new(filename, FALSE, NULL);
+  g_free(filename);
+  if(!mapped) return FALSE;
+
+  const gsize length = g_mapped_file_get_length(mapped);
+  const char *contents = g_mapped_file_get_contents(mapped);
+  const dt_iop_lut3d_binary_header_t *header = (const dt_iop_lut3d_binary_header_t *)contents;
+  if(length < sizeof(dt_iop_lut3d_binary_header_t)
+     || memcmp(header->magic, DT_IOP_LUT3D_BINARY_MAGIC, sizeof(header->magic))
+     || header->version != DT_IOP_LUT3D_BINARY_VERSION || header->level < 2 || header->level > 256
+     || length != sizeof(dt_iop_lut3d_binary_header_t)
+                  + sizeof(float) * 3 * header->level * header->level * header->level)
+  {
+    g_mapped_file_unref(mapped);
+    return FALSE;
+  }
+  e->mapped = mapped;
+  e->level = header->level;
+  e->clut = (float *)(contents + sizeof(dt_iop_lut3d_binary_header_t));
+  return TRUE;
+}
+
+static void _clut_write_binary(const dt_iop_lut3d_clut_t *const e)
+{
+  gchar *filename = _clut_binary_filename(e->key);
+  gchar *dirname = g_path_get_dirname(filename);
+  g_mkdir_with_parents(dirname, 0750);
+  g_free(dirname);
+
+  const size_t clut_size = sizeof(float) * 3 * e->level * e->level * e->level;
+  const size_t length = sizeof(dt_iop_lut3d_binary_header_t) + clut_size;
+  char *contents = g_malloc(length);
+  dt_iop_lut3d_binary_header_t header = { .version = DT_IOP_LUT3D_BINARY_VERSION, .level = e->level };
+  memcpy(header.magic, DT_IOP_LUT3D_BINARY_MAGIC, sizeof(header.magic));
+  memcpy(contents, &header, sizeof(header));
+  memcpy(contents + sizeof(header), e->clut, clut_size);
+
+  GError *error = NULL;
+  if(!g_file_set_contents(filename, contents, length, &error))
+  {
+    fprintf(stderr, "[lut3d] can't write `%s': %s\n", filename, error->message);
+    g_error_free(error);
+  }
+  g_free(contents);
+  g_free(filename);
+}
+
+// identifies the parsed lut: the file with its modification time and size, or the compressed keypoints
+static gchar *_clut_key(const dt_iop_lut3d_params_t *const p)
+{
+  const char *filepath = p->filepath;
+  if(!filepath[0]) return NULL;
+#ifdef HAVE_GMIC
+  if(p->nb_keypoints)
+  {
+    gchar *checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5, (const guchar *)p->c_clut,
+                                                   MIN(p->nb_keypoints, DT_IOP_LUT3D_MAX_KEYPOINTS) * 2 * 3);
+    gchar *key = g_strdup_printf("gmz:%s:%s:%d", p->lutname, checksum, DT_IOP_LUT3D_CLUT_LEVEL);
+    g_free(checksum);
+    return key;
+  }
+#endif // HAVE_GMIC
+  gchar *key = NULL;
+  gchar *lutfolder = dt_conf_get_string("plugins/darkroom/lut3d/def_path");
+  if(lutfolder[0])
+  {
+    gchar *fullpath = g_build_filename(lutfolder, filepath, NULL);
+    GStatBuf st;
+    if(!g_stat(fullpath, &st))
+      key = g_strdup_printf("file:%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, fullpath, (gint64)st.st_mtime,
+                            (gint64)st.st_size);
+    g_free(fullpath);
+  }
+  g_free(lutfolder);
+  return key;
+}
+
+// needs the lock
+static dt_iop_lut3d_clut_t *_clut_find(dt_iop_lut3d_global_data_t *gd, const char *const key)
+{
+  for(GList *l = gd->cluts; l; l = g_list_next(l))
+  {
+    dt_iop_lut3d_clut_t *e = (dt_iop_lut3d_clut_t *)l->data;
+    if(!strcmp(e->key, key))
+    {
+      e->users++;
+      gd->cluts = g_list_remove_link(gd->cluts, l);
+      gd->cluts = g_list_concat(l, gd->cluts);
+      return e;
+    }
+  }
+  return NULL;
+}
+
+// returns the parsed lut for the params, parsing it only if no other pipe did yet. NULL if there is no valid lut.
+static dt_iop_lut3d_clut_t *_clut_acquire(dt_iop_lut3d_global_data_t *gd, dt_iop_lut3d_params_t *const p)
+{
+  gchar *key = _clut_key(p);
+  if(key)
+  {
+    dt_pthread_mutex_lock(&gd->lock);
+    dt_iop_lut3d_clut_t *e = _clut_find(gd, key);
+    dt_pthread_mutex_unlock(&gd->lock);
+    if(e)
+    {
+      g_free(key);
+      return e;
+    }
+  }
+
+  // parse outside of the lock, it may take a while for large luts
+  dt_iop_lut3d_clut_t *e = (dt_iop_lut3d_clut_t *)calloc(1, sizeof(dt_iop_lut3d_clut_t));
+  e->key = key;
+  e->users = 1;
+  const gboolean binary = key && dt_conf_get_bool("plugins/darkroom/lut3d/binary_cache");
+  if(!(binary && _clut_read_binary(e)))
+  {
+    e->level = calculate_clut(p, &e->clut);
+    if(e->level && binary) _clut_write_binary(e);
+  }
+  if(!e->level)
+  {
+    _clut_free(e);
+    return NULL;
+  }
+  if(!key) return e;
+
+  dt_pthread_mutex_lock(&gd->lock);
+  dt_iop_lut3d_clut_t *other = _clut_find(gd, key);
+  if(!other) gd->cluts = g_list_prepend(gd->cluts, e);
+  dt_pthread_mutex_unlock(&gd->lock);
+  if(other)
+  { // another pipe has been faster
+    _clut_free(e);
+    return other;
+  }
+  return e;
+}
+
+static void _clut_release(dt_iop_lut3d_global_data_t *gd, dt_iop_lut3d_clut_t *e)
+{
+  if(!e) return;
+  if(!e->key)
+  {
+    _clut_free(e);
+    return;
+  }
+
+  dt_pthread_mutex_lock(&gd->lock);
+  e->users--;
+  // keep the most recently used unused luts up to the cache size
+  size_t unused = 0;
+  GList *l = gd->cluts;
+  while(l)
+  {
+    GList *next = g_list_next(l);
+    dt_iop_lut3d_clut_t *c = (dt_iop_lut3d_clut_t *)l->data;
+    if(!c->users)
+    {
+      unused += sizeof(float) * 3 * c->level * c->level * c->level;
+      if(unused > DT_IOP_LUT3D_CACHE_SIZE)
+      {
+        gd->cluts = g_list_delete_link(gd->cluts, l);
+        _clut_free(c);
+      }
+    }
+    l = next;
+  }
+  dt_pthread_mutex_unlock(&gd->lock);
+}
+
+void init_global(dt_iop_module_so_t *module)
+{
+  const int program = 28; // rgbcurve.cl, from programs.conf
+  dt_iop_lut3d_global_data_t *gd
+      = (dt_iop_lut3d_global_data_t *)malloc(sizeof(dt_iop_lut3d_global_data_t));
+  module->data = gd;
+  gd->kernel_lut3d_tetrahedral = dt_opencl_create_kernel(program, "lut3d_tetrahedral");
+  gd->kernel_lut3d_trilinear = dt_opencl_create_kernel(program, "lut3d_trilinear");
+  gd->kernel_lut3d_pyramid = dt_opencl_create_kernel(program, "lut3d_pyramid");
+  gd->kernel_lut3d_none = dt_opencl_create_kernel(program, "lut3d_none");
+  dt_pthread_mutex_init(&gd->lock, NULL);
+  gd->cluts = NULL;
+
+#ifdef HAVE_GMIC
+  // make sure the cache dir exists
+  char *cache_dir = g_build_filename(g_get_user_cache_dir(), "gmic", NULL);
+  char *cache_gmic_dir = dt_loc_init_generic(cache_dir, NULL, NULL);
+  g_free(cache_dir);
+  g_free(cache_gmic_dir);
+#endif // HAVE_GMIC
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_lut3d_global_data_t *gd = (dt_iop_lut3d_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_lut3d_tetrahedral);
+  dt_opencl_free_kernel(gd->kernel_lut3d_trilinear);
+  dt_opencl_free_kernel(gd->kernel_lut3d_pyramid);
+  dt_opencl_free_kernel(gd->kernel_lut3d_none);
+  g_list_free_full(gd->cluts, _clut_free);
+  dt_pthread_mutex_destroy(&gd->lock);
+  free(module->data);
+  module->data = NULL;
+}
+
 #ifdef HAVE_GMIC
 static gboolean list_match_string(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, dt_iop_lut3d_gui_data_t *g)
 {
@@ -1348,13 +1541,12 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   if (strcmp(p->filepath, d->params.filepath) != 0 || strcmp(p->lutname, d->params.lutname) != 0 )
   { // new clut file
-    if (d->clut)
-    { // reset current clut if any
-      dt_free_align(d->clut);
-      d->clut = NULL;
-      d->level = 0;
-    }
-    d->level = calculate_clut(p, &d->clut);
+    dt_iop_lut3d_global_data_t *gd = (dt_iop_lut3d_global_data_t *)self->global_data;
+    // reset current clut if any
+    _clut_release(gd, d->entry);
+    d->entry = _clut_acquire(gd, p);
+    d->clut = d->entry ? d->entry->clut : NULL;
+    d->level = d->entry ? d->entry->level : 0;
   }
   memcpy(&d->params, p, sizeof(dt_iop_lut3d_params_t));
 }
@@ -1364,6 +1556,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   piece->data = malloc(sizeof(dt_iop_lut3d_data_t));
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
   memcpy(&d->params, self->default_params, sizeof(dt_iop_lut3d_params_t));
+  d->entry = NULL;
   d->clut = NULL;
   d->level = 0;
   d->params.filepath[0] = '\0';
@@ -1371,9 +1564,9 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;;
-  if (d->clut)
-    dt_free_align(d->clut);
+  dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
+  _clut_release((dt_iop_lut3d_global_data_t *)self->global_data, d->entry);
+  d->entry = NULL;
   d->clut = NULL;
   d->level = 0;
   free(piece->data);
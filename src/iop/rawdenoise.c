@@ -330,7 +330,7 @@ static void wavelet_denoise_xtrans(const float *const restrict in, float *const
       fimg[col] = 0.5f;
       fimg[(height-1)*width + col] = 0.5f;
     }
-    const size_t nthreads = darktable.num_openmp_threads; // go direct, dt_get_num_threads() always returns numprocs
+    const size_t nthreads = dt_get_team_threads(); // dt_get_num_threads() always returns numprocs
     const size_t chunksize = (height + nthreads - 1) / nthreads;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
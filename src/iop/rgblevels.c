@@ -1143,6 +1143,70 @@ static void _auto_levels(const float *const img, const int width, const int heig
   p->levels[channel][1] = (p->levels[channel][2] + p->levels[channel][0]) / 2.f;
 }
 
+static inline void _levels_pixel_channels(const dt_iop_rgblevels_data_t *const d, const float mult[3],
+                                          const float *const in, float *const out)
+{
+  for(int c = 0; c < 3; c++)
+  {
+    const float L_in = in[c];
+
+    if(L_in <= d->params.levels[c][0])
+    {
+      // Anything below the lower threshold just clips to zero
+      out[c] = 0.0f;
+    }
+    else if(L_in >= d->params.levels[c][2])
+    {
+      const float percentage = (L_in - d->params.levels[c][0]) * mult[c];
+      out[c] = powf(percentage, d->inv_gamma[c]);
+    }
+    else
+    {
+      // Within the expected input range we can use the lookup table
+      const float percentage = (L_in - d->params.levels[c][0]) * mult[c];
+      out[c] = d->lut[c][CLAMP((int)(percentage * 0x10000ul), 0, 0xffff)];
+    }
+  }
+  out[3] = in[3];
+}
+
+static inline void _levels_pixel_norm(const dt_iop_rgblevels_data_t *const d, const float mult_ch,
+                                      const dt_iop_order_iccprofile_info_t *const work_profile,
+                                      const float *const in, float *const out)
+{
+  const int ch_levels = 0;
+  const float *const levels = d->params.levels[ch_levels];
+  const float lum = dt_rgb_norm(in, d->params.preserve_colors, work_profile);
+  const float alpha = in[3];
+  if(lum > levels[0])
+  {
+    float curve_lum;
+    const float percentage = (lum - levels[0]) * mult_ch;
+    if(lum >= levels[2])
+    {
+      curve_lum = powf(percentage, d->inv_gamma[ch_levels]);
+    }
+    else
+    {
+      // Within the expected input range we can use the lookup table
+      curve_lum = d->lut[ch_levels][CLAMP((int)(percentage * 0x10000ul), 0, 0xffff)];
+    }
+
+    const float ratio = curve_lum / lum;
+
+    for(int c = 0; c < 3; c++)
+    {
+      out[c] = (ratio * in[c]);
+    }
+  }
+  else
+  {
+    for(int c = 0; c < 3; c++)
+      out[c] = 0.f;
+  }
+  out[3] = alpha;
+}
+
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -1192,76 +1256,47 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
   {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(npixels, in, out, work_profile, d, mult) \
+  dt_omp_firstprivate(npixels, in, out, d, mult) \
   schedule(static)
 #endif
     for(int k = 0; k < 4U*npixels; k += 4)
     {
-      for(int c = 0; c < 3; c++)
-      {
-        const float L_in = in[k+c];
-
-        if(L_in <= d->params.levels[c][0])
-        {
-          // Anything below the lower threshold just clips to zero
-          out[k+c] = 0.0f;
-        }
-        else if(L_in >= d->params.levels[c][2])
-        {
-          const float percentage = (L_in - d->params.levels[c][0]) * mult[c];
-          out[k+c] = powf(percentage, d->inv_gamma[c]);
-        }
-        else
-        {
-          // Within the expected input range we can use the lookup table
-          const float percentage = (L_in - d->params.levels[c][0]) * mult[c];
-          out[k+c] = d->lut[c][CLAMP((int)(percentage * 0x10000ul), 0, 0xffff)];
-        }
-      }
-      out[k+3] = in[k+3];
+      _levels_pixel_channels(d, mult, in + k, out + k);
     }
   }
   else
   {
-    const int ch_levels = 0;
-    const float mult_ch = mult[ch_levels];
-    const float *const restrict levels = d->params.levels[ch_levels];
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(npixels, in, out, work_profile, d, levels, mult_ch, ch_levels) \
+  dt_omp_firstprivate(npixels, in, out, work_profile, d, mult) \
   schedule(static)
 #endif
     for(int k = 0; k < 4U*npixels; k += 4)
     {
-      const float lum = dt_rgb_norm(in+k, d->params.preserve_colors, work_profile);
-      if(lum > levels[0])
-      {
-        float curve_lum;
-        const float percentage = (lum - levels[0]) * mult_ch;
-        if(lum >= levels[2])
-        {
-          curve_lum = powf(percentage, d->inv_gamma[ch_levels]);
-        }
-        else
-        {
-          // Within the expected input range we can use the lookup table
-          curve_lum = d->lut[ch_levels][CLAMP((int)(percentage * 0x10000ul), 0, 0xffff)];
-        }
+      _levels_pixel_norm(d, mult[0], work_profile, in + k, out + k);
+    }
+  }
+}
 
-        const float ratio = curve_lum / lum;
+void process_pixels(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                    float *const out, const size_t npixels)
+{
+  const dt_iop_rgblevels_data_t *const d = (dt_iop_rgblevels_data_t *)piece->data;
+  const dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_work_profile_info(piece->pipe);
 
-        for_each_channel(c,aligned(in,out:16))
-        {
-          out[k+c] = (ratio * in[k+c]);
-        }
-      }
-      else
-      {
-        for_each_channel(c,aligned(out:16))
-          out[k+c] = 0.f;
-      }
-      out[k+3] = in[k+3];
-   }
+  const float mult[3] = { 1.f / (d->params.levels[0][2] - d->params.levels[0][0]),
+                          1.f / (d->params.levels[1][2] - d->params.levels[1][0]),
+                          1.f / (d->params.levels[2][2] - d->params.levels[2][0]) };
+
+  if (d->params.autoscale == DT_IOP_RGBLEVELS_INDEPENDENT_CHANNELS || d->params.preserve_colors == DT_RGB_NORM_NONE)
+  {
+    for(size_t k = 0; k < 4 * npixels; k += 4)
+      _levels_pixel_channels(d, mult, in + k, out + k);
+  }
+  else
+  {
+    for(size_t k = 0; k < 4 * npixels; k += 4)
+      _levels_pixel_norm(d, mult[0], work_profile, in + k, out + k);
   }
 }
 
@@ -33,6 +33,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe_blur.h"
 #include "develop/tiling.h"
 #include "dtgtk/resetlabel.h"
 #include "gui/accelerators.h"
@@ -124,21 +125,6 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   float *const restrict out = (float *const)ovoid;
 
   const size_t npixels = (size_t)roi_out->width * roi_out->height;
-/* create overexpose image and then blur */
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(brightness, npixels, saturation) \
-  dt_omp_sharedconst(in, out) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < 4 * npixels; k += 4)
-  {
-    float h, s, l;
-    rgb2hsl(&in[k], &h, &s, &l);
-    s *= saturation;
-    l *= brightness;
-    hsl2rgb(&out[k], h, CLIP(s), CLIP(l));
-  }
 
   const float w = piece->iwidth * piece->iscale;
   const float h = piece->iheight * piece->iscale;
@@ -146,7 +132,35 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   int rad = mrad * (fmin(100.0, d->size + 1) / 100.0);
   const int radius = MIN(mrad, ceilf(rad * roi_in->scale / piece->iscale));
 
-  dt_box_mean(out, roi_out->height, roi_out->width, 4, radius, BOX_ITERATIONS);
+  // the blur only depends on brightness, saturation and size, so tuning the mix reuses it
+  const struct
+  {
+    float brightness, saturation;
+    int radius;
+  } params = { brightness, saturation, radius };
+  const size_t size = sizeof(float) * 4 * npixels;
+  const uint64_t key = dt_dev_pixelpipe_blur_key(piece, roi_in, "soften", &params, sizeof(params));
+  if(!dt_dev_pixelpipe_blur_get(piece, key, out, size))
+  {
+    /* create overexpose image and then blur */
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) \
+      dt_omp_firstprivate(brightness, npixels, saturation) \
+      dt_omp_sharedconst(in, out) \
+      schedule(static)
+#endif
+    for(size_t k = 0; k < 4 * npixels; k += 4)
+    {
+      float h, s, l;
+      rgb2hsl(&in[k], &h, &s, &l);
+      s *= saturation;
+      l *= brightness;
+      hsl2rgb(&out[k], h, CLIP(s), CLIP(l));
+    }
+
+    dt_box_mean(out, roi_out->height, roi_out->width, 4, radius, BOX_ITERATIONS);
+    dt_dev_pixelpipe_blur_put(piece, key, out, size);
+  }
 
   const float amt = d->amount / 100.0f;
   dt_iop_image_linear_blend(out, amt, in, roi_out->width, roi_out->height, 4);
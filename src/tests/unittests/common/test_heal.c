@@ -0,0 +1,212 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for common/heal.c: the multigrid solver against the red/black SOR one
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <math.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+#include "common/darktable.h"
+#include "common/heal.h"
+
+// the solvers stop at 0.1 / 255, so they can differ by a few times that
+#define E 2e-3f
+
+/*
+ * HELPERS
+ */
+
+typedef struct heal_case_t
+{
+  int width, height;
+  float *src, *dest, *mask;
+} heal_case_t;
+
+typedef enum heal_shape_t
+{
+  SHAPE_DISC,
+  SHAPE_STRIP,
+  SHAPE_RING,
+  SHAPE_BOX
+} heal_shape_t;
+
+static heal_case_t *_case_new(const int width, const int height, const heal_shape_t shape)
+{
+  heal_case_t *c = malloc(sizeof(heal_case_t));
+  c->width = width;
+  c->height = height;
+  c->src = dt_alloc_align_float((size_t)4 * width * height);
+  c->dest = dt_alloc_align_float((size_t)4 * width * height);
+  c->mask = dt_alloc_align_float((size_t)width * height);
+
+  for(int i = 0; i < height; i++)
+    for(int j = 0; j < width; j++)
+    {
+      const size_t k = (size_t)i * width + j;
+      const float x = 2.0f * j / width - 1.0f, y = 2.0f * i / height - 1.0f;
+      for(int c4 = 0; c4 < 4; c4++)
+      {
+        c->src[4 * k + c4] = 0.5f + 0.3f * sinf(3.0f * x + c4) * cosf(2.0f * y);
+        c->dest[4 * k + c4] = 0.4f + 0.2f * cosf(4.0f * x * y + c4) + 0.02f * ((i * 7 + j * 13) % 17) / 17.0f;
+      }
+      const float r2 = x * x + y * y;
+      switch(shape)
+      {
+        case SHAPE_DISC:
+          c->mask[k] = r2 < 0.8f;
+          break;
+        case SHAPE_STRIP:
+          c->mask[k] = fabsf(x) < 0.9f && fabsf(y) < 0.1f;
+          break;
+        case SHAPE_RING:
+          c->mask[k] = r2 < 0.8f && r2 > 0.1f;
+          break;
+        case SHAPE_BOX:
+          c->mask[k] = i > 0 && i < height - 1 && j > 0 && j < width - 1;
+          break;
+      }
+    }
+  return c;
+}
+
+static void _case_free(heal_case_t *c)
+{
+  dt_free_align(c->src);
+  dt_free_align(c->dest);
+  dt_free_align(c->mask);
+  free(c);
+}
+
+// the running times of both solvers are stored in times if not NULL
+static void _compare_solvers(const int width, const int height, const heal_shape_t shape, double *const times)
+{
+  heal_case_t *c = _case_new(width, height, shape);
+  const size_t size = (size_t)4 * width * height;
+  float *mg = dt_alloc_align_float(size);
+  float *sor = dt_alloc_align_float(size);
+  memcpy(mg, c->dest, sizeof(float) * size);
+  memcpy(sor, c->dest, sizeof(float) * size);
+
+  const double start = dt_get_wtime();
+  dt_heal(c->src, mg, c->mask, width, height, 4, 0);
+  const double mid = dt_get_wtime();
+  dt_heal_sor(c->src, sor, c->mask, width, height, 4, 0);
+  const double end = dt_get_wtime();
+  if(times)
+  {
+    times[0] = mid - start;
+    times[1] = end - mid;
+  }
+
+  float max = 0.0f;
+  for(size_t k = 0; k < size; k++)
+  {
+    if(!c->mask[k / 4] || k % 4 == 3)
+    {
+      // fixed pixels and alpha are left alone
+      assert_float_equal(mg[k], c->dest[k], 1e-6f);
+      continue;
+    }
+    max = fmaxf(max, fabsf(mg[k] - sor[k]));
+  }
+  print_message("%dx%d shape %d: max difference %g, %.3fs against %.3fs with sor\n", width, height, shape, max,
+                mid - start, end - mid);
+  assert_true(max < E);
+
+  dt_free_align(mg);
+  dt_free_align(sor);
+  _case_free(c);
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_disc(void **state)
+{
+  _compare_solvers(64, 64, SHAPE_DISC, NULL);
+  _compare_solvers(301, 197, SHAPE_DISC, NULL);
+}
+
+static void test_strip(void **state)
+{
+  _compare_solvers(255, 128, SHAPE_STRIP, NULL);
+}
+
+static void test_thin_strip(void **state)
+{
+  // the coarsest level of a thin area stays long, it must not take many times longer than sor
+  double times[2];
+  _compare_solvers(4000, 8, SHAPE_BOX, times);
+  assert_true(times[0] < 2.0 * times[1] + 0.05);
+  _compare_solvers(4000, 16, SHAPE_BOX, times);
+  assert_true(times[0] < 2.0 * times[1] + 0.05);
+}
+
+static void test_ring(void **state)
+{
+  _compare_solvers(160, 170, SHAPE_RING, NULL);
+}
+
+static void test_laplace_is_exact(void **state)
+{
+  // a linear difference between the images is harmonic, so it is reproduced inside of the mask
+  const int width = 80, height = 60;
+  heal_case_t *c = _case_new(width, height, SHAPE_DISC);
+  for(size_t k = 0; k < (size_t)width * height; k++)
+    for(int c4 = 0; c4 < 4; c4++)
+      c->dest[4 * k + c4] = c->src[4 * k + c4] + 0.001f * (k % width) + 0.002f * (k / width);
+
+  float *expected = dt_alloc_align_float((size_t)4 * width * height);
+  memcpy(expected, c->dest, sizeof(float) * 4 * width * height);
+  // scribble into the area to be healed
+  for(size_t k = 0; k < (size_t)width * height; k++)
+    if(c->mask[k]) c->dest[4 * k] = c->dest[4 * k + 1] = c->dest[4 * k + 2] = 0.0f;
+
+  dt_heal(c->src, c->dest, c->mask, width, height, 4, 0);
+  for(size_t k = 0; k < (size_t)width * height; k++)
+    for(int c4 = 0; c4 < 3; c4++) assert_float_equal(c->dest[4 * k + c4], expected[4 * k + c4], E);
+
+  dt_free_align(expected);
+  _case_free(c);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_disc),
+    cmocka_unit_test(test_strip),
+    cmocka_unit_test(test_thin_strip),
+    cmocka_unit_test(test_ring),
+    cmocka_unit_test(test_laplace_is_exact)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,214 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for common/icc_lut.c: exactness on linear transforms and accuracy of a baked lut
+ * based rgb profile against lcms2
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <math.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <cmocka.h>
+
+#include "common/icc_lut.h"
+
+#define E 1e-4f
+
+/*
+ * HELPERS
+ */
+
+static void _sample_identity(const float *const in, float *const out, const size_t npixels, void *data)
+{
+  for(size_t k = 0; k < 4 * npixels; k++) out[k] = in[k];
+}
+
+static void _sample_lcms2(const float *const in, float *const out, const size_t npixels, void *data)
+{
+  cmsDoTransform((cmsHTRANSFORM)data, in, out, npixels);
+}
+
+// samples the clut of the test profile: srgb to Lab
+static cmsInt32Number _srgb_to_lab(const cmsUInt16Number in[], cmsUInt16Number out[], void *data)
+{
+  cmsDoTransform((cmsHTRANSFORM)data, in, out, 1);
+  return TRUE;
+}
+
+// an rgb input profile which is a 17^3 clut only, like the lut based camera profiles colorin bakes
+static cmsHPROFILE _make_clut_profile(void)
+{
+  cmsHPROFILE srgb = cmsCreate_sRGBProfile();
+  cmsHPROFILE lab = cmsCreateLab4Profile(NULL);
+  cmsHTRANSFORM xform = cmsCreateTransform(srgb, TYPE_RGB_16, lab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+
+  cmsHPROFILE profile = cmsCreateProfilePlaceholder(NULL);
+  cmsSetProfileVersion(profile, 4.3);
+  cmsSetDeviceClass(profile, cmsSigInputClass);
+  cmsSetColorSpace(profile, cmsSigRgbData);
+  cmsSetPCS(profile, cmsSigLabData);
+
+  cmsPipeline *pipeline = cmsPipelineAlloc(NULL, 3, 3);
+  cmsStage *clut = cmsStageAllocCLut16bit(NULL, 17, 3, 3, NULL);
+  cmsStageSampleCLut16bit(clut, _srgb_to_lab, xform, 0);
+  cmsPipelineInsertStage(pipeline, cmsAT_BEGIN, clut);
+  cmsWriteTag(profile, cmsSigAToB0Tag, pipeline);
+  cmsPipelineFree(pipeline);
+
+  cmsDeleteTransform(xform);
+  cmsCloseProfile(lab);
+  cmsCloseProfile(srgb);
+  return profile;
+}
+
+static float _delta_e(const float *const a, const float *const b)
+{
+  return sqrtf((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_lab_identity_is_exact(void **state)
+{
+  // the Lab shaper is linear, so a linear transform is reproduced exactly in the whole cube
+  dt_icc_lut_t *lut = dt_icc_lut_bake(DT_ICC_LUT_LAB, 9, _sample_identity, NULL, NULL);
+  assert_non_null(lut);
+
+  float px[4 * 4] = { 0.0f, -128.0f, -128.0f, 0.5f,
+                      50.0f, 10.0f, -20.0f, 1.0f,
+                      73.3f, -55.5f, 99.9f, 0.0f,
+                      100.0f, 128.0f, 128.0f, 0.25f };
+  float out[4 * 4];
+  dt_icc_lut_apply(lut, px, out, 4);
+  for(int k = 0; k < 4 * 4; k++) assert_float_equal(out[k], px[k], E);
+
+  // in place works as well
+  dt_icc_lut_apply(lut, out, out, 4);
+  for(int k = 0; k < 4 * 4; k++) assert_float_equal(out[k], px[k], E);
+
+  dt_icc_lut_free(lut);
+}
+
+static void test_input_is_clipped(void **state)
+{
+  dt_icc_lut_t *lut = dt_icc_lut_bake(DT_ICC_LUT_RGB, 5, _sample_identity, NULL, NULL);
+  assert_non_null(lut);
+
+  const float px[4] = { -0.5f, 2.0f, 1.0f, 0.75f };
+  float out[4];
+  dt_icc_lut_apply(lut, px, out, 1);
+  assert_float_equal(out[0], 0.0f, E);
+  assert_float_equal(out[1], 1.0f, E);
+  assert_float_equal(out[2], 1.0f, E);
+  assert_float_equal(out[3], 0.75f, E);
+
+  dt_icc_lut_free(lut);
+}
+
+static void test_clut_profile_accuracy(void **state)
+{
+  cmsHPROFILE profile = _make_clut_profile();
+  assert_false(cmsIsMatrixShaper(profile));
+  cmsHPROFILE lab = cmsCreateLab4Profile(NULL);
+  cmsHTRANSFORM xform = cmsCreateTransform(profile, TYPE_RGBA_FLT, lab, TYPE_LabA_FLT, INTENT_PERCEPTUAL, 0);
+  assert_non_null(xform);
+
+  dt_icc_lut_t *lut = dt_icc_lut_bake(DT_ICC_LUT_RGB, DT_ICC_LUT_LEVEL, _sample_lcms2, xform, NULL);
+  assert_non_null(lut);
+
+  // compare to lcms2 on random colors, with a bias towards the shadows
+  const int n = 100000;
+  float *in = malloc(sizeof(float) * 4 * n);
+  float *ref = malloc(sizeof(float) * 4 * n);
+  float *out = malloc(sizeof(float) * 4 * n);
+  srand(42);
+  for(int k = 0; k < 4 * n; k++)
+  {
+    const float r = (float)rand() / RAND_MAX;
+    in[k] = (k & 1) ? r : r * r * r;
+  }
+  cmsDoTransform(xform, in, ref, n);
+  dt_icc_lut_apply(lut, in, out, n);
+
+  double sum = 0.0;
+  float max = 0.0f;
+  for(int k = 0; k < n; k++)
+  {
+    const float de = _delta_e(out + 4 * k, ref + 4 * k);
+    sum += de;
+    max = fmaxf(max, de);
+  }
+  const float mean = sum / n;
+  print_message("baked %d^3 lut vs lcms2: mean dE %.4f, max dE %.4f\n", DT_ICC_LUT_LEVEL, mean, max);
+  assert_true(mean < 0.5f);
+  assert_true(max < 3.0f);
+
+  free(in);
+  free(ref);
+  free(out);
+  dt_icc_lut_free(lut);
+  cmsDeleteTransform(xform);
+  cmsCloseProfile(lab);
+  cmsCloseProfile(profile);
+}
+
+static void test_key(void **state)
+{
+  cmsHPROFILE srgb = cmsCreate_sRGBProfile();
+  cmsHPROFILE profile = _make_clut_profile();
+
+  gchar *a = dt_icc_lut_key(&profile, 1, INTENT_PERCEPTUAL, "colorin");
+  gchar *b = dt_icc_lut_key(&profile, 1, INTENT_PERCEPTUAL, "colorin");
+  gchar *c = dt_icc_lut_key(&profile, 1, INTENT_RELATIVE_COLORIMETRIC, "colorin");
+  gchar *d = dt_icc_lut_key(&srgb, 1, INTENT_PERCEPTUAL, "colorin");
+  assert_non_null(a);
+  assert_string_equal(a, b);
+  assert_string_not_equal(a, c);
+  assert_string_not_equal(a, d);
+
+  g_free(a);
+  g_free(b);
+  g_free(c);
+  g_free(d);
+  cmsCloseProfile(profile);
+  cmsCloseProfile(srgb);
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_lab_identity_is_exact),
+    cmocka_unit_test(test_input_is_clipped),
+    cmocka_unit_test(test_clut_profile_accuracy),
+    cmocka_unit_test(test_key)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,163 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for common/locallaplacian.c: a cancelled run gives up early and its output
+ * doesn't stay in the pixelpipe cache
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <math.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+#include "common/darktable.h"
+#include "common/locallaplacian.h"
+#include "develop/develop.h"
+#include "develop/pixelpipe_hb.h"
+
+#define WIDTH 96
+#define HEIGHT 64
+// never produced by the filter, marks pixels it didn't write
+#define SENTINEL -12345.0f
+
+/*
+ * HELPERS
+ */
+
+static dt_develop_t test_dev;
+static dt_iop_module_t test_module;
+static dt_dev_pixelpipe_t test_pipe;
+static dt_dev_pixelpipe_iop_t test_piece;
+static float *test_input;
+
+static int setup(void **state)
+{
+  // the darkroom pipe, the only one which gets restarted with new parameters
+  test_dev.gui_attached = 1;
+  test_dev.pipe = &test_pipe;
+  test_module.dev = &test_dev;
+  test_piece.module = &test_module;
+  test_piece.pipe = &test_pipe;
+  if(!dt_dev_pixelpipe_cache_init(&test_pipe.cache, 4, 0)) return 1;
+
+  test_input = dt_alloc_align_float((size_t)4 * WIDTH * HEIGHT);
+  for(int j = 0; j < HEIGHT; j++)
+    for(int i = 0; i < WIDTH; i++)
+    {
+      float *const px = test_input + 4 * ((size_t)j * WIDTH + i);
+      px[0] = 50.0f + 40.0f * sinf(0.2f * i) * cosf(0.15f * j);
+      px[1] = 0.1f * i - 5.0f;
+      px[2] = 0.1f * j - 3.0f;
+      px[3] = 0.0f;
+    }
+  return 0;
+}
+
+static int teardown(void **state)
+{
+  dt_free_align(test_input);
+  dt_dev_pixelpipe_cache_cleanup(&test_pipe.cache);
+  return 0;
+}
+
+// runs the filter into the cache line of hash the way the pipe does and tells whether the pipe dropped it
+static float *_run(const uint64_t hash, const dt_dev_pixelpipe_change_t changed_during_run,
+                   const dt_dev_pixelpipe_change_t changed_after_run, int *dropped)
+{
+  const size_t size = sizeof(float) * 4 * WIDTH * HEIGHT;
+  void *output = NULL;
+  dt_iop_buffer_dsc_t *dsc = &test_pipe.dsc;
+  dt_dev_pixelpipe_cache_get(&test_pipe.cache, hash, hash, size, &output, &dsc);
+  float *const out = (float *)output;
+  for(size_t k = 0; k < (size_t)4 * WIDTH * HEIGHT; k++) out[k] = SENTINEL;
+
+  test_pipe.changed = changed_during_run;
+  dt_atomic_set_int(&test_piece.incomplete, 0);
+  local_laplacian(test_input, out, WIDTH, HEIGHT, 0.5f, 0.5f, 0.5f, 0.3f, NULL, &test_piece);
+
+  test_pipe.changed = changed_after_run;
+  *dropped = dt_dev_pixelpipe_discard_incomplete(&test_pipe, &test_piece, output);
+  return out;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_cancelled_run_is_dropped(void **state)
+{
+  int dropped = 0;
+  const float *const out = _run(1, DT_DEV_PIPE_SYNCH, DT_DEV_PIPE_SYNCH, &dropped);
+
+  // the filter gave up before writing anything
+  for(size_t k = 0; k < (size_t)4 * WIDTH * HEIGHT; k++) assert_true(out[k] == SENTINEL);
+  assert_int_equal(dt_atomic_get_int(&test_piece.incomplete), 1);
+
+  assert_int_equal(dropped, 1);
+  assert_false(dt_dev_pixelpipe_cache_available(&test_pipe.cache, 1));
+}
+
+static void test_complete_run_is_kept(void **state)
+{
+  // a later module changes while this one finishes, its output stays valid
+  int dropped = 0;
+  const float *const out = _run(2, DT_DEV_PIPE_UNCHANGED, DT_DEV_PIPE_SYNCH, &dropped);
+
+  for(size_t k = 0; k < (size_t)WIDTH * HEIGHT; k++)
+  {
+    assert_true(isfinite(out[4 * k]) && out[4 * k] != SENTINEL);
+    assert_true(out[4 * k + 1] == test_input[4 * k + 1]);
+  }
+  assert_int_equal(dt_atomic_get_int(&test_piece.incomplete), 0);
+
+  assert_int_equal(dropped, 0);
+  assert_true(dt_dev_pixelpipe_cache_available(&test_pipe.cache, 2));
+}
+
+static void test_shutdown_drops_output(void **state)
+{
+  // outside of darkroom changes, shutting the pipe down cancels the run and drops its output
+  int dropped = 0;
+  dt_atomic_set_int(&test_pipe.shutdown, 1);
+  _run(3, DT_DEV_PIPE_UNCHANGED, DT_DEV_PIPE_UNCHANGED, &dropped);
+  dt_atomic_set_int(&test_pipe.shutdown, 0);
+
+  assert_int_equal(dt_atomic_get_int(&test_piece.incomplete), 1);
+  assert_int_equal(dropped, 1);
+  assert_false(dt_dev_pixelpipe_cache_available(&test_pipe.cache, 3));
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_cancelled_run_is_dropped),
+    cmocka_unit_test(test_complete_run_is_kept),
+    cmocka_unit_test(test_shutdown_drops_output)
+  };
+
+  return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,122 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for common/numa.c, using simulated topologies
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cmocka.h>
+
+#include "common/numa.h"
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_parse_two_nodes(void **state)
+{
+  dt_numa_t *numa = dt_numa_new("0-3;4-5,7");
+  assert_non_null(numa);
+  assert_int_equal(numa->num_nodes, 2);
+
+  assert_int_equal(numa->nodes[0].id, 0);
+  assert_int_equal(numa->nodes[0].num_cpus, 4);
+  for(int k = 0; k < 4; k++) assert_int_equal(numa->nodes[0].cpus[k], k);
+
+  assert_int_equal(numa->nodes[1].id, 1);
+  assert_int_equal(numa->nodes[1].num_cpus, 3);
+  assert_int_equal(numa->nodes[1].cpus[0], 4);
+  assert_int_equal(numa->nodes[1].cpus[1], 5);
+  assert_int_equal(numa->nodes[1].cpus[2], 7);
+
+  dt_numa_free(numa);
+}
+
+static void test_parse_invalid(void **state)
+{
+  assert_null(dt_numa_new("0-3;"));
+  assert_null(dt_numa_new("3-0"));
+  assert_null(dt_numa_new("0-3;x"));
+  assert_null(dt_numa_new("0,1a"));
+}
+
+static void test_single_node(void **state)
+{
+  dt_numa_t *numa = dt_numa_new("0-7");
+  assert_non_null(numa);
+  assert_int_equal(numa->num_nodes, 1);
+  // nothing to balance on a single node
+  assert_int_equal(dt_numa_acquire_node(numa), -1);
+  dt_numa_free(numa);
+}
+
+static void test_acquire_balances(void **state)
+{
+  dt_numa_t *numa = dt_numa_new("0-1;2-3;4-5");
+  assert_non_null(numa);
+
+  assert_int_equal(dt_numa_acquire_node(numa), 0);
+  assert_int_equal(dt_numa_acquire_node(numa), 1);
+  assert_int_equal(dt_numa_acquire_node(numa), 2);
+  assert_int_equal(dt_numa_acquire_node(numa), 0);
+
+  // a released node is the first to get the next job
+  dt_numa_release_node(numa, 1);
+  assert_int_equal(dt_numa_acquire_node(numa), 1);
+
+  for(int k = 0; k < numa->num_nodes; k++) assert_true(numa->nodes[k].users >= 1);
+  dt_numa_free(numa);
+}
+
+static void test_first_touch_unbound(void **state)
+{
+  dt_numa_t *numa = dt_numa_new("0-1;2-3");
+  assert_non_null(numa);
+
+  // threads which are not bound to a node leave the buffer alone
+  char buf[16] = { 1 };
+  dt_numa_first_touch(numa, buf, sizeof(buf));
+  assert_int_equal(buf[0], 1);
+  assert_int_equal(dt_numa_thread_cpus(), 0);
+  for(int k = 0; k < numa->num_nodes; k++) assert_int_equal(numa->nodes[k].placed, 0);
+
+  dt_numa_free(numa);
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_parse_two_nodes),
+    cmocka_unit_test(test_parse_invalid),
+    cmocka_unit_test(test_single_node),
+    cmocka_unit_test(test_acquire_balances),
+    cmocka_unit_test(test_first_touch_unbound)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
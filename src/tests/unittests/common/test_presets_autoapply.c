@@ -0,0 +1,367 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the in-memory matching of auto-applied presets in common/presets.c, against the
+ * queries on the preset tables it replaces
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cmocka.h>
+
+#include "common/presets.c"
+#include "gui/presets.h"
+
+/*
+ * DEFINITIONS
+ */
+
+#define PRESETS 300
+
+static sqlite3 *db = NULL;
+
+/*
+ * MOCKED FUNCTIONS
+ */
+
+// the preset tables and memory.history live in an in-memory database
+struct sqlite3 *__wrap_dt_database_get(const struct dt_database_t *database)
+{
+  return db;
+}
+
+/*
+ * HELPERS
+ */
+
+#define PRESET_COLUMNS                                                                                            \
+  "(name VARCHAR, description VARCHAR, operation VARCHAR, op_version INTEGER, op_params BLOB,"                  \
+  " enabled INTEGER, blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER,"                      \
+  " multi_name VARCHAR(256), model VARCHAR, maker VARCHAR, lens VARCHAR, iso_min REAL, iso_max REAL,"           \
+  " exposure_min REAL, exposure_max REAL, aperture_min REAL, aperture_max REAL, focal_length_min REAL,"         \
+  " focal_length_max REAL, writeprotect INTEGER, autoapply INTEGER, filter INTEGER, def INTEGER,"                \
+  " format INTEGER)"
+
+static const char *operations[] = { "exposure", "basecurve", "ioporder", "metadata", "lens", "colorin",
+                                    "filmicrgb" };
+static const char *patterns[] = { "%", "Canon", "canon%", "%5D%", "Nikon%", "%D8_0", "", "_anon", "%EOS%",
+                                  "Sony", "%-%", NULL };
+static const char *names[] = { "display-referred default", "scene-referred default", NULL };
+
+// one of the bounds, NULL or text for half of the ranges, the other half lets everything through
+static void _bind_range(sqlite3_stmt *stmt, const int col, const double *bounds, const int nbounds)
+{
+  for(int k = 0; k < 2; k++)
+  {
+    const int r = rand() % (2 * (nbounds + 2));
+    if(r < nbounds)
+      sqlite3_bind_double(stmt, col + k, bounds[r]);
+    else if(r == nbounds)
+      sqlite3_bind_null(stmt, col + k);
+    else if(r == nbounds + 1)
+      sqlite3_bind_text(stmt, col + k, "100", -1, SQLITE_STATIC);
+    else
+      sqlite3_bind_double(stmt, col + k, k ? 100000000.0 : 0.0);
+  }
+}
+
+// "%" for half of the presets
+static void _bind_pattern(sqlite3_stmt *stmt, const int col)
+{
+  const char *pattern = rand() % 2 ? "%" : patterns[rand() % (sizeof(patterns) / sizeof(patterns[0]))];
+  if(pattern)
+    sqlite3_bind_text(stmt, col, pattern, -1, SQLITE_STATIC);
+  else
+    sqlite3_bind_null(stmt, col);
+}
+
+// inserts the presets first .. first + count - 1 into table
+static void _fill_presets(const char *table, const int first, const int count)
+{
+  static const double iso[] = { 100.0, 800.0, 6400.0 };
+  static const double exposure[] = { 0.001, 0.01, 1.0 };
+  static const double aperture[] = { 1.4, 5.6, 16.0 };
+  static const double focal_length[] = { 24.0, 50.0, 200.0 };
+  static const int formats[] = { 0, 0, FOR_LDR, FOR_RAW, FOR_HDR, FOR_RAW | FOR_NOT_MONO,
+                                 FOR_LDR | FOR_RAW | FOR_NOT_COLOR, FOR_NOT_MONO, -1 };
+
+  gchar *query = g_strdup_printf("INSERT INTO %s VALUES (?1, '', ?2, ?3, ?4, 1, ?5, 7, 0, '', ?6, ?7, ?8,"
+                                 " ?9, ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, 0, 0, ?19)",
+                                 table);
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
+  for(int i = first; i < first + count; i++)
+  {
+    gchar *name = g_strdup_printf("preset %d", i);
+    const char *workflow = names[rand() % (sizeof(names) / sizeof(names[0]))];
+    sqlite3_bind_text(stmt, 1, workflow && rand() % 8 == 0 ? workflow : name, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, operations[rand() % (sizeof(operations) / sizeof(operations[0]))], -1,
+                      SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, i);
+    // the parameters tell the presets apart in memory.history
+    sqlite3_bind_blob(stmt, 4, &i, sizeof(i), SQLITE_TRANSIENT);
+    sqlite3_bind_blob(stmt, 5, name, strlen(name), SQLITE_TRANSIENT);
+    for(int k = 0; k < 3; k++) _bind_pattern(stmt, 6 + k);
+    _bind_range(stmt, 9, iso, 3);
+    _bind_range(stmt, 11, exposure, 3);
+    _bind_range(stmt, 13, aperture, 3);
+    _bind_range(stmt, 15, focal_length, 3);
+    const int writeprotect = rand() % 3;
+    if(writeprotect == 2)
+      sqlite3_bind_null(stmt, 17);
+    else
+      sqlite3_bind_int(stmt, 17, writeprotect);
+    const int autoapply = rand() % 4;
+    if(autoapply == 3)
+      sqlite3_bind_null(stmt, 18);
+    else
+      sqlite3_bind_int(stmt, 18, autoapply ? 1 : 0);
+    const int format = formats[rand() % (sizeof(formats) / sizeof(formats[0]))];
+    if(format < 0)
+      sqlite3_bind_null(stmt, 19);
+    else
+      sqlite3_bind_int(stmt, 19, format);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    g_free(name);
+  }
+  sqlite3_finalize(stmt);
+  g_free(query);
+}
+
+// all rows of memory.history in the order they were inserted, as text
+static gchar *_history(void)
+{
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db,
+                     "SELECT group_concat(row, ';') FROM"
+                     " (SELECT quote(imgid) || ',' || quote(num) || ',' || quote(module) || ','"
+                     "         || quote(operation) || ',' || quote(op_params) || ',' || quote(enabled) || ','"
+                     "         || quote(blendop_params) || ',' || quote(blendop_version) || ','"
+                     "         || quote(multi_priority) || ',' || quote(multi_name) AS row"
+                     "  FROM memory.history ORDER BY rowid)",
+                     -1, &stmt, NULL);
+  sqlite3_step(stmt);
+  gchar *history = g_strdup((const char *)sqlite3_column_text(stmt, 0));
+  sqlite3_finalize(stmt);
+  sqlite3_exec(db, "DELETE FROM memory.history", NULL, NULL, NULL);
+  return history;
+}
+
+static void _bind_image(sqlite3_stmt *stmt, const dt_presets_image_t *image)
+{
+  sqlite3_bind_int(stmt, 1, 1);
+  sqlite3_bind_text(stmt, 2, image->model, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 3, image->maker, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 4, image->camera_alias, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 5, image->camera_maker, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 6, image->lens, -1, SQLITE_STATIC);
+  sqlite3_bind_double(stmt, 7, image->iso);
+  sqlite3_bind_double(stmt, 8, image->exposure);
+  sqlite3_bind_double(stmt, 9, image->aperture);
+  sqlite3_bind_double(stmt, 10, image->focal_length);
+  sqlite3_bind_int(stmt, 11, image->format);
+  sqlite3_bind_int(stmt, 12, image->excluded);
+}
+
+// the query of _dev_auto_apply_presets() before the presets were matched in memory
+static gchar *_history_sql(const dt_presets_image_t *image, const gboolean legacy, const char *name,
+                           const gboolean display_referred)
+{
+  gchar *query = g_strdup_printf(
+      "INSERT INTO memory.history"
+      " SELECT ?1, 0, op_version, operation, op_params,"
+      "       enabled, blendop_params, blendop_version, multi_priority, multi_name"
+      " FROM %s"
+      " WHERE ( (autoapply=1"
+      "          AND ((?2 LIKE model AND ?3 LIKE maker) OR (?4 LIKE model AND ?5 LIKE maker))"
+      "          AND ?6 LIKE lens AND ?7 BETWEEN iso_min AND iso_max"
+      "          AND ?8 BETWEEN exposure_min AND exposure_max"
+      "          AND ?9 BETWEEN aperture_min AND aperture_max"
+      "          AND ?10 BETWEEN focal_length_min AND focal_length_max"
+      "          AND (format = 0 OR (format&?11 != 0 AND ~format&?12 != 0)))"
+      "        OR (name = ?13))"
+      "   AND operation NOT IN"
+      "        ('ioporder', 'metadata', 'modulegroups', 'export', 'tagging', 'collect', '%s')"
+      " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
+      legacy ? "main.legacy_presets" : "data.presets", display_referred ? "" : "basecurve");
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
+  _bind_image(stmt, image);
+  sqlite3_bind_text(stmt, 13, name, -1, SQLITE_STATIC);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  g_free(query);
+  return _history();
+}
+
+static gchar *_history_memory(const dt_presets_image_t *image, const gboolean legacy, const char *name,
+                              const gboolean display_referred)
+{
+  const char *exclude[] = { "ioporder", "metadata", "modulegroups", "export", "tagging", "collect",
+                            display_referred ? "" : "basecurve", NULL };
+  dt_presets_autoapply_to_history(1, image, legacy, name, exclude);
+  return _history();
+}
+
+// the iop order query of _dev_auto_apply_presets() before the presets were matched in memory
+static gboolean _ioporder_sql(const dt_presets_image_t *image, int32_t *params)
+{
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db,
+                     "SELECT op_params"
+                     " FROM data.presets"
+                     " WHERE autoapply=1"
+                     "       AND ((?2 LIKE model AND ?3 LIKE maker) OR (?4 LIKE model AND ?5 LIKE maker))"
+                     "       AND ?6 LIKE lens AND ?7 BETWEEN iso_min AND iso_max"
+                     "       AND ?8 BETWEEN exposure_min AND exposure_max"
+                     "       AND ?9 BETWEEN aperture_min AND aperture_max"
+                     "       AND ?10 BETWEEN focal_length_min AND focal_length_max"
+                     "       AND (format = 0 OR (format&?11 != 0 AND ~format&?12 != 0))"
+                     "       AND operation = 'ioporder'"
+                     " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
+                     -1, &stmt, NULL);
+  _bind_image(stmt, image);
+  const gboolean found = sqlite3_step(stmt) == SQLITE_ROW;
+  if(found) memcpy(params, sqlite3_column_blob(stmt, 0), sizeof(int32_t));
+  sqlite3_finalize(stmt);
+  return found;
+}
+
+static void _check_images(void)
+{
+  static const char *models[] = { "Canon EOS 5D Mark IV", "Nikon D850", "X-T3", "", NULL };
+  static const char *makers[] = { "Canon", "NIKON CORPORATION", "Fujifilm", "", NULL };
+  static const char *aliases[] = { "EOS 5D Mark IV", "D850", "X-T3", "", NULL };
+  static const char *lenses[] = { "EF24-70mm f/2.8L II USM", "", NULL };
+  static const double values[][4] = { { 100.0, 0.01, 5.6, 50.0 }, { 6400.0, 1.0, 1.4, 200.0 },
+                                      { 50.0, 0.0001, 22.0, 10.0 }, { 800.0, 0.001, 16.0, 24.0 } };
+  static const int formats[][2] = { { FOR_RAW, FOR_NOT_MONO }, { FOR_LDR, FOR_NOT_MONO },
+                                    { FOR_RAW | FOR_HDR, FOR_NOT_COLOR }, { 0, FOR_NOT_MONO } };
+
+  for(int i = 0; i < 500; i++)
+  {
+    const int m = rand() % 5, v = rand() % 4, f = rand() % 4;
+    const dt_presets_image_t image = { .model = models[m],
+                                       .maker = makers[rand() % 2 ? m : rand() % 5],
+                                       .camera_alias = aliases[m],
+                                       .camera_maker = makers[m],
+                                       .lens = lenses[rand() % 3],
+                                       .iso = values[v][0],
+                                       .exposure = values[v][1],
+                                       .aperture = values[v][2],
+                                       .focal_length = values[v][3],
+                                       .format = formats[f][0],
+                                       .excluded = formats[f][1] };
+    const gboolean legacy = rand() % 2;
+    const gboolean display_referred = rand() % 2;
+    const char *name = names[rand() % (sizeof(names) / sizeof(names[0]))];
+
+    gchar *expected = _history_sql(&image, legacy, name, display_referred);
+    gchar *history = _history_memory(&image, legacy, name, display_referred);
+    assert_string_equal(history ? history : "", expected ? expected : "");
+    g_free(expected);
+    g_free(history);
+
+    int32_t expected_params = -1;
+    const gboolean expected_found = _ioporder_sql(&image, &expected_params);
+    void *params = NULL;
+    int32_t params_size = 0;
+    const gboolean found = dt_presets_autoapply_params("ioporder", &image, &params, &params_size);
+    assert_int_equal(found, expected_found);
+    if(found)
+    {
+      assert_int_equal(params_size, sizeof(int32_t));
+      assert_int_equal(*(int32_t *)params, expected_params);
+    }
+    g_free(params);
+  }
+}
+
+/*
+ * SETUP AND TEARDOWN FUNCTIONS
+ */
+
+static int setup(void **state)
+{
+  srand(42);
+  sqlite3_open(":memory:", &db);
+  sqlite3_exec(db, "ATTACH DATABASE ':memory:' AS data", NULL, NULL, NULL);
+  sqlite3_exec(db, "ATTACH DATABASE ':memory:' AS memory", NULL, NULL, NULL);
+  sqlite3_exec(db, "CREATE TABLE data.presets " PRESET_COLUMNS, NULL, NULL, NULL);
+  sqlite3_exec(db, "CREATE TABLE main.legacy_presets " PRESET_COLUMNS, NULL, NULL, NULL);
+  sqlite3_exec(db,
+               "CREATE TABLE memory.history (imgid INTEGER, num INTEGER, module INTEGER, "
+               "operation VARCHAR(256) UNIQUE ON CONFLICT REPLACE, op_params BLOB, enabled INTEGER, "
+               "blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER, multi_name VARCHAR(256))",
+               NULL, NULL, NULL);
+  _fill_presets("data.presets", 0, PRESETS);
+  _fill_presets("main.legacy_presets", PRESETS, PRESETS);
+  return 0;
+}
+
+static int teardown(void **state)
+{
+  dt_presets_autoapply_cleanup();
+  // the triggers went away with the database
+  _autoapply_triggers = FALSE;
+  sqlite3_close(db);
+  db = NULL;
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_autoapply(void **state)
+{
+  _check_images();
+}
+
+static void test_autoapply_changed_tables(void **state)
+{
+  // the index has to follow inserts, updates and deletes on both tables
+  _check_images();
+  sqlite3_exec(db, "DELETE FROM data.presets WHERE rowid % 3 = 0", NULL, NULL, NULL);
+  _check_images();
+  sqlite3_exec(db, "UPDATE main.legacy_presets SET autoapply = 1 - autoapply, model = '%'", NULL, NULL, NULL);
+  _check_images();
+  _fill_presets("data.presets", 2 * PRESETS, PRESETS / 3);
+  _check_images();
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown(test_autoapply, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_autoapply_changed_tables, setup, teardown)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
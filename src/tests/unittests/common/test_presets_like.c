@@ -0,0 +1,94 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the LIKE matching of auto-applied presets in common/presets.c, against the LIKE
+ * operator of sqlite
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <cmocka.h>
+#include <sqlite3.h>
+
+#include "common/presets.h"
+
+/*
+ * HELPERS
+ */
+
+static gboolean _sqlite_like(sqlite3 *db, const char *string, const char *pattern)
+{
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db, "SELECT ?1 LIKE ?2", -1, &stmt, NULL);
+  sqlite3_bind_text(stmt, 1, string, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(stmt, 2, pattern, -1, SQLITE_TRANSIENT);
+  sqlite3_step(stmt);
+  const gboolean match = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  return match;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_like(void **state)
+{
+  // only ascii letters differ in case: the library database may use the case folding of icu for the others
+  const char *strings[] = { "", "Canon", "canon", "Canon EOS 5D Mark IV", "NIKON CORPORATION", "Nikon D850",
+                            "X-T3", "Leica M10-P", "%", "_", "a_b", "ébène", "5D" };
+  const char *patterns[] = { "", "%", "%%", "_", "_%", "%_", "Canon", "CANON", "canon%", "%5D%", "_anon",
+                             "%EOS%IV", "%d8_0", "Nikon%", "%-%", "_b_n_", "%_b%", "%\\%", "a%b", "x-t_" };
+
+  sqlite3 *db;
+  sqlite3_open(":memory:", &db);
+  for(int s = 0; s < sizeof(strings) / sizeof(strings[0]); s++)
+    for(int p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+    {
+      const gboolean expected = _sqlite_like(db, strings[s], patterns[p]);
+      if(dt_presets_like(strings[s], patterns[p]) != expected)
+        fail_msg("'%s' LIKE '%s' should be %d", strings[s], patterns[p], expected);
+    }
+  sqlite3_close(db);
+}
+
+static void test_like_null(void **state)
+{
+  // NULL is never matched, like in sql
+  assert_false(dt_presets_like(NULL, "%"));
+  assert_false(dt_presets_like("Canon", NULL));
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_like),
+    cmocka_unit_test(test_like_null)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
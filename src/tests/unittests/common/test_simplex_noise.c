@@ -0,0 +1,206 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for common/simplex_noise.c: the vectorized rows against single points and against the
+ * double precision noise grain used before, periodicity and range of the noise
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <math.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <cmocka.h>
+
+#include "common/simplex_noise.h"
+
+#define E 1e-6f
+#define N 1000
+
+// the double precision noise grain used before, as the reference for the single precision one
+static const int grad3[12][3] = { { 1, 1, 0 },  { -1, 1, 0 },  { 1, -1, 0 }, { -1, -1, 0 },
+                                  { 1, 0, 1 },  { -1, 0, 1 },  { 1, 0, -1 }, { -1, 0, -1 },
+                                  { 0, 1, 1 },  { 0, -1, 1 },  { 0, 1, -1 }, { 0, -1, -1 } };
+
+static const int permutation[256]
+    = { 151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233, 7,   225, 140, 36,  103, 30,
+        69,  142, 8,   99,  37,  240, 21,  10,  23,  190, 6,   148, 247, 120, 234, 75,  0,   26,  197, 62,
+        94,  252, 219, 203, 117, 35,  11,  32,  57,  177, 33,  88,  237, 149, 56,  87,  174, 20,  125, 136,
+        171, 168, 68,  175, 74,  165, 71,  134, 139, 48,  27,  166, 77,  146, 158, 231, 83,  111, 229, 122,
+        60,  211, 133, 230, 220, 105, 92,  41,  55,  46,  245, 40,  244, 102, 143, 54,  65,  25,  63,  161,
+        1,   216, 80,  73,  209, 76,  132, 187, 208, 89,  18,  169, 200, 196, 135, 130, 116, 188, 159, 86,
+        164, 100, 109, 198, 173, 186, 3,   64,  52,  217, 226, 250, 124, 123, 5,   202, 38,  147, 118, 126,
+        255, 82,  85,  212, 207, 206, 59,  227, 47,  16,  58,  17,  182, 189, 28,  42,  223, 183, 170, 213,
+        119, 248, 152, 2,   44,  154, 163, 70,  221, 153, 101, 155, 167, 43,  172, 9,   129, 22,  39,  253,
+        19,  98,  108, 110, 79,  113, 224, 232, 178, 185, 112, 104, 218, 246, 97,  228, 251, 34,  242, 193,
+        238, 210, 144, 12,  191, 179, 162, 241, 81,  51,  145, 235, 249, 14,  239, 107, 49,  192, 214, 31,
+        181, 199, 106, 157, 184, 84,  204, 176, 115, 121, 50,  45,  127, 4,   150, 254, 138, 236, 205, 93,
+        222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156, 180 };
+
+static int perm(const int i)
+{
+  return permutation[i & 255];
+}
+
+static double corner(const int gi, const double x, const double y, const double z)
+{
+  double t = 0.6 - x * x - y * y - z * z;
+  if(t < 0) return 0.0;
+  t *= t;
+  return t * t * (grad3[gi][0] * x + grad3[gi][1] * y + grad3[gi][2] * z);
+}
+
+static double reference_noise(const double xin, const double yin, const double zin)
+{
+  const double F3 = 1.0 / 3.0, G3 = 1.0 / 6.0;
+  const double s = (xin + yin + zin) * F3;
+  const int i = floor(xin + s), j = floor(yin + s), k = floor(zin + s);
+  const double t = (i + j + k) * G3;
+  const double x0 = xin - (i - t), y0 = yin - (j - t), z0 = zin - (k - t);
+  int i1, j1, k1, i2, j2, k2;
+  if(x0 >= y0)
+  {
+    if(y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+    else if(x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+    else              { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+  }
+  else
+  {
+    if(y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+    else if(x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+    else              { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+  }
+  const int gi0 = perm(i + perm(j + perm(k))) % 12;
+  const int gi1 = perm(i + i1 + perm(j + j1 + perm(k + k1))) % 12;
+  const int gi2 = perm(i + i2 + perm(j + j2 + perm(k + k2))) % 12;
+  const int gi3 = perm(i + 1 + perm(j + 1 + perm(k + 1))) % 12;
+  return 32.0 * (corner(gi0, x0, y0, z0)
+                 + corner(gi1, x0 - i1 + G3, y0 - j1 + G3, z0 - k1 + G3)
+                 + corner(gi2, x0 - i2 + 2.0 * G3, y0 - j2 + 2.0 * G3, z0 - k2 + 2.0 * G3)
+                 + corner(gi3, x0 - 1.0 + 3.0 * G3, y0 - 1.0 + 3.0 * G3, z0 - 1.0 + 3.0 * G3));
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_row_matches_points(void **state)
+{
+  // coordinates which are exact in single precision, so both paths see the same inputs
+  const float x = 0.25f, dx = 0.0625f, y = 3.5f, z = 2.0f;
+  float row[N] = { 0.0f };
+  dt_simplex_noise_row_add(row, N, x, dx, y, z, 1.0f);
+  dt_simplex_noise_row_add(row, N, x, dx, y, z, 0.5f);
+  for(int i = 0; i < N; i++) assert_float_equal(row[i], 1.5f * dt_simplex_noise_3d(x + i * dx, y, z), E);
+}
+
+static void test_matches_double_reference(void **state)
+{
+  // the single precision noise differs from the double one by up to about 5e-3 near the largest gradients,
+  // which grain's three octaves add up to about 7e-3. the coordinates span a few periods, as with the per
+  // image offsets of grain.
+  const float tolerance = 1e-2f;
+  const double freq[3] = { 0.4910, 0.9441, 1.7280 };
+  const float amp[3] = { 0.2340, 0.7850, 1.2150 };
+  double max_noise = 0.0, max_grain = 0.0;
+  for(int j = 0; j < 200; j++)
+  {
+    const double x = j * 13.37, dx = 0.0137 * (1 + j % 37), y = j * 11.03, zoom = 0.5 + j % 20;
+    float noise[N] = { 0.0f };
+    float grain[N] = { 0.0f };
+    dt_simplex_noise_row_add(noise, N, x, dx, y, j % 3, 1.0f);
+    for(int o = 0; o < 3; o++)
+    {
+      const double f = freq[o] / zoom;
+      dt_simplex_noise_row_add(grain, N, x * f, dx * f, y * f, o, amp[o]);
+    }
+    for(int i = 0; i < N; i++)
+    {
+      double expected = 0.0;
+      for(int o = 0; o < 3; o++)
+        expected += reference_noise((x + i * dx) * freq[o] / zoom, y * freq[o] / zoom, o) * amp[o];
+      max_noise = fmax(max_noise, fabs(noise[i] - reference_noise(x + i * dx, y, j % 3)));
+      max_grain = fmax(max_grain, fabs(grain[i] - expected));
+      assert_float_equal(noise[i], reference_noise(x + i * dx, y, j % 3), tolerance);
+      assert_float_equal(grain[i], expected, tolerance);
+    }
+  }
+  print_message("max difference to the double noise %g, to the double grain %g\n", max_noise, max_grain);
+}
+
+static void test_period(void **state)
+{
+  // large offsets are reduced by the period without losing precision
+  float row[N] = { 0.0f };
+  float shifted[N] = { 0.0f };
+  dt_simplex_noise_row_add(row, N, 0.125, 0.125, 7.25, 1.0, 1.0f);
+  dt_simplex_noise_row_add(shifted, N, 0.125 + 1000 * DT_SIMPLEX_NOISE_PERIOD, 0.125,
+                           7.25 + 3 * DT_SIMPLEX_NOISE_PERIOD, 1.0, 1.0f);
+  for(int i = 0; i < N; i++) assert_float_equal(row[i], shifted[i], E);
+}
+
+static void test_range(void **state)
+{
+  double sum = 0.0, sum2 = 0.0;
+  float min = INFINITY, max = -INFINITY;
+  for(int j = 0; j < N; j++)
+  {
+    float row[N] = { 0.0f };
+    dt_simplex_noise_row_add(row, N, 0.0, 0.37, j * 0.29, j % 3, 1.0f);
+    for(int i = 0; i < N; i++)
+    {
+      sum += row[i];
+      sum2 += row[i] * row[i];
+      min = fminf(min, row[i]);
+      max = fmaxf(max, row[i]);
+    }
+  }
+  const double mean = sum / (N * N);
+  const double sigma = sqrt(sum2 / (N * N) - mean * mean);
+  print_message("mean %g, sigma %g, range [%g, %g]\n", mean, sigma, min, max);
+  assert_true(min >= -1.0f && max <= 1.0f);
+  assert_true(fabs(mean) < 0.01);
+  assert_true(sigma > 0.1);
+}
+
+static void test_seed(void **state)
+{
+  assert_int_equal(dt_simplex_noise_seed(""), 0);
+  assert_int_equal(dt_simplex_noise_seed("IMG_0001.CR2"), dt_simplex_noise_seed("IMG_0001.CR2"));
+  assert_int_not_equal(dt_simplex_noise_seed("IMG_0001.CR2"), dt_simplex_noise_seed("IMG_0002.CR2"));
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_row_matches_points),
+    cmocka_unit_test(test_matches_double_reference),
+    cmocka_unit_test(test_period),
+    cmocka_unit_test(test_range),
+    cmocka_unit_test(test_seed)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,135 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for develop/imageop.c: the number of threads given to a module
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cmocka.h>
+
+#include "common/darktable.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe_hb.h"
+
+/*
+ * HELPERS
+ */
+
+static dt_iop_module_so_t test_so;
+static dt_iop_module_t test_module;
+static dt_dev_pixelpipe_t test_pipe;
+static dt_dev_pixelpipe_iop_t test_piece;
+
+static int setup(void **state)
+{
+  test_module.so = &test_so;
+  test_piece.module = &test_module;
+  test_piece.pipe = &test_pipe;
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_single_cpu(void **state)
+{
+  const dt_iop_roi_t huge = { .width = 8000, .height = 6000, .scale = 1.0f };
+  darktable.num_openmp_threads = 1;
+  test_so.cpu_cost = 1.0f;
+
+  test_pipe.adaptive_threads = TRUE;
+  assert_int_equal(dt_iop_get_num_threads(&test_piece, &huge), 1);
+  test_pipe.adaptive_threads = FALSE;
+  assert_int_equal(dt_iop_get_num_threads(&test_piece, &huge), 1);
+
+  // never 0, even if the thread count wasn't set up
+  darktable.num_openmp_threads = 0;
+  assert_int_equal(dt_iop_get_num_threads(&test_piece, &huge), 1);
+}
+
+static void test_not_adaptive(void **state)
+{
+  const dt_iop_roi_t tiny = { .width = 1, .height = 1, .scale = 1.0f };
+  darktable.num_openmp_threads = 8;
+  test_so.cpu_cost = 0.0f;
+  test_pipe.adaptive_threads = FALSE;
+
+  // all threads, however small the region
+  assert_int_equal(dt_iop_get_num_threads(&test_piece, &tiny), 8);
+}
+
+static void test_tiny_buffer(void **state)
+{
+  const dt_iop_roi_t tiny = { .width = 1, .height = 1, .scale = 1.0f };
+  const dt_iop_roi_t empty = { .width = 0, .height = 0, .scale = 1.0f };
+  darktable.num_openmp_threads = 8;
+  test_so.cpu_cost = 0.0f;
+  test_pipe.adaptive_threads = TRUE;
+
+  assert_int_equal(dt_iop_get_num_threads(&test_piece, &tiny), 1);
+  assert_int_equal(dt_iop_get_num_threads(&test_piece, &empty), 1);
+  // a module measured at 100 thread-seconds per megapixel gets no more than one thread on a single pixel
+  assert_int_equal(dt_iop_share_threads(8, 1, 100.0f, &tiny), 1);
+}
+
+static void test_clamped_to_share(void **state)
+{
+  const dt_iop_roi_t huge = { .width = 8000, .height = 6000, .scale = 1.0f };
+
+  // enough work for all threads of a single pipe
+  assert_int_equal(dt_iop_share_threads(8, 0, 1.0f, &huge), 8);
+  assert_int_equal(dt_iop_share_threads(8, 1, 1.0f, &huge), 8);
+  // the cores are shared between the running pipes, rounding to the nearest count
+  assert_int_equal(dt_iop_share_threads(8, 2, 1.0f, &huge), 4);
+  assert_int_equal(dt_iop_share_threads(8, 3, 1.0f, &huge), 3);
+  // more pipes than cores still leaves one thread each
+  assert_int_equal(dt_iop_share_threads(8, 20, 1.0f, &huge), 1);
+}
+
+static void test_scales_with_work(void **state)
+{
+  // 0.01 thread-seconds per megapixel while unknown, one thread per 0.5 ms of work
+  const dt_iop_roi_t small = { .width = 100, .height = 100, .scale = 1.0f };  // 0.1 ms
+  const dt_iop_roi_t medium = { .width = 400, .height = 500, .scale = 1.0f }; // 2 ms
+  assert_int_equal(dt_iop_share_threads(16, 1, 0.0f, &small), 1);
+  assert_int_equal(dt_iop_share_threads(16, 1, 0.0f, &medium), 4);
+  // a measured expensive module spreads the same region over more threads
+  assert_int_equal(dt_iop_share_threads(16, 1, 0.02f, &medium), 8);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_single_cpu),
+    cmocka_unit_test(test_not_adaptive),
+    cmocka_unit_test(test_tiny_buffer),
+    cmocka_unit_test(test_clamped_to_share),
+    cmocka_unit_test(test_scales_with_work)
+  };
+
+  return cmocka_run_group_tests(tests, setup, NULL);
+}
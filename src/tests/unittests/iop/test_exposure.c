@@ -0,0 +1,108 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/exposure.c: a fused run of the pointwise
+ * callbacks against process()
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/pointwise.h"
+
+#include "iop/exposure.c"
+
+/*
+ * DEFINITIONS
+ */
+
+#define E 1e-6f
+// not a multiple of the span of fused runs
+#define WIDTH 1531
+#define HEIGHT 7
+
+static dt_iop_module_so_t test_so;
+static dt_iop_module_t test_module;
+static dt_dev_pixelpipe_t test_pipe;
+
+static void init_piece(dt_dev_pixelpipe_iop_t *piece, dt_iop_exposure_data_t *d, const float black,
+                       const float exposure)
+{
+  memset(d, 0, sizeof(*d));
+  d->params.mode = EXPOSURE_MODE_MANUAL;
+  d->params.black = black;
+  d->params.exposure = exposure;
+  d->deflicker = 0;
+
+  memset(piece, 0, sizeof(*piece));
+  piece->module = &test_module;
+  piece->pipe = &test_pipe;
+  piece->data = d;
+  piece->enabled = 1;
+  piece->colors = 4;
+}
+
+static int setup_module(void **state)
+{
+  test_so.flags = flags;
+  test_module.so = &test_so;
+  test_module.process = process;
+  test_module.process_pixels = process_pixels;
+  test_module.process_pixels_prepare = process_pixels_prepare;
+  test_pipe.type = DT_DEV_PIXELPIPE_EXPORT;
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_fused_matches_process(void **state)
+{
+  const float black[] = { 0.0f, 0.02f, -0.01f };
+  const float exposure[] = { 0.0f, 1.5f, -2.3f };
+  float *const in = pointwise_image(WIDTH, HEIGHT);
+
+  for(int i = 0; i < 3; i++)
+  {
+    dt_iop_exposure_data_t d1, d2;
+    dt_dev_pixelpipe_iop_t first, second;
+    init_piece(&first, &d1, black[i], exposure[i]);
+    init_piece(&second, &d2, black[(i + 1) % 3], exposure[(i + 2) % 3]);
+    assert_fused_matches_process(&test_module, &first, &second, in, WIDTH, HEIGHT, E);
+  }
+
+  dt_free_align(in);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_fused_matches_process)
+  };
+
+  return cmocka_run_group_tests(tests, setup_module, NULL);
+}
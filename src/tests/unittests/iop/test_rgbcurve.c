@@ -0,0 +1,129 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/rgbcurve.c: a fused run of the pointwise
+ * callbacks against process()
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/pointwise.h"
+
+#include "iop/rgbcurve.c"
+
+/*
+ * DEFINITIONS
+ */
+
+#define E 1e-6f
+
+// not a multiple of the span of fused runs
+#define WIDTH 1531
+#define HEIGHT 7
+
+static dt_iop_module_so_t test_so;
+static dt_iop_module_t test_module;
+static dt_dev_pixelpipe_t test_pipe;
+static dt_iop_rgbcurve_params_t test_defaults;
+
+static void init_piece(dt_dev_pixelpipe_iop_t *piece, const dt_iop_rgbcurve_autoscale_t autoscale,
+                       const dt_iop_rgb_norms_t preserve_colors, const float lift)
+{
+  dt_iop_rgbcurve_params_t p = test_defaults;
+  p.curve_autoscale = autoscale;
+  p.preserve_colors = preserve_colors;
+  p.compensate_middle_grey = FALSE;
+  for(int ch = 0; ch < DT_IOP_RGBCURVE_MAX_CHANNELS; ch++)
+  {
+    // an s-curve whose end slope extrapolates beyond white
+    p.curve_num_nodes[ch] = 4;
+    p.curve_type[ch] = MONOTONE_HERMITE;
+    p.curve_nodes[ch][0] = (dt_iop_rgbcurve_node_t){ 0.0f, 0.0f };
+    p.curve_nodes[ch][1] = (dt_iop_rgbcurve_node_t){ 0.25f, 0.2f - lift };
+    p.curve_nodes[ch][2] = (dt_iop_rgbcurve_node_t){ 0.6f + 0.05f * ch, 0.7f + lift };
+    p.curve_nodes[ch][3] = (dt_iop_rgbcurve_node_t){ 1.0f, 1.0f };
+  }
+
+  memset(piece, 0, sizeof(*piece));
+  piece->module = &test_module;
+  piece->pipe = &test_pipe;
+  piece->enabled = 1;
+  piece->colors = 4;
+  init_pipe(&test_module, &test_pipe, piece);
+  commit_params(&test_module, (dt_iop_params_t *)&p, &test_pipe, piece);
+}
+
+static int setup_module(void **state)
+{
+  for(int ch = 0; ch < DT_IOP_RGBCURVE_MAX_CHANNELS; ch++)
+  {
+    test_defaults.curve_num_nodes[ch] = 2;
+    test_defaults.curve_type[ch] = MONOTONE_HERMITE;
+    test_defaults.curve_nodes[ch][1] = (dt_iop_rgbcurve_node_t){ 1.0f, 1.0f };
+  }
+  test_so.flags = flags;
+  test_module.so = &test_so;
+  test_module.default_params = (dt_iop_params_t *)&test_defaults;
+  test_module.process = process;
+  test_module.process_pixels = process_pixels;
+  test_module.process_pixels_prepare = process_pixels_prepare;
+  test_pipe.type = DT_DEV_PIXELPIPE_EXPORT;
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_fused_matches_process(void **state)
+{
+  const dt_iop_rgbcurve_autoscale_t autoscale[] = { DT_S_SCALE_MANUAL_RGB, DT_S_SCALE_AUTOMATIC_RGB,
+                                                    DT_S_SCALE_AUTOMATIC_RGB };
+  const dt_iop_rgb_norms_t preserve_colors[] = { DT_RGB_NORM_NONE, DT_RGB_NORM_LUMINANCE, DT_RGB_NORM_NORM };
+  float *const in = pointwise_image(WIDTH, HEIGHT);
+
+  for(int i = 0; i < 3; i++)
+  {
+    dt_dev_pixelpipe_iop_t first, second;
+    init_piece(&first, autoscale[i], preserve_colors[i], 0.05f);
+    init_piece(&second, autoscale[(i + 1) % 3], preserve_colors[(i + 2) % 3], -0.03f);
+    assert_fused_matches_process(&test_module, &first, &second, in, WIDTH, HEIGHT, E);
+    cleanup_pipe(&test_module, &test_pipe, &first);
+    cleanup_pipe(&test_module, &test_pipe, &second);
+  }
+
+  dt_free_align(in);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_fused_matches_process)
+  };
+
+  return cmocka_run_group_tests(tests, setup_module, NULL);
+}
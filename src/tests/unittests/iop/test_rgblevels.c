@@ -0,0 +1,114 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/rgblevels.c: a fused run of the pointwise
+ * callbacks against process()
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/pointwise.h"
+
+#include "iop/rgblevels.c"
+
+/*
+ * DEFINITIONS
+ */
+
+#define E 1e-6f
+
+// not a multiple of the span of fused runs
+#define WIDTH 1531
+#define HEIGHT 7
+
+static dt_iop_module_so_t test_so;
+static dt_iop_module_t test_module;
+static dt_dev_pixelpipe_t test_pipe;
+
+static void init_piece(dt_dev_pixelpipe_iop_t *piece, const dt_iop_rgblevels_autoscale_t autoscale,
+                       const dt_iop_rgb_norms_t preserve_colors, const float shift)
+{
+  dt_iop_rgblevels_params_t p = { .autoscale = autoscale, .preserve_colors = preserve_colors };
+  for(int ch = 0; ch < DT_IOP_RGBLEVELS_MAX_CHANNELS; ch++)
+  {
+    p.levels[ch][0] = 0.02f + shift * ch;
+    p.levels[ch][1] = 0.45f - shift;
+    p.levels[ch][2] = 0.95f - shift * ch;
+  }
+
+  memset(piece, 0, sizeof(*piece));
+  piece->module = &test_module;
+  piece->pipe = &test_pipe;
+  piece->enabled = 1;
+  piece->colors = 4;
+  init_pipe(&test_module, &test_pipe, piece);
+  commit_params(&test_module, (dt_iop_params_t *)&p, &test_pipe, piece);
+}
+
+static int setup_module(void **state)
+{
+  test_so.flags = flags;
+  test_module.so = &test_so;
+  test_module.process = process;
+  test_module.process_pixels = process_pixels;
+  test_pipe.type = DT_DEV_PIXELPIPE_EXPORT;
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_fused_matches_process(void **state)
+{
+  const dt_iop_rgblevels_autoscale_t autoscale[] = { DT_IOP_RGBLEVELS_INDEPENDENT_CHANNELS,
+                                                     DT_IOP_RGBLEVELS_LINKED_CHANNELS,
+                                                     DT_IOP_RGBLEVELS_LINKED_CHANNELS };
+  const dt_iop_rgb_norms_t preserve_colors[] = { DT_RGB_NORM_NONE, DT_RGB_NORM_LUMINANCE, DT_RGB_NORM_POWER };
+  float *const in = pointwise_image(WIDTH, HEIGHT);
+
+  for(int i = 0; i < 3; i++)
+  {
+    dt_dev_pixelpipe_iop_t first, second;
+    init_piece(&first, autoscale[i], preserve_colors[i], 0.01f);
+    init_piece(&second, autoscale[(i + 1) % 3], preserve_colors[(i + 2) % 3], -0.02f);
+    assert_fused_matches_process(&test_module, &first, &second, in, WIDTH, HEIGHT, E);
+    cleanup_pipe(&test_module, &test_pipe, &first);
+    cleanup_pipe(&test_module, &test_pipe, &second);
+  }
+
+  dt_free_align(in);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_fused_matches_process)
+  };
+
+  return cmocka_run_group_tests(tests, setup_module, NULL);
+}
@@ -0,0 +1,89 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <math.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+#include "develop/develop.h"
+#include "pointwise.h"
+
+float *pointwise_image(const int width, const int height)
+{
+  const size_t npixels = (size_t)width * height;
+  float *const img = dt_alloc_align_float(4 * npixels);
+  for(size_t k = 0; k < npixels; k++)
+  {
+    // a ramp from below black to beyond white, with the channels at different speeds. every 7th pixel is
+    // grey and every 11th one exactly black.
+    const float v = -0.05f + 2.5f * (k % 1009) / 1008.0f;
+    img[4 * k + 0] = v;
+    img[4 * k + 1] = (k % 7) ? 0.7f * v + 0.02f * (k % 13) : v;
+    img[4 * k + 2] = (k % 7) ? 1.3f * v - 0.03f * (k % 5) : v;
+    img[4 * k + 3] = 0.25f * (k % 5);
+    if(k % 11 == 0) img[4 * k + 0] = img[4 * k + 1] = img[4 * k + 2] = 0.0f;
+  }
+  return img;
+}
+
+void assert_fused_matches_process(dt_iop_module_t *const module, dt_dev_pixelpipe_iop_t *const first,
+                                  dt_dev_pixelpipe_iop_t *const second, const float *const in,
+                                  const int width, const int height, const float eps)
+{
+  const size_t npixels = (size_t)width * height;
+  const dt_iop_roi_t roi = { .x = 0, .y = 0, .width = width, .height = height, .scale = 1.0f };
+  dt_dev_pixelpipe_t *const pipe = first->pipe;
+  float *const tmp = dt_alloc_align_float(4 * npixels);
+  float *const expected = dt_alloc_align_float(4 * npixels);
+  float *const fused = dt_alloc_align_float(4 * npixels);
+
+  // unfused: each piece reads the output of the previous one from its own buffer
+  for(int c = 0; c < 3; c++) pipe->dsc.processed_maximum[c] = 1.0f;
+  module->process(module, first, in, tmp, &roi, &roi);
+  module->process(module, second, tmp, expected, &roi, &roi);
+  float expected_maximum[3];
+  memcpy(expected_maximum, pipe->dsc.processed_maximum, sizeof(expected_maximum));
+
+  // fused: both pieces are prepared first, then every span goes through both of them, in place after the first
+  for(int c = 0; c < 3; c++) pipe->dsc.processed_maximum[c] = 1.0f;
+  if(module->process_pixels_prepare)
+  {
+    module->process_pixels_prepare(module, first, &roi);
+    module->process_pixels_prepare(module, second, &roi);
+  }
+  GList *modules = g_list_append(g_list_append(NULL, module), module);
+  GList *pieces = g_list_append(g_list_append(NULL, first), second);
+  dt_develop_t *dev = calloc(1, sizeof(dt_develop_t));
+  dt_dev_pixelpipe_process_pointwise(dev, modules, pieces, NULL, in, fused, npixels, 4);
+
+  for(size_t k = 0; k < 4 * npixels; k++)
+    assert_float_equal(fused[k], expected[k], eps * fmaxf(1.0f, fabsf(expected[k])));
+  for(int c = 0; c < 3; c++)
+    assert_float_equal(pipe->dsc.processed_maximum[c], expected_maximum[c], eps * expected_maximum[c]);
+
+  free(dev);
+  g_list_free(modules);
+  g_list_free(pieces);
+  dt_free_align(fused);
+  dt_free_align(expected);
+  dt_free_align(tmp);
+}
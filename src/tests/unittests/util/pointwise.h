@@ -0,0 +1,38 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Helpers to check the pointwise callbacks of image processing modules against
+ * their process(), to be used for unit testing with cmocka.
+ *
+ * Please see ../README.md for more detailed documentation.
+ */
+
+#include "develop/imageop.h"
+#include "develop/pixelpipe_hb.h"
+
+// fills width x height pixels with colors from below black to above white,
+// including negative and equal channels:
+float *pointwise_image(const int width, const int height);
+
+// runs the two pieces one after the other with process(), as the unfused pipe
+// does, and as a fused run with process_pixels() on the same input. asserts
+// that the outputs and the processed maximum of the pipe match within eps
+// (relative above 1).
+void assert_fused_matches_process(dt_iop_module_t *const module, dt_dev_pixelpipe_iop_t *const first,
+                                  dt_dev_pixelpipe_iop_t *const second, const float *const in,
+                                  const int width, const int height, const float eps);
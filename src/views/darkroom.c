@@ -38,6 +38,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/masks.h"
+#include "develop/prefetch.h"
 #include "dtgtk/button.h"
 #include "dtgtk/thumbtable.h"
 #include "gui/accelerators.h"
@@ -169,6 +170,7 @@ void cleanup(dt_view_t *self)
     gtk_widget_destroy(dev->second_window.second_wnd);
     dev->second_window.second_wnd = NULL;
     dev->second_window.widget = NULL;
+    dt_dev_pixelpipe_shared_cache_flush(dev->shared_cache);
   }
   else
   {
@@ -374,8 +376,12 @@ void expose(
     float ht = dev->pipe->output_backbuf_height;
     stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
     surface = dt_cairo_image_surface_create_for_data(dev->pipe->output_backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
-    wd /= darktable.gui->ppd;
-    ht /= darktable.gui->ppd;
+    // coarse or reduced renderings are stretched to the requested scale until the real one is done
+    const gboolean reduced = dev->pipe->backbuf_reduction != 1.0f;
+    const float device_scale = darktable.gui->ppd / dev->pipe->backbuf_reduction;
+    if(reduced) cairo_surface_set_device_scale(surface, device_scale, device_scale);
+    wd /= device_scale;
+    ht /= device_scale;
 
     if(dev->iso_12646.enabled)
     {
@@ -412,7 +418,7 @@ void expose(
     cairo_pattern_set_filter(cairo_get_source(cr), _get_filtering_level(dev));
     cairo_paint(cr);
 
-    if(darktable.gui->show_focus_peaking)
+    if(darktable.gui->show_focus_peaking && !reduced)
     {
       cairo_save(cr);
       cairo_scale(cr, 1./ darktable.gui->ppd, 1. / darktable.gui->ppd);
@@ -925,9 +931,15 @@ static void dt_dev_change_image(dt_develop_t *dev, const int32_t imgid)
     dev->history = g_list_delete_link(dev->history, dev->history);
   }
 
+  // a prefetched preview of the image we leave would be outdated by the edits done meanwhile
+  dt_dev_prefetch_forget(dev->prefetch, dev->image_storage.id);
+
   // get new image:
   dt_dev_reload_image(dev, imgid);
 
+  // show the prefetched preview, if any, until the preview pipe is done
+  dt_dev_prefetch_take(dev->prefetch, dev->preview_pipe, imgid, dev->preview_downsampling);
+
   // make sure no signals propagate here:
   ++darktable.gui->reset;
 
@@ -1223,6 +1235,10 @@ static gboolean skip_b_key_accel_callback(GtkAccelGroup *accel_group, GObject *a
 static void _darkroom_ui_pipe_finish_signal_callback(gpointer instance, gpointer data)
 {
   dt_control_queue_redraw_center();
+
+  // the center view is done, use the idle time for the neighbouring images
+  dt_view_t *self = (dt_view_t *)data;
+  dt_dev_prefetch_neighbours((dt_develop_t *)self->data);
 }
 
 static void _darkroom_ui_preview2_pipe_finish_signal_callback(gpointer instance, gpointer user_data)
@@ -1396,6 +1412,7 @@ static void _second_window_quickbutton_clicked(GtkWidget *w, dt_develop_t *dev)
     gtk_widget_destroy(dev->second_window.second_wnd);
     dev->second_window.second_wnd = NULL;
     dev->second_window.widget = NULL;
+    dt_dev_pixelpipe_shared_cache_flush(dev->shared_cache);
   }
   else if(gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(w)))
     _darkroom_display_second_window(dev);
@@ -3082,6 +3099,9 @@ void leave(dt_view_t *self)
   // commit image ops to db
   dt_dev_write_history(dev);
 
+  // prefetched previews are only useful while staying in darkroom
+  dt_dev_prefetch_flush(dev->prefetch);
+
   // update aspect ratio
   if(dev->preview_pipe->backbuf && dev->preview_status == DT_DEV_PIXELPIPE_VALID)
   {
@@ -4674,6 +4694,7 @@ static gboolean _second_window_delete_callback(GtkWidget *widget, GdkEvent *even
 
   dev->second_window.second_wnd = NULL;
   dev->second_window.widget = NULL;
+  dt_dev_pixelpipe_shared_cache_flush(dev->shared_cache);
 
   gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(dev->second_window.button), FALSE);
 